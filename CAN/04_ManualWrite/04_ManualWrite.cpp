@@ -1,10 +1,16 @@
 #include "04_ManualWrite.h"
+#include <cstring>
+#include "can_frame.h"
 
-ManualWrite::ManualWrite()
+ManualWrite::ManualWrite(const CanSettings& settings)
+    : PcanHandle(ChannelHandle(settings.channel)), IsFD(settings.fd), Bitrate(BitrateValue(settings.bitrate_kbit)),
+      BitrateFD(settings.bitrate_fd)
 {
+    ShowCurrentConfiguration();
+
     TPCANStatus stsResult;
     if (IsFD)
-        stsResult = CAN_InitializeFD(PcanHandle, BitrateFD);
+        stsResult = CAN_InitializeFD(PcanHandle, const_cast<LPSTR>(BitrateFD.c_str()));
     else
         stsResult = CAN_Initialize(PcanHandle, Bitrate);
 
@@ -13,29 +19,25 @@ ManualWrite::ManualWrite()
         return;
     }
 
+    Initialized = true;
     std::cout << "CAN Initialized Successfully" << std::endl;
 }
 
 ManualWrite::~ManualWrite()
 {
-    CAN_Uninitialize(PCAN_NONEBUS);
+    // only our channel: PCAN_NONEBUS would release every channel this process opened
+    if (Initialized) CAN_Uninitialize(PcanHandle);
 }
 
-TPCANStatus ManualWrite::SendAcceleration(PedalValues values)
+TPCANStatus ManualWrite::SendAcceleration(PedalValues values, const CanSettings& settings)
 {
-    // Sends a CAN message with extended ID, and 8 data bytes
+    // Sends the pedal status frame (can.id, extended 0x100 by default, 8 data bytes, layout in can_frame.h)
+    const CanFrame frame = pack_pedal_status(values.accel, values.drivemode, values.rightPressure, values.middlePressure);
     TPCANMsg msgCanMessage;
-    msgCanMessage.ID = 0x100;
-    msgCanMessage.LEN = (BYTE)8;
-    msgCanMessage.MSGTYPE = PCAN_MESSAGE_EXTENDED;
-    
-    for (int i = 0; i < 8; i++) {
-        i == 0 ? msgCanMessage.DATA[i] = values.accel           : msgCanMessage.DATA[i] = msgCanMessage.DATA[i];
-        i == 1 ? msgCanMessage.DATA[i] = values.drivemode       : msgCanMessage.DATA[i] = msgCanMessage.DATA[i];
-        i == 2 ? msgCanMessage.DATA[i] = values.rightPressure   : msgCanMessage.DATA[i] = msgCanMessage.DATA[i];
-        i == 3 ? msgCanMessage.DATA[i] = values.middlePressure  : msgCanMessage.DATA[i] = msgCanMessage.DATA[i];
-        i > 3  ? msgCanMessage.DATA[i] = 0                      : msgCanMessage.DATA[i] = msgCanMessage.DATA[i];
-    }
+    msgCanMessage.ID = settings.id;
+    msgCanMessage.LEN = frame.len;
+    msgCanMessage.MSGTYPE = settings.extended ? PCAN_MESSAGE_EXTENDED : PCAN_MESSAGE_STANDARD;
+    memcpy(msgCanMessage.DATA, frame.data, sizeof(frame.data));
 
     return CAN_Write(PcanHandle, &msgCanMessage);
 }
@@ -282,4 +284,51 @@ void ManualWrite::ConvertBitrateToString(TPCANBaudrate bitrate, LPSTR buffer)
         strcpy_s(buffer, MAX_PATH, "Unknown Bitrate");
         break;
     }
-}
\ No newline at end of file
+}
+
+TPCANHandle ManualWrite::ChannelHandle(const std::string& channel)
+{
+    static const TPCANHandle usb[16] = {
+        PCAN_USBBUS1, PCAN_USBBUS2, PCAN_USBBUS3, PCAN_USBBUS4, PCAN_USBBUS5, PCAN_USBBUS6, PCAN_USBBUS7, PCAN_USBBUS8,
+        PCAN_USBBUS9, PCAN_USBBUS10, PCAN_USBBUS11, PCAN_USBBUS12, PCAN_USBBUS13, PCAN_USBBUS14, PCAN_USBBUS15, PCAN_USBBUS16 };
+    static const TPCANHandle pci[16] = {
+        PCAN_PCIBUS1, PCAN_PCIBUS2, PCAN_PCIBUS3, PCAN_PCIBUS4, PCAN_PCIBUS5, PCAN_PCIBUS6, PCAN_PCIBUS7, PCAN_PCIBUS8,
+        PCAN_PCIBUS9, PCAN_PCIBUS10, PCAN_PCIBUS11, PCAN_PCIBUS12, PCAN_PCIBUS13, PCAN_PCIBUS14, PCAN_PCIBUS15, PCAN_PCIBUS16 };
+    static const TPCANHandle lan[16] = {
+        PCAN_LANBUS1, PCAN_LANBUS2, PCAN_LANBUS3, PCAN_LANBUS4, PCAN_LANBUS5, PCAN_LANBUS6, PCAN_LANBUS7, PCAN_LANBUS8,
+        PCAN_LANBUS9, PCAN_LANBUS10, PCAN_LANBUS11, PCAN_LANBUS12, PCAN_LANBUS13, PCAN_LANBUS14, PCAN_LANBUS15, PCAN_LANBUS16 };
+
+    // the config parser only lets valid names through; anything else falls back to the first USB channel
+    char bus;
+    int index;
+    if (!RuntimeConfig::channel(channel, bus, index))
+        return PCAN_USBBUS1;
+    switch (bus)
+    {
+    case 'u': return usb[index - 1];
+    case 'p': return pci[index - 1];
+    case 'l': return lan[index - 1];
+    default: return static_cast<TPCANHandle>(index);
+    }
+}
+
+TPCANBaudrate ManualWrite::BitrateValue(int kbit)
+{
+    switch (kbit)
+    {
+    case 1000: return PCAN_BAUD_1M;
+    case 800: return PCAN_BAUD_800K;
+    case 250: return PCAN_BAUD_250K;
+    case 125: return PCAN_BAUD_125K;
+    case 100: return PCAN_BAUD_100K;
+    case 95: return PCAN_BAUD_95K;
+    case 83: return PCAN_BAUD_83K;
+    case 50: return PCAN_BAUD_50K;
+    case 47: return PCAN_BAUD_47K;
+    case 33: return PCAN_BAUD_33K;
+    case 20: return PCAN_BAUD_20K;
+    case 10: return PCAN_BAUD_10K;
+    case 5: return PCAN_BAUD_5K;
+    default: return PCAN_BAUD_500K;
+    }
+}
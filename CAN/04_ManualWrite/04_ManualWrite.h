@@ -1,5 +1,7 @@
 #include "stdafx.h"
 #include "PCANBasic.h"
+#include <string>
+#include "runtime_config.h"
 
 struct PedalValues {
     int accel;
@@ -12,30 +14,42 @@ class ManualWrite
 {
 private:
     /// <summary>
-    /// Sets the PCANHandle (Hardware Channel)
+    /// Sets the PCANHandle (Hardware Channel), from can.channel
     /// </summary>
-    const TPCANHandle PcanHandle = PCAN_USBBUS1;
+    TPCANHandle PcanHandle = PCAN_USBBUS1;
     /// <summary>
-    /// Sets the desired connection mode (CAN = false / CAN-FD = true)
+    /// Sets the desired connection mode (CAN = false / CAN-FD = true), from can.fd
     /// </summary>
-    const bool IsFD = false;
+    bool IsFD = false;
     /// <summary>
-    /// Sets the bitrate for normal CAN devices
+    /// Sets the bitrate for normal CAN devices, from can.bitrate
     /// </summary>
-    const TPCANBaudrate Bitrate = PCAN_BAUD_500K;
+    TPCANBaudrate Bitrate = PCAN_BAUD_500K;
     /// <summary>
-    /// Sets the bitrate for CAN FD devices. 
+    /// Sets the bitrate for CAN FD devices, from can.bitrate_fd.
     /// Example - Bitrate Nom: 1Mbit/s Data: 2Mbit/s:
     ///   "f_clock_mhz=20, nom_brp=5, nom_tseg1=2, nom_tseg2=1, nom_sjw=1, data_brp=2, data_tseg1=3, data_tseg2=1, data_sjw=1"
     /// </summary>
-    const TPCANBitrateFD BitrateFD = const_cast<LPSTR>("f_clock_mhz=20, nom_brp=5, nom_tseg1=2, nom_tseg2=1, nom_sjw=1, data_brp=2, data_tseg1=3, data_tseg2=1, data_sjw=1");
+    std::string BitrateFD;
+    /// <summary>
+    /// Set once the channel is initialized; only then does the destructor release it
+    /// </summary>
+    bool Initialized = false;
 
 public:
-    // ManualWrite constructor
+    // ManualWrite constructor: opens the channel given by the settings
     //
-    ManualWrite();
+    explicit ManualWrite(const CanSettings& settings = CanSettings());
 
-    TPCANStatus SendAcceleration(PedalValues values);
+    /// <summary>
+    /// Sends the pedal status frame with the ID and ID type of the given settings
+    /// </summary>
+    TPCANStatus SendAcceleration(PedalValues values, const CanSettings& settings = CanSettings());
+
+    /// <summary>
+    /// If the constructor initialized the channel
+    /// </summary>
+    bool IsInitialized() const { return Initialized; }
 
     // ManualWrite destructor
     //
@@ -103,4 +117,14 @@ private:
     /// <param name="bitrate">Bitrate to be converted</param>
     /// <param name="buffer">A string buffer for the converted bitrate (size MAX_PATH)</param>
     void ConvertBitrateToString(TPCANBaudrate bitrate, LPSTR buffer);
+
+    /// <summary>
+    /// Gets the PCAN-Basic handle for a can.channel value ("usb1", "pci2", "lan1" or a number)
+    /// </summary>
+    static TPCANHandle ChannelHandle(const std::string& channel);
+
+    /// <summary>
+    /// Gets the BTR0/BTR1 value for a can.bitrate value in kbit/s
+    /// </summary>
+    static TPCANBaudrate BitrateValue(int kbit);
 };
\ No newline at end of file
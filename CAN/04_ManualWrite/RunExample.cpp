@@ -1,237 +1,432 @@
 #define NOMINMAX 
 #include "04_ManualWrite.h"
+#include "hid_device.h"
+#include "pedal_engine.h"
+#include "response_curve.h"
+#include "runtime_config.h"
+#include "raw_input_thread.h"
+#include "spsc_queue.h"
+#include "maneuver_source.h"
+#include "latency_histogram.h"
+#include "latency_trace.h"
+#include "lifecycle.h"
+#include "session_recorder.h"
+#include "shared_pedals.h"
+#include "reactor.h"
+#include "stats_endpoint.h"
+#include "telemetry_server.h"
+#include "thread_policy.h"
+#include "timing.h"
 #include <thread>
 #include <atomic>
 #include <mutex>
 #include <algorithm>
 #include <cstring>
-
-class Debounce {
-public:
-    Debounce(int debounceMS) { this->debounceMS = debounceMS; }
-    void mark() { lastChangeTime = GetTickCount(); }
-    bool isReady() { DWORD now = GetTickCount(); return (now - lastChangeTime) >= debounceMS; }
-    void setDebounce(int ms) { debounceMS = ms; }
-
-    int debounceMS;
-    DWORD lastChangeTime = 0;
-};
-
-enum DriveMode {
-    Static,
-    Dynamic
-};
+#include <string>
 
 PedalValues pedalValues;
-DriveMode mode = Static;
 
 BYTE rawData[8] = { 0 };
 
-int pAccelCount = 0;
-int middlePedalPressure = 0;
-int rightPedalPressure = 0;
 int rMiddlePedalPressure = 0;
 int rRightPedalPressure = 0;
-int speedIndex = 0;
-int rpEdge = 0;
-int mpEdge = 0;
-
-const int SPEED_HISTORY_SIZE = 100;
 
-int speedHistory[SPEED_HISTORY_SIZE] = { 0 };
+// the pedal logic runs on the pedal slot's engine, same rules as the desktop app; its
+// settings, the CAN frame ID and the send period come from fanatec.cfg, reloaded when it changes
+RuntimeConfigStore config;
+const RuntimeConfig* startupConfig = nullptr;  // the snapshot the channel and ports were opened with
+std::atomic<int> modeRequest{ -1 }; // ModeTrigger from the keyboard, taken by the tick task
 
-constexpr int maxSpeed = 300;
-
-bool leftPedalPressed = false;
-bool middlePedalPressed = false;
-bool rightPedalPressed = false;
+std::atomic<bool> running{ true };
 
-Debounce lpDebounce(1000);
-Debounce mpDebounce(500);
-Debounce rpDebounce(1000);
+// only reports from the pedal set drive the logic below; wheels and shifters are routed away.
+// The input thread routes reports and the tick task steps the engines, under routerMutex.
+DeviceRouter router;
+std::mutex routerMutex;
+uint64_t engineSeq = 0;             // bumped under routerMutex whenever an engine changed
+PedalResponse response;     // pedal_curves.cfg, R reloads
+
+// input thread -> CAN transmit task
+struct PedalUpdate {
+    PedalValues values;
+    PedalSample pedals;             // filtered and shaped, for the session file
+    int64_t receivedUs;
+    uint64_t seq;                   // engineSeq after this report
+    LatencyTag trace;
+};
 
-std::atomic<bool> running{ true };
-HWND g_hWnd = NULL;
+RawInputThread inputThread;
+ManeuverSource maneuver;            // FANATEC_MANEUVER: synthetic pedals instead of inputThread
+SharedPedalSource shared;           // FANATEC_SHARED: the desktop app's pedals instead of inputThread
+SpscQueue<PedalUpdate, 256> pedalQueue;
+std::atomic<uint64_t> droppedUpdates{ 0 };
+LatencyHistogram inputLatency;      // WM_INPUT picked up -> update queued, in microseconds
+LatencyHistogram queueDepth;        // queue depth seen by each push
+LatencyTrace trace;                 // report -> CAN frame, per stage; served on localhost:5557
+StatsEndpoint statsEndpoint;
+SessionRecorder session;            // FANATEC_SESSION: every report and CAN frame to a file
+TelemetryServer telemetry;          // vehicle state for dashboards on localhost:5559
+ThreadMonitor threads;              // input, CAN, net and recorder threads, served after the trace
+
+// The frames go out from a task on a reactor of their own, so a CAN_Write that takes long
+// holds neither the keyboard nor the sockets; telemetry runs on the network reactor.
+Reactor bus;
+Reactor network;
+std::atomic<uint64_t> canFrames{ 0 }, canBusy{ 0 }, canErrors{ 0 }, unsentUpdates{ 0 };
+LatencyHistogram canWriteUs;        // CAN_Write call, in microseconds
+
+// the pedal set's state after the last model tick; bus thread only
+PedalValues tickValues = {};
+PedalSample tickPedals;
+uint64_t tickSeq = 0;
+uint64_t droppedSteps = 0;          // model steps skipped after the bus thread stalled
+
+void ProcessValues(const PedalEngineState& engine, PedalValues& values) {
+    values.accel = engine.speed;
+    values.drivemode = engine.mode;
+    values.middlePressure = engine.brake;
+    values.rightPressure = engine.throttle;
+}
 
-void ProcessValues() {
-    pedalValues.accel = pAccelCount;
-    pedalValues.drivemode = mode;
-    pedalValues.middlePressure = middlePedalPressure;
-    pedalValues.rightPressure = rightPedalPressure;
+TelemetrySnapshot MakeSnapshot(int64_t tUs, const PedalSample& pedals, const PedalEngineState& engine)
+{
+    TelemetrySnapshot snapshot;
+    snapshot.t_us = tUs;
+    for (int c = 0; c < ChannelSteering; c++) snapshot.pedal[c] = pedals.axis[c];
+    snapshot.speed = static_cast<int16_t>(engine.speed);
+    snapshot.mode = static_cast<uint8_t>(engine.mode);
+    snapshot.sources = 1;
+    return snapshot;
 }
 
-void ProcessMiddlePedal(const BYTE* data)
+// Runs on the input thread for every HID report. The model steps and keyboard requests
+// are the tick task's; a report only runs the pedal rules.
+void OnPedalReport(HANDLE device, const BYTE* data, UINT size, int64_t receivedUs)
 {
-    if (data[6] > 0) {
-        leftPedalPressed = true;
-        if (data[6] > 14 && lpDebounce.isReady()) {
-            if (mode == Static) {
-                mode = Dynamic;
-            }
-            else if (mode == Dynamic) {
-                mode = Static;
-                pAccelCount = 0;
-            }
-            lpDebounce.mark();
-        }
+    PedalUpdate update;
+    update.trace.begin(receivedUs);
+    PedalEngineState engine;
+    uint16_t raw[ChannelSteering];
+    {
+        std::lock_guard<std::mutex> lock(routerMutex);
+        DeviceSlot* slot = HidDevices::route(router, device, data, size, receivedUs);
+        if (!slot || slot->role != RolePedals) return;
+        update.trace.stamp(StageDecode);
+
+        pedal_engine_process(slot->engine, slot->sample, receivedUs, config.current().engine);
+        DeviceRouter::record_latency(*slot, now_us() - receivedUs);
+        update.trace.stamp(StageEngine);
+        engine = slot->engine;
+        update.pedals = slot->sample;
+        update.seq = ++engineSeq;
+        for (int c = 0; c < ChannelSteering; c++) raw[c] = slot->filter.pedal[c].in;
     }
-    else {
-        leftPedalPressed = false;
+
+    ProcessValues(engine, pedalValues);
+    if (session.is_open()) {
+        session.record(session_row(SessionReport, receivedUs, update.pedals, engine.speed, engine.mode, raw));
+    }
+    telemetry.publish(MakeSnapshot(receivedUs, update.pedals, engine));
+    update.values = pedalValues;
+    update.receivedUs = receivedUs;
+    update.trace.stamp(StagePublish);
+
+    queueDepth.record(static_cast<int64_t>(pedalQueue.size()));
+    if (!pedalQueue.try_push(update)) {
+        droppedUpdates.fetch_add(1, std::memory_order_relaxed);
+        return;
     }
+    inputLatency.record(now_us() - receivedUs);
 }
 
-void ProcessRightPedal(const BYTE* data)
+// Swaps in the curves from the file; the input thread keeps mapping with the old ones
+// until the new tables are published.
+void LoadCurves()
 {
-    if (data[2] > 0) {
-        rightPedalPressed = true;
-        if (mode == Static) {
-            if (data[2] > 13 && rpEdge < 2) {
-                rpEdge++;
-                pAccelCount += 10;
-            }
-        }
-        else if (mode == Dynamic) {
-                pAccelCount < 300 ? pAccelCount + (rightPedalPressure / 5) : pAccelCount += 0;
-                rightPedalPressure < 2 ? pAccelCount += 1 : pAccelCount += 0;
-        }
-        else {
-            rightPedalPressed = false;
-            rpEdge = 0;
-        }
+    std::string error;
+    if (response.load("pedal_curves.cfg", &error)) {
+        std::cout << "Response curves loaded (generation " << response.generation() << ")" << std::endl;
     }
     else {
-        rightPedalPressed = false;
-        rpEdge = 0;
+        std::cout << "Response curves: " << error << ", pedals stay linear" << std::endl;
     }
 }
 
-void ProcessLeftPedal(const BYTE* data)
+// Runs on the config watch thread after fanatec.cfg changed.
+void OnConfigReload(const RuntimeConfig& cfg, const std::string& error)
 {
-    if (data[4] > 0) {
-        middlePedalPressed = true;
-        if (data[4] > 30 && mpDebounce.isReady()) {
-            if (mode == Static) {
-                mpEdge++;
-                mpEdge < 2 ? pAccelCount -= 20 : pAccelCount += 0;
-            }
-            else if (mode == Dynamic) {
-                pAccelCount -= (middlePedalPressure * 2);
-            }
-            mpDebounce.mark();
-        }
+    if (!error.empty()) {
+        std::cout << "\nfanatec.cfg: " << error << ", settings unchanged" << std::endl;
+        return;
     }
-    else {
-        middlePedalPressed = false;
-        mpEdge = 0;
+    std::cout << "\nfanatec.cfg reloaded (generation " << cfg.generation << ")" << std::endl;
+    if (RuntimeConfig::startup_differs(cfg, *startupConfig)) {
+        std::cout << "The CAN channel, bitrate and ports change at the next start" << std::endl;
     }
 }
 
-LRESULT CALLBACK WindowProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam) {
-    switch (msg) {
-    case WM_INPUT: {
-        UINT dwSize = 0;
-        GetRawInputData((HRAWINPUT)lParam, RID_INPUT, NULL, &dwSize, sizeof(RAWINPUTHEADER));
-
-        if (dwSize > 0) {
-            BYTE* lpb = new BYTE[dwSize];
-            if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, lpb, &dwSize, sizeof(RAWINPUTHEADER)) == dwSize) {
-                RAWINPUT* raw = (RAWINPUT*)lpb;
-
-                if (raw->header.dwType == RIM_TYPEHID) {
-                    BYTE* data = raw->data.hid.bRawData;
-                    UINT dataSize = raw->data.hid.dwSizeHid;
-
-                    if (dataSize > 2) rightPedalPressure = data[2];
-                    if (dataSize > 4) middlePedalPressure = data[4];
+void OnPedalDevice(HANDLE device, bool arrived)
+{
+    std::lock_guard<std::mutex> lock(routerMutex);
+    if (arrived) {
+        if (!HidDevices::attach(router, device)) std::cout << "\nRouter full, device ignored" << std::endl;
+    }
+    else HidDevices::detach(router, device);
+}
 
-                    ProcessRightPedal(data);
-                    ProcessMiddlePedal(data);
-                    ProcessLeftPedal(data);
-                }
+// Every engine.tick_ms on wall time, like the desktop app's speed thread: the model steps
+// due on every device's engine, then a pending keyboard request. Speed and the test modes
+// follow time whether or not the pedals report (they only do on change), and a request is
+// taken within a step. Runs on the bus reactor next to TransmitPedals, which sends what
+// the tick left when it is newer than the last report.
+Task<> TickEngines()
+{
+    PedalTickSchedule schedule;
+    schedule.start(now_us(), config.current().engine);
+    for (;;) {
+        if (co_await bus.sleep_until(schedule.next_us) == IoStatus::Cancelled) break;
+        const PedalEngineConfig& engineConfig = config.current().engine;
+        const int steps = schedule.due(now_us(), engineConfig);
+        const int request = modeRequest.exchange(-1);
+        droppedSteps = schedule.dropped;
+        if (steps == 0 && request < 0) continue;
+
+        PedalEngineState engine;
+        bool hasPedals = false;
+        {
+            std::lock_guard<std::mutex> lock(routerMutex);
+            for (int n = 0; n < steps; n++) router.tick_engines(engineConfig);
+            if (request >= 0) router.request_mode(static_cast<ModeTrigger>(request), engineConfig);
+            for (int i = 0; i < router.count() && !hasPedals; i++) {
+                const DeviceSlot& slot = router.slot(i);
+                if (!slot.handle || slot.role != RolePedals) continue;
+                engine = slot.engine;
+                tickPedals = slot.sample;
+                tickSeq = ++engineSeq;
+                hasPedals = true;
             }
-            delete[] lpb;
         }
-        return 0;
-    }
-
-    case WM_DESTROY:
-        running = false;
-        PostQuitMessage(0);
-        return 0;
+        if (!hasPedals) continue;
+        ProcessValues(engine, tickValues);
+        telemetry.publish(MakeSnapshot(now_us(), tickPedals, engine));
     }
-
-    return DefWindowProc(hWnd, msg, wParam, lParam);
 }
 
-DWORD WINAPI MessagePumpThread(LPVOID) {
-    WNDCLASSEX wc = { sizeof(WNDCLASSEX) };
-    wc.lpfnWndProc = WindowProc;
-    wc.hInstance = GetModuleHandle(NULL);
-    wc.lpszClassName = L"PedalWindow";
-
-    if (!RegisterClassEx(&wc)) {
-        std::cout << "Failed to register window class!" << std::endl;
-        return 1;
-    }
-
-    g_hWnd = CreateWindowEx(
-        0, wc.lpszClassName, L"Pedal Input",
-        WS_OVERLAPPEDWINDOW, 0, 0, 100, 100,
-        NULL, NULL, wc.hInstance, NULL);
-
-    if (!g_hWnd) {
-        std::cout << "Failed to create window!" << std::endl;
-        return 1;
-    }
-
-    ShowWindow(g_hWnd, SW_SHOWMINIMIZED);
-
-    RAWINPUTDEVICE rid;
-    rid.usUsagePage = 0x01;
-    rid.usUsage = 0x04;
-    rid.dwFlags = RIDEV_INPUTSINK;
-    rid.hwndTarget = g_hWnd;
+// Every can.period_ms on an absolute schedule, so the period holds whatever a write took:
+// only the newest update goes on the bus, older ones are superseded. A full transmit
+// queue skips the frame rather than waiting for room; the next period has newer values.
+Task<> TransmitPedals(ManualWrite& canWriter)
+{
+    PedalValues latest = {};
+    PedalSample latestPedals;
+    uint64_t latestSeq = 0;
+    PedalUpdate pending;            // newest update not on the bus yet
+    bool hasPending = false;
+    int64_t nextSend = now_us();
+    for (;;) {
+        const RuntimeConfig& cfg = config.current();
+        PedalUpdate update;
+        while (pedalQueue.try_pop(update)) {
+            if (hasPending) trace.record(pending.trace);
+            pending = update;
+            hasPending = true;
+            latest = update.values;
+            latestPedals = update.pedals;
+            latestSeq = update.seq;
+        }
+        if (tickSeq > latestSeq) {
+            latest = tickValues;
+            latestPedals = tickPedals;
+            latestSeq = tickSeq;
+        }
 
-    if (!RegisterRawInputDevices(&rid, 1, sizeof(rid))) {
-        std::cout << "Failed to register HID!" << std::endl;
-    }
-    else {
-        std::cout << "HID registered to window successfully!" << std::endl;
-    }
+        std::cout << "\r" << drive_mode_name(static_cast<DriveMode>(latest.drivemode))
+            << " | Accel: " << latest.accel
+            << " | R: " << latest.rightPressure
+            << " | M: " << latest.middlePressure
+            << "    " << std::flush;
 
-    MSG msg;
-    while (running) {
-        if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
+        const int64_t writeStart = now_us();
+        const TPCANStatus status = canWriter.SendAcceleration(latest, cfg.can);
+        canWriteUs.record(now_us() - writeStart);
+        if (status == PCAN_ERROR_OK) canFrames.fetch_add(1, std::memory_order_relaxed);
+        else if (status & (PCAN_ERROR_QXMTFULL | PCAN_ERROR_XMTFULL)) canBusy.fetch_add(1, std::memory_order_relaxed);
+        else canErrors.fetch_add(1, std::memory_order_relaxed);
+        if (session.is_open()) {
+            session.record(session_row(SessionCanTx, now_us(), latestPedals, latest.accel, latest.drivemode));
         }
-        else {
-            Sleep(1);
+        if (hasPending) {
+            pending.trace.stamp(StageTransmit);
+            trace.record(pending.trace);
+            hasPending = false;
         }
-    }
 
-    DestroyWindow(g_hWnd);
-    UnregisterClass(wc.lpszClassName, wc.hInstance);
+        nextSend += cfg.can.period_ms * 1000;
+        if (co_await bus.sleep_until(nextSend) == IoStatus::Cancelled) break;
+        if (nextSend + cfg.can.period_ms * 1000 < now_us()) nextSend = now_us();     // fell behind: no burst
+    }
+}
 
-    return 0;
+// After the transmit task ended: what it did not get to leaves the queue with its trace
+// recorded, so the report covers every update and a new task starts from an empty queue.
+void FlushPedalQueue()
+{
+    PedalUpdate update;
+    while (pedalQueue.try_pop(update)) {
+        trace.record(update.trace);
+        unsentUpdates.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 int main() {
     std::cout << "====================================" << std::endl;
     std::cout << "Pedal-to-CAN with Hidden Window" << std::endl;
-    std::cout << "Press ESC to exit" << std::endl;
+    std::cout << "Press ESC to exit, R to reload pedal_curves.cfg" << std::endl;
+    std::cout << "C cruise, A ramp test, T step test, X cancel" << std::endl;
     std::cout << "====================================" << std::endl;
 
-    // Start window thread
-    HANDLE hThread = CreateThread(NULL, 0, MessagePumpThread, NULL, 0, NULL);
+    std::string configError;
+    if (config.load("fanatec.cfg", &configError)) {
+        std::cout << "Settings loaded from fanatec.cfg" << std::endl;
+    }
+    else {
+        std::cout << "Settings: " << configError << ", using the defaults" << std::endl;
+    }
+    // the channel, bitrate and ports are taken once; a reload changes the rest
+    startupConfig = &config.current();
+    const RuntimeConfig& startup = *startupConfig;
+
+    // each thread applies its policy (thread.* in fanatec.cfg) when it starts; the main
+    // thread only reads the keyboard
+    ThreadStats& inputStats = threads.add("input", startup.threads[ThreadInput]);
+    ThreadStats& canStats = threads.add("can", startup.threads[ThreadCanTx]);
+    ThreadStats& netStats = threads.add("net", startup.threads[ThreadNetwork]);
+    session.set_thread(&threads.add("recorder", startup.threads[ThreadRecorder]));
+    thread_policy_fine_timer();
+    std::string lockError;
+    if (startup.lock_memory && !thread_policy_lock_memory(&lockError)) {
+        std::cout << "Memory not locked: " << lockError << std::endl;
+    }
 
-    Sleep(1000);
+    // the filter settings belong to the router, so they are only read before the input thread starts
+    PedalFilterConfig filter;
+    std::string filterError;
+    if (PedalFilterConfig::load("pedal_filter.cfg", filter, &filterError)) {
+        router.set_filter(filter);
+        std::cout << "Pedal filter loaded" << std::endl;
+    }
+    else {
+        std::cout << "Pedal filter: " << filterError << ", pedals unfiltered" << std::endl;
+    }
+    router.set_response(&response);
+    LoadCurves();
 
     // Initialize CAN - FIXED: No blocking constructor
     std::cout << "Initializing CAN..." << std::endl;
 
-    ManualWrite canWriter;
-
+    ManualWrite canWriter(startup.can);
+
+    // Started in dependency order and stopped in reverse, each stop timed against its
+    // deadline: the pedal source stops first, so nothing queues, records or publishes into
+    // what stops after it.
+    Lifecycle life;
+    life.on_overrun([](const std::string& stage, int64_t elapsedUs) {
+        std::cout << "\n" << stage << " still stopping after " << elapsedUs / 1000 << " ms" << std::endl;
+    });
+    life.add("config", {}, [](std::string*) { return config.watch("fanatec.cfg", OnConfigReload); },
+        [] { config.unwatch(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    life.add("session", {}, [](std::string* error) {
+            if (session.open_from_environment(now_us(), error)) {
+                std::cout << "Recording the session (FANATEC_SESSION)" << std::endl;
+                return true;
+            }
+            if (!error->empty()) std::cout << "Session: " << *error << ", not recording" << std::endl;
+            return error->empty();
+        },
+        [] {
+            if (!session.is_open()) return;
+            std::cout << "\nSession: " << session.rows() << " rows, " << session.dropped() << " dropped";
+            session.close();        // flushes the mapped chunks to the file
+        }, 2000000, Lifecycle::Optional);
+    life.add("stats", {}, [&](std::string*) {
+            if (!statsEndpoint.start([]() { return trace.report() + "\n" + threads.report(); },
+                    RuntimeConfig::port_or(startup.stats_port, StatsEndpoint::DefaultPort + 1))) return false;
+            std::cout << "Latency stats on localhost:" << statsEndpoint.port() << std::endl;
+            return true;
+        }, [] { statsEndpoint.stop(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    life.add("network", {}, [&](std::string*) { return network.start(&netStats); }, [] { network.stop(); },
+        Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    life.add("telemetry", { "network" }, [&](std::string*) {
+            if (!telemetry.start(network, RuntimeConfig::port_or(startup.telemetry_port, TelemetryServer::DefaultPort + 1))) return false;
+            std::cout << "Telemetry on localhost:" << telemetry.port() << std::endl;
+            return true;
+        }, [] { telemetry.stop(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    life.add("can", { "session" }, [&](std::string* error) {
+            bus.spawn(TickEngines());
+            bus.spawn(TransmitPedals(canWriter));
+            if (bus.start(&canStats)) return true;
+            *error = "Failed to start the CAN thread!";
+            return false;
+        },
+        [] {
+            bus.stop();             // the transmit task ends at its next wait
+            FlushPedalQueue();
+        });
+    life.add("input", { "can", "session", "telemetry" }, [&](std::string* error) {
+            std::string sharedName;
+            ManeuverPlan plan;
+            std::string planError;
+            if (SharedPedalSource::name_from_environment(sharedName)) {
+                {
+                    std::lock_guard<std::mutex> lock(routerMutex);     // the tick task walks the slots
+                    if (!SharedPedalSource::attach(router)) {
+                        *error = "Shared pedals: router full";
+                        return false;
+                    }
+                }
+                if (!shared.start(sharedName, [](uint64_t device, const uint8_t* report, size_t size, int64_t receivedUs) {
+                        OnPedalReport(reinterpret_cast<HANDLE>(static_cast<uintptr_t>(device)), report, static_cast<UINT>(size), receivedUs);
+                    }, error)) {
+                    *error = "Shared pedals: " + *error;
+                    return false;
+                }
+                std::cout << "Pedals from shared memory " << sharedName << " (FANATEC_SHARED)" << std::endl;
+            }
+            else if (ManeuverPlan::from_environment(plan, &planError)) {
+                {
+                    std::lock_guard<std::mutex> lock(routerMutex);     // the tick task walks the slots
+                    if (!ManeuverSource::attach(router)) {
+                        *error = "Synthetic pedals: router full";
+                        return false;
+                    }
+                }
+                maneuver.start(plan, [](uint64_t device, const uint8_t* report, size_t size, int64_t receivedUs) {
+                    OnPedalReport(reinterpret_cast<HANDLE>(static_cast<uintptr_t>(device)), report, static_cast<UINT>(size), receivedUs);
+                });
+                std::cout << "Synthetic pedals at " << plan.rate_hz << " Hz (FANATEC_MANEUVER)" << std::endl;
+            }
+            else {
+                if (!planError.empty()) std::cout << "Maneuver plan: " << planError << ", using the pedals" << std::endl;
+                // start() returns once raw input is registered, no need to wait for the window
+                if (!inputThread.start(OnPedalReport, OnPedalDevice, &inputStats)) {
+                    *error = "Failed to register HID!";
+                    return false;
+                }
+                std::cout << "HID registered to input thread successfully!" << std::endl;
+            }
+            return true;
+        },
+        [] {
+            maneuver.stop();
+            shared.stop();
+            inputThread.stop();
+        });
+
+    std::string startError;
+    if (!life.start(&startError)) {
+        std::cout << startError << std::endl;
+        return 1;
+    }
     std::cout << "Main loop running..." << std::endl;
 
     while (running) {
@@ -242,24 +437,32 @@ int main() {
                 running = false;
                 break;
             }
+            if (key == 'r' || key == 'R') LoadCurves();
+            if (key == 'c' || key == 'C') modeRequest.store(TriggerCruise);
+            if (key == 'a' || key == 'A') modeRequest.store(TriggerRampTest);
+            if (key == 't' || key == 'T') modeRequest.store(TriggerStepTest);
+            if (key == 'x' || key == 'X') modeRequest.store(TriggerCancel);
         }
-
-        std::cout << "\rAccel: " << pAccelCount
-            << " | R: " << rightPedalPressure
-            << " | M: " << middlePedalPressure
-            << "    " << std::flush;
-        
-        ProcessValues();
-        canWriter.SendAcceleration(pedalValues);
-
- //       canWriter.SendAcceleration(pAccelCount, rightPedalPressure, middlePedalPressure);
-        Sleep(100);
+        Sleep(20);
     }
 
     running = false;
-    WaitForSingleObject(hThread, 2000);
-    CloseHandle(hThread);
+    const bool stoppedInTime = life.stop();
 
-    std::cout << "\nApplication terminated." << std::endl;
+    if (shared.samples()) {
+        std::cout << "\nShared pedals: " << shared.samples() << " samples, " << shared.lost() << " lost";
+    }
+    std::cout << "\nInput latency p50 " << inputLatency.percentile(50)
+        << " us, p99 " << inputLatency.percentile(99)
+        << " us, max queue " << queueDepth.maximum()
+        << ", dropped " << droppedUpdates.load() << std::endl;
+    std::cout << "CAN: " << canFrames.load() << " frames, " << canBusy.load() << " skipped (queue full), "
+        << canErrors.load() << " errors, " << unsentUpdates.load() << " updates left unsent, write p99 "
+        << canWriteUs.percentile(99) << " us, " << droppedSteps << " model steps skipped" << std::endl;
+    std::cout << trace.report();
+    std::cout << threads.report();
+    std::cout << (stoppedInTime ? "Shutdown" : "Shutdown, not all in time") << ":\n" << life.report();
+    thread_policy_coarse_timer();
+    std::cout << "Application terminated." << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #pragma once
 #include <iostream>
+#include <winsock2.h>     // before atlstr.h/Windows.h; used by the stats endpoint
 #include <atlstr.h>
 #include <conio.h>
 #include <Windows.h>
@@ -0,0 +1,126 @@
+// frame_harness.cpp - per-step cost of the S-function outputs without MATLAB
+//
+// Replays what mdlOutputs does on every step (snapshot read + port packing, and in
+// vector mode the frame drain) against a producer thread that publishes pedal reports
+// like the input thread does. Builds with any C++17 compiler on Linux or Windows:
+//
+//   g++ -std=c++17 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard frame_harness.cpp -o frame_harness
+//   ./frame_harness [report_hz] [step_us] [seconds]
+//
+// Defaults: 1000 Hz reports, 1 ms steps, 5 s per mode.
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "pedal_frame.h"
+#include "spsc_queue.h"
+#include "triple_buffer.h"
+#include "latency_histogram.h"
+#include "timing.h"
+
+struct HarnessResult {
+    uint64_t steps = 0;
+    uint64_t rows = 0;
+    uint64_t produced = 0;
+    uint64_t dropped = 0;
+    LatencyHistogram stepNs;
+};
+
+static void run_mode(PedalOutputMode mode, int reportHz, int stepUs, int seconds, HarnessResult& result) {
+    TripleBuffer<PedalSnapshot> snapshots;
+    SpscQueue<PedalSnapshot, 1024> frames;
+    std::atomic<bool> running{ true };
+    std::atomic<uint64_t> produced{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+    const int64_t startUs = now_us();
+
+    // stands in for the raw input thread
+    std::thread producer([&]() {
+        const int64_t periodUs = 1000000 / reportHz;
+        int64_t next = now_us();
+        uint64_t n = 0;
+        while (running.load(std::memory_order_relaxed)) {
+            next += periodUs;
+            while (now_us() < next) std::this_thread::yield();
+
+            PedalSnapshot& snap = snapshots.write_buffer();
+            n++;
+            snap.speed = static_cast<int>(n % 300);
+            snap.driveMode = (n / 1000) & 1;
+            snap.throttle = static_cast<int>(n % 256);
+            snap.brake = static_cast<int>((n * 7) % 256);
+            snap.clutch = (n % 500) < 50;
+            snap.updatedUs = now_us();
+            snap.reports = n;
+            if (mode == OutputVectorPorts && !frames.try_push(snap)) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            snapshots.publish();
+        }
+        produced.store(n);
+    });
+
+    double signals[SignalCount];
+    static double frame[FrameCapacity * FrameColumns];
+    volatile double sink = 0.0;             // keeps the packing from being optimized away
+
+    const int64_t endUs = startUs + static_cast<int64_t>(seconds) * 1000000;
+    int64_t nextStep = now_us();
+    while (now_us() < endUs) {
+        nextStep += stepUs;
+        while (now_us() < nextStep) std::this_thread::yield();
+
+        auto t0 = std::chrono::steady_clock::now();
+
+        PedalSnapshot snap;
+        snapshots.read(snap);
+        pack_signals(snap, now_us(), signals);
+        if (mode == OutputVectorPorts) {
+            result.rows += drain_frame(frames, startUs, frame);
+        }
+
+        auto t1 = std::chrono::steady_clock::now();
+        result.stepNs.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        result.steps++;
+        sink = sink + signals[SignalSpeed] + frame[0];
+    }
+
+    running = false;
+    producer.join();
+    result.produced = produced.load();
+    result.dropped = dropped.load();
+}
+
+static void print_result(const char* name, const HarnessResult& r) {
+    printf("%-7s steps %8llu  step ns p50 %6llu p99 %6llu p99.9 %6llu max %8llu",
+        name, (unsigned long long)r.steps,
+        (unsigned long long)r.stepNs.percentile(50), (unsigned long long)r.stepNs.percentile(99),
+        (unsigned long long)r.stepNs.percentile(99.9), (unsigned long long)r.stepNs.maximum());
+    if (r.rows || r.dropped) {
+        printf("  rows %llu/%llu dropped %llu", (unsigned long long)r.rows,
+            (unsigned long long)r.produced, (unsigned long long)r.dropped);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    int reportHz = argc > 1 ? atoi(argv[1]) : 1000;
+    int stepUs = argc > 2 ? atoi(argv[2]) : 1000;
+    int seconds = argc > 3 ? atoi(argv[3]) : 5;
+    if (reportHz <= 0 || stepUs <= 0 || seconds <= 0) {
+        fprintf(stderr, "usage: frame_harness [report_hz] [step_us] [seconds]\n");
+        return 1;
+    }
+
+    printf("reports %d Hz, step %d us, %d s per mode\n", reportHz, stepUs, seconds);
+
+    HarnessResult scalar;
+    run_mode(OutputScalarPorts, reportHz, stepUs, seconds, scalar);
+    print_result("scalar", scalar);
+
+    HarnessResult vector;
+    run_mode(OutputVectorPorts, reportHz, stepUs, seconds, vector);
+    print_result("vector", vector);
+    return 0;
+}
@@ -3,358 +3,300 @@
 
 #include "simstruc.h"
 #include <windows.h>
+#include <atomic>
+#include <cstdint>
 #include <mutex>
-#include <algorithm>
-#include <cstring>
+#include <string>
+#include <thread>
+#include "hid_device.h"
+#include "pedal_engine.h"
+#include "response_curve.h"
+#include "raw_input_thread.h"
+#include "triple_buffer.h"
+#include "spsc_queue.h"
+#include "maneuver_source.h"
+#include "pedal_frame.h"
+#include "shared_pedals.h"
+#include "thread_policy.h"
+#include "timing.h"
+
+// Optional block parameters:
+//   PedalOutputMode (0 = one scalar port per signal, the default; 1 = signal vector +
+//   frame of every report since the last step + frame row count)
+//   SampleTime in seconds (0.01 when left out; -1 inherits it from the model)
+#define OUTPUT_MODE_PARAM 0
+#define SAMPLE_TIME_PARAM 1
+#define DEFAULT_SAMPLE_TIME 0.01
 
 class FanatecPedals {
 private:
-    std::mutex dataMutex;
-    HWND hwnd;
+    RawInputThread inputThread;
+    ManeuverSource maneuver;        // synthetic pedals instead of inputThread (FANATEC_MANEUVER)
+    SharedPedalSource shared;       // the desktop app's pedals instead of inputThread (FANATEC_SHARED)
+    DeviceRouter router;            // only the pedal set feeds the snapshots
+    std::mutex routerMutex;         // input thread (reports, devices) and tick thread
+    PedalResponse response;         // curves from pedal_curves.cfg in the working folder
+    TripleBuffer<PedalSnapshot> snapshots;   // input and tick threads -> mdlOutputs, wait-free to read
+    SpscQueue<PedalSnapshot, 1024> frames;   // every report, only filled in vector mode
+    bool framesEnabled{false};
+    int64_t startUs{0};
     
-    // Your pedal variables
-    int pAccelCount{0};
-    bool leftPedalPressed{false};
-    bool rightPedalPressed{false};
-    bool middlePedalPressed{false};
-    int middlePedalPressure{0};
-    int rightPedalPressure{0};
-    int driveMode{0};
-    int rpEdge{0};
-    int mpEdge{0};
-    BYTE rawData[8] = {0};
+    // pedal logic runs on the pedal slot's engine (same rules as the desktop app); reports
+    // run the pedal rules on the input thread, the model steps on the tick thread
+    PedalEngineConfig engineConfig;
+    std::thread tickThread;
+    std::atomic<bool> ticking{false};
+    ThreadStats tickStats{"tick", ThreadPolicy()};
+    uint64_t pedalReports{0};       // under routerMutex, like the snapshot writes
 
-    // Static instance pointer for window procedure
-    static FanatecPedals* instance;
+    // mexPrintf is not thread-safe, so the input thread only counts; mdlOutputs prints
+    std::atomic<uint64_t> ignoredReports{0};
+    std::atomic<uint64_t> rejectedReports{0};
+    std::atomic<uint64_t> droppedFrames{0};
+    std::atomic<uint64_t> routerFull{0};         // arrivals turned away, all slots attached
 
 public:
-    FanatecPedals() : hwnd(nullptr) {
+    FanatecPedals() {
         mexPrintf("=== FanatecPedals constructor called ===\n");
-        instance = this;
     }
     
     ~FanatecPedals() {
         mexPrintf("=== FanatecPedals destructor called ===\n");
-        if (hwnd) {
-            DestroyWindow(hwnd);
-            mexPrintf("Message window destroyed\n");
+        maneuver.stop();
+        shared.stop();
+        if (inputThread.running()) {
+            inputThread.stop();
+            mexPrintf("Input thread stopped\n");
         }
-        instance = nullptr;
+        ticking.store(false);
+        if (tickThread.joinable()) tickThread.join();
     }
     
-    bool initialize() {
+    bool initialize(bool withFrames) {
         mexPrintf("=== FanatecPedals::initialize() called ===\n");
-        
-        // Create message window for Raw Input
-        WNDCLASS wc = {};
-        wc.lpfnWndProc = WindowProc;
-        wc.hInstance = GetModuleHandle(NULL);
-        wc.lpszClassName = "FanatecHIDWindow";
-        
-        mexPrintf(">>> Registering window class...\n");
-        if (!RegisterClass(&wc)) {
-            DWORD error = GetLastError();
-            mexPrintf("!!! ERROR: Failed to register window class (Error: %lu)\n", error);
-            
-            if (error == ERROR_CLASS_ALREADY_EXISTS) {
-                mexPrintf("!!! Window class already exists - this might be OK\n");
-            } else {
-                return false;
-            }
-        } else {
-            mexPrintf(">>> Window class registered successfully\n");
+        framesEnabled = withFrames;
+        startUs = now_us();
+        
+        // filter settings are copied before the input thread exists, so no lock is needed
+        PedalFilterConfig filter;
+        std::string filterError;
+        if (PedalFilterConfig::load("pedal_filter.cfg", filter, &filterError)) {
+            router.set_filter(filter);
+            mexPrintf(">>> Pedal filter loaded from pedal_filter.cfg\n");
         }
-        
-        mexPrintf(">>> Creating message-only window...\n");
-        hwnd = CreateWindow(wc.lpszClassName, "Fanatec HID Window", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, wc.hInstance, NULL);
-        
-        if (!hwnd) {
-            DWORD error = GetLastError();
-            mexPrintf("!!! ERROR: Failed to create message window (Error: %lu)\n", error);
-            return false;
+        else {
+            mexPrintf(">>> Pedal filter: %s, pedals unfiltered\n", filterError.c_str());
+        }
+
+        router.set_response(&response);
+        std::string curveError;
+        if (response.load("pedal_curves.cfg", &curveError)) {
+            mexPrintf(">>> Response curves loaded from pedal_curves.cfg\n");
+        }
+        else {
+            mexPrintf(">>> Response curves: %s, pedals stay linear\n", curveError.c_str());
         }
-        mexPrintf(">>> Message window created successfully (HWND: %p)\n", hwnd);
-        
-        // Register for raw input - try multiple HID device types
-        RAWINPUTDEVICE rid[3];
-        
-        // Try Joystick
-        rid[0].usUsagePage = 0x01;
-        rid[0].usUsage = 0x04;  // Joystick
-        rid[0].dwFlags = RIDEV_INPUTSINK;
-        rid[0].hwndTarget = hwnd;
-        
-        // Try Game Pad
-        rid[1].usUsagePage = 0x01;
-        rid[1].usUsage = 0x05;  // Game Pad
-        rid[1].dwFlags = RIDEV_INPUTSINK;
-        rid[1].hwndTarget = hwnd;
-        
-        // Try Generic Desktop Controls
-        rid[2].usUsagePage = 0x01;
-        rid[2].usUsage = 0x00;  // Wildcard - any generic desktop device
-        rid[2].dwFlags = RIDEV_INPUTSINK;
-        rid[2].hwndTarget = hwnd;
-        
-        
-        bool registrationSuccess = false;
-        int successCount = 0;
         
-        // Try registering each device type
-        for (int i = 0; i < 3; i++) {
-            if (RegisterRawInputDevices(&rid[i], 1, sizeof(RAWINPUTDEVICE))) {
-                mexPrintf(">>> SUCCESS: Registered device type %d\n", i);
-                successCount++;
-                registrationSuccess = true;
-            } else {
-                DWORD error = GetLastError();
-                mexPrintf("!!! Failed to register device type %d (Error: %lu)\n", i, error);
-                
-                // Print common error meanings
-                switch (error) {
-                    case ERROR_ACCESS_DENIED:
-                        mexPrintf("!!!   Access denied - may need administrator privileges\n");
-                        break;
-                    case ERROR_INVALID_PARAMETER:
-                        mexPrintf("!!!   Invalid parameter - bad usage page/usage values\n");
-                        break;
-                    case ERROR_NOT_FOUND:
-                        mexPrintf("!!!   Device not found - no HID devices of this type\n");
-                        break;
-                    default:
-                        mexPrintf("!!!   Unknown error\n");
-                        break;
+        // The vehicle model steps on wall time, so speed and the test modes keep going while
+        // the pedals are held still (they only report on change) and between Simulink steps.
+        if (!tickThread.joinable()) {
+            ticking.store(true);
+            tickThread = std::thread([this]() { tickLoop(); });
+        }
+
+        // Another process that owns the pedals shares them: same report path, the device
+        // stays with that process.
+        std::string sharedName;
+        if (SharedPedalSource::name_from_environment(sharedName)) {
+            {
+                std::lock_guard<std::mutex> lock(routerMutex);     // the tick thread walks the slots
+                if (!SharedPedalSource::attach(router)) {
+                    mexPrintf("!!! Shared pedals: router full\n");
+                    return false;
+                }
+            }
+            std::string sharedError;
+            const bool started = shared.start(sharedName, [this](uint64_t device, const uint8_t* report, size_t size, int64_t receivedUs) {
+                onReport(reinterpret_cast<HANDLE>(static_cast<uintptr_t>(device)), report, static_cast<UINT>(size), receivedUs);
+            }, &sharedError);
+            if (started) mexPrintf(">>> Pedals from shared memory %s (FANATEC_SHARED), raw input not started\n", sharedName.c_str());
+            else mexPrintf("!!! Shared pedals: %s\n", sharedError.c_str());
+            return started;
+        }
+
+        // A test manoeuvre replaces the pedals: same report path, no hardware needed.
+        ManeuverPlan plan;
+        std::string planError;
+        if (ManeuverPlan::from_environment(plan, &planError)) {
+            {
+                std::lock_guard<std::mutex> lock(routerMutex);     // the tick thread walks the slots
+                if (!ManeuverSource::attach(router)) {
+                    mexPrintf("!!! Synthetic pedals: router full\n");
+                    return false;
                 }
             }
+            maneuver.start(plan, [this](uint64_t device, const uint8_t* report, size_t size, int64_t receivedUs) {
+                onReport(reinterpret_cast<HANDLE>(static_cast<uintptr_t>(device)), report, static_cast<UINT>(size), receivedUs);
+            });
+            mexPrintf(">>> Synthetic pedals at %.0f Hz (FANATEC_MANEUVER), raw input not started\n", plan.rate_hz);
+            return true;
         }
+        if (!planError.empty()) {
+            mexPrintf(">>> Maneuver plan: %s, using the pedals\n", planError.c_str());
+        }
+
+        // The input thread creates a message-only window, registers joysticks and game pads
+        // (the router sorts out which of them are the pedals) and then blocks in GetMessage,
+        // so reports are handled as they arrive instead of once per Simulink step.
+        mexPrintf(">>> Starting raw input thread...\n");
+        bool started = inputThread.start(
+            [this](HANDLE device, const BYTE* data, UINT size, int64_t receivedUs) {
+                onReport(device, data, size, receivedUs);
+            },
+            [this](HANDLE device, bool arrived) {
+                std::lock_guard<std::mutex> lock(routerMutex);
+                if (arrived) {
+                    if (!HidDevices::attach(router, device)) routerFull.fetch_add(1, std::memory_order_relaxed);
+                }
+                else HidDevices::detach(router, device);
+            });
         
-        if (!registrationSuccess) {
-            mexPrintf("!!! CRITICAL ERROR: Failed to register ANY HID device types\n");
+        if (!started) {
+            DWORD error = GetLastError();
+            mexPrintf("!!! CRITICAL ERROR: Failed to register HID devices (Error: %lu)\n", error);
             mexPrintf("!!! The pedals may not be detected or may need different HID codes\n");
-            DestroyWindow(hwnd);
-            hwnd = nullptr;
             return false;
         }
         
-        mexPrintf(">>> Successfully registered %d HID device type(s)\n", successCount);
         mexPrintf(">>> FanatecPedals initialization COMPLETE - Ready for HID data!\n");
-        mexPrintf(">>> Listening window HWND: %p\n", hwnd);
-        
         return true;
     }
     
-    void update() {
-        // Process any pending Windows messages
-        MSG msg;
-        int messageCount = 0;
-        while (PeekMessage(&msg, hwnd, 0, 0, PM_REMOVE)) {
-            messageCount++;
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
-        }
-        
-        static int updateCount = 0;
-        updateCount++;
-        
-        if (updateCount % 100 == 0) {  // Print every 100 updates (1 second)
-            mexPrintf("--- Update #%d - Processed %d messages\n", updateCount, messageCount);
+    // Copies the newest state without waiting on the input thread into a PedalSignal
+    // vector; the age is the time since the report behind it was received.
+    void getData(double* signals) {
+        PedalSnapshot snap;
+        snapshots.read(snap);
+        pack_signals(snap, now_us(), signals);
+        
+        // Debug the actual output values
+        static int getDataCount = 0;
+        getDataCount++;
+        
+        if (getDataCount % 100 == 0) {
+            mexPrintf(">>> GETDATA OUTPUTS - Speed:%.1fkm/h, Mode:%d, Throttle:%d/255, Brake:%d/255, Clutch:%d, Age:%.4fs\n",
+                     signals[SignalSpeed] * 300, (int)signals[SignalMode], snap.throttle, snap.brake, snap.clutch,
+                     signals[SignalAge]);
+            mexPrintf("--- Input thread: %llu messages, %llu pedal reports, %llu ignored, %llu rejected, %llu frames dropped, %llu devices turned away (router full)\n",
+                     (unsigned long long)inputThread.messages(), (unsigned long long)snap.reports,
+                     (unsigned long long)ignoredReports.load(), (unsigned long long)rejectedReports.load(),
+                     (unsigned long long)droppedFrames.load(), (unsigned long long)routerFull.load());
         }
     }
     
-void getData(double* outputs) {
-    std::lock_guard<std::mutex> lock(dataMutex);
-    
-    outputs[0] = static_cast<double>(pAccelCount) / 300.0;
-    outputs[1] = static_cast<double>(driveMode);
-    outputs[2] = static_cast<double>(rightPedalPressure) / 255.0;
-    outputs[3] = static_cast<double>(middlePedalPressure) / 255.0;
-    outputs[4] = leftPedalPressed ? 1.0 : 0.0;
-    
-    // Debug the actual output values
-    static int getDataCount = 0;
-    getDataCount++;
-    
-    if (getDataCount % 20 == 0) {
-        mexPrintf(">>> GETDATA OUTPUTS - Speed:%.1fkm/h, Mode:%d, Throttle:%d/255, Brake:%d/255, Clutch:%d\n",
-                 outputs[0] * 300, (int)outputs[1], rightPedalPressure, middlePedalPressure, leftPedalPressed);
+    // Moves the reports queued since the last step into a FrameCapacity x FrameColumns
+    // matrix and returns the number of rows filled.
+    size_t getFrame(double* frame) {
+        return drain_frame(frames, startUs, frame);
     }
-}
 
 private:
-    void processRawInput(LPARAM lParam) {
-        mexPrintf(">>> WM_INPUT received! Processing raw input...\n");
-        
-        UINT dwSize;
-        GetRawInputData((HRAWINPUT)lParam, RID_INPUT, NULL, &dwSize, sizeof(RAWINPUTHEADER));
-        
-        mexPrintf(">>> Raw input data size: %d bytes\n", dwSize);
-        
-        if (dwSize == 0) {
-            mexPrintf("!!! ERROR: Raw input data size is 0\n");
+    // Runs on the input thread for every HID report.
+    void onReport(HANDLE device, const BYTE* data, UINT size, int64_t receivedUs) {
+        std::lock_guard<std::mutex> lock(routerMutex);
+        DeviceSlot* slot = HidDevices::route(router, device, data, size, receivedUs);
+        if (!slot) {
+            rejectedReports.fetch_add(1, std::memory_order_relaxed);
             return;
         }
-        
-        BYTE* lpb = new BYTE[dwSize];
-        if (!lpb) {
-            mexPrintf("!!! ERROR: Failed to allocate buffer for HID data\n");
+        if (slot->role != RolePedals) {
+            ignoredReports.fetch_add(1, std::memory_order_relaxed);
             return;
         }
         
-        if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, lpb, &dwSize, sizeof(RAWINPUTHEADER)) == dwSize) {
-            RAWINPUT* raw = (RAWINPUT*)lpb;
-            
-            if (raw->header.dwType == RIM_TYPEHID) {
-                mexPrintf(">>> HID Data detected! Size: %d\n", raw->data.hid.dwSizeHid);
-                
-                BYTE* data = raw->data.hid.bRawData;
-                UINT size = raw->data.hid.dwSizeHid;
-                
-                // Print first 8 bytes for debugging
-                mexPrintf(">>> HID Bytes: ");
-                for (UINT i = 0; i < std::min(size, 8u); i++) {
-                    mexPrintf("%02X ", data[i]);
-                }
-                mexPrintf("\n");
-                
-                std::lock_guard<std::mutex> lock(dataMutex);
-                
-                memset(rawData, 0, sizeof(rawData));
-                memcpy(rawData, data, std::min(size, 8u));
-                processPedalData(data);
-            } else {
-                mexPrintf("!!! Not HID data, type: %d\n", raw->header.dwType);
-            }
-        } else {
-            mexPrintf("!!! ERROR: Failed to get raw input data\n");
-        }
-        delete[] lpb;
-    }
-    
-    void processPedalData(const BYTE* data) {
-        mexPrintf(">>> Processing pedal data - Throttle[2]: %d, Brake[4]: %d, Clutch[6]: %d\n", 
-                 data[2], data[4], data[6]);
-        
-        static DWORD lastModeChange = 0;
-        static DWORD lastBrakeTime = 0;
-        DWORD currentTime = GetTickCount();
-        
-        // LEFT PEDAL LOGIC
-        if (data[6] > 0) {
-            mexPrintf(">>> Clutch pressed: %d\n", data[6]);
-            leftPedalPressed = true;
-            if (data[6] > 14) {
-                if (currentTime - lastModeChange > 1000) {
-                    mexPrintf(">>> Mode change triggered!\n");
-                    if (driveMode == 0) {
-                        driveMode = 1;
-                        mexPrintf(">>> Switching to DYNAMIC mode\n");
-                    } else {
-                        driveMode = 0;
-                        pAccelCount = 0;
-                        mexPrintf(">>> Switching to STATIC mode, speed reset to 0\n");
-                    }
-                    lastModeChange = currentTime;
-                }
-            }
-        } else {
-            leftPedalPressed = false;
-        }
-        
-        // RIGHT PEDAL LOGIC
-        if (data[2] > 0) {
-            mexPrintf(">>> Throttle pressed: %d\n", data[2]);
-            rightPedalPressed = true;
-            rightPedalPressure = data[2];
-            
-            if (driveMode == 0) {
-                if (data[2] > 13) {
-                    rpEdge++;
-                    if (rpEdge < 2) {
-                        pAccelCount += 20;
-                        if (pAccelCount > 300) pAccelCount = 300;
-                    }
-                }
-            } else {
-                if (pAccelCount < 300) {
-                    pAccelCount = pAccelCount + (rightPedalPressure / 5);
-                    if (pAccelCount > 300) pAccelCount = 300;
-                }
-                if (rightPedalPressure < 2) {
-                    pAccelCount += 1;
-                    if (pAccelCount > 300) pAccelCount = 300;
-                }
-            }
-        } else {
-            rightPedalPressed = false;
-            rpEdge = 0;
-        }
+        pedal_engine_process(slot->engine, slot->sample, receivedUs, engineConfig);
+        DeviceRouter::record_latency(*slot, now_us() - receivedUs);
         
-        // MIDDLE PEDAL LOGIC
-        if (data[4] > 0) {
-            mexPrintf(">>> Brake pressed: %d\n", data[4]);
-            middlePedalPressed = true;
-            middlePedalPressure = data[4];
-            
-            if (data[4] > 30) {
-                if (currentTime - lastBrakeTime > 500) {
-                    if (driveMode == 0) {
-                        mpEdge++;
-                        if (mpEdge < 2) {
-                            pAccelCount -= 20;
-                            if (pAccelCount < 0) pAccelCount = 0;
-                        }
-                    } else {
-                        pAccelCount -= (middlePedalPressure * 2);
-                        if (pAccelCount < 0) pAccelCount = 0;
-                    }
-                    lastBrakeTime = currentTime;
-                }
-            }
-        } else {
-            middlePedalPressed = false;
-            mpEdge = 0;
+        PedalSnapshot& snap = writeSnapshot(slot->engine, receivedUs);
+        snap.reports = ++pedalReports;
+        if (framesEnabled && !frames.try_push(snap)) {
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
         }
-        
-        // Speed decay in dynamic mode
-        if (driveMode == 1) {
-            static int decayCounter = 0;
-            if (++decayCounter >= 10) {
-                pAccelCount--;
-                if (pAccelCount < 0) pAccelCount = 0;
-                decayCounter = 0;
+        snapshots.publish();
+    }
+
+    // Every engine tick (10 ms) on wall time: the model steps due on every device's engine,
+    // then the pedal set's state goes out like a report's, keeping the time of the report
+    // behind it so the age output still says how old the pedal values are. Ticks are not
+    // frame rows; the frame holds reports.
+    void tickLoop() {
+        tickStats.apply();
+        PedalTickSchedule schedule;
+        schedule.start(now_us(), engineConfig);
+        while (ticking.load()) {
+            tickStats.sleep_until(schedule.next_us);
+            const int steps = schedule.due(now_us(), engineConfig);
+            if (steps == 0) continue;
+
+            std::lock_guard<std::mutex> lock(routerMutex);
+            for (int n = 0; n < steps; n++) router.tick_engines(engineConfig);
+            for (int i = 0; i < router.count(); i++) {
+                const DeviceSlot& slot = router.slot(i);
+                if (!slot.handle || slot.role != RolePedals || !slot.has_sample) continue;
+                PedalSnapshot& snap = writeSnapshot(slot.engine, slot.stats.last_us);
+                snap.reports = pedalReports;
+                snapshots.publish();
+                break;
             }
         }
-        
-        mexPrintf(">>> Final state - Speed: %d, Mode: %d\n", pAccelCount, driveMode);
     }
 
-    // Static window procedure
-    static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-        if (uMsg == WM_INPUT && instance) {
-            mexPrintf(">>> WindowProc: WM_INPUT message received\n");
-            instance->processRawInput(lParam);
-            return 0;
-        }
-        
-        if (uMsg == WM_INPUT && !instance) {
-            mexPrintf("!!! WindowProc: WM_INPUT received but no instance!\n");
-        }
-        
-        return DefWindowProc(hwnd, uMsg, wParam, lParam);
+    // Both writers hold routerMutex, so the triple buffer still has one writer at a time.
+    PedalSnapshot& writeSnapshot(const PedalEngineState& engine, int64_t updatedUs) {
+        PedalSnapshot& snap = snapshots.write_buffer();
+        snap.speed = engine.speed;
+        snap.driveMode = engine.mode;
+        snap.throttle = engine.throttle;
+        snap.brake = engine.brake;
+        snap.clutch = engine.left_pressed;
+        snap.updatedUs = updatedUs;
+        return snap;
     }
 };
 
-// Initialize static member
-FanatecPedals* FanatecPedals::instance = nullptr;
-
 // S-function interface
 static FanatecPedals* pedalSystem = nullptr;
 
+static int_T getOutputMode(SimStruct *S) {
+    if (ssGetSFcnParamsCount(S) <= OUTPUT_MODE_PARAM) return OutputScalarPorts;
+    const mxArray* param = ssGetSFcnParam(S, OUTPUT_MODE_PARAM);
+    if (!mxIsNumeric(param) || mxGetNumberOfElements(param) != 1) return OutputScalarPorts;
+    return mxGetScalar(param) != 0.0 ? OutputVectorPorts : OutputScalarPorts;
+}
+
+// The block's period: the parameter when it is positive, inherited for -1, 0.01 s
+// without it. Anything else is NaN so mdlInitializeSizes can refuse it.
+static real_T getSampleTime(SimStruct *S) {
+    if (ssGetSFcnParamsCount(S) <= SAMPLE_TIME_PARAM) return DEFAULT_SAMPLE_TIME;
+    const mxArray* param = ssGetSFcnParam(S, SAMPLE_TIME_PARAM);
+    if (!mxIsNumeric(param) || mxGetNumberOfElements(param) != 1) return mxGetNaN();
+    const real_T ts = mxGetScalar(param);
+    if (ts == -1.0) return INHERITED_SAMPLE_TIME;
+    return ts > 0.0 ? ts : mxGetNaN();
+}
+
 static void mdlInitializeSizes(SimStruct *S) {
     mexPrintf("=== mdlInitializeSizes called ===\n");
-    ssSetNumSFcnParams(S, 0);
-    if (ssGetNumSFcnParams(S) != ssGetSFcnParamsCount(S)) {
-        mexPrintf("!!! Parameter count mismatch\n");
+    // both parameters are optional so existing blocks keep their five+1 ports at 100 Hz
+    int_T numParams = ssGetSFcnParamsCount(S);
+    if (numParams > 2) {
+        ssSetErrorStatus(S, "pedal_interface takes at most two parameters (output mode 0 or 1, sample time in s or -1)");
+        return;
+    }
+    ssSetNumSFcnParams(S, numParams);
+    for (int_T param = 0; param < numParams; param++) ssSetSFcnParamTunable(S, param, SS_PRM_NOT_TUNABLE);
+    if (mxIsNaN(getSampleTime(S))) {
+        ssSetErrorStatus(S, "pedal_interface: the sample time must be a positive number of seconds, or -1 to inherit it");
         return;
     }
     
@@ -366,17 +308,26 @@ static void mdlInitializeSizes(SimStruct *S) {
         return;
     }
     
-    if (!ssSetNumOutputPorts(S, 5)) {
-        mexPrintf("!!! Failed to set 5 output ports\n");
-        return;
+    if (getOutputMode(S) == OutputVectorPorts) {
+        if (!ssSetNumOutputPorts(S, 3)) {
+            mexPrintf("!!! Failed to set 3 output ports\n");
+            return;
+        }
+        
+        ssSetOutputPortWidth(S, 0, SignalCount);    // PedalSignal vector
+        ssSetOutputPortMatrixDimensions(S, 1, static_cast<int_T>(FrameCapacity), FrameColumns);
+        ssSetOutputPortWidth(S, 2, 1);              // valid rows in the frame
+    } else {
+        if (!ssSetNumOutputPorts(S, SignalCount)) {
+            mexPrintf("!!! Failed to set %d output ports\n", SignalCount);
+            return;
+        }
+        
+        for (int_T port = 0; port < SignalCount; port++) {
+            ssSetOutputPortWidth(S, port, 1);
+        }
     }
     
-    ssSetOutputPortWidth(S, 0, 1);
-    ssSetOutputPortWidth(S, 1, 1);
-    ssSetOutputPortWidth(S, 2, 1);
-    ssSetOutputPortWidth(S, 3, 1);
-    ssSetOutputPortWidth(S, 4, 1);
-    
     ssSetNumSampleTimes(S, 1);
     ssSetNumRWork(S, 0);
     ssSetNumIWork(S, 0);
@@ -387,12 +338,14 @@ static void mdlInitializeSizes(SimStruct *S) {
     ssSetSimStateCompliance(S, USE_DEFAULT_SIM_STATE);
     ssSetOptions(S, SS_OPTION_EXCEPTION_FREE_CODE);
     
-    mexPrintf("=== S-function configured with 5 output ports ===\n");
+    mexPrintf("=== S-function configured with %d output ports ===\n", ssGetNumOutputPorts(S));
 }
 
 static void mdlInitializeSampleTimes(SimStruct *S) {
-    mexPrintf("=== mdlInitializeSampleTimes called - Setting 100Hz (0.01s)\n");
-    ssSetSampleTime(S, 0, 0.01);
+    const real_T ts = getSampleTime(S);
+    if (ts == INHERITED_SAMPLE_TIME) mexPrintf("=== mdlInitializeSampleTimes called - inherited sample time\n");
+    else mexPrintf("=== mdlInitializeSampleTimes called - Setting %.0fHz (%gs)\n", 1.0 / ts, ts);
+    ssSetSampleTime(S, 0, ts);
     ssSetOffsetTime(S, 0, 0.0);
 }
 
@@ -404,7 +357,7 @@ static void mdlStart(SimStruct *S) {
     PWork[0] = pedalSystem;
     
     mexPrintf(">>> Calling initialize...\n");
-    bool success = pedalSystem->initialize();
+    bool success = pedalSystem->initialize(getOutputMode(S) == OutputVectorPorts);
     mexPrintf(">>> Initialize result: %s\n", success ? "SUCCESS" : "FAILED");
 }
 
@@ -413,49 +366,43 @@ static void mdlOutputs(SimStruct *S, int_T tid) {
     outputCount++;
     
     // Reduced debug spam
-    if (outputCount % 50 == 0) {
+    if (outputCount % 100 == 0) {
         mexPrintf("--- mdlOutputs #%d\n", outputCount);
     }
     
     FanatecPedals* system = static_cast<FanatecPedals*>(ssGetPWork(S)[0]);
+    const bool vectorPorts = getOutputMode(S) == OutputVectorPorts;
     
+    // Snapshot read only - the input thread has already processed every report
+    double signals[SignalCount];
     if (system) {
-        system->update();  // Process HID messages
-        
-        double outputs[5];
-        system->getData(outputs);
-        
-        real_T *y0 = ssGetOutputPortRealSignal(S, 0);
-        real_T *y1 = ssGetOutputPortRealSignal(S, 1);
-        real_T *y2 = ssGetOutputPortRealSignal(S, 2);
-        real_T *y3 = ssGetOutputPortRealSignal(S, 3);
-        real_T *y4 = ssGetOutputPortRealSignal(S, 4);
-        
-        // ✅ CRITICAL FIX: Use REAL data, not forced values
-        y0[0] = outputs[0];  // Speed (from your pedal logic)
-        y1[0] = outputs[1];  // Mode  
-        y2[0] = outputs[2];  // Throttle
-        y3[0] = outputs[3];  // Brake
-        y4[0] = outputs[4];  // Clutch
-        
-        // Debug what we're actually sending
-        if (outputCount % 50 == 0) {
-            mexPrintf(">>> SCOPE OUTPUTS - y0:%.3f, y1:%.0f, y2:%.3f, y3:%.3f, y4:%.0f\n",
-                     y0[0], y1[0], y2[0], y3[0], y4[0]);
-        }
+        system->getData(signals);
     } else {
         // Zero outputs if no system
-        real_T *y0 = ssGetOutputPortRealSignal(S, 0);
-        real_T *y1 = ssGetOutputPortRealSignal(S, 1);
-        real_T *y2 = ssGetOutputPortRealSignal(S, 2);
-        real_T *y3 = ssGetOutputPortRealSignal(S, 3);
-        real_T *y4 = ssGetOutputPortRealSignal(S, 4);
-        
-        if (y0) y0[0] = 0.0;
-        if (y1) y1[0] = 0.0;
-        if (y2) y2[0] = 0.0;
-        if (y3) y3[0] = 0.0;
-        if (y4) y4[0] = 0.0;
+        for (int i = 0; i < SignalCount; i++) signals[i] = 0.0;
+        signals[SignalAge] = -1.0;
+    }
+    
+    if (vectorPorts) {
+        real_T *y = ssGetOutputPortRealSignal(S, 0);
+        for (int i = 0; i < SignalCount; i++) y[i] = signals[i];
+        
+        real_T *frame = ssGetOutputPortRealSignal(S, 1);
+        size_t rows = 0;
+        if (system) rows = system->getFrame(frame);
+        else clear_frame_rows(0, frame);
+        ssGetOutputPortRealSignal(S, 2)[0] = static_cast<real_T>(rows);
+    } else {
+        for (int_T port = 0; port < SignalCount; port++) {
+            ssGetOutputPortRealSignal(S, port)[0] = signals[port];
+        }
+    }
+    
+    // Debug what we're actually sending
+    if (outputCount % 100 == 0) {
+        mexPrintf(">>> SCOPE OUTPUTS - speed:%.3f, mode:%.0f, throttle:%.3f, brake:%.3f, clutch:%.0f, age:%.4f\n",
+                 signals[SignalSpeed], signals[SignalMode], signals[SignalThrottle], signals[SignalBrake],
+                 signals[SignalClutch], signals[SignalAge]);
     }
 }
 
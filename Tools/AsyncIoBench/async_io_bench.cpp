@@ -0,0 +1,298 @@
+// async_io_bench.cpp - XCP server on a reactor vs a thread per connection
+//
+// Serves the XCP CONNECT request/response two ways, one after the other, on localhost:
+//
+//   reactor   XcpServer (xcp_server.h): one reactor thread, a task per client
+//   threads   a blocking accept() thread and a blocking thread per client, the design
+//             the XCP server had (with a shutdown() so its stop() cannot hang)
+//
+// <clients> connections on one client thread each send a CONNECT every <interval> us
+// (0 = as soon as the answer is in) for <seconds>; --idle adds connections that never
+// send, which cost the thread design a thread each. Reports per design the server
+// threads, round trips per second, the round trip p50/p99/max, the server's CPU time
+// per request (the process minus the client thread) and how long stop() took with all
+// clients still connected.
+//
+//   g++ -std=c++20 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard async_io_bench.cpp -o async_io_bench
+//   cl /std:c++20 /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard async_io_bench.cpp
+//   ./async_io_bench [--clients 50] [--idle 0] [--interval 0] [--seconds 5] [--port 5555]
+#include "xcp_server.h"             // before anything that pulls in <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_histogram.h"
+#include "timing.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+// CPU seconds of the process, or of the calling thread
+static double cpu_seconds(bool thread) {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    const BOOL ok = thread ? GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)
+                           : GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+    if (!ok) return 0;
+    const auto ticks = [](const FILETIME& f) { return (static_cast<uint64_t>(f.dwHighDateTime) << 32) | f.dwLowDateTime; };
+    return static_cast<double>(ticks(kernel) + ticks(user)) * 1e-7;
+#else
+    timespec ts;
+    clock_gettime(thread ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// The thread-per-connection design: blocking sockets, one thread each.
+class ThreadedXcpServer {
+public:
+    bool start(uint16_t port) {
+        listener_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener_ == STATS_INVALID_SOCKET) return false;
+        int reuse = 1;
+        setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener_, 64) != 0) {
+            stats_close_socket(listener_);
+            return false;
+        }
+        acceptor_ = std::thread([this] {
+            for (;;) {
+                stats_socket_t s = accept(listener_, nullptr, nullptr);
+                if (s == STATS_INVALID_SOCKET || stop_.load()) {
+                    if (s != STATS_INVALID_SOCKET) stats_close_socket(s);
+                    return;
+                }
+                int on = 1;
+                setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+                std::lock_guard<std::mutex> lock(mutex_);
+                clients_.push_back(s);
+                threads_.emplace_back(&ThreadedXcpServer::serve, this, s);
+            }
+        });
+        return true;
+    }
+
+    // shutdown() wakes the blocking accept() and recv() calls
+    void stop() {
+        stop_.store(true);
+        shutdown(listener_, 2);
+        stats_close_socket(listener_);
+        acceptor_.join();
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (stats_socket_t s : clients_) shutdown(s, 2);
+        for (std::thread& t : threads_) t.join();
+        for (stats_socket_t s : clients_) stats_close_socket(s);
+    }
+
+    int threads() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<int>(threads_.size()) + 1;
+    }
+
+private:
+    stats_socket_t listener_ = STATS_INVALID_SOCKET;
+    std::thread acceptor_;
+    std::atomic<bool> stop_{ false };
+    std::mutex mutex_;
+    std::vector<stats_socket_t> clients_;
+    std::vector<std::thread> threads_;
+
+    void serve(stats_socket_t s) {
+        uint8_t rx[64];
+        for (;;) {
+            const int n = recv(s, reinterpret_cast<char*>(rx), sizeof(rx), 0);
+            if (n <= 0) return;
+            if (rx[0] != 0xFF) continue;
+            const uint8_t tx[2] = { 0xFF, 0x00 };
+            if (send(s, reinterpret_cast<const char*>(tx), 2, STATS_SEND_FLAGS) != 2) return;
+        }
+    }
+};
+
+struct Client {
+    stats_socket_t socket = STATS_INVALID_SOCKET;
+    int64_t sent_us = 0;            // 0 = no request outstanding
+    int64_t due_us = 0;
+};
+
+struct Result {
+    int threads = 0;
+    uint64_t requests = 0;
+    double seconds = 0;
+    double server_cpu_s = 0;
+    double stop_ms = 0;
+    LatencyHistogram rtt_us;
+};
+
+static stats_socket_t connect_client(uint16_t port) {
+    stats_socket_t s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == STATS_INVALID_SOCKET) return s;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    int on = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+    if (connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        stats_close_socket(s);
+        return STATS_INVALID_SOCKET;
+    }
+    return s;
+}
+
+// Connects, runs the clients for seconds on this thread and closes nothing: stop() is
+// timed with the connections still open. false if a connection failed.
+static bool drive(uint16_t port, int clientCount, int idleCount, int64_t interval, double seconds,
+                  std::vector<Client>& clients, std::vector<stats_socket_t>& idle, Result& r) {
+    for (int i = 0; i < idleCount; i++) {
+        idle.push_back(connect_client(port));
+        if (idle.back() == STATS_INVALID_SOCKET) return false;
+    }
+    clients.resize(static_cast<size_t>(clientCount));
+    for (Client& c : clients) {
+        c.socket = connect_client(port);
+        if (c.socket == STATS_INVALID_SOCKET || !reactor_set_nonblocking(c.socket)) return false;
+    }
+
+    std::vector<pollfd> fds(clients.size());
+    const double cpuStart = cpu_seconds(false), clientStart = cpu_seconds(true);
+    const int64_t start = now_us(), end = start + static_cast<int64_t>(seconds * 1e6);
+    for (Client& c : clients) c.due_us = start;
+    for (int64_t now = start; now < end; now = now_us()) {
+        int64_t wait = end - now;
+        for (Client& c : clients) {
+            if (c.sent_us || c.due_us > now) {
+                if (!c.sent_us) wait = (std::min)(wait, c.due_us - now);
+                continue;
+            }
+            const uint8_t connectCmd[2] = { 0xFF, 0x00 };
+            if (send(c.socket, reinterpret_cast<const char*>(connectCmd), 2, STATS_SEND_FLAGS) == 2) c.sent_us = now;
+        }
+        for (size_t i = 0; i < clients.size(); i++) {
+            fds[i].fd = clients[i].socket;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        const int timeoutMs = static_cast<int>((std::max)(int64_t(0), (std::min)(wait, int64_t(100000))) / 1000);
+        if (reactor_poll(fds.data(), static_cast<unsigned long>(fds.size()), timeoutMs) <= 0) continue;
+        now = now_us();
+        for (size_t i = 0; i < clients.size(); i++) {
+            if (!fds[i].revents) continue;
+            Client& c = clients[i];
+            uint8_t rx[64];
+            const int n = recv(c.socket, reinterpret_cast<char*>(rx), sizeof(rx), 0);
+            if (n < 2 || !c.sent_us) continue;
+            r.rtt_us.record(now - c.sent_us);
+            r.requests++;
+            c.due_us = interval ? c.sent_us + interval : now;
+            c.sent_us = 0;
+        }
+    }
+    r.seconds = (now_us() - start) * 1e-6;
+    r.server_cpu_s = (cpu_seconds(false) - cpuStart) - (cpu_seconds(true) - clientStart);
+    return true;
+}
+
+static void close_all(std::vector<Client>& clients, std::vector<stats_socket_t>& idle) {
+    for (Client& c : clients) {
+        if (c.socket != STATS_INVALID_SOCKET) stats_close_socket(c.socket);
+    }
+    for (stats_socket_t s : idle) {
+        if (s != STATS_INVALID_SOCKET) stats_close_socket(s);
+    }
+    clients.clear();
+    idle.clear();
+}
+
+static void print(const char* name, const Result& r) {
+    const LatencyHistogram& h = r.rtt_us;
+    printf("%-9s %7d %10.0f %8llu %8llu %8llu %12.2f %8.2f\n", name, r.threads, r.requests / r.seconds,
+        (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99), (unsigned long long)h.maximum(),
+        r.requests ? r.server_cpu_s * 1e6 / r.requests : 0.0, r.stop_ms);
+}
+
+int main(int argc, char** argv) {
+    int clientCount = 50, idleCount = 0, port = XcpServer::DefaultPort;
+    int64_t interval = 0;
+    double seconds = 5;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string a = argv[i];
+        if (a == "--clients") clientCount = atoi(argv[i + 1]);
+        else if (a == "--idle") idleCount = atoi(argv[i + 1]);
+        else if (a == "--interval") interval = atoll(argv[i + 1]);
+        else if (a == "--seconds") seconds = atof(argv[i + 1]);
+        else if (a == "--port") port = atoi(argv[i + 1]);
+        else {
+            fprintf(stderr, "unknown option %s\n", a.c_str());
+            return 1;
+        }
+    }
+    if (clientCount < 1 || clientCount + idleCount > XcpServer::MaxClients) {
+        fprintf(stderr, "1 to %d connections, idle ones included\n", XcpServer::MaxClients);
+        return 1;
+    }
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    const uint16_t p = static_cast<uint16_t>(port);
+    std::vector<Client> clients;
+    std::vector<stats_socket_t> idle;
+
+    Result reactor;
+    {
+        XcpServer server;
+        if (!server.start(p)) {
+            fprintf(stderr, "cannot listen on port %d\n", port);
+            return 1;
+        }
+        if (!drive(p, clientCount, idleCount, interval, seconds, clients, idle, reactor)) {
+            fprintf(stderr, "cannot connect to the reactor server\n");
+            return 1;
+        }
+        reactor.threads = 1;
+        const int64_t t0 = now_us();
+        server.stop();
+        reactor.stop_ms = (now_us() - t0) * 1e-3;
+        close_all(clients, idle);
+    }
+
+    Result threaded;
+    {
+        ThreadedXcpServer server;
+        if (!server.start(p)) {
+            fprintf(stderr, "cannot listen on port %d\n", port);
+            return 1;
+        }
+        if (!drive(p, clientCount, idleCount, interval, seconds, clients, idle, threaded)) {
+            fprintf(stderr, "cannot connect to the threaded server\n");
+            return 1;
+        }
+        threaded.threads = server.threads();
+        const int64_t t0 = now_us();
+        server.stop();
+        threaded.stop_ms = (now_us() - t0) * 1e-3;
+        close_all(clients, idle);
+    }
+
+    printf("%d clients (+%d idle), %s, %.1f s per design\n", clientCount, idleCount,
+        interval ? (std::to_string(interval) + " us between requests").c_str() : "back to back", seconds);
+    printf("design    threads  round/s   p50_us   p99_us   max_us  cpu_us/req  stop_ms\n");
+    print("reactor", reactor);
+    print("threads", threaded);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
@@ -0,0 +1,222 @@
+// batch_runner.cpp - replays many pedal captures through the pedal engine in parallel
+//
+// Each capture gets its own engine state and vehicle model (pedal_replay.h), so traces
+// are independent and spread over a work-stealing pool. One summary row per trace is
+// written as CSV or as a simple columnar file (see write_columnar).
+//
+// Build (no Windows headers needed):
+//   g++ -std=c++17 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard batch_runner.cpp -o batch_runner
+//   cl /std:c++17 /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard batch_runner.cpp
+//
+// Usage:
+//   batch_runner [--threads N] [--format csv|columnar] [--out FILE] capture...
+//   batch_runner [--threads N] --synthesize COUNT SECONDS     (generated traces, for scaling runs)
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "pedal_capture.h"
+#include "pedal_replay.h"
+#include "thread_pool.h"
+
+struct TraceResult {
+    std::string name;
+    bool loaded = false;
+    ReplayMetrics metrics;
+};
+
+// Pedal work the way a test driver does it: holds, ramps and clutch taps at 1 kHz.
+// Deterministic per index so runs are comparable.
+static void synthesize(PedalCapture& capture, uint64_t index, int seconds) {
+    capture.name = "synthetic_" + std::to_string(index);
+    uint64_t state = 0x9E3779B97F4A7C15ull * (index + 1);
+    auto next = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    };
+
+    const int64_t total = static_cast<int64_t>(seconds) * 1000;
+    capture.records.reserve(static_cast<size_t>(total));
+    uint16_t throttle = 0, brake = 0, clutch = 0;
+    int64_t holdUntil = 0;
+    for (int64_t ms = 0; ms < total; ms++) {
+        if (ms >= holdUntil) {
+            uint64_t r = next();
+            throttle = (r & 3) ? static_cast<uint16_t>(r >> 16) : 0;
+            brake = (r & 12) == 12 ? static_cast<uint16_t>(r >> 32) : 0;
+            clutch = (r & 0x3F0) == 0x3F0 ? 0xFFFF : 0;
+            holdUntil = ms + 50 + static_cast<int64_t>((r >> 48) % 2000);
+        }
+        CaptureRecord rec;
+        rec.t_us = ms * 1000;
+        rec.axis[ChannelThrottle] = throttle;
+        rec.axis[ChannelBrake] = brake;
+        rec.axis[ChannelClutch] = clutch;
+        rec.axis[ChannelSteering] = 0x8000;
+        rec.buttons = 0;
+        capture.records.push_back(rec);
+    }
+}
+
+static bool write_csv(FILE* f, const std::vector<TraceResult>& results) {
+    fprintf(f, "trace,loaded,samples,duration_s,final_speed,max_speed,mode_switches,time_at_limit_s,distance_m,final_mode\n");
+    for (const TraceResult& r : results) {
+        const ReplayMetrics& m = r.metrics;
+        fprintf(f, "%s,%d,%llu,%.3f,%d,%d,%d,%.3f,%.1f,%s\n", r.name.c_str(), r.loaded ? 1 : 0,
+            (unsigned long long)m.samples, m.duration_s, m.final_speed, m.max_speed, m.mode_switches,
+            m.time_at_limit_s, m.distance_m, m.final_mode == Static ? "static" : "dynamic");
+    }
+    return !ferror(f);
+}
+
+// Columnar layout, all little endian:
+//   "FPCOL1\0\0", uint64 rows, uint32 columns
+//   per column: uint32 name length, name, uint8 type ('i' int64, 'd' double, 's' string),
+//               then rows values back to back (strings as uint32 length + bytes)
+// Readers can map one column without touching the others.
+class ColumnWriter {
+public:
+    ColumnWriter(FILE* f, uint64_t rows, uint32_t columns) : f_(f) {
+        fwrite("FPCOL1\0\0", 1, 8, f_);
+        fwrite(&rows, sizeof(rows), 1, f_);
+        fwrite(&columns, sizeof(columns), 1, f_);
+    }
+
+    template <typename Fn>
+    void int_column(const char* name, const std::vector<TraceResult>& rs, Fn get) {
+        header(name, 'i');
+        for (const TraceResult& r : rs) {
+            int64_t v = static_cast<int64_t>(get(r));
+            fwrite(&v, sizeof(v), 1, f_);
+        }
+    }
+
+    template <typename Fn>
+    void double_column(const char* name, const std::vector<TraceResult>& rs, Fn get) {
+        header(name, 'd');
+        for (const TraceResult& r : rs) {
+            double v = get(r);
+            fwrite(&v, sizeof(v), 1, f_);
+        }
+    }
+
+    void string_column(const char* name, const std::vector<TraceResult>& rs) {
+        header(name, 's');
+        for (const TraceResult& r : rs) {
+            uint32_t len = static_cast<uint32_t>(r.name.size());
+            fwrite(&len, sizeof(len), 1, f_);
+            fwrite(r.name.data(), 1, len, f_);
+        }
+    }
+
+private:
+    FILE* f_;
+
+    void header(const char* name, char type) {
+        uint32_t len = static_cast<uint32_t>(strlen(name));
+        fwrite(&len, sizeof(len), 1, f_);
+        fwrite(name, 1, len, f_);
+        fwrite(&type, 1, 1, f_);
+    }
+};
+
+static bool write_columnar(FILE* f, const std::vector<TraceResult>& rs) {
+    ColumnWriter w(f, rs.size(), 10);
+    w.string_column("trace", rs);
+    w.int_column("loaded", rs, [](const TraceResult& r) { return r.loaded ? 1 : 0; });
+    w.int_column("samples", rs, [](const TraceResult& r) { return r.metrics.samples; });
+    w.double_column("duration_s", rs, [](const TraceResult& r) { return r.metrics.duration_s; });
+    w.int_column("final_speed", rs, [](const TraceResult& r) { return r.metrics.final_speed; });
+    w.int_column("max_speed", rs, [](const TraceResult& r) { return r.metrics.max_speed; });
+    w.int_column("mode_switches", rs, [](const TraceResult& r) { return r.metrics.mode_switches; });
+    w.double_column("time_at_limit_s", rs, [](const TraceResult& r) { return r.metrics.time_at_limit_s; });
+    w.double_column("distance_m", rs, [](const TraceResult& r) { return r.metrics.distance_m; });
+    w.int_column("final_mode", rs, [](const TraceResult& r) { return static_cast<int>(r.metrics.final_mode); });
+    return !ferror(f);
+}
+
+static int usage() {
+    fprintf(stderr,
+        "usage: batch_runner [--threads N] [--format csv|columnar] [--out FILE] capture...\n"
+        "       batch_runner [--threads N] [--format csv|columnar] [--out FILE] --synthesize COUNT SECONDS\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = 0;
+    std::string format = "csv";
+    std::string outPath;
+    uint64_t synthCount = 0;
+    int synthSeconds = 0;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "--threads" && i + 1 < argc) threads = static_cast<unsigned>(atoi(argv[++i]));
+        else if (a == "--format" && i + 1 < argc) format = argv[++i];
+        else if (a == "--out" && i + 1 < argc) outPath = argv[++i];
+        else if (a == "--synthesize" && i + 2 < argc) {
+            synthCount = strtoull(argv[++i], nullptr, 10);
+            synthSeconds = atoi(argv[++i]);
+        }
+        else if (a.size() > 1 && a[0] == '-') return usage();
+        else inputs.push_back(a);
+    }
+    if (format != "csv" && format != "columnar") return usage();
+    if (inputs.empty() && synthCount == 0) return usage();
+    if (synthCount > 0 && synthSeconds <= 0) return usage();
+
+    const size_t traces = synthCount > 0 ? static_cast<size_t>(synthCount) : inputs.size();
+    std::vector<TraceResult> results(traces);
+    const PedalEngineConfig cfg;
+
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool pool(threads);
+    parallel_for(pool, traces, [&](size_t i) {
+        // loading happens on the worker too, so file reads overlap with replays
+        PedalCapture capture;
+        TraceResult& r = results[i];
+        if (synthCount > 0) {
+            synthesize(capture, i, synthSeconds);
+            r.loaded = true;
+        }
+        else {
+            r.loaded = CaptureFile::read(inputs[i], capture);
+        }
+        r.name = synthCount > 0 ? capture.name : inputs[i];
+        if (r.loaded) r.metrics = replay_capture(capture, cfg);
+    });
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t samples = 0;
+    size_t failed = 0;
+    for (const TraceResult& r : results) {
+        samples += r.metrics.samples;
+        if (!r.loaded) failed++;
+    }
+
+    FILE* out = stdout;
+    if (!outPath.empty()) {
+        out = fopen(outPath.c_str(), format == "csv" ? "w" : "wb");
+        if (!out) {
+            fprintf(stderr, "cannot open %s\n", outPath.c_str());
+            return 1;
+        }
+    }
+    else if (format == "columnar") {
+        fprintf(stderr, "--format columnar needs --out\n");
+        return 2;
+    }
+    bool ok = format == "csv" ? write_csv(out, results) : write_columnar(out, results);
+    if (out != stdout) ok = fclose(out) == 0 && ok;
+
+    fprintf(stderr, "%zu traces (%zu unreadable), %llu samples, %u threads, %.3f s, %.0f samples/s, %llu steals\n",
+        traces, failed, (unsigned long long)samples, pool.size(), seconds, samples / (seconds > 0 ? seconds : 1),
+        (unsigned long long)pool.steals());
+    return ok && failed == 0 ? 0 : 1;
+}
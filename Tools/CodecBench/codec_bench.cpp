@@ -0,0 +1,261 @@
+// codec_bench.cpp - delta_codec ratio and throughput against raw column storage
+//
+// Compresses the columns of a pedal trace (the standard manoeuvre at 1 kHz, a capture or
+// a session file) and reports per column the compressed size, encode speed, and two
+// comparisons with raw storage. Into an array: decoding the whole column against a copy
+// of it. Streamed: summing every value as it is read raw from memory, against decoding
+// a block at a time into a buffer that stays in L1 and summing that; a 256 MB write
+// evicts both from the caches first, so the raw read runs at memory bandwidth. It also
+// times random block access and checks the FPC2 capture round trip.
+//
+// Build with -mavx2 (/arch:AVX2) for the AVX2 decoder, without for SSE2.
+//
+//   g++ -std=c++14 -O2 -mavx2 -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard codec_bench.cpp -o codec_bench
+//   cl /O2 /EHsc /arch:AVX2 /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard codec_bench.cpp
+//   ./codec_bench [--seconds 3600] [--capture trace.fpc|trace.csv] [--session run.fsr]
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "delta_codec.h"
+#include "maneuver_source.h"
+#include "pedal_capture.h"
+#include "session_recorder.h"
+
+struct NamedColumn {
+    std::string name;
+    std::vector<int64_t> values;
+    size_t value_bytes;             // raw width in the recorder or capture
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static volatile uint64_t g_sink;
+
+// Written over before each scan so that the column and its encoding start in memory, not in
+// a cache: larger than the last-level cache of the machines this runs on.
+static const size_t EvictBytes = 256u << 20;
+static std::vector<uint8_t> g_evict;
+
+static void evict_caches() {
+    if (g_evict.empty()) g_evict.resize(EvictBytes);
+    memset(g_evict.data(), static_cast<int>(g_sink & 0xFF), g_evict.size());
+    g_sink = g_sink + g_evict[g_evict.size() / 2];
+}
+
+// The consumer of both scans: a wrapping sum at the column's width and a fixed count, so it
+// is the same cheap vector loop for both and the memory or the decoder sets the pace.
+template <typename T>
+static uint64_t sum_block(const T* v) {
+    typedef typename std::make_unsigned<T>::type U;
+    U sum = 0;
+    for (size_t i = 0; i < delta_codec::BlockValues; i++) sum = static_cast<U>(sum + static_cast<U>(v[i]));
+    return sum;
+}
+
+// Raw copy of a column of T, then delta decoding into the same T; best of 3 runs each.
+template <typename T>
+static void bench_column(const NamedColumn& c) {
+    const size_t n = c.values.size();
+    std::vector<T> raw(n), out(n);
+    for (size_t i = 0; i < n; i++) raw[i] = static_cast<T>(c.values[i]);
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<uint8_t> encoded;
+    delta_codec::encode(raw.data(), n, encoded);
+    const double encodeS = seconds_since(t0);
+
+    delta_codec::Column col;
+    if (!col.open(encoded.data(), encoded.size())) {
+        printf("%-14s cannot open its own encoding\n", c.name.c_str());
+        return;
+    }
+
+    double rawS = 1e9, decodeS = 1e9;
+    for (int r = 0; r < 3; r++) {
+        t0 = std::chrono::steady_clock::now();
+        memcpy(out.data(), raw.data(), n * sizeof(T));
+        rawS = std::min(rawS, seconds_since(t0));
+        g_sink = g_sink + out[n / 2];
+
+        t0 = std::chrono::steady_clock::now();
+        col.decode(out.data());
+        decodeS = std::min(decodeS, seconds_since(t0));
+        g_sink = g_sink + out[n / 2];
+    }
+    const bool same = out == raw;
+
+    // streaming: every value summed, read raw from memory or decoded a block at a time
+    // into a buffer that stays in L1; both start with cold caches
+    const size_t fullBlocks = n / delta_codec::BlockValues;
+    double scanRawS = 1e9, scanDecodeS = 1e9;
+    uint64_t rawSum = 0, decodeSum = 0;
+    T buf[delta_codec::BlockValues];
+    for (int r = 0; r < 3; r++) {
+        evict_caches();
+        t0 = std::chrono::steady_clock::now();
+        rawSum = 0;
+        for (size_t b = 0; b < fullBlocks; b++) rawSum += sum_block(raw.data() + b * delta_codec::BlockValues);
+        scanRawS = std::min(scanRawS, seconds_since(t0));
+
+        evict_caches();
+        t0 = std::chrono::steady_clock::now();
+        decodeSum = 0;
+        for (size_t b = 0; b < fullBlocks; b++) {
+            col.decode_block(b, buf);
+            decodeSum += sum_block(buf);
+        }
+        scanDecodeS = std::min(scanDecodeS, seconds_since(t0));
+    }
+    g_sink = g_sink + rawSum;
+
+    // random access: one block decoded per lookup
+    uint64_t seed = 12345;
+    T block[delta_codec::BlockValues];
+    const int lookups = 100000;
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        const size_t b = static_cast<size_t>((seed >> 33) % col.blocks());
+        col.decode_block(b, block);
+        g_sink = g_sink + block[0];
+    }
+    const double blockNs = seconds_since(t0) * 1e9 / lookups;
+
+    const double rawBytes = static_cast<double>(n) * sizeof(T);
+    const double scanned = static_cast<double>(fullBlocks * delta_codec::BlockValues);
+    printf("%-10s %6.2f%% %5.2f  %6.0f  %6.0f %6.0f  %6.0f %6.0f  %5.0f  %s\n",
+        c.name.c_str(), 100.0 * encoded.size() / rawBytes, 8.0 * encoded.size() / n, rawBytes / encodeS / 1e6,
+        n / decodeS / 1e6, n / rawS / 1e6, scanned / scanDecodeS / 1e6, scanned / scanRawS / 1e6, blockNs,
+        same && rawSum == decodeSum ? "ok" : "MISMATCH");
+}
+
+static void bench(const NamedColumn& c) {
+    switch (c.value_bytes) {
+    case 1: bench_column<uint8_t>(c); break;
+    case 2: bench_column<uint16_t>(c); break;
+    case 4: bench_column<uint32_t>(c); break;
+    default: bench_column<int64_t>(c); break;
+    }
+}
+
+int main(int argc, char** argv) {
+    double seconds = 3600;
+    std::string capturePath, sessionPath;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string a = argv[i];
+        if (a == "--seconds") seconds = atof(argv[i + 1]);
+        else if (a == "--capture") capturePath = argv[i + 1];
+        else if (a == "--session") sessionPath = argv[i + 1];
+        else {
+            fprintf(stderr, "unknown option %s\n", a.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<NamedColumn> columns;
+    PedalCapture capture;
+    if (!sessionPath.empty()) {
+        SessionReader reader;
+        std::string error;
+        if (!reader.open(sessionPath, &error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        const session_format::ColumnInfo* info = session_format::columns();
+        for (int k = 0; k < session_format::ColumnCount; k++) {
+            columns.push_back(NamedColumn{ info[k].name, {}, info[k].size });
+        }
+        for (const SessionReader::Chunk& ch : reader.chunks()) {
+            for (uint32_t i = 0; i < ch.rows; i++) {
+                const SessionRow r = ch.row(i);
+                columns[session_format::ColTime].values.push_back(r.t_us);
+                for (int p = 0; p < ChannelSteering; p++) {
+                    columns[session_format::ColThrottleRaw + p].values.push_back(r.raw[p]);
+                    columns[session_format::ColThrottle + p].values.push_back(r.value[p]);
+                }
+                columns[session_format::ColSpeed].values.push_back(static_cast<uint16_t>(r.speed));
+                columns[session_format::ColMode].values.push_back(r.mode);
+                columns[session_format::ColEvent].values.push_back(r.event);
+            }
+        }
+        printf("%s: %llu rows\n", sessionPath.c_str(), (unsigned long long)reader.rows());
+    }
+    else {
+        if (!capturePath.empty()) {
+            if (!CaptureFile::read(capturePath, capture) || capture.records.empty()) {
+                fprintf(stderr, "cannot read capture %s\n", capturePath.c_str());
+                return 1;
+            }
+        }
+        else {
+            // what the legacy 8-bit pedals deliver: levels scaled to the 16-bit axes
+            ManeuverGenerator gen(ManeuverPlan::standard());
+            const size_t n = static_cast<size_t>(seconds * 1000);
+            capture.records.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                PedalSample s;
+                gen.next(s);
+                for (int c = 0; c < ChannelCount; c++) s.axis[c] = static_cast<uint16_t>((s.axis[c] >> 8) * 257);
+                capture.records[i] = PedalCapture::record_of(s, static_cast<int64_t>(i) * 1000);
+            }
+        }
+        static const char* const names[ChannelCount] = { "throttle", "brake", "clutch", "steering" };
+        columns.push_back(NamedColumn{ "t_us", {}, 8 });
+        for (int c = 0; c < ChannelCount; c++) columns.push_back(NamedColumn{ names[c], {}, 2 });
+        columns.push_back(NamedColumn{ "buttons", {}, 4 });
+        for (const CaptureRecord& r : capture.records) {
+            columns[0].values.push_back(r.t_us);
+            for (int c = 0; c < ChannelCount; c++) columns[1 + c].values.push_back(r.axis[c]);
+            columns[1 + ChannelCount].values.push_back(r.buttons);
+        }
+        printf("%s: %zu records\n", capturePath.empty() ? "standard manoeuvre, 8-bit levels, 1 kHz" : capturePath.c_str(),
+            capture.records.size());
+    }
+
+    printf("%-10s %7s %5s  %6s  %13s  %13s  %5s\n", "", "size", "bits", "encode", "into an array", "streamed", "block");
+    printf("%-10s %7s %5s  %6s  %6s %6s  %6s %6s  %5s\n", "column", "%", "/val", "MB/s", "decode", "copy", "decode", "read",
+        "ns");
+    for (const NamedColumn& c : columns) {
+        if (!c.values.empty()) bench(c);
+    }
+    printf("(M values/s; streamed scans start with cold caches)\n");
+
+    if (!capture.records.empty()) {
+        const std::string fpc = "codec_bench.fpc", fpz = "codec_bench_compressed.fpc";
+        PedalCapture back;
+        auto t0 = std::chrono::steady_clock::now();
+        const bool ok = CaptureFile::write_binary(fpc, capture) && CaptureFile::write_compressed(fpz, capture);
+        const double writeS = seconds_since(t0);
+        t0 = std::chrono::steady_clock::now();
+        const bool read = ok && CaptureFile::read(fpz, back);
+        const double readS = seconds_since(t0);
+        bool same = read && back.records.size() == capture.records.size();
+        for (size_t i = 0; same && i < back.records.size(); i++) {
+            same = memcmp(&back.records[i], &capture.records[i], sizeof(CaptureRecord)) == 0;
+        }
+        FILE* a = fopen(fpc.c_str(), "rb");
+        FILE* b = fopen(fpz.c_str(), "rb");
+        long sa = 0, sb = 0;
+        if (a && b) {
+            fseek(a, 0, SEEK_END);
+            fseek(b, 0, SEEK_END);
+            sa = ftell(a);
+            sb = ftell(b);
+        }
+        if (a) fclose(a);
+        if (b) fclose(b);
+        remove(fpc.c_str());
+        remove(fpz.c_str());
+        printf("capture file: FPC1 %ld bytes, FPC2 %ld bytes (%.2f%%), both written in %.0f ms, FPC2 read in %.0f ms: %s\n",
+            sa, sb, sa ? 100.0 * sb / sa : 0.0, writeS * 1e3, readS * 1e3, same ? "ok" : "MISMATCH");
+    }
+    return 0;
+}
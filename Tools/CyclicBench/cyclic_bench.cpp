@@ -0,0 +1,162 @@
+// cyclic_bench.cpp - cyclictest-style wake-up latency of periodic threads under a policy
+//
+// Starts <threads> threads that each wake up every <interval> microseconds on an
+// absolute schedule (ThreadStats::sleep_until, as the front ends' loops do) and record
+// how late every wake-up was. Optional busy threads (--load) compete for the CPUs, and
+// the measuring threads can be pinned (--affinity, thread i on CPU i), given a priority
+// (--priority normal|high|realtime, --fifo for SCHED_FIFO) and run with memory locked
+// (--mlock). Prints one line per thread like cyclictest, in microseconds, then the
+// ThreadMonitor table the front ends serve.
+//
+// With --config it runs the front ends' threads instead: tick, can, xcp and recorder,
+// each at its own period (engine.tick_ms, can.period_ms, 10 ms, 2 ms) and with its
+// policy from the file, so a fanatec.cfg can be checked on the machine before a run.
+//
+//   g++ -std=c++14 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard cyclic_bench.cpp -o cyclic_bench
+//   cl /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard cyclic_bench.cpp
+//   ./cyclic_bench [--threads 4] [--interval 1000] [--seconds 10] [--priority realtime] [--fifo 80]
+//                  [--affinity] [--mlock] [--load 4]
+//   ./cyclic_bench --config fanatec.cfg [--seconds 10] [--load 4]
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "runtime_config.h"
+#include "thread_policy.h"
+#include "timing.h"
+
+struct Cycle {
+    ThreadStats* stats;
+    int64_t interval_us;
+    int64_t min_us = INT64_MAX;
+    int64_t last_us = 0;
+};
+
+int main(int argc, char** argv) {
+    int threadCount = 4, loadThreads = 0;
+    int64_t interval = 1000;
+    double seconds = 10;
+    bool affinity = false, lockMemory = false;
+    ThreadPolicy policy;
+    std::string configPath;
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--affinity") {
+            affinity = true;
+            continue;
+        }
+        if (a == "--mlock") {
+            lockMemory = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "%s needs a value\n", a.c_str());
+            return 1;
+        }
+        const std::string v = argv[++i];
+        if (a == "--threads") threadCount = atoi(v.c_str());
+        else if (a == "--interval") interval = atoll(v.c_str());
+        else if (a == "--seconds") seconds = atof(v.c_str());
+        else if (a == "--fifo") policy.fifo = atoi(v.c_str());
+        else if (a == "--load") loadThreads = atoi(v.c_str());
+        else if (a == "--config") configPath = v;
+        else if (a == "--priority") {
+            if (!thread_priority_from_name(v, policy.priority)) {
+                fprintf(stderr, "priority is normal, high or realtime\n");
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "unknown option %s\n", a.c_str());
+            return 1;
+        }
+    }
+    if (threadCount < 1 || interval < 50) {
+        fprintf(stderr, "need at least one thread and 50 us\n");
+        return 1;
+    }
+
+    ThreadMonitor monitor;
+    std::vector<Cycle> cycles;
+    if (!configPath.empty()) {
+        RuntimeConfig cfg;
+        std::string error;
+        if (!RuntimeConfig::load(configPath, cfg, &error)) {
+            fprintf(stderr, "%s: %s\n", configPath.c_str(), error.c_str());
+            return 1;
+        }
+        lockMemory = lockMemory || cfg.lock_memory;
+        // input and net wait for events, not on a period
+        const int64_t periods[ThreadRoleCount] = { 0, std::llround(cfg.engine.vehicle.dt_s * 1e6),
+            cfg.can.period_ms * 1000LL, 10000, 2000, 0 };
+        for (int r = ThreadTick; r < ThreadRoleCount; r++) {
+            if (!periods[r]) continue;
+            Cycle c;
+            c.stats = &monitor.add(thread_role_name(static_cast<ThreadRole>(r)), cfg.threads[r]);
+            c.interval_us = periods[r];
+            cycles.push_back(c);
+        }
+    }
+    else {
+        const int cpus = static_cast<int>((std::max)(1u, std::thread::hardware_concurrency()));
+        for (int i = 0; i < threadCount; i++) {
+            ThreadPolicy p = policy;
+            if (affinity) p.cpu = i % cpus;
+            Cycle c;
+            c.stats = &monitor.add("T" + std::to_string(i), p);
+            c.interval_us = interval;
+            cycles.push_back(c);
+        }
+    }
+
+    thread_policy_fine_timer();
+    std::string error;
+    if (lockMemory && !thread_policy_lock_memory(&error)) fprintf(stderr, "%s, running unlocked\n", error.c_str());
+
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> load;
+    std::atomic<uint64_t> spins{ 0 };
+    for (int i = 0; i < loadThreads; i++) {
+        load.emplace_back([&] {
+            uint64_t n = 0;
+            while (!done.load(std::memory_order_relaxed)) n++;
+            spins.fetch_add(n);
+        });
+    }
+
+    const int64_t end = now_us() + static_cast<int64_t>(seconds * 1e6);
+    std::vector<std::thread> workers;
+    for (Cycle& c : cycles) {
+        workers.emplace_back([&c, end] {
+            c.stats->apply();
+            int64_t next = now_us() + c.interval_us;
+            while (next < end) {
+                c.stats->sleep_until(next);
+                const int64_t late = now_us() - next;
+                c.min_us = (std::min)(c.min_us, late);
+                c.last_us = late;
+                next += c.interval_us;
+            }
+        });
+    }
+    for (std::thread& t : workers) t.join();
+    done.store(true);
+    for (std::thread& t : load) t.join();
+    thread_policy_coarse_timer();
+
+    printf("%zu threads, %d busy threads, %.1f s%s\n", cycles.size(), loadThreads, seconds,
+        lockMemory && error.empty() ? ", memory locked" : "");
+    for (size_t i = 0; i < cycles.size(); i++) {
+        const Cycle& c = cycles[i];
+        const LatencyHistogram& h = c.stats->wakeup_us();
+        printf("T:%2zu %-9s I:%lld C:%8llu Min:%6lld Act:%6lld Avg:%6.0f p99:%6llu Max:%7llu\n", i, c.stats->name().c_str(),
+            (long long)c.interval_us, (unsigned long long)h.count(), (long long)(h.count() ? c.min_us : 0),
+            (long long)c.last_us, h.mean(), (unsigned long long)h.percentile(99), (unsigned long long)h.maximum());
+    }
+    printf("\n%s", monitor.report().c_str());
+    return 0;
+}
@@ -0,0 +1,165 @@
+// engine_bench.cpp - checks the batch pedal engine against the scalar one and times both
+//
+// Drives N vehicles with pseudo-random pedal work (holds, clutch taps, brake stabs) at a
+// 1 kHz report rate with the vehicle model ticked every 10 ms, compares every field of
+// every lane after every step, then reports vehicle-steps per second for each engine.
+//
+//   g++ -std=c++17 -O2 -mavx2 -ffp-contract=off -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard engine_bench.cpp -o engine_bench
+//   cl /std:c++17 /O2 /arch:AVX2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard engine_bench.cpp
+//   ./engine_bench [vehicles] [seconds]
+//
+// Leave out -mavx2 to check the portable mask path.
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "pedal_engine.h"
+#include "pedal_engine_batch.h"
+
+struct PedalInputs {
+    std::vector<uint16_t> throttle, brake, clutch;
+    std::vector<uint64_t> rng;
+    std::vector<int> hold;
+
+    explicit PedalInputs(size_t n) : throttle(n), brake(n), clutch(n), rng(n), hold(n, 0) {
+        for (size_t i = 0; i < n; i++) rng[i] = 0x9E3779B97F4A7C15ull * (i + 1);
+    }
+
+    void next() {
+        for (size_t i = 0; i < throttle.size(); i++) {
+            if (--hold[i] > 0) continue;
+            uint64_t& s = rng[i];
+            s ^= s << 13;
+            s ^= s >> 7;
+            s ^= s << 17;
+            throttle[i] = (s & 3) ? static_cast<uint16_t>(s >> 16) : 0;
+            brake[i] = (s & 12) == 12 ? static_cast<uint16_t>(s >> 32) : 0;
+            clutch[i] = (s & 0x1F0) == 0x1F0 ? static_cast<uint16_t>(s >> 48) : 0;
+            hold[i] = 1 + static_cast<int>((s >> 40) % 400);
+        }
+    }
+};
+
+static bool same_edges(const PedalEdgeState& a, const PedalEdgeState& b) {
+    for (int c = 0; c < ChannelSteering; c++) {
+        if (a.pedal[c].high != b.pedal[c].high || a.pedal[c].changed_us != b.pedal[c].changed_us) return false;
+    }
+    return true;
+}
+
+static bool same_state(const PedalEngineState& a, const PedalEngineState& b) {
+    return a.mode == b.mode && a.speed == b.speed &&
+        a.left_pressed == b.left_pressed && a.right_pressed == b.right_pressed && a.middle_pressed == b.middle_pressed &&
+        a.throttle == b.throttle && a.brake == b.brake && a.clutch == b.clutch &&
+        same_edges(a.edges, b.edges) &&
+        memcmp(&a.vehicle.speed_ms, &b.vehicle.speed_ms, sizeof(double)) == 0 &&
+        memcmp(&a.vehicle.distance_m, &b.vehicle.distance_m, sizeof(double)) == 0 &&
+        a.vehicle.gear == b.vehicle.gear;
+}
+
+static const char* kernel_name() {
+#if defined(PEDAL_BATCH_AVX2)
+    return "avx2";
+#elif defined(PEDAL_BATCH_NEON)
+    return "neon";
+#else
+    return "masks";
+#endif
+}
+
+int main(int argc, char** argv) {
+    const size_t vehicles = argc > 1 ? static_cast<size_t>(atoll(argv[1])) : 4096;
+    const int seconds = argc > 2 ? atoi(argv[2]) : 10;
+    const int steps = seconds * 1000;           // 1 kHz reports
+    const int64_t stepUs = 1000;
+    const int ticksEvery = 10;                  // vehicle dt = 10 ms
+    const PedalEngineConfig cfg;
+
+    // 1) bit-exact check
+    {
+        const size_t n = vehicles < 1027 ? vehicles : 1027;     // odd count exercises the tail
+        PedalInputs in(n);
+        std::vector<PedalEngineState> scalar(n);
+        PedalEngineBatch batch(n, cfg);
+
+        std::vector<int32_t> changed(n);
+
+        for (int step = 0; step < steps; step++) {
+            const int64_t t = step * stepUs;
+            in.next();
+            for (size_t i = 0; i < n; i++) {
+                PedalSample s;
+                s.axis[ChannelThrottle] = in.throttle[i];
+                s.axis[ChannelBrake] = in.brake[i];
+                s.axis[ChannelClutch] = in.clutch[i];
+                changed[i] = pedal_engine_process(scalar[i], s, t, cfg) ? 1 : 0;
+            }
+            batch.process(in.throttle.data(), in.brake.data(), in.clutch.data(), t);
+            if (memcmp(changed.data(), batch.changed(), n * sizeof(int32_t)) != 0) {
+                fprintf(stderr, "MISMATCH in changed flags at step %d\n", step);
+                return 1;
+            }
+            if (step % ticksEvery == ticksEvery - 1) {
+                for (size_t i = 0; i < n; i++) pedal_engine_tick(scalar[i], cfg);
+                batch.tick();
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (!same_state(scalar[i], batch.state(i))) {
+                    fprintf(stderr, "MISMATCH lane %zu step %d: scalar speed %d mode %d, batch speed %d mode %d\n",
+                        i, step, scalar[i].speed, scalar[i].mode, batch.state(i).speed, batch.state(i).mode);
+                    return 1;
+                }
+            }
+        }
+        printf("bit-exact: %zu lanes x %d steps, kernel %s\n", n, steps, kernel_name());
+    }
+
+    // 2) throughput
+    PedalInputs in(vehicles);
+    std::vector<std::vector<uint16_t>> th, br, cl;     // pregenerated so only the engines are timed
+    const int patterns = 1000;
+    for (int p = 0; p < patterns; p++) {
+        in.next();
+        th.push_back(in.throttle);
+        br.push_back(in.brake);
+        cl.push_back(in.clutch);
+    }
+
+    std::vector<PedalEngineState> scalar(vehicles);
+    auto t0 = std::chrono::steady_clock::now();
+    for (int step = 0; step < steps; step++) {
+        const int p = step % patterns;
+        for (size_t i = 0; i < vehicles; i++) {
+            PedalSample s;
+            s.axis[ChannelThrottle] = th[p][i];
+            s.axis[ChannelBrake] = br[p][i];
+            s.axis[ChannelClutch] = cl[p][i];
+            pedal_engine_process(scalar[i], s, step * stepUs, cfg);
+        }
+        if (step % ticksEvery == ticksEvery - 1) {
+            for (size_t i = 0; i < vehicles; i++) pedal_engine_tick(scalar[i], cfg);
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    PedalEngineBatch batch(vehicles, cfg);
+    for (int step = 0; step < steps; step++) {
+        const int p = step % patterns;
+        batch.process(th[p].data(), br[p].data(), cl[p].data(), step * stepUs);
+        if (step % ticksEvery == ticksEvery - 1) batch.tick();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    const double total = static_cast<double>(vehicles) * steps;
+    const double scalarS = std::chrono::duration<double>(t1 - t0).count();
+    const double batchS = std::chrono::duration<double>(t2 - t1).count();
+    int64_t checksum = 0;
+    for (size_t i = 0; i < vehicles; i++) checksum += scalar[i].speed - batch.speed()[i];
+
+    printf("%zu vehicles, %d steps (1 kHz reports, 100 Hz model)\n", vehicles, steps);
+    printf("scalar  %8.3f s  %12.0f vehicle-steps/s\n", scalarS, total / scalarS);
+    printf("batch   %8.3f s  %12.0f vehicle-steps/s  (%s, %.2fx)\n", batchS, total / batchS, kernel_name(), scalarS / batchS);
+    return checksum == 0 ? 0 : 1;
+}
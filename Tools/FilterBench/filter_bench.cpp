@@ -0,0 +1,107 @@
+// filter_bench.cpp - cost and effect of the pedal noise filter
+//
+// Builds a 1 kHz pedal trace: long stretches at rest with a few counts of sensor noise
+// and occasional single-report spikes, plus real presses. Each filter setting runs the
+// whole trace; the table shows the time per report (all three pedals) and how often the
+// 8-bit "pressed" view (level > 0) flips while the pedal is actually at rest, which is
+// what turned into spurious edges and creep.
+//
+//   g++ -std=c++17 -O2 -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard filter_bench.cpp -o filter_bench
+//   cl /std:c++17 /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard filter_bench.cpp
+//   ./filter_bench [reports]
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "pedal_filter.h"
+
+struct TraceSample {
+    PedalSample sample;
+    int64_t t_us;
+    bool at_rest[FilterPedals];
+};
+
+static std::vector<TraceSample> noisy_trace(size_t n) {
+    std::vector<TraceSample> trace(n);
+    uint64_t s = 0x2545F4914F6CDD1Dull;
+    auto next = [&s]() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    };
+
+    int32_t target[FilterPedals] = { 0 };
+    int32_t pos[FilterPedals] = { 0 };
+    int64_t t = 0;
+    for (size_t i = 0; i < n; i++) {
+        TraceSample& ts = trace[i];
+        t += 900 + static_cast<int64_t>(next() % 200);          // ~1 kHz with jitter
+        ts.t_us = t;
+        for (int c = 0; c < FilterPedals; c++) {
+            const uint64_t r = next();
+            if ((r & 0x3FF) == 0) target[c] = (r >> 10) & 1 ? static_cast<int32_t>((r >> 16) & 0xFFFF) : 0;
+            pos[c] += (target[c] - pos[c]) / 16;
+            int32_t v = pos[c] + static_cast<int32_t>((r >> 32) % 320);   // noise floor just over one 8-bit count
+            if (((r >> 48) & 0x1FF) == 0) v += 9000;                       // single-report spike
+            ts.sample.axis[c] = static_cast<uint16_t>((std::min)((std::max)(v, 0), 65535));
+            ts.at_rest[c] = target[c] == 0 && pos[c] < 256;
+        }
+    }
+    return trace;
+}
+
+static PedalFilterConfig make_config(bool median, double smoothing, double rateLimit) {
+    PedalFilterConfig cfg;
+    for (int c = 0; c < FilterPedals; c++) {
+        cfg.pedal[c].median = median;
+        cfg.pedal[c].alpha_q15 = static_cast<int32_t>(smoothing * FilterAlphaOne);
+        cfg.pedal[c].rate_per_ms = static_cast<int32_t>(rateLimit * 65535.0 / 1000.0);
+    }
+    return cfg;
+}
+
+int main(int argc, char** argv) {
+    const size_t n = argc > 1 ? static_cast<size_t>(atoll(argv[1])) : 2000000;
+    const std::vector<TraceSample> trace = noisy_trace(n);
+
+    struct Setting { const char* name; PedalFilterConfig cfg; };
+    const Setting settings[] = {
+        { "off", make_config(false, 1.0, 0.0) },
+        { "median3", make_config(true, 1.0, 0.0) },
+        { "iir 0.25", make_config(false, 0.25, 0.0) },
+        { "rate 20/s", make_config(false, 1.0, 20.0) },
+        { "median+iir+rate", make_config(true, 0.25, 20.0) },
+    };
+
+    printf("%zu reports, 3 pedals each\n", n);
+    printf("%-16s %12s %18s\n", "filter", "ns/report", "flips at rest");
+    uint64_t sink = 0;
+    for (const Setting& st : settings) {
+        PedalFilterState state;
+        std::vector<PedalSample> out(n);
+
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            out[i] = trace[i].sample;
+            pedal_filter_apply(state, st.cfg, out[i], trace[i].t_us);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+
+        uint64_t flips = 0;
+        for (int c = 0; c < FilterPedals; c++) {
+            bool pressed = false;
+            for (size_t i = 0; i < n; i++) {
+                const bool p = pedal_level8(out[i], static_cast<PedalChannel>(c)) > 0;
+                if (trace[i].at_rest[c] && p != pressed) flips++;
+                pressed = p;
+                sink += out[i].axis[c];
+            }
+        }
+        printf("%-16s %12.2f %18llu\n", st.name,
+            std::chrono::duration<double, std::nano>(t1 - t0).count() / n, (unsigned long long)flips);
+    }
+    return sink != 0 ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+// hid_parser_test.cpp - checks the descriptor parser and the plans it compiles into
+//
+// Feeds stored report descriptors through HidDescriptorParser::parse(), compares the
+// fields it finds (report ID, bit offset, size, logical range) with what the descriptor
+// says, compiles each into a HidExtractionPlan and decodes hand-made reports with it.
+// Covers a device with numbered reports, a pedal set with a 16-bit load-cell brake as
+// Windows delivers it (report ID byte in front), and the 0x26 0xFF 0xFF logical maximum
+// that sign-extends to -1. Prints every failed check and exits non-zero on any.
+//
+//   g++ -std=c++17 -O2 -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard hid_parser_test.cpp -o hid_parser_test
+//   cl /std:c++17 /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard hid_parser_test.cpp
+//   ./hid_parser_test
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "hid_report.h"
+
+static int checks = 0, failures = 0;
+
+static void check(bool ok, const char* what) {
+    checks++;
+    if (ok) return;
+    failures++;
+    fprintf(stderr, "FAIL %s\n", what);
+}
+
+static void check_value(long long got, long long want, long long tolerance, const char* what) {
+    checks++;
+    if (llabs(got - want) <= tolerance) return;
+    failures++;
+    fprintf(stderr, "FAIL %s: %lld, expected %lld\n", what, got, want);
+}
+
+static bool same_field(const HidField& f, uint16_t page, uint16_t usage, uint8_t id, uint32_t bit, uint8_t size,
+    int32_t lmin, int32_t lmax) {
+    return f.usage_page == page && f.usage == usage && f.report_id == id && f.bit_offset == bit && f.bit_size == size &&
+        f.logical_min == lmin && f.logical_max == lmax;
+}
+
+// A joystick with two numbered input reports: ID 1 carries X, Y, Z and 8 buttons,
+// ID 2 a single Rx axis. The plan decodes report 1 only.
+static void report_ids() {
+    static const uint8_t desc[] = {
+        0x05, 0x01, 0x09, 0x04, 0xA1, 0x01,             // Generic Desktop, Joystick, Application
+        0x85, 0x01,                                     // Report ID 1
+        0x09, 0x30, 0x09, 0x31, 0x09, 0x32,             // X, Y, Z
+        0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x03, 0x81, 0x02,
+        0x05, 0x09, 0x19, 0x01, 0x29, 0x08,             // Buttons 1..8
+        0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+        0x85, 0x02,                                     // Report ID 2
+        0x05, 0x01, 0x09, 0x33,                         // Rx
+        0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x01, 0x81, 0x02,
+        0xC0,
+    };
+    std::vector<HidField> fields;
+    check(HidDescriptorParser::parse(desc, sizeof(desc), false, fields), "report IDs: parse");
+    check(fields.size() == 12, "report IDs: 3 axes + 8 buttons + Rx");
+    if (fields.size() != 12) return;
+    // the report ID byte comes first, so the bits of each report start at 8
+    check(same_field(fields[0], hid_usage::PageGenericDesktop, hid_usage::X, 1, 8, 8, 0, 255), "report IDs: X");
+    check(same_field(fields[1], hid_usage::PageGenericDesktop, hid_usage::Y, 1, 16, 8, 0, 255), "report IDs: Y");
+    check(same_field(fields[2], hid_usage::PageGenericDesktop, hid_usage::Z, 1, 24, 8, 0, 255), "report IDs: Z");
+    check(same_field(fields[3], hid_usage::PageButton, 1, 1, 32, 1, 0, 1), "report IDs: button 1");
+    check(same_field(fields[10], hid_usage::PageButton, 8, 1, 39, 1, 0, 1), "report IDs: button 8");
+    check(same_field(fields[11], hid_usage::PageGenericDesktop, hid_usage::Rx, 2, 8, 8, 0, 255), "report IDs: Rx in report 2");
+
+    HidExtractionPlan plan;
+    check(plan.compile(fields, HidChannelMap::pedals()), "report IDs: compile");
+    check(plan.has_channel(ChannelThrottle) && plan.has_channel(ChannelBrake) && plan.has_channel(ChannelClutch),
+        "report IDs: X, Y, Z are throttle, brake, clutch");
+    check(plan.button_count() == 8, "report IDs: 8 buttons");
+    check(plan.min_report_size() == 5, "report IDs: 5-byte report");
+
+    const uint8_t report1[] = { 0x01, 0x00, 0x80, 0xFF, 0x05 };
+    PedalSample s;
+    check(plan.extract(report1, sizeof(report1), s), "report IDs: decode report 1");
+    check_value(s.axis[ChannelThrottle], 0, 0, "report IDs: throttle");
+    check_value(s.axis[ChannelBrake], 0x80 * 257, 0, "report IDs: brake");
+    check_value(s.axis[ChannelClutch], 65535, 0, "report IDs: clutch");
+    check_value(s.buttons, 0x05, 0, "report IDs: buttons 1 and 3");
+
+    const uint8_t report2[] = { 0x02, 0xC8, 0x00, 0x00, 0x00 };
+    PedalSample untouched;
+    untouched.axis[ChannelThrottle] = 1234;
+    check(!plan.extract(report2, sizeof(report2), untouched), "report IDs: report 2 is not decoded");
+    check(untouched.axis[ChannelThrottle] == 1234, "report IDs: report 2 leaves the sample alone");
+    check(!plan.extract(report1, 3, untouched), "report IDs: short report is rejected");
+}
+
+// Simulation Controls pedals: a 10-bit throttle with 6 bits of padding, a 16-bit
+// load-cell brake (logical maximum written in 4 bytes) and an 8-bit clutch. No report
+// IDs, but delivered with a leading 0 byte like Windows raw input does.
+static void load_cell_brake() {
+    static const uint8_t desc[] = {
+        0x05, 0x01, 0x09, 0x04, 0xA1, 0x01,
+        0x05, 0x02,                                     // Simulation Controls
+        0x09, 0xC4, 0x15, 0x00, 0x26, 0xFF, 0x03, 0x75, 0x0A, 0x95, 0x01, 0x81, 0x02,     // Accelerator, 10 bits
+        0x75, 0x06, 0x95, 0x01, 0x81, 0x03,                                               // padding
+        0x09, 0xC5, 0x15, 0x00, 0x27, 0xFF, 0xFF, 0x00, 0x00, 0x75, 0x10, 0x95, 0x01, 0x81, 0x02,   // Brake, 16 bits
+        0x09, 0xC6, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x01, 0x81, 0x02,     // Clutch, 8 bits
+        0xC0,
+    };
+    std::vector<HidField> fields;
+    check(HidDescriptorParser::parse(desc, sizeof(desc), true, fields), "load cell: parse");
+    check(fields.size() == 3, "load cell: padding is not a field");
+    if (fields.size() != 3) return;
+    check(same_field(fields[0], hid_usage::PageSimulation, hid_usage::Accelerator, 0, 8, 10, 0, 1023), "load cell: throttle");
+    check(same_field(fields[1], hid_usage::PageSimulation, hid_usage::Brake, 0, 24, 16, 0, 65535), "load cell: brake");
+    check(same_field(fields[2], hid_usage::PageSimulation, hid_usage::Clutch, 0, 40, 8, 0, 255), "load cell: clutch");
+
+    HidExtractionPlan plan;
+    check(plan.compile(fields, HidChannelMap::pedals()), "load cell: compile");
+    check(plan.min_report_size() == 6, "load cell: 6-byte report");
+
+    const uint8_t report[] = { 0x00, 0xFF, 0x03, 0x34, 0x12, 0x80 };
+    PedalSample s;
+    check(plan.extract(report, sizeof(report), s), "load cell: decode");
+    check_value(s.axis[ChannelThrottle], 65535, 1, "load cell: throttle at 1023");
+    check_value(s.axis[ChannelBrake], 0x1234, 0, "load cell: brake keeps all 16 bits");
+    check_value(s.axis[ChannelClutch], 0x80 * 257, 0, "load cell: clutch");
+
+    const uint8_t half[] = { 0x00, 0x00, 0x02, 0xFF, 0xFF, 0x00 };
+    check(plan.extract(half, sizeof(half), s), "load cell: decode 512");
+    check_value(s.axis[ChannelThrottle], 512 * 65535 / 1023, 1, "load cell: throttle at 512");
+    check_value(s.axis[ChannelBrake], 65535, 0, "load cell: brake at full load");
+}
+
+// 16-bit axes with Logical Maximum 0x26 0xFF 0xFF: read as a signed 2-byte item that
+// is -1, which the parser has to take as 65535 because the minimum is 0.
+static void logical_max_quirk() {
+    static const uint8_t desc[] = {
+        0x05, 0x01, 0x09, 0x04, 0xA1, 0x01,
+        0x09, 0x30, 0x09, 0x31,
+        0x15, 0x00, 0x26, 0xFF, 0xFF, 0x75, 0x10, 0x95, 0x02, 0x81, 0x02,
+        0xC0,
+    };
+    std::vector<HidField> fields;
+    check(HidDescriptorParser::parse(desc, sizeof(desc), false, fields), "quirk: parse");
+    check(fields.size() == 2, "quirk: two axes");
+    if (fields.size() != 2) return;
+    check(same_field(fields[0], hid_usage::PageGenericDesktop, hid_usage::X, 0, 0, 16, 0, 65535), "quirk: X range 0..65535");
+    check(same_field(fields[1], hid_usage::PageGenericDesktop, hid_usage::Y, 0, 16, 16, 0, 65535), "quirk: Y range 0..65535");
+
+    HidExtractionPlan plan;
+    check(plan.compile(fields, HidChannelMap::pedals()), "quirk: compile");
+    check(plan.op(ChannelThrottle).sign_shift == 0, "quirk: unsigned field");
+
+    const uint8_t report[] = { 0xFF, 0xFF, 0x00, 0x80 };
+    PedalSample s;
+    check(plan.extract(report, sizeof(report), s), "quirk: decode");
+    check_value(s.axis[ChannelThrottle], 65535, 0, "quirk: throttle at 0xFFFF");
+    check_value(s.axis[ChannelBrake], 0x8000, 0, "quirk: brake at 0x8000");
+
+    // a descriptor cut off inside an item is refused
+    check(!HidDescriptorParser::parse(desc, 14, false, fields), "quirk: truncated descriptor");
+}
+
+int main() {
+    report_ids();
+    load_cell_brake();
+    logical_max_quirk();
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
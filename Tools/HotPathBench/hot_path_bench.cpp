@@ -0,0 +1,215 @@
+// hot_path_bench.cpp - micro benchmarks of the per-report and per-frame hot paths, JSON out
+//
+// Times report decoding (the legacy Fanatec layout and a descriptor-compiled plan through
+// the whole router), the pedal engine, speed history append and decimation, CAN frame
+// packing, XCP DAQ packet assembly and A2L generation on synthetic pedal data (the
+// standard manoeuvre) or a recorded capture. Runs on Google Benchmark: each benchmark
+// is repeated 5 times and reported as mean, median, stddev and cv.
+//
+// Without --json the report is Google Benchmark's JSON on stdout; --json writes it to a
+// file and prints the table. Its compare.py diffs two runs across releases. --filter is
+// --benchmark_filter, and the other --benchmark_ flags pass through.
+//
+//   cmake -S ../.. -B build && cmake --build build --target hot_path_bench     (top-level CMakeLists.txt)
+//   g++ -std=c++17 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard hot_path_bench.cpp -lbenchmark -o hot_path_bench
+//   cl /std:c++17 /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard hot_path_bench.cpp benchmark.lib shlwapi.lib
+//   ./hot_path_bench [--json out.json] [--capture trace.fpc|trace.csv] [--filter regex] [--benchmark_...]
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "a2l_generator.h"
+#include "can_frame.h"
+#include "maneuver_source.h"
+#include "pedal_capture.h"
+#include "pedal_engine.h"
+#include "speed_history.h"
+#include "xcp_daq.h"
+
+using benchmark::DoNotOptimize;
+
+int main(int argc, char** argv) {
+    // our options, turned into Google Benchmark's; everything else goes to it as given
+    std::string capturePath;
+    std::vector<std::string> args = { argv[0] };
+    bool toFile = false;
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if ((a == "--json" || a == "--capture" || a == "--filter") && i + 1 >= argc) {
+            fprintf(stderr, "%s needs a value\n", a.c_str());
+            return 1;
+        }
+        if (a == "--json") {
+            args.push_back(std::string("--benchmark_out=") + argv[++i]);
+            args.push_back("--benchmark_out_format=json");
+            toFile = true;
+        }
+        else if (a == "--capture") capturePath = argv[++i];
+        else if (a == "--filter") args.push_back(std::string("--benchmark_filter=") + argv[++i]);
+        else args.push_back(a);
+    }
+    if (!toFile) args.insert(args.begin() + 1, "--benchmark_format=json");
+    std::vector<char*> bargv;
+    for (std::string& a : args) bargv.push_back(&a[0]);
+    int bargc = static_cast<int>(bargv.size());
+    benchmark::Initialize(&bargc, bargv.data());
+    if (benchmark::ReportUnrecognizedArguments(bargc, bargv.data())) return 1;
+
+    // input: decoded samples with their receive times
+    std::vector<PedalSample> samples;
+    std::vector<int64_t> times;
+    if (!capturePath.empty()) {
+        PedalCapture capture;
+        if (!CaptureFile::read(capturePath, capture) || capture.records.empty()) {
+            fprintf(stderr, "cannot read capture %s\n", capturePath.c_str());
+            return 1;
+        }
+        for (const CaptureRecord& r : capture.records) {
+            samples.push_back(PedalCapture::sample_of(r));
+            times.push_back(r.t_us);
+        }
+    }
+    else {
+        ManeuverGenerator gen(ManeuverPlan::standard());      // 1 kHz
+        samples.resize(65536);
+        for (size_t i = 0; i < samples.size(); i++) {
+            gen.next(samples[i]);
+            times.push_back(static_cast<int64_t>(i) * 1000);
+        }
+    }
+    const size_t count = samples.size();
+    benchmark::AddCustomContext("data",
+        capturePath.empty() ? "synthetic: standard manoeuvre, " + std::to_string(count) + " reports" : capturePath);
+
+    // the same samples as the two report layouts the router sees
+    std::vector<uint8_t> legacy(count * 8, 0), wide(count * ManeuverSource::ReportSize);
+    for (size_t i = 0; i < count; i++) {
+        for (int c = 0; c < ChannelSteering; c++) {
+            legacy[i * 8 + 2 + 2 * c] = static_cast<uint8_t>(pedal_level8(samples[i], static_cast<PedalChannel>(c)));
+        }
+        ManeuverSource::encode(samples[i], &wide[i * ManeuverSource::ReportSize]);
+    }
+
+    // one operation per iteration
+    auto bench = [](const char* name, auto fn) {
+        benchmark::RegisterBenchmark(name, fn)->Repetitions(5)->ReportAggregatesOnly(true);
+    };
+
+    const HidExtractionPlan plan = HidExtractionPlan::legacy_fanatec();
+    bench("decode/legacy_fanatec", [&](benchmark::State& state) {
+        PedalSample s;
+        size_t k = 0;
+        for (auto _ : state) {
+            plan.extract(&legacy[k * 8], 8, s);
+            DoNotOptimize(s);
+            if (++k == count) k = 0;
+        }
+    });
+
+    DeviceRouter router;
+    ManeuverSource::attach(router);
+    bench("decode/router_16bit", [&](benchmark::State& state) {
+        size_t k = 0;
+        for (auto _ : state) {
+            DeviceSlot* slot = router.route(ManeuverSource::Device, &wide[k * ManeuverSource::ReportSize],
+                ManeuverSource::ReportSize, times[k]);
+            DoNotOptimize(slot);
+            if (++k == count) k = 0;
+        }
+    });
+
+    const PedalEngineConfig cfg;
+    bench("engine/process_and_tick", [&](benchmark::State& state) {
+        PedalEngineState engine;
+        PedalTickSchedule clock;
+        const int64_t span = times.back() - times.front() + 1000;
+        size_t k = 0;
+        int64_t lap = 0;
+        for (auto _ : state) {
+            const int64_t t = times[k] + lap;
+            for (int d = clock.due(t, cfg); d > 0; d--) pedal_engine_tick(engine, cfg);
+            pedal_engine_process(engine, samples[k], t, cfg);
+            if (++k == count) {
+                k = 0;
+                lap += span;
+            }
+        }
+        DoNotOptimize(engine);
+    });
+
+    // full before the decimation runs, also when --filter leaves out the push benchmark
+    SpeedHistory<1000> history;
+    for (int i = 0; i < 1000; i++) history.push(i & 255);
+    bench("history/push", [&](benchmark::State& state) {
+        int i = 0;
+        for (auto _ : state) history.push(i++ & 255);
+        DoNotOptimize(history);
+    });
+    bench("history/decimate_1000_to_100", [&](benchmark::State& state) {
+        int bars[100];
+        for (auto _ : state) {
+            history.decimate(bars, 100);
+            DoNotOptimize(bars);
+        }
+    });
+
+    bench("can/pack_pedal_status", [&](benchmark::State& state) {
+        size_t k = 0;
+        int i = 0;
+        for (auto _ : state) {
+            const PedalSample& s = samples[k];
+            const CanFrame f = pack_pedal_status(i % 300, i % DriveModeCount,
+                pedal_level8(s, ChannelThrottle), pedal_level8(s, ChannelBrake));
+            DoNotOptimize(f);
+            if (++k == count) k = 0;
+            if (++i == 300 * DriveModeCount) i = 0;
+        }
+    });
+
+    // the desktop's measurement set: 4 + 9 filter + 6 latency variables
+    struct {
+        uint8_t brake, throttle, mode;
+        uint16_t speed;
+        uint16_t in[3], filtered[3];
+        uint32_t limited[3];
+        uint32_t latency[6];
+    } vars = {};
+    XcpDaqList daq;
+    daq.add(&vars.brake, 1);
+    daq.add(&vars.throttle, 1);
+    daq.add(&vars.speed, 2);
+    daq.add(&vars.mode, 1);
+    for (int c = 0; c < 3; c++) {
+        daq.add(&vars.in[c], 2);
+        daq.add(&vars.filtered[c], 2);
+        daq.add(&vars.limited[c], 4);
+    }
+    for (int i = 0; i < 6; i++) daq.add(&vars.latency[i], 4);
+    std::vector<uint8_t> packet(daq.frame_bytes());
+    bench("xcp/daq_sample", [&](benchmark::State& state) {
+        uint16_t counter = 0;
+        uint32_t i = 0;
+        for (auto _ : state) {
+            vars.speed = static_cast<uint16_t>(i);
+            DoNotOptimize(daq.sample(i++, counter, packet.data(), packet.size()));
+        }
+    });
+
+    bench("a2l/generate_text", [&](benchmark::State& state) {
+        for (auto _ : state) {
+            A2LGenerator a2l;
+            a2l.add_variable("brake_raw", "Brake Pedal Raw Value", "UBYTE");
+            a2l.add_variable("throttle_raw", "Throttle Pedal Raw Value", "UBYTE");
+            a2l.add_variable("vehicle_speed", "Vehicle Speed", "UWORD");
+            a2l.add_variable("drive_mode", "Drive Mode", "UBYTE", DriveModeCount - 1);
+            for (int v = 0; v < 15; v++) a2l.add_variable("var_" + std::to_string(v), "Measurement", "ULONG");
+            const std::string text = a2l.text();
+            DoNotOptimize(text);
+        }
+    });
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
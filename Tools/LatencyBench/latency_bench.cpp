@@ -0,0 +1,142 @@
+// latency_bench.cpp - end-to-end latency trace of the input path, driven by synthetic pedals
+//
+// Runs the CAN bridge's pipeline without hardware: a ManeuverSource feeds the router and
+// engine on its thread (the input thread's job), updates go through an SpscQueue to a
+// consumer that polls every <poll ms> and "transmits" the newest one as an 8-byte frame,
+// the way RunExample.cpp does. Every sample carries a LatencyTag; at the end the per-stage
+// table is fetched from the stats endpoint over localhost, as an external tool would.
+//
+//   g++ -std=c++17 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard latency_bench.cpp -o latency_bench
+//   ./latency_bench [seconds] [rate Hz] [poll ms] [port]
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "latency_trace.h"
+#include "maneuver_source.h"
+#include "pedal_engine.h"
+#include "spsc_queue.h"
+#include "stats_endpoint.h"
+
+struct Update {
+    int speed;
+    int mode;
+    int throttle;
+    int brake;
+    LatencyTag trace;
+};
+
+// what an external client does: connect, read until the endpoint closes
+static std::string fetch_stats(uint16_t port) {
+    std::string text;
+    int s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s < 0) return text;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+        char buf[1024];
+        ssize_t n;
+        while ((n = recv(s, buf, sizeof(buf), 0)) > 0) text.append(buf, static_cast<size_t>(n));
+    }
+    close(s);
+    return text;
+}
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+    const double rate = argc > 2 ? atof(argv[2]) : 1000.0;
+    const int pollMs = argc > 3 ? atoi(argv[3]) : 10;
+    const uint16_t port = static_cast<uint16_t>(argc > 4 ? atoi(argv[4]) : StatsEndpoint::DefaultPort + 10);
+
+    ManeuverPlan plan = ManeuverPlan::standard();
+    plan.rate_hz = rate;
+    plan.duration_s = seconds;
+
+    DeviceRouter router;
+    ManeuverSource::attach(router);
+    const PedalEngineConfig cfg;
+    PedalTickSchedule clock;        // report time stands in for the tick thread's clock
+    SpscQueue<Update, 256> queue;
+    uint64_t dropped = 0;
+    LatencyTrace trace;
+
+    // input side: same order of stamps as RunExample.cpp's OnPedalReport
+    auto onReport = [&](uint64_t device, const uint8_t* report, size_t size, int64_t receivedUs) {
+        Update u;
+        u.trace.begin(receivedUs);
+        DeviceSlot* slot = router.route(device, report, size, receivedUs);
+        if (!slot) return;
+        u.trace.stamp(StageDecode);
+        for (int n = clock.due(receivedUs, cfg); n > 0; n--) pedal_engine_tick(slot->engine, cfg);
+        pedal_engine_process(slot->engine, slot->sample, receivedUs, cfg);
+        u.trace.stamp(StageEngine);
+        u.speed = slot->engine.speed;
+        u.mode = slot->engine.mode;
+        u.throttle = slot->engine.throttle;
+        u.brake = slot->engine.brake;
+        u.trace.stamp(StagePublish);
+        if (!queue.try_push(u)) {
+            trace.record(u.trace);
+            dropped++;
+        }
+    };
+
+    StatsEndpoint endpoint;
+    if (!endpoint.start([&trace]() { return trace.report(); }, port)) {
+        fprintf(stderr, "cannot listen on 127.0.0.1:%u\n", port);
+        return 1;
+    }
+
+    ManeuverSource source;
+    source.start(plan, onReport);
+
+    // output side: newest update on the "bus" every poll, older ones superseded
+    uint8_t frame[8] = {};
+    uint64_t frames = 0, superseded = 0;
+    Update pending;
+    bool hasPending = false;
+    auto drain = [&]() {
+        Update u;
+        while (queue.try_pop(u)) {
+            if (hasPending) {
+                trace.record(pending.trace);
+                superseded++;
+            }
+            pending = u;
+            hasPending = true;
+        }
+        if (!hasPending) return;
+        frame[0] = static_cast<uint8_t>(pending.speed);
+        frame[1] = static_cast<uint8_t>(pending.speed >> 8);
+        frame[2] = static_cast<uint8_t>(pending.mode);
+        frame[3] = static_cast<uint8_t>(pending.throttle);
+        frame[4] = static_cast<uint8_t>(pending.brake);
+        pending.trace.stamp(StageTransmit);
+        trace.record(pending.trace);
+        hasPending = false;
+        frames++;
+    };
+    while (source.running()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(pollMs));
+        drain();
+    }
+    source.stop();
+    drain();
+
+    printf("%.0f Hz for %.1f s, poll %d ms: %llu reports, %llu frames, %llu superseded, %llu dropped, %llu late\n",
+        rate, seconds, pollMs, (unsigned long long)source.reports(), (unsigned long long)frames,
+        (unsigned long long)superseded, (unsigned long long)dropped, (unsigned long long)source.late());
+    const std::string stats = fetch_stats(port);
+    endpoint.stop();
+    if (stats.empty()) {
+        fprintf(stderr, "stats endpoint did not answer\n");
+        return 1;
+    }
+    printf("from 127.0.0.1:%u (us)\n%s", port, stats.c_str());
+    return 0;
+}
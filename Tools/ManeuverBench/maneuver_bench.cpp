@@ -0,0 +1,102 @@
+// maneuver_bench.cpp - synthetic pedal manoeuvres through the router and engine, no hardware
+//
+// First times the generator alone, then runs a ManeuverSource in real time into the
+// same path a front end uses (router decode, filter, curves, engine with its tick clock)
+// and reports how well the reports were paced and what the engine did with them.
+//
+//   g++ -std=c++17 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard maneuver_bench.cpp -o maneuver_bench
+//   cl /std:c++17 /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard maneuver_bench.cpp
+//   ./maneuver_bench [seconds] [rate Hz] [plan file]
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "latency_histogram.h"
+#include "maneuver_source.h"
+#include "pedal_engine.h"
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? atof(argv[1]) : 5.0;
+    ManeuverPlan plan = ManeuverPlan::standard();
+    if (argc > 3) {
+        std::string error;
+        if (!ManeuverPlan::load(argv[3], plan, &error)) {
+            fprintf(stderr, "%s: %s\n", argv[3], error.c_str());
+            return 1;
+        }
+    }
+    if (argc > 2) plan.rate_hz = atof(argv[2]);
+    if (plan.rate_hz < 1.0 || plan.rate_hz > ManeuverMaxRate) {
+        fprintf(stderr, "rate must be 1..%.0f Hz\n", ManeuverMaxRate);
+        return 1;
+    }
+    plan.duration_s = seconds;
+
+    // 1) generator alone
+    {
+        ManeuverGenerator gen(plan);
+        const int n = 2000000;
+        PedalSample s;
+        uint64_t sink = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < n; i++) {
+            gen.next(s);
+            sink += s.axis[ChannelThrottle] + s.axis[ChannelBrake] + s.axis[ChannelClutch];
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        printf("generator  %.1f ns/report (3 pedals), checksum %llu\n",
+            std::chrono::duration<double, std::nano>(t1 - t0).count() / n, (unsigned long long)sink);
+    }
+
+    // 2) real time through router and engine, all on the source thread like a front end
+    DeviceRouter router;
+    ManeuverSource::attach(router);
+    const PedalEngineConfig cfg;
+    PedalTickSchedule clock;        // report time stands in for the tick thread's clock
+    LatencyHistogram pacing;        // report handed over -> due time, microseconds late
+    LatencyHistogram handling;      // handler time per report
+    int modeChanges = 0;
+    int maxSpeed = 0;
+    DriveMode mode = Static;
+
+    const double periodUs = 1e6 / plan.rate_hz;
+    int64_t start = 0;
+    uint64_t index = 0;
+    auto onReport = [&](uint64_t device, const uint8_t* report, size_t size, int64_t receivedUs) {
+        if (index == 0) start = receivedUs;
+        pacing.record(receivedUs - (start + static_cast<int64_t>(index * periodUs)));
+        index++;
+
+        DeviceSlot* slot = router.route(device, report, size, receivedUs);
+        if (!slot) return;
+        for (int n = clock.due(receivedUs, cfg); n > 0; n--) pedal_engine_tick(slot->engine, cfg);
+        pedal_engine_process(slot->engine, slot->sample, receivedUs, cfg);
+        if (slot->engine.mode != mode) {
+            mode = slot->engine.mode;
+            modeChanges++;
+        }
+        if (slot->engine.speed > maxSpeed) maxSpeed = slot->engine.speed;
+        handling.record(now_us() - receivedUs);
+    };
+
+    ManeuverSource source;
+    const int64_t t0 = now_us();
+    source.start(plan, onReport);
+    while (source.running()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    source.stop();
+    const double elapsed = (now_us() - t0) / 1e6;
+
+    const DeviceSlot* slot = router.find(ManeuverSource::Device);
+    printf("%.0f Hz for %.1f s: %llu reports in %.2f s (%.0f/s), %llu late\n", plan.rate_hz, seconds,
+        (unsigned long long)source.reports(), elapsed, source.reports() / elapsed, (unsigned long long)source.late());
+    printf("pacing     p50 %llu us  p99 %llu us  max %llu us behind schedule\n",
+        (unsigned long long)pacing.percentile(50), (unsigned long long)pacing.percentile(99),
+        (unsigned long long)pacing.maximum());
+    printf("handler    p50 %llu us  p99 %llu us  max %llu us\n",
+        (unsigned long long)handling.percentile(50), (unsigned long long)handling.percentile(99),
+        (unsigned long long)handling.maximum());
+    printf("engine     %d mode changes, max speed %d km/h, final %s %d km/h, %.0f Hz measured\n",
+        modeChanges, maxSpeed, drive_mode_name(slot->engine.mode), slot->engine.speed, slot->stats.rate_hz());
+    return source.reports() > 0 ? 0 : 1;
+}
@@ -0,0 +1,473 @@
+// pipeline_runner.cpp - models of the front ends' data flows, run headless
+//
+// Builds a model of one front end's flow on pipeline.h and runs it from a report source
+// that needs no Windows: the standard manoeuvre or a plan file, a capture replayed at
+// its recorded pace, or the desktop app's shared memory channel. Prints the per-stage
+// table (items, items/s, time per item, drops, queue depth) at the end.
+//
+//   can       input -> route -> [queue] newest on "can"; a CAN frame every 100 ms
+//   desktop   input -> route -> xcp variables, [queue] UI state and speed history on "ui";
+//             a DAQ packet every 10 ms on "xcp", a repaint every 16 ms on "ui"
+//   simulink  input -> route -> snapshot + [queue] frame rows on "model"; a 10 ms step
+//             reads the newest snapshot and the frame like mdlOutputs
+//
+// In all three a model step every 10 ms on "tick" feeds the same stages as route (not
+// the frame rows or the session), so speed keeps following time between reports.
+//
+// These are models, not the front ends themselves: the stages do the same work on the
+// same headers (router, engine, CAN packing, DAQ, frame rows), but there is no Raw Input,
+// PCAN driver, window or Simulink, and the CAN example sends from a reactor task rather
+// than a lane. What they measure is the cost of the shared code and how the threads
+// hand over, not the front ends' own timings.
+//
+// Any configuration can also feed the session recorder (--session), the telemetry
+// server (--telemetry port), the shared memory channel (--publish) and serve the stage
+// table like the stats endpoint (--stats port).
+//
+// The sinks and the pipeline start and stop through lifecycle.h; --runs N starts and
+// stops the lot N times, as a test harness does between runs, and prints how long each
+// stage took to stop.
+//
+//   g++ -std=c++20 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard pipeline_runner.cpp -o pipeline_runner
+//   cl /std:c++20 /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard pipeline_runner.cpp
+//   ./pipeline_runner [--config can|desktop|simulink] [--source standard|plan.cfg|trace.fpc|shared[:name]]
+//                     [--seconds 10] [--runs 1] [--pin] [--session run.fsr] [--telemetry 5558] [--publish] [--stats 5556]
+#include "telemetry_server.h"       // before anything that pulls in <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "can_frame.h"
+#include "device_router.h"
+#include "lifecycle.h"
+#include "maneuver_source.h"
+#include "pedal_capture.h"
+#include "pedal_engine.h"
+#include "pedal_frame.h"
+#include "pipeline.h"
+#include "session_recorder.h"
+#include "shared_pedals.h"
+#include "speed_history.h"
+#include "stats_endpoint.h"
+#include "timing.h"
+#include "triple_buffer.h"
+#include "xcp_daq.h"
+
+// One report as a source hands it over.
+struct PedalReport {
+    uint64_t device = 0;
+    int64_t t_us = 0;
+    uint8_t size = 0;
+    uint8_t data[ManeuverSource::ReportSize] = {};
+};
+
+// What the route stage makes of a pedal report, and the tick of a model step.
+struct VehicleUpdate {
+    int64_t t_us = 0;
+    int64_t report_us = 0;          // the report behind the pedal values
+    uint64_t n = 0;                 // reports routed so far
+    PedalSample raw;                // as decoded
+    PedalSample pedals;             // filtered and shaped
+    int speed = 0;
+    int mode = 0;
+    int gear = 0;
+    int throttle = 0;               // 8-bit levels
+    int brake = 0;
+    bool clutch = false;
+};
+
+// Plays a capture at its recorded pace, as reports of the virtual pedal set.
+class CaptureSource {
+public:
+    ~CaptureSource() { stop(); }
+
+    bool start(const PedalCapture& capture, ManeuverSource::ReportHandler onReport) {
+        if (capture.records.empty()) return false;
+        stop_.store(false);
+        thread_ = std::thread([this, &capture, onReport] {
+            const int64_t offset = now_us() - capture.records.front().t_us;
+            uint8_t report[ManeuverSource::ReportSize];
+            for (const CaptureRecord& r : capture.records) {
+                while (!stop_.load() && now_us() < r.t_us + offset) std::this_thread::sleep_for(std::chrono::microseconds(200));
+                if (stop_.load()) return;
+                PedalSample s;
+                memcpy(s.axis, r.axis, sizeof(s.axis));
+                ManeuverSource::encode(s, report);
+                onReport(ManeuverSource::Device, report, sizeof(report), r.t_us + offset);
+            }
+        });
+        return true;
+    }
+
+    void stop() {
+        stop_.store(true);
+        if (thread_.joinable()) thread_.join();
+    }
+
+private:
+    std::thread thread_;
+    std::atomic<bool> stop_{ false };
+};
+
+static bool ends_with(const std::string& s, const char* suffix) {
+    const size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+int main(int argc, char** argv) {
+    std::string config = "can", sourceSpec = "standard", sessionPath;
+    double seconds = 10;
+    bool pin = false, publish = false;
+    int telemetryPort = 0, statsPort = 0, runs = 1;
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--pin") pin = true;
+        else if (a == "--publish") publish = true;
+        else if (i + 1 >= argc) {
+            fprintf(stderr, "%s needs a value\n", a.c_str());
+            return 1;
+        }
+        else if (a == "--config") config = argv[++i];
+        else if (a == "--source") sourceSpec = argv[++i];
+        else if (a == "--seconds") seconds = atof(argv[++i]);
+        else if (a == "--runs") runs = (std::max)(1, atoi(argv[++i]));
+        else if (a == "--session") sessionPath = argv[++i];
+        else if (a == "--telemetry") telemetryPort = atoi(argv[++i]);
+        else if (a == "--stats") statsPort = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "unknown option %s\n", a.c_str());
+            return 1;
+        }
+    }
+    if (config != "can" && config != "desktop" && config != "simulink") {
+        fprintf(stderr, "unknown configuration %s (can, desktop, simulink)\n", config.c_str());
+        return 1;
+    }
+
+    // the source: reports of a virtual pedal set, like FANATEC_MANEUVER / FANATEC_SHARED
+    DeviceRouter router;
+    ManeuverPlan plan = ManeuverPlan::standard();
+    PedalCapture capture;
+    ManeuverSource maneuver;
+    SharedPedalSource shared;
+    CaptureSource replay;
+    std::string sharedName, error;
+    if (sourceSpec.compare(0, 6, "shared") == 0) {
+        sharedName = sourceSpec.size() > 7 ? sourceSpec.substr(7) : shared_pedals::DefaultName;
+        SharedPedalSource::attach(router);
+    }
+    else if (ends_with(sourceSpec, ".fpc") || ends_with(sourceSpec, ".csv")) {
+        if (!CaptureFile::read(sourceSpec, capture) || capture.records.empty()) {
+            fprintf(stderr, "cannot read capture %s\n", sourceSpec.c_str());
+            return 1;
+        }
+        ManeuverSource::attach(router);
+    }
+    else {
+        if (sourceSpec != "standard" && !ManeuverPlan::load(sourceSpec, plan, &error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        ManeuverSource::attach(router);
+    }
+
+    Pipeline pipe;
+    int nextCpu = 1;
+    auto lane = [&](const char* name) -> PipelineLane& { return pipe.lane(name, pin ? nextCpu++ : -1); };
+
+    Source<PedalReport>& input = pipe.source<PedalReport>("input",
+        [&](Source<PedalReport>& src) {
+            auto handler = [&src](uint64_t device, const uint8_t* data, size_t size, int64_t t) {
+                PedalReport r;
+                r.device = device;
+                r.t_us = t;
+                r.size = static_cast<uint8_t>((std::min)(size, sizeof(r.data)));
+                memcpy(r.data, data, r.size);
+                src.emit(r);
+            };
+            if (!sharedName.empty()) return shared.start(sharedName, handler, &error);
+            if (!capture.records.empty()) return replay.start(capture, handler);
+            return maneuver.start(plan, handler);
+        },
+        [&] {
+            maneuver.stop();
+            shared.stop();
+            replay.stop();
+        });
+
+    // route: router, filter, curves and the pedal rules of the engine (input thread);
+    // tick: the model steps of every engine on wall time, on their own lane like the front
+    // ends' tick thread or task. Both emit under routerMutex, so the direct stages after
+    // them never run on two threads at once.
+    Outlet<VehicleUpdate> updates;      // one per report
+    Outlet<VehicleUpdate> ticks;        // one per model step, once the pedals have reported
+    std::mutex routerMutex;
+    PedalEngineConfig engineConfig;
+    uint64_t routed = 0;
+    auto vehicleUpdate = [&](const DeviceSlot& slot, int64_t t) {
+        VehicleUpdate u;
+        u.t_us = t;
+        u.report_us = slot.stats.last_us;
+        u.n = routed;
+        u.pedals = slot.sample;
+        u.raw = slot.sample;
+        for (int c = 0; c < ChannelSteering; c++) u.raw.axis[c] = slot.filter.pedal[c].in;
+        u.speed = slot.engine.speed;
+        u.mode = slot.engine.mode;
+        u.gear = slot.engine.vehicle.gear;
+        u.throttle = slot.engine.throttle;
+        u.brake = slot.engine.brake;
+        u.clutch = slot.engine.left_pressed;
+        return u;
+    };
+    Stage<PedalReport>& route = pipe.stage<PedalReport>("route", [&](const PedalReport& r) {
+        std::lock_guard<std::mutex> lock(routerMutex);
+        DeviceSlot* slot = router.route(r.device, r.data, r.size, r.t_us);
+        if (!slot || slot->role != RolePedals) return;
+        pedal_engine_process(slot->engine, slot->sample, r.t_us, engineConfig);
+        routed++;
+        updates.emit(vehicleUpdate(*slot, r.t_us));
+    });
+    PipelineLane& tickLane = lane("tick");
+    pipe.every(tickLane, "tick", PedalTickSchedule::step_us(engineConfig), [&](int64_t now) {
+        std::lock_guard<std::mutex> lock(routerMutex);
+        router.tick_engines(engineConfig);
+        for (int i = 0; i < router.count(); i++) {
+            const DeviceSlot& slot = router.slot(i);
+            if (!slot.handle || slot.role != RolePedals || !slot.has_sample) continue;
+            ticks.emit(vehicleUpdate(slot, now));
+            break;
+        }
+    });
+    pipe.connect(input.out, route);
+
+    // can: only the newest state goes on the bus, every 100 ms
+    VehicleUpdate canLatest;
+    uint64_t canFrames = 0, canSuperseded = 0;
+    bool canPending = false;
+    // desktop: UI state and speed history, XCP measurement variables
+    SpeedHistory<1000> history;
+    VehicleUpdate uiState;
+    int bars[100] = {};
+    uint64_t repaints = 0, daqPackets = 0;
+    struct {
+        uint8_t brake, throttle, mode;
+        uint16_t speed;
+        uint16_t in[3], filtered[3];
+    } vars = {};
+    XcpDaqList daq;
+    std::vector<uint8_t> daqPacket;
+    uint16_t daqCounter = 0;
+    // simulink: newest snapshot for the step, every report for the frame port
+    TripleBuffer<PedalSnapshot> snapshots;
+    std::vector<double> frame(FrameCapacity * FrameColumns);
+    double signals[SignalCount] = {};
+    size_t frameRows = 0, maxFrameRows = 0;
+    uint64_t steps = 0;
+    const int64_t startUs = now_us();
+
+    if (config == "can") {
+        PipelineLane& can = lane("can");
+        Stage<VehicleUpdate>& newest = pipe.stage<VehicleUpdate>("newest", [&](const VehicleUpdate& u) {
+            if (canPending) canSuperseded++;
+            canLatest = u;
+            canPending = true;
+        });
+        pipe.connect<256>(updates, newest, can);
+        pipe.connect<256>(ticks, newest, can);
+        pipe.every(can, "send", 100000, [&](int64_t) {
+            const CanFrame f = pack_pedal_status(canLatest.speed, canLatest.mode, canLatest.throttle, canLatest.brake);
+            if (f.len) canFrames++;
+            canPending = false;
+        });
+    }
+    else if (config == "desktop") {
+        Stage<VehicleUpdate>& xcp = pipe.stage<VehicleUpdate>("xcp", [&](const VehicleUpdate& u) {
+            vars.brake = static_cast<uint8_t>(u.brake);
+            vars.throttle = static_cast<uint8_t>(u.throttle);
+            vars.speed = static_cast<uint16_t>(u.speed);
+            vars.mode = static_cast<uint8_t>(u.mode);
+            for (int c = 0; c < 3; c++) {
+                vars.in[c] = u.raw.axis[c];
+                vars.filtered[c] = u.pedals.axis[c];
+            }
+        });
+        pipe.connect(updates, xcp);
+        pipe.connect(ticks, xcp);
+        daq.add(&vars.brake, 1);
+        daq.add(&vars.throttle, 1);
+        daq.add(&vars.speed, 2);
+        daq.add(&vars.mode, 1);
+        for (int c = 0; c < 3; c++) {
+            daq.add(&vars.in[c], 2);
+            daq.add(&vars.filtered[c], 2);
+        }
+        PipelineLane& xcpLane = lane("xcp");
+        daqPacket.resize(daq.frame_bytes());
+        pipe.every(xcpLane, "daq", 10000, [&](int64_t now) {
+            if (daq.sample(static_cast<uint32_t>(now), daqCounter, daqPacket.data(), daqPacket.size())) daqPackets++;
+        });
+
+        PipelineLane& ui = lane("ui");
+        Stage<VehicleUpdate>& uiStage = pipe.stage<VehicleUpdate>("ui", [&](const VehicleUpdate& u) {
+            if (u.speed != uiState.speed || !uiState.n) history.push(u.speed);
+            uiState = u;
+        });
+        pipe.connect<256>(updates, uiStage, ui);
+        pipe.connect<256>(ticks, uiStage, ui);
+        pipe.every(ui, "repaint", 16000, [&](int64_t) {
+            history.decimate(bars, 100);
+            repaints++;
+        });
+    }
+    else {
+        Stage<VehicleUpdate>& snapshot = pipe.stage<VehicleUpdate>("snapshot", [&](const VehicleUpdate& u) {
+            PedalSnapshot& s = snapshots.write_buffer();
+            s.speed = u.speed;
+            s.driveMode = u.mode;
+            s.throttle = u.throttle;
+            s.brake = u.brake;
+            s.clutch = u.clutch;
+            s.updatedUs = u.report_us;
+            s.reports = u.n;
+            snapshots.publish();
+        });
+        pipe.connect(updates, snapshot);
+        pipe.connect(ticks, snapshot);
+        PipelineLane& model = lane("model");
+        Stage<VehicleUpdate>& rows = pipe.stage<VehicleUpdate>("frame", [&](const VehicleUpdate& u) {
+            if (frameRows == FrameCapacity) return;         // the step drains it; the rest waits in the queue
+            PedalSnapshot s;
+            s.speed = u.speed;
+            s.driveMode = u.mode;
+            s.throttle = u.throttle;
+            s.brake = u.brake;
+            s.clutch = u.clutch;
+            s.updatedUs = u.t_us;
+            pack_frame_row(s, startUs, frameRows++, frame.data());
+        });
+        pipe.connect<1024>(updates, rows, model);
+        pipe.every(model, "step", 10000, [&](int64_t now) {
+            PedalSnapshot s;
+            snapshots.read(s);
+            pack_signals(s, now, signals);
+            clear_frame_rows(frameRows, frame.data());
+            maxFrameRows = (std::max)(maxFrameRows, frameRows);
+            frameRows = 0;
+            steps++;
+        });
+    }
+
+    // optional sinks, on the route thread like in the front ends; they start before the
+    // pipeline and stop after it
+    Lifecycle life;
+    std::vector<std::string> sinks;
+    SessionRecorder session;
+    if (!sessionPath.empty()) {
+        life.add("session", {}, [&](std::string* e) { return session.open(sessionPath, now_us(), e); },
+            [&] { session.close(); }, 2000000);
+        sinks.push_back("session");
+        pipe.connect(updates, pipe.stage<VehicleUpdate>("session", [&](const VehicleUpdate& u) {
+            session.record(session_row(SessionReport, u.t_us, u.pedals, u.speed, u.mode, u.raw.axis));
+        }));
+    }
+    TelemetryServer telemetry;
+    if (telemetryPort) {
+        life.add("telemetry", {}, [&](std::string* e) {
+                if (telemetry.start(static_cast<uint16_t>(telemetryPort))) return true;
+                *e = "cannot listen on port " + std::to_string(telemetryPort);
+                return false;
+            }, [&] { telemetry.stop(); });
+        sinks.push_back("telemetry");
+        Stage<VehicleUpdate>& toTelemetry = pipe.stage<VehicleUpdate>("telemetry", [&](const VehicleUpdate& u) {
+            TelemetrySnapshot s;
+            s.t_us = u.t_us;
+            for (int c = 0; c < ChannelSteering; c++) s.pedal[c] = u.pedals.axis[c];
+            s.speed = static_cast<int16_t>(u.speed);
+            s.mode = static_cast<uint8_t>(u.mode);
+            s.gear = static_cast<int8_t>(u.gear);
+            s.sources = 1;
+            telemetry.publish(s);
+        });
+        pipe.connect(updates, toTelemetry);
+        pipe.connect(ticks, toTelemetry);
+    }
+    SharedPedalWriter writer;
+    if (publish) {
+        life.add("publish", {}, [&](std::string* e) { return writer.open(shared_pedals::DefaultName, e); },
+            [&] { writer.close(); });
+        sinks.push_back("publish");
+        pipe.connect(updates, pipe.stage<VehicleUpdate>("publish", [&](const VehicleUpdate& u) {
+            writer.push(u.raw, u.t_us);
+            SharedPedalState s;
+            s.t_us = u.t_us;
+            memcpy(s.pedal, u.pedals.axis, sizeof(s.pedal));
+            s.speed = static_cast<int16_t>(u.speed);
+            s.mode = static_cast<uint8_t>(u.mode);
+            s.gear = static_cast<int8_t>(u.gear);
+            s.sources = 1;
+            writer.publish(s);
+        }));
+    }
+    StatsEndpoint stats;
+    if (statsPort) {
+        life.add("stats", {}, [&](std::string* e) {
+                if (stats.start([&pipe] { return pipe.report(); }, static_cast<uint16_t>(statsPort))) return true;
+                *e = "cannot listen on port " + std::to_string(statsPort);
+                return false;
+            }, [&] { stats.stop(); });
+    }
+    life.add("pipeline", sinks, [&](std::string* e) { return pipe.start(e); }, [&] { pipe.stop(); });
+    life.on_overrun([](const std::string& stage, int64_t elapsedUs) {
+        fprintf(stderr, "%s still stopping after %lld ms\n", stage.c_str(), (long long)(elapsedUs / 1000));
+    });
+
+    printf("%s configuration from %s for %.0f s%s%s\n", config.c_str(), sourceSpec.c_str(), seconds,
+        runs > 1 ? (" x " + std::to_string(runs)).c_str() : "", pin ? ", lanes pinned" : "");
+    int64_t slowestStop = 0;
+    for (int run = 1; run <= runs; run++) {
+        if (!life.start(&error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        const int64_t end = now_us() + static_cast<int64_t>(seconds * 1e6);
+        while (now_us() < end) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        const bool inTime = life.stop();
+        slowestStop = (std::max)(slowestStop, life.stop_us());
+        if (runs > 1) {
+            printf("run %d: started in %.1f ms, stopped in %.1f ms%s\n", run, life.start_us() / 1e3, life.stop_us() / 1e3,
+                inTime ? "" : " (a stage overran)");
+        }
+    }
+
+    printf("%s", pipe.report().c_str());
+    for (const auto& l : pipe.lanes()) {
+        printf("lane %-6s cpu %2d%s, %llu busy wake-ups\n", l->name().c_str(), l->cpu(), l->pinned() ? " (pinned)" : "",
+            (unsigned long long)l->wakeups());
+    }
+    if (config == "can") {
+        printf("CAN: %llu frames, %llu updates superseded before a send, last speed %d\n", (unsigned long long)canFrames,
+            (unsigned long long)canSuperseded, canLatest.speed);
+    }
+    else if (config == "desktop") {
+        printf("desktop: %llu repaints, %llu DAQ packets, last speed %d\n", (unsigned long long)repaints,
+            (unsigned long long)daqPackets, uiState.speed);
+    }
+    else {
+        printf("simulink: %llu steps, up to %zu frame rows per step, last speed %.0f km/h\n", (unsigned long long)steps,
+            maxFrameRows, signals[SignalSpeed] * 300);
+    }
+    if (!sharedName.empty()) {
+        printf("shared: %llu samples, %llu lost\n", (unsigned long long)shared.samples(), (unsigned long long)shared.lost());
+    }
+    printf("\n%s", life.report().c_str());
+    if (runs > 1) printf("slowest stop of %d runs: %.1f ms\n", runs, slowestStop / 1e3);
+    return 0;
+}
@@ -0,0 +1,232 @@
+// router_test.cpp - checks the device router with several devices reporting at once
+//
+// Attaches a pedal set, a wheel base with its own pedal axes and rim buttons, a shifter
+// and a vendor device from stored descriptors (parsed like hid_device.h does on attach),
+// then interleaves their reports for two seconds of report time: pedals at 1 kHz, the
+// wheel at 500 Hz, the shifter on change, with the engines ticked every 10 ms like the
+// front ends. Checks that every report lands on its own slot, that each slot's engine
+// only sees its own device, the merged VehicleInput (pedals from the pedal set, steering
+// from the wheel, gear from the shifter) before and after the pedal set drops out, and
+// the per-device rate, interval, rejected and latency counters, and that a device without
+// a path reuses its slot on reconnect while a full table returns null. Prints every failed
+// check and exits non-zero on any.
+//
+//   g++ -std=c++17 -O2 -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard router_test.cpp -o router_test
+//   cl /std:c++17 /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard router_test.cpp
+//   ./router_test
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "device_router.h"
+#include "hid_report.h"
+
+static int checks = 0, failures = 0;
+
+static void check(bool ok, const char* what) {
+    checks++;
+    if (ok) return;
+    failures++;
+    fprintf(stderr, "FAIL %s\n", what);
+}
+
+static void check_value(double got, double want, double tolerance, const char* what) {
+    checks++;
+    if (std::fabs(got - want) <= tolerance) return;
+    failures++;
+    fprintf(stderr, "FAIL %s: %.2f, expected %.2f\n", what, got, want);
+}
+
+// Simulation Controls throttle, brake and clutch, 16 bits each
+static const uint8_t PedalDescriptor[] = {
+    0x05, 0x01, 0x09, 0x04, 0xA1, 0x01, 0x05, 0x02,
+    0x09, 0xC4, 0x09, 0xC5, 0x09, 0xC6,
+    0x15, 0x00, 0x27, 0xFF, 0xFF, 0x00, 0x00, 0x75, 0x10, 0x95, 0x03, 0x81, 0x02,
+    0xC0,
+};
+
+// 16-bit steering, two 8-bit pedal axes (X, Y) and 8 rim buttons
+static const uint8_t WheelDescriptor[] = {
+    0x05, 0x01, 0x09, 0x04, 0xA1, 0x01,
+    0x05, 0x02, 0x09, 0xC8, 0x15, 0x00, 0x27, 0xFF, 0xFF, 0x00, 0x00, 0x75, 0x10, 0x95, 0x01, 0x81, 0x02,
+    0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x02, 0x81, 0x02,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x08, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0xC0,
+};
+
+// 8 buttons, one per gear
+static const uint8_t ShifterDescriptor[] = {
+    0x05, 0x01, 0x09, 0x04, 0xA1, 0x01,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x08, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0xC0,
+};
+
+// four vendor-defined bytes: neither axes nor buttons
+static const uint8_t VendorDescriptor[] = {
+    0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01,
+    0x09, 0x02, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x04, 0x81, 0x02,
+    0xC0,
+};
+
+static const uint64_t Pedals = 0x101, Wheel = 0x202, Shifter = 0x303, Vendor = 0x404, Unknown = 0x505;
+
+static DeviceSlot* attach(DeviceRouter& router, uint64_t handle, const char* path, const uint8_t* desc, size_t len) {
+    std::vector<HidField> fields;
+    if (!HidDescriptorParser::parse(desc, len, true, fields)) return nullptr;
+    return router.attach(handle, path, fields);
+}
+
+// Reports as raw input hands them over: a 0 report ID byte in front, little-endian fields.
+static std::vector<uint8_t> pedal_report(uint16_t throttle, uint16_t brake, uint16_t clutch) {
+    return { 0, uint8_t(throttle), uint8_t(throttle >> 8), uint8_t(brake), uint8_t(brake >> 8), uint8_t(clutch), uint8_t(clutch >> 8) };
+}
+
+static std::vector<uint8_t> wheel_report(uint16_t steering, uint8_t x, uint8_t y, uint8_t buttons) {
+    return { 0, uint8_t(steering), uint8_t(steering >> 8), x, y, buttons };
+}
+
+int main() {
+    DeviceRouter router;
+    DeviceSlot* pedals = attach(router, Pedals, "usb:pedals", PedalDescriptor, sizeof(PedalDescriptor));
+    DeviceSlot* wheel = attach(router, Wheel, "usb:wheel", WheelDescriptor, sizeof(WheelDescriptor));
+    DeviceSlot* shifter = attach(router, Shifter, "usb:shifter", ShifterDescriptor, sizeof(ShifterDescriptor));
+    DeviceSlot* vendor = attach(router, Vendor, "usb:vendor", VendorDescriptor, sizeof(VendorDescriptor));
+    check(pedals && wheel && shifter && vendor, "attach: four slots");
+    if (!pedals || !wheel || !shifter || !vendor) return 1;
+    check(router.count() == 4, "attach: count");
+    check(pedals->role == RolePedals, "attach: pedal set classified as pedals");
+    check(wheel->role == RoleWheel, "attach: wheel base classified as wheel");
+    check(shifter->role == RoleShifter, "attach: shifter classified as shifter");
+    check(vendor->role == RoleIgnored, "attach: vendor device ignored");
+    check(wheel->plan.has_channel(ChannelSteering) && wheel->plan.has_channel(ChannelThrottle) &&
+        wheel->plan.has_channel(ChannelBrake), "attach: wheel plan has steering and its pedal axes");
+
+    // Two seconds of report time. The pedal set taps the clutch (Static -> Dynamic), then
+    // holds full throttle from 300 ms; the wheel's own pedals stay at rest while it steers
+    // and holds rim button 5; the shifter puts in second gear at 100 ms.
+    const PedalEngineConfig cfg;
+    PedalTickSchedule schedule;
+    uint64_t misrouted = 0, wheelDecoded = 0;
+    uint16_t lastSteering = 0;
+    for (int64_t t = 1000; t <= 2000000; t += 1000) {
+        for (int n = schedule.due(t, cfg); n > 0; n--) router.tick_engines(cfg);
+
+        const bool clutch = t >= 50000 && t < 150000;
+        const bool throttle = t >= 300000;
+        std::vector<uint8_t> r = pedal_report(throttle ? 65535 : 0, 0, clutch ? 65535 : 0);
+        DeviceSlot* slot = router.route(Pedals, r.data(), r.size(), t);
+        if (slot != pedals) misrouted++;
+        else {
+            pedal_engine_process(slot->engine, slot->sample, t, cfg);
+            DeviceRouter::record_latency(*slot, 40);
+        }
+
+        if (t % 2000 == 0) {
+            lastSteering = static_cast<uint16_t>(32768 + 16384 * std::sin(t / 250000.0));
+            r = wheel_report(lastSteering, 0, 0, 0x10);
+            slot = router.route(Wheel, r.data(), r.size(), t + 300);
+            if (slot != wheel) misrouted++;
+            else {
+                wheelDecoded++;
+                pedal_engine_process(slot->engine, slot->sample, t + 300, cfg);
+                DeviceRouter::record_latency(*slot, (t / 2000) % 2 ? 100 : 300);
+            }
+        }
+
+        if (t == 100000) {
+            const uint8_t gear2[] = { 0, 0x02 };
+            if (router.route(Shifter, gear2, sizeof(gear2), t + 500) != shifter) misrouted++;
+        }
+
+        const uint8_t vendorReport[] = { 0, 1, 2, 3, 4 };
+        if (router.route(Vendor, vendorReport, sizeof(vendorReport), t)) misrouted++;
+        if (router.route(Unknown, vendorReport, sizeof(vendorReport), t)) misrouted++;
+
+        // a truncated pedal report every 100 ms: rejected and counted, the sample untouched
+        if (t % 100000 == 0) {
+            r = pedal_report(0, 0, 0);
+            if (router.route(Pedals, r.data(), 3, t + 100)) misrouted++;
+        }
+    }
+
+    // routing
+    check(misrouted == 0, "routing: every report on its own slot, ignored and unknown devices dropped");
+    check(wheel->sample.axis[ChannelSteering] == lastSteering, "routing: wheel steering decoded");
+    check(shifter->has_sample && shifter->sample.buttons == 0x02, "routing: shifter buttons decoded");
+    check(!vendor->has_sample, "routing: vendor device never decoded");
+
+    // engine isolation: only the pedal set saw the clutch tap and the throttle
+    check(pedals->engine.mode == Dynamic, "isolation: pedal set engine is in Dynamic");
+    check(wheel->engine.mode == Static, "isolation: wheel engine stayed Static");
+    check(pedals->engine.throttle == 255 && wheel->engine.throttle == 0, "isolation: throttle levels per slot");
+    check(pedals->engine.speed > 0, "isolation: pedal set speed rose under throttle");
+    check(wheel->engine.speed == 0, "isolation: wheel speed stayed 0");
+    check(pedals->engine.vehicle.gear == 2, "isolation: shifter gear drives the pedal set model");
+
+    // merged input
+    VehicleInput v = router.merge();
+    check(v.sources == 3, "merge: pedals, wheel and shifter count, the vendor device does not");
+    check(v.pedals.axis[ChannelThrottle] == 65535, "merge: throttle from the pedal set, not the wheel's axis");
+    check(v.pedals.axis[ChannelClutch] == 0, "merge: clutch from the pedal set");
+    check(v.pedals.axis[ChannelSteering] == lastSteering, "merge: steering from the wheel");
+    check(v.pedals.buttons == 0x10, "merge: rim buttons, not the shifter's");
+    check(v.gear == 2, "merge: gear from the shifter");
+    check(v.engine.speed == pedals->engine.speed && v.engine.mode == Dynamic, "merge: engine of the pedal set");
+
+    // counters
+    const DeviceStats& ps = pedals->stats;
+    const DeviceStats& ws = wheel->stats;
+    check_value(static_cast<double>(ps.reports), 2000, 0, "stats: pedal reports");
+    check_value(static_cast<double>(ps.rejected), 20, 0, "stats: truncated pedal reports rejected");
+    check_value(ps.rate_hz(), 1000, 0.5, "stats: pedal rate");
+    check_value(static_cast<double>(ps.interval_min_us), 1000, 0, "stats: pedal interval min");
+    check_value(static_cast<double>(ps.interval_max_us), 1000, 0, "stats: pedal interval max");
+    check_value(static_cast<double>(ws.reports), static_cast<double>(wheelDecoded), 0, "stats: wheel reports");
+    check_value(ws.rate_hz(), 500, 0.5, "stats: wheel rate");
+    check_value(ws.interval_avg_us, 2000, 1, "stats: wheel interval average");
+    check_value(static_cast<double>(ps.latency_max_us), 40, 0, "stats: pedal latency max");
+    check_value(ps.latency_avg_us, 40, 0.5, "stats: pedal latency average");
+    check_value(static_cast<double>(ws.latency_max_us), 300, 0, "stats: wheel latency max");
+    check_value(ws.latency_avg_us, 200, 10, "stats: wheel latency average");
+    check(shifter->stats.reports == 1 && shifter->stats.rate_hz() == 0.0, "stats: one shifter report, no rate");
+    check(vendor->stats.reports == 0, "stats: vendor device has no reports");
+
+    // the pedal set drops out: the wheel's axes take over, and a reconnect on a new
+    // handle finds the same slot and engine again
+    const int speed = pedals->engine.speed;
+    router.detach(Pedals);
+    v = router.merge();
+    check(v.sources == 2, "detach: two sources left");
+    check(v.pedals.axis[ChannelThrottle] == 0, "detach: throttle from the wheel's axis");
+    check(v.engine.mode == Static, "detach: engine of the wheel");
+    DeviceSlot* again = attach(router, 0x111, "usb:pedals", PedalDescriptor, sizeof(PedalDescriptor));
+    check(again == pedals && router.count() == 4, "reattach: same slot for the same path");
+    check(again && again->engine.speed == speed && again->engine.mode == Dynamic, "reattach: engine state kept");
+    std::vector<uint8_t> r = pedal_report(65535, 0, 0);
+    check(router.route(0x111, r.data(), r.size(), 2001000) == pedals, "reattach: routed on the new handle");
+    check(!router.route(Pedals, r.data(), r.size(), 2001000), "reattach: old handle no longer routes");
+
+    // a device whose path cannot be read takes a new handle on every reconnect; it must
+    // take its old slot back instead of eating the table
+    DeviceRouter small;
+    for (uint64_t n = 1; n <= 20; n++) {
+        if (!attach(small, 0x1000 + n, "", PedalDescriptor, sizeof(PedalDescriptor))) break;
+        small.detach(0x1000 + n);
+    }
+    check(small.count() == 1, "pathless: reconnects reuse one slot");
+    check(attach(small, 0x1100, "", PedalDescriptor, sizeof(PedalDescriptor)) == &small.slot(0), "pathless: back in slot 0");
+    for (uint64_t n = 0; n < DeviceRouter::MaxDevices - 1; n++) {
+        const std::string path = "usb:" + std::to_string(n);
+        attach(small, 0x2000 + n, path.c_str(), PedalDescriptor, sizeof(PedalDescriptor));
+    }
+    check(small.count() == DeviceRouter::MaxDevices, "full: every slot taken");
+    check(!attach(small, 0x3000, "usb:new", PedalDescriptor, sizeof(PedalDescriptor)), "full: router full is null");
+    small.detach(0x2003);
+    DeviceSlot* reclaimed = attach(small, 0x3000, "usb:new", PedalDescriptor, sizeof(PedalDescriptor));
+    check(reclaimed && reclaimed->path == "usb:new" && reclaimed->stats.reports == 0, "full: a detached slot is reclaimed");
+
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
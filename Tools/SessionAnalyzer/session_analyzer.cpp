@@ -0,0 +1,390 @@
+// session_analyzer.cpp - statistics over recorded sessions and captures, per time window
+//
+// Opens a session file (session_recorder.h, memory-mapped, so it can be far larger than
+// RAM) or a pedal capture (any encoding CaptureFile reads; it is replayed through the
+// pedal engine for speed and mode) and cuts it into windows that a thread pool analyses
+// in parallel. Per window and in total:
+//
+//   pedal histograms     filtered pedal levels (8-bit view, 0..255), 16 bins
+//   speed percentiles    p50, p90, p99, max of the report rows
+//   mode dwell           seconds in each drive mode, and mode changes
+//   edges                presses per pedal (the engine's hysteresis triggers)
+//   latency              report interval, report -> CAN frame, report -> XCP update
+//
+// A window starts its edge triggers and its "previous report" a few seconds early, so the
+// counts do not depend on where the windows are cut; the dwell between the last report
+// before a window and its first one counts in the window. --csv writes min/max/mean of
+// the pedal levels and the speed per bucket (default 100 ms) for plotting, filled by the
+// same pass.
+//
+//   g++ -std=c++17 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard session_analyzer.cpp -o session_analyzer
+//   cl /std:c++17 /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard session_analyzer.cpp
+//   session_analyzer [--threads N] [--window s] [--csv out.csv] [--bucket ms] run.fsr|trace.fpc|trace.csv
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "edge_detector.h"
+#include "latency_histogram.h"
+#include "pedal_capture.h"
+#include "pedal_engine.h"
+#include "session_recorder.h"
+#include "thread_pool.h"
+
+static const int LevelBins = 16;            // 8-bit levels, 16 per bin
+static const int SpeedBins = 1024;          // km/h, clamped
+static const int64_t WarmupUs = 2000000;
+
+struct Bucket {
+    uint64_t reports = 0;
+    int min[ChannelSteering + 1];           // pedals, then speed
+    int max[ChannelSteering + 1];
+    int64_t sum[ChannelSteering + 1];
+    int mode = 0;                           // of the last report
+    int64_t last_t = INT64_MIN;
+
+    Bucket() {
+        for (int i = 0; i <= ChannelSteering; i++) {
+            min[i] = INT32_MAX;
+            max[i] = INT32_MIN;
+            sum[i] = 0;
+        }
+    }
+
+    void add(const int* v, int m, int64_t t) {
+        for (int i = 0; i <= ChannelSteering; i++) {
+            min[i] = (std::min)(min[i], v[i]);
+            max[i] = (std::max)(max[i], v[i]);
+            sum[i] += v[i];
+        }
+        reports++;
+        if (t >= last_t) {
+            last_t = t;
+            mode = m;
+        }
+    }
+
+    void merge(const Bucket& b) {
+        for (int i = 0; i <= ChannelSteering; i++) {
+            min[i] = (std::min)(min[i], b.min[i]);
+            max[i] = (std::max)(max[i], b.max[i]);
+            sum[i] += b.sum[i];
+        }
+        reports += b.reports;
+        if (b.reports && b.last_t >= last_t) {
+            last_t = b.last_t;
+            mode = b.mode;
+        }
+    }
+};
+
+struct WindowStats {
+    int64_t t0 = 0, t1 = 0;
+    uint64_t rows[SessionEventCount] = {};
+    uint64_t level[ChannelSteering][LevelBins] = {};
+    uint64_t speed[SpeedBins] = {};
+    int64_t dwell_us[DriveModeCount] = {};
+    uint64_t mode_changes = 0;
+    uint64_t presses[ChannelSteering] = {};
+    int64_t first_bucket = 0;
+    std::vector<Bucket> buckets;
+
+    void merge(const WindowStats& w) {
+        for (int e = 0; e < SessionEventCount; e++) rows[e] += w.rows[e];
+        for (int c = 0; c < ChannelSteering; c++) {
+            for (int b = 0; b < LevelBins; b++) level[c][b] += w.level[c][b];
+            presses[c] += w.presses[c];
+        }
+        for (int s = 0; s < SpeedBins; s++) speed[s] += w.speed[s];
+        for (int m = 0; m < DriveModeCount; m++) dwell_us[m] += w.dwell_us[m];
+        mode_changes += w.mode_changes;
+    }
+
+    int speed_percentile(double p) const {
+        uint64_t n = 0;
+        for (int s = 0; s < SpeedBins; s++) n += speed[s];
+        if (n == 0) return 0;
+        const uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * n));
+        uint64_t seen = 0;
+        for (int s = 0; s < SpeedBins; s++) {
+            seen += speed[s];
+            if (seen >= (std::max<uint64_t>)(rank, 1)) return s;
+        }
+        return SpeedBins - 1;
+    }
+
+    int speed_max() const {
+        for (int s = SpeedBins - 1; s >= 0; s--) {
+            if (speed[s]) return s;
+        }
+        return 0;
+    }
+};
+
+// The latency distributions are shared by the workers; the histograms take atomic adds.
+struct Latencies {
+    LatencyHistogram interval;          // between consecutive reports
+    LatencyHistogram to_can;            // newest report -> CAN frame with it
+    LatencyHistogram to_xcp;            // newest report -> XCP update
+};
+
+// A capture as one in-memory chunk, with speed and mode from an engine replay (the same
+// loop as pedal_replay.h).
+struct CaptureColumns {
+    std::vector<int64_t> t;
+    std::vector<uint16_t> raw[ChannelSteering];
+    std::vector<int16_t> speed;
+    std::vector<uint8_t> mode, event;
+
+    SessionChunk load(const PedalCapture& capture) {
+        const size_t n = capture.records.size();
+        const PedalEngineConfig cfg;
+        const int64_t stepUs = std::llround(cfg.vehicle.dt_s * 1e6);
+        PedalEngineState s;
+        int64_t nextTick = n ? capture.records.front().t_us + stepUs : 0;
+        t.resize(n);
+        speed.resize(n);
+        mode.resize(n);
+        event.assign(n, SessionReport);
+        for (int c = 0; c < ChannelSteering; c++) raw[c].resize(n);
+        for (size_t i = 0; i < n; i++) {
+            const CaptureRecord& r = capture.records[i];
+            while (nextTick <= r.t_us) {
+                pedal_engine_tick(s, cfg);
+                nextTick += stepUs;
+            }
+            pedal_engine_process(s, PedalCapture::sample_of(r), r.t_us, cfg);
+            t[i] = r.t_us;
+            for (int c = 0; c < ChannelSteering; c++) raw[c][i] = r.axis[c];
+            speed[i] = static_cast<int16_t>(s.speed);
+            mode[i] = static_cast<uint8_t>(s.mode);
+        }
+
+        SessionChunk chunk;
+        chunk.t = t.data();
+        for (int c = 0; c < ChannelSteering; c++) chunk.raw[c] = chunk.value[c] = raw[c].data();
+        chunk.speed = speed.data();
+        chunk.mode = mode.data();
+        chunk.event = event.data();
+        chunk.rows = static_cast<uint32_t>(n);
+        chunk.min_t = n ? t.front() : 0;
+        chunk.max_t = n ? t.back() : 0;
+        return chunk;
+    }
+};
+
+static void analyze_window(const std::vector<SessionChunk>& chunks, WindowStats& w, int64_t bucketUs, int64_t origin,
+    Latencies& lat) {
+    const PedalEdgeConfig edgeCfg;
+    PedalEdgeState edges;
+    bool havePrev = false;
+    int64_t prevT = 0, lastReport = INT64_MIN;
+    int prevMode = 0;
+
+    w.first_bucket = (w.t0 - origin) / bucketUs;
+    w.buckets.resize(static_cast<size_t>((w.t1 - origin + bucketUs - 1) / bucketUs - w.first_bucket));
+
+    auto visit = [&](bool counted) {
+        return [&, counted](const SessionChunk& c, uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                const int64_t t = c.t[i];
+                const int event = c.event[i];
+                if (event != SessionReport) {
+                    if (counted && event < SessionEventCount) w.rows[event]++;
+                    if (counted && lastReport != INT64_MIN) {
+                        (event == SessionCanTx ? lat.to_can : lat.to_xcp).record(t - lastReport);
+                    }
+                    continue;
+                }
+
+                PedalSample sample;
+                for (int ch = 0; ch < ChannelSteering; ch++) sample.axis[ch] = c.value[ch][i];
+                EdgeEvents found;
+                detect_pedal_edges(edges, edgeCfg, sample, t, found);
+                lastReport = t;
+                const int m = c.mode[i];
+                if (counted) {
+                    w.rows[SessionReport]++;
+                    for (const EdgeEvent& e : found) {
+                        if (e.edge == EdgeRising) w.presses[e.channel]++;
+                    }
+                    int v[ChannelSteering + 1];
+                    for (int ch = 0; ch < ChannelSteering; ch++) {
+                        v[ch] = pedal_level8(sample, static_cast<PedalChannel>(ch));
+                        w.level[ch][v[ch] * LevelBins / 256]++;
+                    }
+                    v[ChannelSteering] = c.speed[i];
+                    w.speed[(std::min)((std::max)(static_cast<int>(c.speed[i]), 0), SpeedBins - 1)]++;
+                    const size_t b = static_cast<size_t>((t - origin) / bucketUs - w.first_bucket);
+                    if (b < w.buckets.size()) w.buckets[b].add(v, m, t);
+                    if (havePrev) {
+                        lat.interval.record(t - prevT);
+                        if (prevMode < DriveModeCount) w.dwell_us[prevMode] += t - prevT;
+                        if (m != prevMode) w.mode_changes++;
+                    }
+                }
+                havePrev = true;
+                prevT = t;
+                prevMode = m;
+            }
+        };
+    };
+    session_slice(chunks, w.t0 - WarmupUs, w.t0, visit(false));
+    session_slice(chunks, w.t0, w.t1, visit(true));
+}
+
+// The header and the rows share these widths, so every value sits under its heading.
+static const int ModeWidth = 9;     // "Step test", the longest drive_mode_name
+
+static void print_stats_header() {
+    printf("\n%-10s %9s %6s %6s %9s %9s %9s %9s", "window s", "reports", "can", "xcp", "speed p50", "speed p90",
+        "speed p99", "speed max");
+    for (int m = 0; m < DriveModeCount; m++) printf(" %*s", ModeWidth, drive_mode_name(static_cast<DriveMode>(m)));
+    printf(" %6s %6s %6s %6s\n", "modes", "thr", "brk", "clu");
+}
+
+static void print_stats(const char* label, const WindowStats& w) {
+    printf("%-10s %9llu %6llu %6llu %9d %9d %9d %9d", label, (unsigned long long)w.rows[SessionReport],
+        (unsigned long long)w.rows[SessionCanTx], (unsigned long long)w.rows[SessionXcpTx], w.speed_percentile(50),
+        w.speed_percentile(90), w.speed_percentile(99), w.speed_max());
+    for (int m = 0; m < DriveModeCount; m++) printf(" %*.1f", ModeWidth, w.dwell_us[m] / 1e6);
+    printf(" %6llu %6llu %6llu %6llu\n", (unsigned long long)w.mode_changes, (unsigned long long)w.presses[ChannelThrottle],
+        (unsigned long long)w.presses[ChannelBrake], (unsigned long long)w.presses[ChannelClutch]);
+}
+
+static void print_latency(const char* name, const LatencyHistogram& h) {
+    if (h.count() == 0) return;
+    printf("  %-18s %10llu %10.0f %8llu %8llu %8llu %8llu\n", name, (unsigned long long)h.count(), h.mean(),
+        (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99), (unsigned long long)h.percentile(99.9),
+        (unsigned long long)h.maximum());
+}
+
+static bool write_csv(const std::string& path, const std::vector<Bucket>& buckets, int64_t bucketUs) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) return false;
+    static const char* const names[ChannelSteering + 1] = { "throttle", "brake", "clutch", "speed" };
+    fprintf(f, "t_s,reports");
+    for (int i = 0; i <= ChannelSteering; i++) fprintf(f, ",%s_min,%s_max,%s_mean", names[i], names[i], names[i]);
+    fprintf(f, ",mode\n");
+    for (size_t b = 0; b < buckets.size(); b++) {
+        const Bucket& k = buckets[b];
+        if (k.reports == 0) continue;
+        fprintf(f, "%.3f,%llu", b * bucketUs / 1e6, (unsigned long long)k.reports);
+        for (int i = 0; i <= ChannelSteering; i++) {
+            fprintf(f, ",%d,%d,%.1f", k.min[i], k.max[i], static_cast<double>(k.sum[i]) / k.reports);
+        }
+        fprintf(f, ",%s\n", drive_mode_name(static_cast<DriveMode>(k.mode)));
+    }
+    return fclose(f) == 0;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: session_analyzer [--threads N] [--window s] [--csv out.csv] [--bucket ms] run.fsr|capture\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = 0;
+    double windowS = 60.0, bucketMs = 100.0;
+    std::string csvPath, input;
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--threads" && i + 1 < argc) threads = static_cast<unsigned>(atoi(argv[++i]));
+        else if (a == "--window" && i + 1 < argc) windowS = atof(argv[++i]);
+        else if (a == "--csv" && i + 1 < argc) csvPath = argv[++i];
+        else if (a == "--bucket" && i + 1 < argc) bucketMs = atof(argv[++i]);
+        else if (a[0] != '-' && input.empty()) input = a;
+        else return usage();
+    }
+    if (input.empty() || windowS <= 0 || bucketMs <= 0) return usage();
+
+    const auto start = std::chrono::steady_clock::now();
+    SessionReader reader;
+    PedalCapture capture;
+    CaptureColumns captureColumns;
+    std::vector<SessionChunk> captureChunks;
+    std::string error;
+    const std::vector<SessionChunk>* chunks = &reader.chunks();
+    if (reader.open(input, &error)) {
+        printf("%s: session, %llu rows%s\n", input.c_str(), (unsigned long long)reader.rows(),
+            reader.closed() ? "" : " (not closed: recording or crashed)");
+    }
+    else if (CaptureFile::read(input, capture) && !capture.records.empty()) {
+        captureChunks.push_back(captureColumns.load(capture));
+        chunks = &captureChunks;
+        printf("%s: capture, %zu reports (speed and mode replayed)\n", input.c_str(), capture.records.size());
+    }
+    else {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (chunks->empty()) {
+        fprintf(stderr, "%s: no rows\n", input.c_str());
+        return 1;
+    }
+
+    const int64_t origin = chunks->front().min_t;
+    int64_t last = origin;
+    for (const SessionChunk& c : *chunks) last = (std::max)(last, c.max_t);
+    const int64_t windowUs = (std::max<int64_t>)(1, static_cast<int64_t>(windowS * 1e6));
+    const int64_t bucketUs = (std::max<int64_t>)(1, static_cast<int64_t>(bucketMs * 1e3));
+    const size_t windows = static_cast<size_t>((last - origin) / windowUs + 1);
+
+    std::vector<WindowStats> stats(windows);
+    Latencies lat;
+    ThreadPool pool(threads);
+    parallel_for(pool, windows, [&](size_t i) {
+        WindowStats& w = stats[i];
+        w.t0 = origin + static_cast<int64_t>(i) * windowUs;
+        w.t1 = w.t0 + windowUs;
+        analyze_window(*chunks, w, bucketUs, origin, lat);
+    });
+
+    WindowStats total;
+    print_stats_header();
+    for (const WindowStats& w : stats) {
+        char label[32];
+        snprintf(label, sizeof(label), "%.0f", (w.t0 - origin) / 1e6);
+        print_stats(label, w);
+        total.merge(w);
+    }
+    print_stats("total", total);
+
+    static const char* const pedals[ChannelSteering] = { "throttle", "brake", "clutch" };
+    printf("\npedal levels, %% of reports per 16-level bin\n");
+    for (int c = 0; c < ChannelSteering; c++) {
+        printf("  %-8s", pedals[c]);
+        for (int b = 0; b < LevelBins; b++) {
+            printf(" %5.1f", total.rows[SessionReport] ? 100.0 * total.level[c][b] / total.rows[SessionReport] : 0.0);
+        }
+        printf("\n");
+    }
+
+    printf("\nlatency, us           %10s %10s %8s %8s %8s %8s\n", "count", "mean", "p50", "p99", "p99.9", "max");
+    print_latency("report interval", lat.interval);
+    print_latency("report -> CAN", lat.to_can);
+    print_latency("report -> XCP", lat.to_xcp);
+
+    if (!csvPath.empty()) {
+        std::vector<Bucket> buckets(static_cast<size_t>((last - origin) / bucketUs + 1));
+        for (const WindowStats& w : stats) {
+            for (size_t b = 0; b < w.buckets.size(); b++) {
+                const size_t k = static_cast<size_t>(w.first_bucket) + b;
+                if (k < buckets.size()) buckets[k].merge(w.buckets[b]);
+            }
+        }
+        if (!write_csv(csvPath, buckets, bucketUs)) {
+            fprintf(stderr, "cannot write %s\n", csvPath.c_str());
+            return 1;
+        }
+        printf("\n%s: %zu buckets of %.0f ms\n", csvPath.c_str(), buckets.size(), bucketMs);
+    }
+    fprintf(stderr, "%zu windows, %u threads, %.3f s\n", windows, pool.size(),
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return 0;
+}
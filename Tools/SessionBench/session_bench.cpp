@@ -0,0 +1,140 @@
+// session_bench.cpp - session recorder throughput, drops and reader open/slice time
+//
+// Records <seconds> worth of standard-manoeuvre reports at <rate> Hz as fast as the
+// producer can go (plus one CAN row per 10 reports from a second thread, like the CAN
+// bridge), then reopens the file, checks every row and times a slice in the middle.
+//
+//   g++ -std=c++17 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard session_bench.cpp -o session_bench
+//   ./session_bench [seconds] [rate Hz] [file]
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "maneuver_source.h"
+#include "pedal_engine.h"
+#include "session_recorder.h"
+
+static double elapsed_ms(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? atof(argv[1]) : 3600.0;
+    const int rate = argc > 2 ? atoi(argv[2]) : 1000;
+    const std::string path = argc > 3 ? argv[3] : "session_bench.fsr";
+    const uint64_t reports = static_cast<uint64_t>(seconds * rate);
+    const int64_t step = 1000000 / rate;
+
+    // one pass of the manoeuvre, replayed for the whole session
+    ManeuverPlan plan = ManeuverPlan::standard();
+    plan.rate_hz = rate;
+    ManeuverGenerator gen(plan);
+    std::vector<SessionRow> rowsIn(static_cast<size_t>(rate) * 30);
+    PedalEngineState engine;
+    PedalEngineConfig cfg;
+    for (size_t i = 0; i < rowsIn.size(); i++) {
+        PedalSample s;
+        gen.next(s);
+        pedal_engine_process(engine, s, static_cast<int64_t>(i) * step, cfg);
+        pedal_engine_tick(engine, cfg);
+        SessionRow& r = rowsIn[i];
+        for (int c = 0; c < ChannelSteering; c++) {
+            r.raw[c] = s.axis[c];
+            r.value[c] = s.axis[c];
+        }
+        r.speed = static_cast<int16_t>(engine.speed);
+        r.mode = static_cast<uint8_t>(engine.mode);
+        r.event = SessionReport;
+    }
+
+    SessionRecorder recorder;
+    std::string error;
+    if (!recorder.open(path, 0, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    std::atomic<uint64_t> produced{ 0 };
+    std::thread can([&] {
+        uint64_t seen = 0;
+        for (;;) {
+            const uint64_t p = produced.load();
+            if (p >= seen + 10) {
+                SessionRow r = rowsIn[(p - 1) % rowsIn.size()];
+                r.t_us = static_cast<int64_t>(p - 1) * step;       // sent now, with the newest state
+                r.event = SessionCanTx;
+                recorder.record(r);
+                seen = p - p % 10;
+            }
+            else if (p == reports) {
+                break;
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    const auto t0 = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < reports; i++) {
+        SessionRow r = rowsIn[i % rowsIn.size()];
+        r.t_us = static_cast<int64_t>(i) * step;
+        recorder.record(r);
+        produced.store(i + 1, std::memory_order_release);
+        if ((i & 1023) == 1023) std::this_thread::yield();     // let the writer run on small machines
+    }
+    const double recordMs = elapsed_ms(t0);
+    can.join();
+    const uint64_t recorded = recorder.rows(), dropped = recorder.dropped();
+    const auto c0 = std::chrono::steady_clock::now();
+    recorder.close();
+    const double closeMs = elapsed_ms(c0);
+
+    printf("recorded %llu rows (%llu dropped) in %.0f ms: %.1f ns/row, close %.0f ms\n", (unsigned long long)recorded,
+        (unsigned long long)dropped, recordMs, recordMs * 1e6 / reports, closeMs);
+
+    const auto o0 = std::chrono::steady_clock::now();
+    SessionReader reader;
+    if (!reader.open(path, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    const double openMs = elapsed_ms(o0);
+    printf("reopened %llu rows in %zu chunks in %.2f ms (closed=%d, %.1f s)\n", (unsigned long long)reader.rows(),
+        reader.chunks().size(), openMs, reader.closed() ? 1 : 0, (reader.last_t() - reader.first_t()) / 1e6);
+
+    // every report row must match what went in
+    uint64_t mismatches = 0, reportRows = 0, canRows = 0;
+    for (const SessionReader::Chunk& c : reader.chunks()) {
+        for (uint32_t i = 0; i < c.rows; i++) {
+            const SessionRow r = c.row(i);
+            if (r.event == SessionCanTx) {
+                canRows++;
+                continue;
+            }
+            const uint64_t k = static_cast<uint64_t>(r.t_us / step);
+            const SessionRow& e = rowsIn[k % rowsIn.size()];
+            if (r.raw[ChannelBrake] != e.raw[ChannelBrake] || r.speed != e.speed || r.mode != e.mode) mismatches++;
+            reportRows++;
+        }
+    }
+    printf("%llu report rows, %llu can rows, %llu mismatches\n", (unsigned long long)reportRows,
+        (unsigned long long)canRows, (unsigned long long)mismatches);
+
+    // one minute from the middle
+    const int64_t mid = (reader.first_t() + reader.last_t()) / 2;
+    const auto s0 = std::chrono::steady_clock::now();
+    uint64_t sliced = 0;
+    int64_t speedSum = 0;
+    reader.slice(mid, mid + 60000000, [&](const SessionReader::Chunk& c, uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) speedSum += c.speed[i];
+        sliced += end - begin;
+    });
+    printf("slice 60 s at %.1f s: %llu rows in %.3f ms (mean speed %.1f)\n", mid / 1e6, (unsigned long long)sliced,
+        elapsed_ms(s0), sliced ? static_cast<double>(speedSum) / sliced : 0.0);
+    return mismatches == 0 && dropped == 0 ? 0 : 1;
+}
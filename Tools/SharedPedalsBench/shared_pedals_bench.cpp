@@ -0,0 +1,192 @@
+// shared_pedals_bench.cpp - shared memory channel: publisher cost, reader latency, losses
+//
+// Publishes <seconds> of samples at <rate> Hz (0 = as fast as possible) on a channel of
+// its own, together with a state per sample, while <readers> threads follow the ring,
+// each through its own read-only mapping as a separate process would. Reports the
+// push and publish cost, push-to-read latency, the cost of reading the state, lost
+// samples and whether every sample arrived intact and in order.
+//
+// With --reader it only follows an existing channel (e.g. the desktop app's) and prints
+// the latency from the sample timestamps, in microseconds.
+//
+//   g++ -std=c++14 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard shared_pedals_bench.cpp -o shared_pedals_bench
+//   cl /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard shared_pedals_bench.cpp
+//   ./shared_pedals_bench [--readers 4] [--seconds 5] [--rate 1000] [--channel name]
+//   ./shared_pedals_bench --reader [--seconds 10] [--channel FanatecPedals]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_histogram.h"
+#include "shared_pedals.h"
+#include "timing.h"
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the content of sample n, so readers can check it
+static PedalSample sample_of(uint64_t n) {
+    PedalSample s;
+    for (int c = 0; c < ChannelCount; c++) s.axis[c] = static_cast<uint16_t>(n * (c + 1) + c);
+    s.buttons = static_cast<uint32_t>(n >> 3);
+    return s;
+}
+
+struct ReaderStats {
+    uint64_t samples = 0;
+    uint64_t lost = 0;
+    uint64_t bad = 0;               // wrong content or out of order
+    uint64_t states = 0;
+};
+
+static int follow(const std::string& channel, double seconds) {
+    SharedPedalReader reader;
+    std::string error;
+    if (!reader.open(channel, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    LatencyHistogram latencyUs;
+    uint64_t cursor = reader.head(), lost = 0, samples = 0;
+    const int64_t end = now_us() + static_cast<int64_t>(seconds * 1e6);
+    while (now_us() < end) {
+        const size_t n = reader.drain(cursor, [&](const SharedPedalSample& s) { latencyUs.record(now_us() - s.t_us); }, &lost);
+        samples += n;
+        if (!n) std::this_thread::yield();
+    }
+    uint32_t version = 0;
+    const SharedPedalState st = reader.state(&version);
+    printf("%s: %llu samples, %llu lost, publisher %s (generation %u), %u states, last speed %d\n", channel.c_str(),
+        (unsigned long long)samples, (unsigned long long)lost, reader.publisher_alive() ? "alive" : "gone",
+        reader.generation(), version, st.speed);
+    printf("push -> read: p50 %llu us, p99 %llu us, max %llu us\n", (unsigned long long)latencyUs.percentile(50),
+        (unsigned long long)latencyUs.percentile(99), (unsigned long long)latencyUs.maximum());
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int readers = 4, rate = 1000;
+    double seconds = 5;
+    bool readOnly = false;
+    std::string channel = "FanatecPedalsBench";
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--reader") {
+            readOnly = true;
+            channel = shared_pedals::DefaultName;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "%s needs a value\n", a.c_str());
+            return 1;
+        }
+        if (a == "--readers") readers = atoi(argv[++i]);
+        else if (a == "--seconds") seconds = atof(argv[++i]);
+        else if (a == "--rate") rate = atoi(argv[++i]);
+        else if (a == "--channel") channel = argv[++i];
+        else {
+            fprintf(stderr, "unknown option %s\n", a.c_str());
+            return 1;
+        }
+    }
+    if (readOnly) return follow(channel, seconds);
+
+    SharedPedalWriter writer;
+    std::string error;
+    if (!writer.open(channel, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    const uint64_t first = writer.pushed();     // a channel left by an earlier run continues
+
+    // push time of every sample, in ns, for the in-process latency
+    const uint64_t total = rate > 0 ? static_cast<uint64_t>(seconds * rate) : static_cast<uint64_t>(seconds * 2e6);
+    std::vector<std::atomic<int64_t>> pushedNs(static_cast<size_t>(total));
+    LatencyHistogram pushNs, publishNs, readNs, stateNs;
+    std::vector<ReaderStats> stats(static_cast<size_t>(readers));
+    std::atomic<bool> done{ false };
+    std::atomic<int> ready{ 0 };
+
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r] {
+            SharedPedalReader reader;
+            if (!reader.open(channel)) return;
+            ReaderStats& st = stats[static_cast<size_t>(r)];
+            uint64_t cursor = first, expect = first;
+            ready.fetch_add(1);
+            for (;;) {
+                const bool last = done.load();
+                const size_t n = reader.drain(cursor, [&](const SharedPedalSample& s) {
+                    const int64_t t = now_ns();
+                    const uint64_t i = s.n - first;
+                    if (i < total) readNs.record(t - pushedNs[static_cast<size_t>(i)].load(std::memory_order_relaxed));
+                    const PedalSample want = sample_of(s.n);
+                    if (s.n < expect || memcmp(s.axis, want.axis, sizeof(want.axis)) != 0 || s.buttons != want.buttons) st.bad++;
+                    expect = s.n + 1;
+                }, &st.lost);
+                st.samples += n;
+                if ((st.samples & 63) == 0) {
+                    const int64_t t0 = now_ns();
+                    reader.state();
+                    stateNs.record(now_ns() - t0);
+                    st.states++;
+                }
+                if (last && cursor == reader.head()) break;
+                if (!n) std::this_thread::yield();
+            }
+        });
+    }
+    while (ready.load() < readers) std::this_thread::yield();
+
+    const int64_t period = rate > 0 ? 1000000 / rate : 0;
+    const int64_t t0 = now_us();
+    SharedPedalState state;
+    for (uint64_t i = 0; i < total; i++) {
+        if (period) {
+            const int64_t due = t0 + static_cast<int64_t>(i) * period;
+            while (now_us() < due) std::this_thread::yield();
+        }
+        const PedalSample s = sample_of(first + i);
+        int64_t a = now_ns();
+        pushedNs[static_cast<size_t>(i)].store(a, std::memory_order_relaxed);
+        writer.push(s, a / 1000);
+        int64_t b = now_ns();
+        pushNs.record(b - a);
+
+        memcpy(state.pedal, s.axis, sizeof(state.pedal));
+        state.t_us = b / 1000;
+        state.speed = static_cast<int16_t>(i % 300);
+        writer.publish(state);
+        publishNs.record(now_ns() - b);
+    }
+    const double runS = (now_us() - t0) / 1e6;
+    done.store(true);
+    for (std::thread& t : threads) t.join();
+
+    uint64_t samples = 0, lost = 0, bad = 0;
+    for (const ReaderStats& st : stats) {
+        samples += st.samples;
+        lost += st.lost;
+        bad += st.bad;
+    }
+    printf("channel %s: %llu samples in %.2f s (%.0f/s), %d readers\n", channel.c_str(), (unsigned long long)total, runS,
+        total / runS, readers);
+    printf("push:    mean %.0f ns, p99 %llu ns, max %llu ns\n", pushNs.mean(), (unsigned long long)pushNs.percentile(99),
+        (unsigned long long)pushNs.maximum());
+    printf("publish: mean %.0f ns, p99 %llu ns, max %llu ns\n", publishNs.mean(),
+        (unsigned long long)publishNs.percentile(99), (unsigned long long)publishNs.maximum());
+    printf("state read: mean %.0f ns, p99 %llu ns\n", stateNs.mean(), (unsigned long long)stateNs.percentile(99));
+    printf("push -> read: p50 %llu ns, p99 %llu ns, max %llu ns\n", (unsigned long long)readNs.percentile(50),
+        (unsigned long long)readNs.percentile(99), (unsigned long long)readNs.maximum());
+    printf("readers: %llu samples read, %llu lost (overwritten), %llu bad: %s\n", (unsigned long long)samples,
+        (unsigned long long)lost, (unsigned long long)bad, bad == 0 && samples + lost == total * readers ? "ok" : "FAILED");
+    writer.close();
+    return bad == 0 ? 0 : 1;
+}
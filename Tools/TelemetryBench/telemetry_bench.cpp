@@ -0,0 +1,191 @@
+// telemetry_bench.cpp - telemetry server fan-out to many localhost subscribers
+//
+// Publishes the standard manoeuvre through the pedal engine at <publish> Hz (as the input
+// thread would), while <clients> subscribers on one thread ask for <rate> Hz each and
+// decode the stream. Reports frames and bytes per second, bytes per frame, the publish
+// cost, publish-to-decode latency and how many frames the server skipped for slow
+// clients. Every decoded state is checked against what was published.
+//
+//   g++ -std=c++20 -O2 -pthread -I../../Win32/FanatecWizard/FanatecWizard/FanatecWizard telemetry_bench.cpp -o telemetry_bench
+//   cl /std:c++20 /O2 /EHsc /I..\..\Win32\FanatecWizard\FanatecWizard\FanatecWizard telemetry_bench.cpp
+//   ./telemetry_bench [--clients 100] [--seconds 10] [--rate 60] [--publish 1000] [--port 5558]
+#include "telemetry_server.h"       // before anything that pulls in <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_histogram.h"
+#include "maneuver_source.h"
+#include "pedal_engine.h"
+#include "timing.h"
+
+struct Subscriber {
+    stats_socket_t socket = STATS_INVALID_SOCKET;
+    TelemetryDecoder decoder;
+    uint64_t frames = 0;            // states decoded, heartbeats included
+    uint64_t bytes = 0;
+    int64_t last_t = 0;
+    uint32_t last_seq = 0;
+    bool broken = false;
+    std::vector<TelemetrySnapshot> seen;
+};
+
+static bool same_state(const TelemetrySnapshot& a, const TelemetrySnapshot& b) {
+    return a.t_us == b.t_us && memcmp(a.pedal, b.pedal, sizeof(a.pedal)) == 0 && a.speed == b.speed &&
+        a.mode == b.mode && a.gear == b.gear && a.sources == b.sources;
+}
+
+int main(int argc, char** argv) {
+    int clients = 100, rate = 60, publishHz = 1000, port = TelemetryServer::DefaultPort;
+    double seconds = 10;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string a = argv[i];
+        if (a == "--clients") clients = atoi(argv[i + 1]);
+        else if (a == "--seconds") seconds = atof(argv[i + 1]);
+        else if (a == "--rate") rate = atoi(argv[i + 1]);
+        else if (a == "--publish") publishHz = atoi(argv[i + 1]);
+        else if (a == "--port") port = atoi(argv[i + 1]);
+        else {
+            fprintf(stderr, "unknown option %s\n", a.c_str());
+            return 1;
+        }
+    }
+    clients = (std::min)(clients, TelemetryServer::MaxClients);
+
+    TelemetryServer server;
+    if (!server.start(static_cast<uint16_t>(port))) {
+        fprintf(stderr, "cannot listen on 127.0.0.1:%d\n", port);
+        return 1;
+    }
+
+    std::vector<Subscriber> subs(static_cast<size_t>(clients));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    for (Subscriber& s : subs) {
+        s.socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s.socket == STATS_INVALID_SOCKET || connect(s.socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            fprintf(stderr, "cannot connect subscriber %d\n", static_cast<int>(&s - subs.data()));
+            return 1;
+        }
+        const uint8_t request[3] = { telemetry_wire::RateRequest, static_cast<uint8_t>(rate), static_cast<uint8_t>(rate >> 8) };
+        send(s.socket, reinterpret_cast<const char*>(request), sizeof(request), STATS_SEND_FLAGS);
+#ifdef _WIN32
+        u_long on = 1;
+        ioctlsocket(s.socket, FIONBIO, &on);
+#else
+        fcntl(s.socket, F_SETFL, fcntl(s.socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    }
+    for (int tries = 0; server.clients() < clients && tries < 1000; tries++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // every published state, in order, for the consistency check after the run
+    const size_t total = static_cast<size_t>(seconds * publishHz);
+    std::vector<TelemetrySnapshot> published(total);
+    LatencyHistogram publishNs, latencyUs;
+    std::atomic<bool> done{ false };
+
+    std::thread subscriberThread([&] {
+        std::vector<pollfd> fds(subs.size());
+        uint8_t buffer[16384];
+        while (!done.load()) {
+            for (size_t i = 0; i < subs.size(); i++) {
+                fds[i].fd = subs[i].socket;
+                fds[i].events = POLLIN;
+                fds[i].revents = 0;
+            }
+            if (telemetry_poll(fds.data(), static_cast<unsigned long>(fds.size()), 10) <= 0) continue;
+            for (size_t i = 0; i < subs.size(); i++) {
+                if (!fds[i].revents) continue;
+                Subscriber& s = subs[i];
+                const int n = recv(s.socket, reinterpret_cast<char*>(buffer), sizeof(buffer), 0);
+                if (n <= 0) continue;
+                s.bytes += static_cast<uint64_t>(n);
+                const int64_t now = now_us();
+                const bool ok = s.decoder.feed(buffer, static_cast<size_t>(n), [&](const TelemetrySnapshot& st, uint32_t seq) {
+                    if (seq != s.last_seq + 1) s.broken = true;
+                    s.last_seq = seq;
+                    s.frames++;
+                    if (st.t_us == s.last_t) return;    // heartbeat
+                    if (st.t_us < s.last_t) s.broken = true;
+                    s.last_t = st.t_us;
+                    latencyUs.record(now - st.t_us);
+                    s.seen.push_back(st);
+                });
+                if (!ok) s.broken = true;
+            }
+        }
+    });
+
+    // the input thread: one report per period through the engine, then publish
+    ManeuverPlan plan = ManeuverPlan::standard();
+    plan.rate_hz = publishHz;
+    ManeuverGenerator gen(plan);
+    PedalEngineState engine;
+    PedalEngineConfig cfg;
+    const int64_t period = 1000000 / publishHz;
+    const int64_t t0 = now_us();
+    for (size_t i = 0; i < total; i++) {
+        const int64_t due = t0 + static_cast<int64_t>(i) * period;
+        while (now_us() < due) std::this_thread::sleep_for(std::chrono::microseconds(200));
+        PedalSample sample;
+        gen.next(sample);
+        pedal_engine_process(engine, sample, due, cfg);
+        pedal_engine_tick(engine, cfg);
+
+        TelemetrySnapshot& snap = published[i];
+        for (int c = 0; c < ChannelSteering; c++) snap.pedal[c] = sample.axis[c];
+        snap.speed = static_cast<int16_t>(engine.speed);
+        snap.mode = static_cast<uint8_t>(engine.mode);
+        snap.gear = static_cast<int8_t>(engine.vehicle.gear);
+        snap.sources = 1;
+        const auto c0 = std::chrono::steady_clock::now();
+        snap.t_us = (std::max)(now_us(), i ? published[i - 1].t_us + 1 : 0);    // unique: states are matched by time
+        server.publish(snap);
+        publishNs.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - c0).count());
+    }
+    const double runS = (now_us() - t0) / 1e6;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));     // let the last frames arrive
+    done.store(true);
+    subscriberThread.join();
+
+    uint64_t frames = 0, bytes = 0, states = 0, mismatched = 0;
+    int broken = 0;
+    for (Subscriber& s : subs) {
+        frames += s.frames;
+        bytes += s.bytes;
+        states += s.seen.size();
+        broken += s.broken ? 1 : 0;
+        size_t at = 0;
+        for (const TelemetrySnapshot& st : s.seen) {
+            while (at < published.size() && published[at].t_us < st.t_us) at++;
+            if (at == published.size() || !same_state(published[at], st)) mismatched++;
+        }
+        stats_close_socket(s.socket);
+    }
+
+    printf("%d subscribers at %d Hz, %d Hz published for %.1f s\n", clients, rate, publishHz, runS);
+    printf("received: %llu frames (%.0f/s), %llu bytes (%.1f KB/s), %.1f bytes/frame incl. hello\n",
+        (unsigned long long)frames, frames / runS, (unsigned long long)bytes, bytes / runS / 1024.0,
+        frames ? static_cast<double>(bytes) / frames : 0.0);
+    printf("server: %llu frames sent, %llu skipped (client socket full), %llu publish collisions\n",
+        (unsigned long long)server.frames_sent(), (unsigned long long)server.frames_skipped(),
+        (unsigned long long)server.publish_collisions());
+    printf("publish: mean %.0f ns, p99 %llu ns, max %llu ns\n", publishNs.mean(),
+        (unsigned long long)publishNs.percentile(99), (unsigned long long)publishNs.maximum());
+    printf("publish -> decode: p50 %llu us, p99 %llu us, max %llu us\n", (unsigned long long)latencyUs.percentile(50),
+        (unsigned long long)latencyUs.percentile(99), (unsigned long long)latencyUs.maximum());
+    printf("consistency: %llu states, %llu mismatched, %d broken streams: %s\n", (unsigned long long)states,
+        (unsigned long long)mismatched, broken, mismatched == 0 && broken == 0 ? "ok" : "FAILED");
+    server.stop();
+    return mismatched == 0 && broken == 0 ? 0 : 1;
+}
@@ -24,6 +24,10 @@
  #pragma comment: links gdi+ at build time
 */
 #define NOMINMAX
+#include "stats_endpoint.h"      // winsock2.h has to come before windows.h
+#include "reactor.h"
+#include "telemetry_server.h"
+#include "xcp_server.h"
 #include <windows.h>
 #include <gdiplus.h>
 #include <cstdio>
@@ -33,21 +37,32 @@
 #include <mutex>
 #include <algorithm>   // std::max
 #include <cstring>     // memcpy
-#include "debounce.h"
+#include <string>
+#include "hid_device.h"
+#include "device_router.h"
+#include "pedal_engine.h"
+#include "response_curve.h"
+#include "runtime_config.h"
+#include "raw_input_thread.h"
+#include "spsc_queue.h"
+#include "latency_histogram.h"
+#include "latency_trace.h"
+#include "lifecycle.h"
+#include "speed_history.h"
+#include "maneuver_source.h"
+#include "session_recorder.h"
+#include "shared_pedals.h"
+#include "thread_policy.h"
+#include "timing.h"
 #include "simplexcp.h"
-// #include "xcp_server.h"
 #include "a2l_generator.h"
 #pragma comment (lib,"Gdiplus.lib")
 
 // UI message for thread -> UI
 #define WM_SPEED_UPDATE (WM_APP + 1)
+#define WM_INPUT_SAMPLES (WM_APP + 2)    // input thread queued processed samples
 
-// global vars
-enum DriveMode {
-    Static,
-    Dynamic
-};
-
+// global vars: merged view of the router, refreshed after every report and tick
 DriveMode mode = Static;
 int pAccelCount = 0;
 
@@ -59,11 +74,7 @@ int middlePedalPressure = 0;
 int rightPedalPressure = 0;
 int rMiddlePedalPressure = 0;    // the 'r' prefix indicates raw pressure values that are not normalized. 
 int rRightPedalPressure = 0;
-
-// debounce globals
-Debounce lpDebounce(1000);  // 1 second debounce
-Debounce mpDebounce(500);   // 0.5 second debounce
-Debounce rpDebounce(1000);  // 1 second debounce for right pedal
+int gear = 0;
 
 // Thread control
 static std::atomic<bool> g_speedThreadRunning{ false };
@@ -72,16 +83,62 @@ static std::mutex g_speedMutex;
 
 // speed history
 BYTE rawData[8] = { 0 };  // stores the latest 8 bytes of raw HID input
-const int SPEED_HISTORY_SIZE = 100;
-int speedHistory[SPEED_HISTORY_SIZE] = { 0 };
-int speedIndex = 0;
-
-// file-scope constant used by WM_PAINT and other functions
-constexpr int maxSpeed = 300;
+// every ui.history_ms (100 ms) and on each speed change; the graph shows the peak of
+// each bar's share, ui.history_bars bars
+SpeedHistory<1000> g_speedHistory;
+
+// fanatec.cfg: engine, edge and UI settings, reloaded when the file changes. Every report,
+// tick and paint reads one snapshot through an atomic pointer; ports are taken at start.
+static RuntimeConfigStore g_config;
+static const char* const g_configFile = "fanatec.cfg";
+static const RuntimeConfig* g_startupConfig = nullptr;     // the snapshot the ports were opened with
+
+// policy and wake-up latency of the input, tick, XCP and recorder threads (thread.* in
+// fanatec.cfg); served on the stats endpoint after g_trace
+static ThreadMonitor g_threads;
+static ThreadStats* g_threadStats[ThreadRoleCount] = {};
+
+// input routing: one slot (plan, engine state, stats) per attached device.
+// Owned by the input thread; the speed thread ticks the engines under g_routerMutex.
+DeviceRouter g_router;
+static std::mutex g_routerMutex;
+
+// pedal noise filter and response curves, applied by g_router; F5 reloads both files
+static PedalResponse g_response;
+static const char* const g_curveFile = "pedal_curves.cfg";
+static const char* const g_filterFile = "pedal_filter.cfg";
+
+// input thread -> UI: processed samples, drained on WM_INPUT_SAMPLES
+struct ProcessedInput {
+    VehicleInput input;
+    BYTE raw[8];
+    bool hasRaw;
+    bool speedChanged;
+    int64_t receivedUs;
+    LatencyTag trace;
+};
 
-// edge detection vars
-int rpEdge = 0;            // the 'rp' prefix indicates right pedal
-int mpEdge = 0;
+static RawInputThread g_inputThread;
+static ManeuverSource g_maneuver;      // replaces g_inputThread when FANATEC_MANEUVER is set
+static SpscQueue<ProcessedInput, 256> g_inputQueue;
+static std::atomic<bool> g_uiWakePending{ false };
+static std::atomic<uint64_t> g_inputDropped{ 0 };
+static SpscQueue<EdgeEvent, 256> g_edgeQueue;     // pedal presses/releases, input thread -> UI
+static std::atomic<uint64_t> g_edgeDropped{ 0 };
+static uint64_t g_edgeCount = 0;                  // UI thread
+static EdgeEvent g_lastEdge;
+static HWND g_hwnd = NULL;
+
+LatencyHistogram g_inputLatency;   // WM_INPUT picked up -> sample queued, in microseconds
+LatencyHistogram g_queueDepth;     // queue depth seen by each push
+LatencyTrace g_trace;              // per stage, recorded when the UI picks a sample up
+static StatsEndpoint g_statsEndpoint;   // g_trace as text on localhost:5556
+static SessionRecorder g_session;       // every report and XCP update, when FANATEC_SESSION is set
+static Reactor g_network;               // the socket servers' tasks, on one thread
+static TelemetryServer g_telemetry;     // vehicle state for dashboards on localhost:5558
+static XcpServer g_xcpServer;           // XCP on TCP for ControlDesk, port 5555
+static SharedPedalWriter g_shared;      // raw reports and vehicle state for local processes (FanatecPedals)
+static Lifecycle g_lifecycle;           // the above and the threads: started on WM_CREATE, stopped in reverse on WM_DESTROY
 
 // gdi globals
 Gdiplus::Font* g_pFont = nullptr;
@@ -93,40 +150,77 @@ Gdiplus::SolidBrush* g_pTextBrush = nullptr;
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 void SpeedThreadProc(HWND hwnd);
 void StartSpeedThread(HWND hwnd);
+void SetupThreads(const RuntimeConfig& startup);
 void StopSpeedThread();
 void InitializeGDIObjects();
 void CleanupGDIObjects();
 void HandleWMCreate(HWND hwnd);
 void HandleWMDestroy();
+void AddStages();
 void HandleWMPaint(HWND hwnd);
-void HandleWMInput(HWND hwnd, LPARAM lParam);
-void ProcessLeftPedal(const BYTE* data);
-void ProcessRightPedal(const BYTE* data);
-void ProcessMiddlePedal(const BYTE* data);
-void DrawSpeedGauge(Gdiplus::Graphics& g);
-void DrawSpeedHistoryGraph(Gdiplus::Graphics& g, int w, int h, Gdiplus::Font* font2, Gdiplus::SolidBrush* wTextBrush);
+bool StartManeuver();
+void LoadPedalConfig();
+void RequestDriveMode(WPARAM key);
+void OnInputReport(HANDLE device, const BYTE* data, UINT size, int64_t receivedUs);
+void OnInputDevice(HANDLE device, bool arrived);
+void PublishInput(const ProcessedInput& sample);
+void PublishVehicleState(const VehicleInput& input);
+void DrainInputQueue(HWND hwnd);
+void ApplyVehicleInput(const VehicleInput& input);
+void DrawSpeedGauge(Gdiplus::Graphics& g, int maxSpeed);
+void DrawSpeedHistoryGraph(Gdiplus::Graphics& g, int w, int h, Gdiplus::Font* font2, Gdiplus::SolidBrush* wTextBrush,
+    const int* bars, int barCount, int maxSpeed);
 void DrawOdometer(Gdiplus::Graphics& g, Gdiplus::SolidBrush* wTextBrush);
 void DrawRawDataPanel(Gdiplus::Graphics& g);
+void DrawDevicePanel(Gdiplus::Graphics& g);
 void DrawPedalBars(Gdiplus::Graphics& g, Gdiplus::Font* font, Gdiplus::SolidBrush* wTextBrush);
 void DrawModeAndSpeed(Gdiplus::Graphics& g, Gdiplus::Font* font, Gdiplus::SolidBrush* wTextBrush);
 
 void SpeedThreadProc(HWND hwnd)
 {
-    g_speedThreadRunning.store(true);
-    const DWORD tickMs = 100;        // update every 100 ms
-    const int decrementPerTick = 1;  // how much speed falls per tick
+    ThreadStats& tick = *g_threadStats[ThreadTick];
+    tick.apply();
+    const RuntimeConfig& first = g_config.current();
+    PedalTickSchedule schedule;      // at most 10 steps per wake-up after a stall
+    schedule.start(now_us(), first.engine);
+    int64_t nextHistory = schedule.next_us + first.ui.history_ms * 1000;
 
     while (g_speedThreadRunning.load()) {
-        Sleep(tickMs);
+        // a reload takes effect from the next step
+        const RuntimeConfig& settings = g_config.current();
+        const PedalEngineConfig& cfg = settings.engine;                 // fixed model step (engine.tick_ms, 10 ms)
+        const int64_t historyUs = settings.ui.history_ms * 1000;       // history/UI update (ui.history_ms, 100 ms)
+        tick.sleep_until(schedule.next_us);
+
+        // run as many fixed steps as wall time says are due, so speed follows real time
+        // even when the wake-up comes late
+        const int64_t now = now_us();
+        const int steps = schedule.due(now, cfg);
+        if (steps == 0) continue;
+
+        VehicleInput merged;
+        {
+            std::lock_guard<std::mutex> lock(g_routerMutex);
+            for (int i = 0; i < steps; i++) g_router.tick_engines(cfg);
+            merged = g_router.merge();
+        }
+        xcp_update_variables(pedal_level8(merged.pedals, ChannelBrake), pedal_level8(merged.pedals, ChannelThrottle),
+            merged.engine.speed, merged.engine.mode);
+        if (g_session.is_open()) {
+            g_session.record(session_row(SessionXcpTx, now_us(), merged.pedals, merged.engine.speed, merged.engine.mode));
+        }
+        PublishVehicleState(merged);
+
+        if (now < nextHistory) continue;
+        nextHistory += historyUs;
+        if (nextHistory <= now) nextHistory = now + historyUs;
+        xcp_update_latency(g_trace);
 
         {
             std::lock_guard<std::mutex> lock(g_speedMutex);
-            if (mode == Dynamic) {
-                pAccelCount = std::max(0, pAccelCount - decrementPerTick);
-            }
+            ApplyVehicleInput(merged);
 
-            speedIndex = (speedIndex + 1) % SPEED_HISTORY_SIZE;
-            speedHistory[speedIndex] = pAccelCount;
+            g_speedHistory.push(pAccelCount);
         }
 
         PostMessage(hwnd, WM_SPEED_UPDATE, 0, 0);
@@ -136,6 +230,8 @@ void SpeedThreadProc(HWND hwnd)
 void StartSpeedThread(HWND hwnd)
 {
     if (g_speedThread.joinable()) return;
+    // set before the thread exists, so a stop right after this start still ends it
+    g_speedThreadRunning.store(true);
     g_speedThread = std::thread([hwnd]() { SpeedThreadProc(hwnd); });
 }
 
@@ -163,17 +259,180 @@ void CleanupGDIObjects()
 
 void HandleWMCreate(HWND hwnd)
 {
+    g_hwnd = hwnd;
     InitializeGDIObjects();
-    StartSpeedThread(hwnd);
+    g_router.set_response(&g_response);
+    LoadPedalConfig();
+    g_startupConfig = &g_config.current();
+    SetupThreads(*g_startupConfig);
+    AddStages();
+    std::string error;
+    if (!g_lifecycle.start(&error)) {
+        std::wstring msg(error.begin(), error.end());
+        OutputDebugString((L"Not started: " + msg + L"\n").c_str());
+    }
+    for (const Lifecycle::Stage& stage : g_lifecycle.stages()) {
+        if (stage.state != LifecycleState::Failed) continue;
+        const std::string line = stage.name + " not started: " + stage.error + "\n";
+        OutputDebugString(std::wstring(line.begin(), line.end()).c_str());
+    }
+}
+
+// What WM_CREATE starts, each after what it needs: the threads that publish come after
+// the recorder, the servers and the shared memory, so on WM_DESTROY they stop before
+// them. Only the speed thread is required; without the others the window still works.
+void AddStages()
+{
+    g_lifecycle.add("config", {}, [](std::string*) {
+            return g_config.watch(g_configFile, [](const RuntimeConfig& cfg, const std::string& error) {
+                if (!error.empty()) {
+                    std::wstring msg(error.begin(), error.end());
+                    OutputDebugString((L"fanatec.cfg not reloaded: " + msg + L"\n").c_str());
+                }
+                else if (RuntimeConfig::startup_differs(cfg, *g_startupConfig)) {
+                    OutputDebugString(L"fanatec.cfg: the ports change at the next start\n");
+                }
+                InvalidateRect(g_hwnd, NULL, FALSE);
+            });
+        }, [] { g_config.unwatch(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    g_lifecycle.add("xcp", {}, [](std::string*) {
+            xcp_init(g_threadStats[ThreadXcp]);
+            return true;
+        }, [] { xcp_cleanup(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    g_lifecycle.add("session", {}, [](std::string* error) {
+            return g_session.open_from_environment(now_us(), error) || error->empty();   // unset: nothing to record
+        }, [] { g_session.close(); }, 2000000, Lifecycle::Optional);   // flushes the mapped chunks
+    g_lifecycle.add("shared", {}, [](std::string* error) { return g_shared.open(shared_pedals::DefaultName, error); },
+        [] { g_shared.close(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    g_lifecycle.add("stats", {}, [](std::string* error) {
+            if (g_statsEndpoint.start([]() { return g_trace.report() + "\n" + g_threads.report(); },
+                    RuntimeConfig::port_or(g_startupConfig->stats_port, StatsEndpoint::DefaultPort))) return true;
+            *error = "port in use? see stats.port";
+            return false;
+        }, [] { g_statsEndpoint.stop(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    g_lifecycle.add("network", {}, [](std::string*) { return g_network.start(g_threadStats[ThreadNetwork]); },
+        [] { g_network.stop(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    g_lifecycle.add("telemetry", { "network" }, [](std::string* error) {
+            if (g_telemetry.start(g_network, RuntimeConfig::port_or(g_startupConfig->telemetry_port, TelemetryServer::DefaultPort))) return true;
+            *error = "port in use? see telemetry.port";
+            return false;
+        }, [] { g_telemetry.stop(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    g_lifecycle.add("xcp server", { "network" }, [](std::string* error) {
+            if (g_xcpServer.start(g_network, RuntimeConfig::port_or(g_startupConfig->xcp_port, XcpServer::DefaultPort))) return true;
+            *error = "port in use? see xcp.port";
+            return false;
+        }, [] { g_xcpServer.stop(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+    g_lifecycle.add("speed", { "xcp", "session", "shared", "telemetry" }, [](std::string*) {
+            StartSpeedThread(g_hwnd);
+            return true;
+        }, [] { StopSpeedThread(); });
+    g_lifecycle.add("input", { "speed" }, [](std::string* error) {
+            if (StartManeuver() || g_inputThread.start(OnInputReport, OnInputDevice, g_threadStats[ThreadInput])) return true;
+            *error = "failed to start the raw input thread";
+            return false;
+        },
+        [] {
+            g_maneuver.stop();
+            g_inputThread.stop();
+        }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+}
+
+// Registers the threads with their policies from fanatec.cfg; each applies its own when
+// it starts. Also the process-wide part: 1 ms timers and, with thread.lock_memory, RAM.
+void SetupThreads(const RuntimeConfig& startup)
+{
+    static const ThreadRole roles[] = { ThreadInput, ThreadTick, ThreadXcp, ThreadRecorder, ThreadNetwork };
+    for (ThreadRole r : roles) g_threadStats[r] = &g_threads.add(thread_role_name(r), startup.threads[r]);
+    g_session.set_thread(g_threadStats[ThreadRecorder]);
+
+    thread_policy_fine_timer();
+    std::string error;
+    if (startup.lock_memory && !thread_policy_lock_memory(&error)) {
+        std::wstring msg(error.begin(), error.end());
+        OutputDebugString((L"Memory not locked: " + msg + L"\n").c_str());
+    }
+}
+
+// With FANATEC_MANEUVER set, a synthetic pedal set drives the app instead of the raw
+// input thread; its reports take the same OnInputReport path as real ones.
+bool StartManeuver()
+{
+    ManeuverPlan plan;
+    std::string error;
+    if (!ManeuverPlan::from_environment(plan, &error)) {
+        if (!error.empty()) {
+            std::wstring msg(error.begin(), error.end());
+            OutputDebugString((L"Maneuver plan not loaded, using the pedals: " + msg + L"\n").c_str());
+        }
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_routerMutex);
+        if (!ManeuverSource::attach(g_router)) {
+            OutputDebugString(L"Router full: synthetic pedals not attached, using the pedals\n");
+            return false;
+        }
+    }
+    return g_maneuver.start(plan, [](uint64_t device, const uint8_t* report, size_t size, int64_t receivedUs) {
+        OnInputReport(reinterpret_cast<HANDLE>(static_cast<uintptr_t>(device)), report, static_cast<UINT>(size), receivedUs);
+    });
+}
+
+// Reads the filter, curve and settings files. Curves and settings are swapped in without
+// stopping the input thread; the filter settings are copied under the router lock. A
+// missing or broken file leaves the current settings in place (unfiltered, linear and
+// the defaults at start).
+void LoadPedalConfig()
+{
+    std::string error;
+    PedalFilterConfig filter;
+    if (PedalFilterConfig::load(g_filterFile, filter, &error)) {
+        std::lock_guard<std::mutex> lock(g_routerMutex);
+        g_router.set_filter(filter);
+    }
+    else {
+        std::wstring msg(error.begin(), error.end());
+        OutputDebugString((L"Pedal filter not loaded: " + msg + L"\n").c_str());
+    }
+
+    if (!g_response.load(g_curveFile, &error)) {
+        std::wstring msg(error.begin(), error.end());
+        OutputDebugString((L"Response curves not loaded: " + msg + L"\n").c_str());
+    }
+
+    if (!g_config.load(g_configFile, &error)) {
+        std::wstring msg(error.begin(), error.end());
+        OutputDebugString((L"Settings not loaded: " + msg + L"\n").c_str());
+    }
+}
+
+// C = cruise (from dynamic), R = ramp test, T = step test (from static), Esc = cancel.
+// The engines belong to the input thread, so requests go through the router lock.
+void RequestDriveMode(WPARAM key)
+{
+    ModeTrigger request;
+    switch (key) {
+    case 'C': request = TriggerCruise; break;
+    case 'R': request = TriggerRampTest; break;
+    case 'T': request = TriggerStepTest; break;
+    case VK_ESCAPE: request = TriggerCancel; break;
+    default: return;
+    }
+    std::lock_guard<std::mutex> lock(g_routerMutex);
+    g_router.request_mode(request);
 }
 
 void HandleWMDestroy()
 {
+    // the threads that post to this window are joined before the GDI objects go, and the
+    // samples they queued are applied so the last state reaches the trace
+    const bool inTime = g_lifecycle.stop();
+    DrainInputQueue(g_hwnd);
     CleanupGDIObjects();
-    StopSpeedThread();
-    // g_xcp_server.stop();
     PostQuitMessage(0);
-    xcp_cleanup();
+    thread_policy_coarse_timer();
+    const std::string report = std::string(inTime ? "Stopped" : "Stopped, not all in time") + ":\n" + g_lifecycle.report();
+    OutputDebugString(std::wstring(report.begin(), report.end()).c_str());
 }
 
 void DrawPedalBars(Gdiplus::Graphics& g, Gdiplus::Font* font, Gdiplus::SolidBrush* wTextBrush)
@@ -212,7 +471,7 @@ void DrawPedalBars(Gdiplus::Graphics& g, Gdiplus::Font* font, Gdiplus::SolidBrus
 void DrawModeAndSpeed(Gdiplus::Graphics& g, Gdiplus::Font* font, Gdiplus::SolidBrush* wTextBrush)
 {
     wchar_t modeBuf[64];
-    swprintf_s(modeBuf, sizeof(modeBuf) / sizeof(modeBuf[0]), L"Mode: %s", (mode == Static) ? L"Static" : L"Dynamic");
+    swprintf_s(modeBuf, sizeof(modeBuf) / sizeof(modeBuf[0]), L"Mode: %S", drive_mode_name(mode));
     g.DrawString(modeBuf, -1, font, Gdiplus::PointF(40.0f, 170.0f), wTextBrush);
 
     wchar_t speedBuf[64];
@@ -220,7 +479,7 @@ void DrawModeAndSpeed(Gdiplus::Graphics& g, Gdiplus::Font* font, Gdiplus::SolidB
     g.DrawString(speedBuf, -1, font, Gdiplus::PointF(40.0f, 200.0f), wTextBrush);
 }
 
-void DrawSpeedGauge(Gdiplus::Graphics& g)
+void DrawSpeedGauge(Gdiplus::Graphics& g, int maxSpeed)
 {
     int gaugeX = 200;
     int gaugeY = 200;
@@ -253,7 +512,8 @@ void DrawSpeedGauge(Gdiplus::Graphics& g)
     g.DrawString(gaugeText, -1, &gaugeFont, textRect, &format, &gaugeTextBrush);
 }
 
-void DrawSpeedHistoryGraph(Gdiplus::Graphics& g, int w, int h, Gdiplus::Font* font2, Gdiplus::SolidBrush* wTextBrush)
+void DrawSpeedHistoryGraph(Gdiplus::Graphics& g, int w, int h, Gdiplus::Font* font2, Gdiplus::SolidBrush* wTextBrush,
+    const int* bars, int barCount, int maxSpeed)
 {
     int uiLeftMargin = 40;
     int labelAreaWidth = 120;
@@ -266,7 +526,7 @@ void DrawSpeedHistoryGraph(Gdiplus::Graphics& g, int w, int h, Gdiplus::Font* fo
     float desiredBarSpacing = 7.5f;
     float availableWidth = static_cast<float>(bgWidth);
 
-    float totalDesired = SPEED_HISTORY_SIZE * desiredBarWidth + (SPEED_HISTORY_SIZE - 1) * desiredBarSpacing;
+    float totalDesired = barCount * desiredBarWidth + (barCount - 1) * desiredBarSpacing;
     float barWidth = desiredBarWidth;
     float barSpacing = desiredBarSpacing;
     if (totalDesired > availableWidth) {
@@ -303,10 +563,9 @@ void DrawSpeedHistoryGraph(Gdiplus::Graphics& g, int w, int h, Gdiplus::Font* fo
     Gdiplus::Pen speedBarOutline(Gdiplus::Color(255, 0, 120, 200), 1.0f);
     float maxRight = innerX + innerWidth;
 
-    for (int i = 0; i < SPEED_HISTORY_SIZE; ++i) {
-        int histIndex = (speedIndex + i) % SPEED_HISTORY_SIZE;
+    for (int i = 0; i < barCount; ++i) {
         float barX = innerX + i * (barWidth + barSpacing);
-        float barH = (speedHistory[histIndex] * innerHeight) / static_cast<float>(maxSpeed);
+        float barH = (bars[i] * innerHeight) / static_cast<float>(maxSpeed);
         float barY = innerY + innerHeight - barH;
 
         float drawW = barWidth;
@@ -363,92 +622,88 @@ void DrawRawDataPanel(Gdiplus::Graphics& g)
     }
 }
 
-void ProcessLeftPedal(const BYTE* data)
+void DrawDevicePanel(Gdiplus::Graphics& g)
 {
-    if (data[6] > 0) {
-        leftPedalPressed = true;
-        if (data[6] > 14 && lpDebounce.isReady()) {
-            if (mode == Static) {
-                mode = Dynamic;
-            }
-            else if (mode == Dynamic) {
-                mode = Static;
-                pAccelCount = 0;
-            }
-            lpDebounce.mark();
-        }
-    }
-    else {
-        leftPedalPressed = false;
-    }
-}
+    const int boxX = 1000;
+    const int boxY = 220;
+    const int padding = 12;
+    const int lineHeight = 20;
+    const int boxW = 260;
 
-void ProcessRightPedal(const BYTE* data)
-{
-    if (data[2] > 0) {
-        rightPedalPressed = true;
-        if (mode == Static) {
-            if (data[2] > 13 && rpEdge < 2) {
-                rpEdge++;
-                pAccelCount += 10;
-                speedHistory[speedIndex] = pAccelCount;
-                speedIndex = (speedIndex + 1) % SPEED_HISTORY_SIZE;
-            }
-        }
-        else if (mode == Dynamic) {
-            if (pAccelCount < 300) {
-                pAccelCount = pAccelCount + (rightPedalPressure / 5);
-            }
-            if (rightPedalPressure < 2) {
-                pAccelCount = pAccelCount + 1;
-            }
-            speedHistory[speedIndex] = pAccelCount;
-            speedIndex = (speedIndex + 1) % SPEED_HISTORY_SIZE;
+    Gdiplus::SolidBrush boxBrush(Gdiplus::Color(255, 30, 30, 30));
+    Gdiplus::SolidBrush whiteBrush(Gdiplus::Color(255, 255, 255, 255));
+    Gdiplus::Font devFont(L"Courier New", 10);
+
+    // copy what is shown so the input thread is only held up for the copy
+    struct DeviceLine { DeviceRole role; double rate; double latency; };
+    DeviceLine devices[DeviceRouter::MaxDevices];
+    int deviceCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(g_routerMutex);
+        for (int i = 0; i < g_router.count(); i++) {
+            const DeviceSlot& slot = g_router.slot(i);
+            if (!slot.handle) continue;
+            devices[deviceCount].role = slot.role;
+            devices[deviceCount].rate = slot.stats.rate_hz();
+            devices[deviceCount].latency = slot.stats.latency_avg_us;
+            deviceCount++;
         }
     }
-    else {
-        rightPedalPressed = false;
-        rpEdge = 0;
+
+    const int lines = deviceCount + 5;
+    const int boxH = padding * 2 + lines * lineHeight;
+    g.FillRectangle(&boxBrush, boxX, boxY, boxW, boxH);
+
+    auto DrawLine = [&](int line, const wchar_t* text) {
+        g.DrawString(text, -1, &devFont, Gdiplus::PointF(static_cast<Gdiplus::REAL>(boxX + padding),
+            static_cast<Gdiplus::REAL>(boxY + padding + line * lineHeight)), &whiteBrush);
+        };
+
+    wchar_t buf[96];
+    swprintf_s(buf, 96, L"Devices (gear %d)", gear);
+    DrawLine(0, buf);
+
+    for (int i = 0; i < deviceCount; i++) {
+        swprintf_s(buf, 96, L"%-7S %5.0f Hz %5.0f us", device_role_name(devices[i].role),
+            devices[i].rate, devices[i].latency);
+        DrawLine(i + 1, buf);
     }
+
+    swprintf_s(buf, 96, L"Input p50 %llu p99 %llu us, to UI p99 %llu us",
+        g_inputLatency.percentile(50), g_inputLatency.percentile(99), g_trace.total().percentile(99));
+    DrawLine(deviceCount + 1, buf);
+    swprintf_s(buf, 96, L"Queue max %llu dropped %llu",
+        g_queueDepth.maximum(), g_inputDropped.load());
+    DrawLine(deviceCount + 2, buf);
+    if (g_response.generation() == 0) swprintf_s(buf, 96, L"Curves linear (F5 loads)");
+    else swprintf_s(buf, 96, L"Curves generation %llu", g_response.generation());
+    DrawLine(deviceCount + 3, buf);
+    swprintf_s(buf, 96, L"Edges %llu (%S) dropped %llu", g_edgeCount, edge_event_name(g_lastEdge),
+        g_edgeDropped.load());
+    DrawLine(deviceCount + 4, buf);
 }
 
-void ProcessMiddlePedal(const BYTE* data)
+void ApplyVehicleInput(const VehicleInput& input)
 {
-    if (data[4] > 0) {
-        middlePedalPressed = true;
-        if (data[4] > 30 && mpDebounce.isReady()) {
-            if (mode == Static) {
-                mpEdge++;
-                if (mpEdge < 2) {
-                    pAccelCount -= 20;
-                    speedHistory[speedIndex] = pAccelCount;
-                    speedIndex = (speedIndex + 1) % SPEED_HISTORY_SIZE;
-                }
-            }
-            else if (mode == Dynamic) {
-                pAccelCount -= (middlePedalPressure * 2);
-                speedHistory[speedIndex] = pAccelCount;
-                speedIndex = (speedIndex + 1) % SPEED_HISTORY_SIZE;
-            }
-            mpDebounce.mark();
-        }
-    }
-    else {
-        middlePedalPressed = false;
-        mpEdge = 0;
-    }
+    mode = input.engine.mode;
+    pAccelCount = input.engine.speed;
+    leftPedalPressed = input.engine.left_pressed;
+    rightPedalPressed = input.engine.right_pressed;
+    middlePedalPressed = input.engine.middle_pressed;
+    rightPedalPressure = pedal_level8(input.pedals, ChannelThrottle);
+    middlePedalPressure = pedal_level8(input.pedals, ChannelBrake);
+    gear = input.gear;
 }
 
 void HandleWMPaint(HWND hwnd)
 {
+    const UiSettings& ui = g_config.current().ui;     // one snapshot for the whole paint
     int localSpeed = 0;
-    int localIndex = 0;
-    int localHistory[SPEED_HISTORY_SIZE];
+    int localBars[RuntimeConfig::MaxHistoryBars];
     {
         std::lock_guard<std::mutex> lock(g_speedMutex);
         localSpeed = pAccelCount;
-        localIndex = speedIndex;
-        std::memcpy(localHistory, speedHistory, sizeof(speedHistory));
+        g_speedHistory.decimate(localBars, ui.history_bars);
     }
 
     PAINTSTRUCT ps;
@@ -470,10 +725,11 @@ void HandleWMPaint(HWND hwnd)
 
     DrawPedalBars(g, font, wTextBrush);
     DrawModeAndSpeed(g, font, wTextBrush);
-    DrawSpeedGauge(g);
-    DrawSpeedHistoryGraph(g, w, h, font2, wTextBrush);
+    DrawSpeedGauge(g, ui.gauge_max);
+    DrawSpeedHistoryGraph(g, w, h, font2, wTextBrush, localBars, ui.history_bars, ui.gauge_max);
     DrawOdometer(g, wTextBrush);
     DrawRawDataPanel(g);
+    DrawDevicePanel(g);
 
     BitBlt(hdc, 0, 0, w, h, memDC, 0, 0, SRCCOPY);
 
@@ -490,43 +746,138 @@ void HandleWMPaint(HWND hwnd)
     EndPaint(hwnd, &ps);
 }
 
-void HandleWMInput(HWND hwnd, LPARAM lParam)
+// Runs on the input thread for every HID report.
+void OnInputReport(HANDLE device, const BYTE* data, UINT size, int64_t receivedUs)
 {
-    UINT dwSize;
-    GetRawInputData((HRAWINPUT)lParam, RID_INPUT, NULL, &dwSize, sizeof(RAWINPUTHEADER));
-    BYTE* lpb = new BYTE[dwSize];
-    if (lpb == NULL) return;
+    ProcessedInput out;
+    out.trace.begin(receivedUs);
+    {
+        std::lock_guard<std::mutex> lock(g_routerMutex);
+        DeviceSlot* slot = HidDevices::route(g_router, device, data, size, receivedUs);
+        if (!slot) return;
+        out.trace.stamp(StageDecode);
+
+        out.hasRaw = slot->role == RolePedals;
+        if (out.hasRaw) {
+            memset(out.raw, 0, sizeof(out.raw));
+            memcpy(out.raw, data, std::min(size, 8u));
+        }
 
-    if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, lpb, &dwSize, sizeof(RAWINPUTHEADER)) == dwSize) {
-        RAWINPUT* raw = (RAWINPUT*)lpb;
+        if (slot->role == RolePedals) xcp_update_filter(slot->filter);
 
-        if (raw->header.dwType == RIM_TYPEHID) {
-            BYTE* data = raw->data.hid.bRawData;
-            UINT size = raw->data.hid.dwSizeHid;
+        out.speedChanged = false;
+        if (slot->role != RoleShifter) {
+            EdgeEvents edges;
+            out.speedChanged = pedal_engine_process(slot->engine, slot->sample, receivedUs, g_config.current().engine, &edges);
+            if (slot->role == RolePedals) {
+                for (const EdgeEvent& e : edges) {
+                    if (!g_edgeQueue.try_push(e)) g_edgeDropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            out.trace.stamp(StageEngine);
+        }
+        if (slot->role == RolePedals) {
+            PedalSample raw = slot->sample;
+            for (int c = 0; c < ChannelSteering; c++) raw.axis[c] = slot->filter.pedal[c].in;
+            g_shared.push(raw, receivedUs);
+            if (g_session.is_open()) {
+                g_session.record(session_row(SessionReport, receivedUs, slot->sample, slot->engine.speed, slot->engine.mode,
+                    raw.axis));
+            }
+        }
+        out.input = g_router.merge();
+        out.receivedUs = receivedUs;
+        DeviceRouter::record_latency(*slot, now_us() - receivedUs);
+    }
 
-            memset(rawData, 0, sizeof(rawData));
-            memcpy(rawData, data, std::min(size, 8u));
+    const VehicleInput& in = out.input;
+    xcp_update_variables(pedal_level8(in.pedals, ChannelBrake), pedal_level8(in.pedals, ChannelThrottle),
+        in.engine.speed, in.engine.mode);
+    PublishVehicleState(in);
+    out.trace.stamp(StagePublish);
+
+    PublishInput(out);
+}
+
+void OnInputDevice(HANDLE device, bool arrived)
+{
+    std::lock_guard<std::mutex> lock(g_routerMutex);
+    if (arrived) {
+        if (!HidDevices::attach(g_router, device)) OutputDebugString(L"Router full: device ignored\n");
+    }
+    else {
+        HidDevices::detach(g_router, device);
+    }
+}
 
-            ProcessLeftPedal(data);
-            ProcessRightPedal(data);
-            ProcessMiddlePedal(data);
+void PublishInput(const ProcessedInput& sample)
+{
+    g_queueDepth.record(static_cast<int64_t>(g_inputQueue.size()));
+    if (!g_inputQueue.try_push(sample)) {
+        g_inputDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    g_inputLatency.record(now_us() - sample.receivedUs);
 
-            rightPedalPressure = data[2];
-            middlePedalPressure = data[4];
+    // one wake-up per batch: the UI clears the flag before it drains
+    if (!g_uiWakePending.exchange(true)) {
+        PostMessage(g_hwnd, WM_INPUT_SAMPLES, 0, 0);
+    }
+}
 
-            InvalidateRect(hwnd, NULL, TRUE);
+// Input and speed threads, to dashboards and to the shared memory channel; neither
+// publish() blocks, a collision just drops this state.
+void PublishVehicleState(const VehicleInput& input)
+{
+    TelemetrySnapshot s;
+    s.t_us = now_us();
+    for (int c = 0; c < ChannelSteering; c++) s.pedal[c] = input.pedals.axis[c];
+    s.speed = static_cast<int16_t>(input.engine.speed);
+    s.mode = static_cast<uint8_t>(input.engine.mode);
+    s.gear = static_cast<int8_t>(input.gear);
+    s.sources = static_cast<uint8_t>(input.sources);
+    g_telemetry.publish(s);
+
+    SharedPedalState shared;
+    shared.t_us = s.t_us;
+    memcpy(shared.pedal, input.pedals.axis, sizeof(shared.pedal));
+    shared.buttons = input.pedals.buttons;
+    shared.speed = s.speed;
+    shared.mode = s.mode;
+    shared.gear = s.gear;
+    shared.sources = s.sources;
+    g_shared.publish(shared);
+}
 
-            xcp_update_variables(middlePedalPressure, rightPedalPressure, pAccelCount, (mode == Static) ? 0 : 1);
+void DrainInputQueue(HWND hwnd)
+{
+    g_uiWakePending.store(false);
 
-            for (UINT i = 0; i < size; i++) {
-                wchar_t byteStr[16];
-                swprintf(byteStr, 16, L"%d ", data[i]);
-                OutputDebugString(byteStr);
+    ProcessedInput sample;
+    bool any = false;
+    const int64_t drainedUs = now_us();
+    {
+        std::lock_guard<std::mutex> lock(g_speedMutex);
+        while (g_inputQueue.try_pop(sample)) {
+            any = true;
+            sample.trace.stamp(StageTransmit, drainedUs);
+            g_trace.record(sample.trace);
+            ApplyVehicleInput(sample.input);
+            if (sample.hasRaw) memcpy(rawData, sample.raw, sizeof(rawData));
+            if (sample.speedChanged) {
+                g_speedHistory.push(pAccelCount);
             }
-            OutputDebugString(L"\n");
         }
     }
-    delete[] lpb;
+
+    // edges ride their own queue; the input sample that carried them wakes us up
+    EdgeEvent edge;
+    while (g_edgeQueue.try_pop(edge)) {
+        g_lastEdge = edge;
+        g_edgeCount++;
+    }
+
+    if (any) InvalidateRect(hwnd, NULL, TRUE);
 }
 
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
@@ -545,8 +896,17 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     case WM_PAINT:
         HandleWMPaint(hwnd);
         return 0;
-    case WM_INPUT:
-        HandleWMInput(hwnd, lParam);
+    case WM_INPUT_SAMPLES:
+        DrainInputQueue(hwnd);
+        return 0;
+    case WM_KEYDOWN:
+        if (wParam == VK_F5) {
+            LoadPedalConfig();
+            InvalidateRect(hwnd, NULL, FALSE);
+        }
+        else {
+            RequestDriveMode(wParam);
+        }
         return 0;
     }
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
@@ -575,21 +935,28 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
         NULL, NULL, hInstance, NULL
     );
 
-    xcp_init();
-
     A2LGenerator a2l_gen;
     a2l_gen.add_variable("brake_raw", "Brake Pedal Raw Value", "UBYTE");
     a2l_gen.add_variable("throttle_raw", "Throttle Pedal Raw Value", "UBYTE");
     a2l_gen.add_variable("vehicle_speed", "Vehicle Speed", "UWORD");
-    a2l_gen.add_variable("drive_mode", "Drive Mode", "UBYTE");
+    a2l_gen.add_variable("drive_mode", "Drive Mode", "UBYTE", DriveModeCount - 1);
+    static const char* const pedals[] = { "throttle", "brake", "clutch" };
+    static const char* const labels[] = { "Throttle", "Brake", "Clutch" };
+    for (int i = 0; i < 3; i++) {
+        const std::string p = pedals[i], l = labels[i];
+        a2l_gen.add_variable(p + "_in", l + " Pedal Filter Input", "UWORD", 65535);
+        a2l_gen.add_variable(p + "_filtered", l + " Pedal Filter Output", "UWORD", 65535);
+        a2l_gen.add_variable(p + "_limited", l + " Pedal Rate Limiter Hits", "ULONG");
+    }
+    for (int i = StageDecode; i < TraceStageCount; i++) {
+        const std::string stage = trace_stage_name(static_cast<TraceStage>(i));
+        a2l_gen.add_variable("latency_" + stage + "_p99", "Latency p99 of the " + stage + " stage in us", "ULONG");
+    }
+    a2l_gen.add_variable("latency_total_p99", "Latency p99 report to UI in us", "ULONG");
+    a2l_gen.add_variable("latency_total_max", "Latency max report to UI in us", "ULONG");
     a2l_gen.generate("fanatec_pedals.a2l");
 
-    RAWINPUTDEVICE rid;
-    rid.usUsagePage = 0x01;
-    rid.usUsage = 0x04;
-    rid.dwFlags = RIDEV_INPUTSINK;
-    rid.hwndTarget = hwnd;
-    RegisterRawInputDevices(&rid, 1, sizeof(rid));
+    // raw input is registered by g_inputThread (started in WM_CREATE) on its own window
 
     if (hwnd == NULL) return 0;
 
@@ -14,7 +14,9 @@ public:
         : project_name_(project_name) {
     }
 
-    void add_variable(const std::string& name, const std::string& description, const std::string& type) {
+    // upper = 0 keeps the type's default range (UBYTE 255, UWORD 300, ULONG 4294967295)
+    void add_variable(const std::string& name, const std::string& description, const std::string& type,
+        unsigned long upper = 0) {
         std::string var_entry = "    /begin CHARACTERISTIC " + name + "\n";
         var_entry += "      \"" + description + "\"\n";
         var_entry += "      VALUE\n";
@@ -24,13 +26,19 @@ public:
             var_entry += "      0\n";
             var_entry += "      " + name + "\n";
             var_entry += "      UBYTE\n";
-            var_entry += "      0 255\n";
+            var_entry += "      0 " + std::to_string(upper ? upper : 255) + "\n";
         }
         else if (type == "UWORD") {
             var_entry += "      0\n";
             var_entry += "      " + name + "\n";
             var_entry += "      UWORD\n";
-            var_entry += "      0 300\n";
+            var_entry += "      0 " + std::to_string(upper ? upper : 300) + "\n";
+        }
+        else if (type == "ULONG") {
+            var_entry += "      0\n";
+            var_entry += "      " + name + "\n";
+            var_entry += "      ULONG\n";
+            var_entry += "      0 " + std::to_string(upper ? upper : 4294967295ul) + "\n";
         }
 
         var_entry += "      ECU_ADDRESS 0x0000\n";
@@ -46,29 +54,34 @@ public:
         variables_.push_back(var_entry);
     }
 
-    bool generate(const std::string& filename) {
-        std::ofstream file(filename);
-        if (!file.is_open()) return false;
-
-        file << "/* generated by SimpleXCP Generator */\n";
-        file << "ASAP2_VERSION 1 71\n\n";
-        file << "/begin PROJECT " << project_name_ << " \"Fanatec Pedal Measurement\"\n\n";
-        file << "  /begin MODULE PedalModule \"Pedal Data Module\"\n\n";
+    // The whole file as text; generate() writes it.
+    std::string text() const {
+        std::string out;
+        out += "/* generated by SimpleXCP Generator */\n";
+        out += "ASAP2_VERSION 1 71\n\n";
+        out += "/begin PROJECT " + project_name_ + " \"Fanatec Pedal Measurement\"\n\n";
+        out += "  /begin MODULE PedalModule \"Pedal Data Module\"\n\n";
 
         // Simple A2ML section
-        file << "    /begin A2ML\n";
-        file << "      // Basic XCP protocol definition\n";
-        file << "    /end A2ML\n\n";
+        out += "    /begin A2ML\n";
+        out += "      // Basic XCP protocol definition\n";
+        out += "    /end A2ML\n\n";
 
         // Add variables
-        file << "    /* Measurement Variables */\n";
+        out += "    /* Measurement Variables */\n";
         for (const auto& var : variables_) {
-            file << var;
+            out += var;
         }
 
-        file << "  /end MODULE\n\n";
-        file << "/end PROJECT\n";
+        out += "  /end MODULE\n\n";
+        out += "/end PROJECT\n";
+        return out;
+    }
 
+    bool generate(const std::string& filename) {
+        std::ofstream file(filename);
+        if (!file.is_open()) return false;
+        file << text();
         file.close();
         return true;
     }
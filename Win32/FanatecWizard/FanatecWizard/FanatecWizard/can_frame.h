@@ -0,0 +1,88 @@
+// can_frame.h - pedal state as a CAN frame, described by a DBC-style signal table
+//
+// The frame the CAN example sends (extended ID 0x100, 8 bytes) is now a signal table
+// instead of hand-written byte stores, so packing, the DBC file and the benchmark share
+// one definition. Signals are unsigned, Intel byte order, raw = value (factor 1).
+//
+// The layout is unchanged on the bus: byte 0 speed, 1 drive mode, 2 throttle, 3 brake,
+// 4..7 zero. Speed keeps its 8-bit field, so values above 255 wrap as before.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+struct CanSignal {
+    const char* name;
+    int start_bit;                  // Intel: bit 0 = LSB of byte 0
+    int length;
+    const char* unit;
+};
+
+struct CanFrame {
+    uint32_t id;
+    bool extended;
+    uint8_t len;
+    uint8_t data[8];
+};
+
+// Writes the low `length` bits of raw at start_bit, leaving the other bits alone.
+inline void can_pack_signal(uint8_t* data, const CanSignal& s, uint64_t raw) {
+    const uint64_t mask = s.length >= 64 ? ~0ull : (1ull << s.length) - 1;
+    uint64_t frame;
+    memcpy(&frame, data, 8);        // little-endian hosts (x86, ARM): the frame is one word
+    frame = (frame & ~(mask << s.start_bit)) | ((raw & mask) << s.start_bit);
+    memcpy(data, &frame, 8);
+}
+
+inline uint64_t can_unpack_signal(const uint8_t* data, const CanSignal& s) {
+    const uint64_t mask = s.length >= 64 ? ~0ull : (1ull << s.length) - 1;
+    uint64_t frame;
+    memcpy(&frame, data, 8);
+    return (frame >> s.start_bit) & mask;
+}
+
+enum PedalStatusSignal {
+    SigSpeed,
+    SigDriveMode,
+    SigThrottle,
+    SigBrake,
+    PedalStatusSignalCount
+};
+
+const uint32_t PedalStatusId = 0x100;
+
+inline const CanSignal* pedal_status_signals() {
+    static const CanSignal signals[PedalStatusSignalCount] = {
+        { "VehicleSpeed", 0, 8, "km/h" },
+        { "DriveMode", 8, 8, "" },
+        { "Throttle", 16, 8, "" },
+        { "Brake", 24, 8, "" },
+    };
+    return signals;
+}
+
+inline CanFrame pack_pedal_status(int speed, int mode, int throttle, int brake) {
+    CanFrame f;
+    f.id = PedalStatusId;
+    f.extended = true;
+    f.len = 8;
+    memset(f.data, 0, sizeof(f.data));
+    const CanSignal* s = pedal_status_signals();
+    can_pack_signal(f.data, s[SigSpeed], static_cast<uint64_t>(speed));
+    can_pack_signal(f.data, s[SigDriveMode], static_cast<uint64_t>(mode));
+    can_pack_signal(f.data, s[SigThrottle], static_cast<uint64_t>(throttle));
+    can_pack_signal(f.data, s[SigBrake], static_cast<uint64_t>(brake));
+    return f;
+}
+
+// The message in DBC syntax, for bus tools; extended IDs carry bit 31 in DBC.
+inline std::string pedal_status_dbc() {
+    std::string out = "BO_ " + std::to_string(PedalStatusId | 0x80000000u) + " PedalStatus: 8 FanatecWizard\n";
+    const CanSignal* s = pedal_status_signals();
+    for (int i = 0; i < PedalStatusSignalCount; i++) {
+        out += " SG_ " + std::string(s[i].name) + " : " + std::to_string(s[i].start_bit) + "|" +
+            std::to_string(s[i].length) + "@1+ (1,0) [0|" + std::to_string((1u << s[i].length) - 1) + "] \"" +
+            s[i].unit + "\" Vector__XXX\n";
+    }
+    return out;
+}
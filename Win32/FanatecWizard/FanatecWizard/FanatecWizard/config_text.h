@@ -0,0 +1,89 @@
+// config_text.h - the "key = value" text format shared by the pedal config files
+//
+// One entry per line, '#' starts a comment, blank lines are skipped. Keys for a single
+// pedal are "<pedal>.<field>" with pedal one of throttle, brake, clutch. Errors come
+// back as "line N: ..." strings so front ends can print them as they are.
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "hid_report.h"
+
+namespace config_text {
+
+inline std::string trim(const std::string& s) {
+    const size_t b = s.find_first_not_of(" \t\r");
+    if (b == std::string::npos) return std::string();
+    return s.substr(b, s.find_last_not_of(" \t\r") - b + 1);
+}
+
+inline bool number(const std::string& s, double& v) {
+    char* end = nullptr;
+    v = strtod(s.c_str(), &end);
+    return end != s.c_str() && *end == '\0';
+}
+
+inline bool fail(std::string* error, int line, const char* what) {
+    if (error) {
+        char buf[160];
+        if (line > 0) snprintf(buf, sizeof(buf), "line %d: %s", line, what);
+        else snprintf(buf, sizeof(buf), "%s", what);
+        *error = buf;
+    }
+    return false;
+}
+
+inline bool read_file(const std::string& path, std::string& text, std::string* error) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        if (error) *error = "cannot open " + path;
+        return false;
+    }
+    text.clear();
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+// Calls set(key, value) for every entry; stops at the first line set() rejects.
+template <typename Set>
+bool for_each_entry(const std::string& text, Set set, std::string* error) {
+    size_t pos = 0;
+    int lineNo = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) end = text.size();
+        std::string line = text.substr(pos, end - pos);
+        pos = end + 1;
+        lineNo++;
+
+        const size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        const size_t eq = line.find('=');
+        const std::string key = trim(line.substr(0, eq));
+        if (key.empty()) continue;
+        if (eq == std::string::npos) return fail(error, lineNo, "expected key = value");
+
+        if (!set(key, trim(line.substr(eq + 1)))) return fail(error, lineNo, ("bad entry '" + key + "'").c_str());
+    }
+    return true;
+}
+
+// Splits "<pedal>.<field>"; returns the pedal channel or -1.
+inline int pedal_key(const std::string& key, std::string& field) {
+    static const char* const names[] = { "throttle", "brake", "clutch" };
+    const size_t dot = key.find('.');
+    if (dot == std::string::npos) return -1;
+    const std::string name = key.substr(0, dot);
+    for (int c = 0; c < ChannelSteering; c++) {
+        if (name == names[c]) {
+            field = key.substr(dot + 1);
+            return c;
+        }
+    }
+    return -1;
+}
+
+}
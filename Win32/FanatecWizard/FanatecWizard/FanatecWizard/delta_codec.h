@@ -0,0 +1,379 @@
+// delta_codec.h - delta + zig-zag + bit-packed blocks for recorded pedal columns
+//
+// A column (one channel, or the timestamps) is cut into blocks of 128 values. Each block
+// stores its first value as the base and the differences between neighbours. The middle
+// of the block's smallest and largest difference is stored once (ref), and each
+// difference minus ref is zig-zag mapped, so small steps either way stay small, and
+// packed in the fewest bits that hold the largest. Slowly moving pedals need 0..4 bits
+// per value instead of 16; timestamps at a steady rate need 0..2 bits instead of 64.
+//
+//   column   count (8) | blocks (4) | block offsets (4 each, from the first block) | blocks
+//   block    width (1) | base (8) | ref (4) | 16 * width bytes of packed deltas
+//            width 0xFF: the 128 values as int64, for blocks whose values span more than
+//            31 bits around the base
+//
+// Packing is vertical over 4 x 32-bit lanes (value i in lane i % 4), as in SIMD-BP128, so
+// one 128-bit load unpacks four neighbouring values and a lane-wise prefix sum rebuilds
+// them. Decoding is AVX2, SSE2 (every x64 CPU) or NEON when the compiler targets them,
+// and a plain loop otherwise; all four produce the same values. AVX2 takes two of those
+// loads per step (eight values) with one unrolled kernel per width, so its shifts and
+// word offsets are constants. The last block is padded by
+// repeating the last value. The offset table gives random access by block.
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DELTA_CODEC_AVX2 1
+#if defined(_MSC_VER)
+#define DELTA_CODEC_UNROLL __forceinline
+#else
+#define DELTA_CODEC_UNROLL inline __attribute__((always_inline))
+#endif
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DELTA_CODEC_SSE2 1
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#include <arm_neon.h>
+#define DELTA_CODEC_NEON 1
+#endif
+
+namespace delta_codec {
+
+const size_t BlockValues = 128;
+const size_t BlockHeader = 13;                  // width + base + ref
+const uint8_t RawWidth = 0xFF;
+const size_t ColumnHeader = 12;                 // count + blocks
+
+inline uint32_t zigzag(int32_t d) { return (static_cast<uint32_t>(d) << 1) ^ static_cast<uint32_t>(d >> 31); }
+inline int32_t unzigzag(uint32_t z) { return static_cast<int32_t>((z >> 1) ^ (0u - (z & 1))); }
+
+inline void put32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }        // little-endian hosts, like can_frame.h
+inline uint32_t get32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+inline void put64(uint8_t* p, int64_t v) { memcpy(p, &v, 8); }
+inline int64_t get64(const uint8_t* p) { int64_t v; memcpy(&v, p, 8); return v; }
+
+inline size_t block_bytes(uint8_t width) {
+    return width == RawWidth ? BlockHeader + BlockValues * 8 : BlockHeader + 16 * width;
+}
+
+// Appends one block of exactly BlockValues values.
+inline void encode_block(const int64_t* v, std::vector<uint8_t>& out) {
+    const int64_t base = v[0];
+    const size_t at = out.size();
+
+    // wrapping 32-bit differences: the decoder's wrapping sums undo them exactly
+    uint32_t d[BlockValues];
+    bool fits = true;
+    int32_t lo = INT32_MAX, hi = INT32_MIN;
+    uint32_t prev = 0;
+    for (size_t i = 0; i < BlockValues && fits; i++) {
+        const int64_t off = v[i] - base;
+        fits = off >= INT32_MIN && off <= INT32_MAX;
+        d[i] = static_cast<uint32_t>(off) - prev;
+        prev = static_cast<uint32_t>(off);
+        if (i > 0) {
+            lo = (std::min)(lo, static_cast<int32_t>(d[i]));
+            hi = (std::max)(hi, static_cast<int32_t>(d[i]));
+        }
+    }
+    if (!fits) {
+        out.resize(at + block_bytes(RawWidth), 0);
+        out[at] = RawWidth;
+        put64(&out[at + 1], base);
+        for (size_t i = 0; i < BlockValues; i++) put64(&out[at + BlockHeader + 8 * i], v[i]);
+        return;
+    }
+
+    // the first value is base itself; it decodes from a running sum that starts at -ref
+    const int32_t ref = static_cast<int32_t>(lo + (static_cast<int64_t>(hi) - lo) / 2);
+    uint32_t z[BlockValues];
+    uint32_t all = 0;
+    z[0] = 0;
+    for (size_t i = 1; i < BlockValues; i++) {
+        z[i] = zigzag(static_cast<int32_t>(d[i] - static_cast<uint32_t>(ref)));
+        all |= z[i];
+    }
+    uint8_t width = 0;
+    while (width < 32 && (all >> width) != 0) width++;
+    out.resize(at + block_bytes(width), 0);
+    out[at] = width;
+    put64(&out[at + 1], base);
+    put32(&out[at + 9], static_cast<uint32_t>(ref));
+
+    // lane l holds values l, l + 4, l + 8, ...: 32 values of width bits = width words
+    uint8_t* packed = &out[at + BlockHeader];
+    for (int lane = 0; lane < 4; lane++) {
+        uint64_t acc = 0;
+        int bits = 0;
+        int word = 0;
+        for (size_t j = 0; j < BlockValues / 4; j++) {
+            acc |= static_cast<uint64_t>(z[j * 4 + lane]) << bits;
+            bits += width;
+            if (bits >= 32) {
+                put32(packed + 16 * word + 4 * lane, static_cast<uint32_t>(acc));
+                acc >>= 32;
+                bits -= 32;
+                word++;
+            }
+        }
+    }
+}
+
+#if defined(DELTA_CODEC_AVX2)
+// Steps J and J + 1 of a block of the given width: words side by side, one 256-bit load
+// pair for eight neighbouring values, each half shifted by its own (constant) amount.
+template <unsigned Width, unsigned J>
+struct Avx2Unpack {
+    static DELTA_CODEC_UNROLL void run(const uint8_t* packed, __m256i refs, __m256i& carry, uint32_t* off) {
+        const unsigned bit0 = J * Width, bit1 = bit0 + Width;
+        const unsigned w0 = bit0 / 32, w1 = bit1 / 32;
+        const int s0 = static_cast<int>(bit0 % 32), s1 = static_cast<int>(bit1 % 32);
+        __m256i z = _mm256_setzero_si256();
+        if (Width) {
+            const __m256i cur = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + 16 * w0))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + 16 * w1)), 1);
+            z = _mm256_srlv_epi32(cur, _mm256_setr_epi32(s0, s0, s0, s0, s1, s1, s1, s1));
+            if (s0 + Width > 32 || s1 + Width > 32) {
+                // a half whose value does not reach into the next word takes its bits at
+                // or above Width, where the mask drops them; the last word stands in for
+                // the one past the end
+                const unsigned n0 = w0 + 1 < Width ? w0 + 1 : w0, n1 = w1 + 1 < Width ? w1 + 1 : w1;
+                const __m256i next = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + 16 * n0))),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + 16 * n1)), 1);
+                z = _mm256_or_si256(z, _mm256_sllv_epi32(next, _mm256_setr_epi32(32 - s0, 32 - s0, 32 - s0, 32 - s0,
+                    32 - s1, 32 - s1, 32 - s1, 32 - s1)));
+            }
+            if (Width < 32) z = _mm256_and_si256(z, _mm256_set1_epi32(static_cast<int>((1u << (Width & 31)) - 1)));
+        }
+        // un-zig-zag and add ref, prefix sum within each half, carry the low half's last
+        // lane into the high half, then add the running carry
+        __m256i d = _mm256_xor_si256(_mm256_srli_epi32(z, 1),
+            _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(z, _mm256_set1_epi32(1))));
+        d = _mm256_add_epi32(d, refs);
+        d = _mm256_add_epi32(d, _mm256_slli_si256(d, 4));
+        d = _mm256_add_epi32(d, _mm256_slli_si256(d, 8));
+        const __m256i low = _mm256_shuffle_epi32(d, _MM_SHUFFLE(3, 3, 3, 3));
+        d = _mm256_add_epi32(d, _mm256_permute2x128_si256(low, low, 0x08));
+        d = _mm256_add_epi32(d, carry);
+        carry = _mm256_permutevar8x32_epi32(d, _mm256_set1_epi32(7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(off + 4 * J), d);
+        Avx2Unpack<Width, J + 2>::run(packed, refs, carry, off);
+    }
+};
+
+template <unsigned Width>
+struct Avx2Unpack<Width, BlockValues / 4> {
+    static DELTA_CODEC_UNROLL void run(const uint8_t*, __m256i, __m256i&, uint32_t*) {}
+};
+
+template <unsigned Width>
+void avx2_unpack(const uint8_t* packed, int32_t ref, uint32_t first, uint32_t* off) {
+    __m256i carry = _mm256_set1_epi32(static_cast<int>(first - static_cast<uint32_t>(ref)));
+    Avx2Unpack<Width, 0>::run(packed, _mm256_set1_epi32(ref), carry, off);
+}
+#endif
+
+// Rebuilds the 128 offsets from the base of a packed block (width <= 32), plus first
+// (wrapping): with the low 32 bits of the base as first they are the low bits of the values.
+inline void unpack_block(const uint8_t* packed, uint8_t width, int32_t ref, uint32_t first, uint32_t* off) {
+#if defined(DELTA_CODEC_AVX2)
+    // one unrolled kernel per width, shifts and word offsets known at compile time
+    typedef void (*Kernel)(const uint8_t*, int32_t, uint32_t, uint32_t*);
+    static const Kernel kernels[33] = {
+        avx2_unpack<0>, avx2_unpack<1>, avx2_unpack<2>, avx2_unpack<3>, avx2_unpack<4>, avx2_unpack<5>,
+        avx2_unpack<6>, avx2_unpack<7>, avx2_unpack<8>, avx2_unpack<9>, avx2_unpack<10>, avx2_unpack<11>,
+        avx2_unpack<12>, avx2_unpack<13>, avx2_unpack<14>, avx2_unpack<15>, avx2_unpack<16>, avx2_unpack<17>,
+        avx2_unpack<18>, avx2_unpack<19>, avx2_unpack<20>, avx2_unpack<21>, avx2_unpack<22>, avx2_unpack<23>,
+        avx2_unpack<24>, avx2_unpack<25>, avx2_unpack<26>, avx2_unpack<27>, avx2_unpack<28>, avx2_unpack<29>,
+        avx2_unpack<30>, avx2_unpack<31>, avx2_unpack<32>,
+    };
+    kernels[width](packed, ref, first, off);
+#elif defined(DELTA_CODEC_SSE2)
+    const __m128i mask = _mm_set1_epi32(width == 32 ? -1 : static_cast<int>((1u << width) - 1));
+    const __m128i refs = _mm_set1_epi32(ref);
+    __m128i carry = _mm_set1_epi32(static_cast<int>(first - static_cast<uint32_t>(ref)));
+    __m128i cur = _mm_setzero_si128(), next = _mm_setzero_si128();
+    int word = -1;
+    for (size_t j = 0; j < BlockValues / 4; j++) {
+        __m128i z = _mm_setzero_si128();
+        if (width) {
+            const unsigned bit = static_cast<unsigned>(j * width);
+            const int w = static_cast<int>(bit / 32);
+            const unsigned shift = bit % 32;
+            if (w != word) {
+                cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + 16 * w));
+                if (static_cast<unsigned>(w + 1) < width) {
+                    next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + 16 * (w + 1)));
+                }
+                word = w;
+            }
+            z = _mm_srl_epi32(cur, _mm_cvtsi32_si128(static_cast<int>(shift)));
+            if (shift + width > 32) z = _mm_or_si128(z, _mm_sll_epi32(next, _mm_cvtsi32_si128(static_cast<int>(32 - shift))));
+            z = _mm_and_si128(z, mask);
+        }
+        // un-zig-zag and add ref, then prefix sum over the four lanes plus the running carry
+        __m128i d = _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi32(1))));
+        d = _mm_add_epi32(d, refs);
+        d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+        d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+        d = _mm_add_epi32(d, carry);
+        carry = _mm_shuffle_epi32(d, _MM_SHUFFLE(3, 3, 3, 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(off + 4 * j), d);
+    }
+#elif defined(DELTA_CODEC_NEON)
+    const uint32x4_t mask = vdupq_n_u32(width == 32 ? 0xFFFFFFFFu : (1u << width) - 1);
+    const uint32x4_t zero = vdupq_n_u32(0);
+    const uint32x4_t refs = vdupq_n_u32(static_cast<uint32_t>(ref));
+    uint32_t carry = first - static_cast<uint32_t>(ref);
+    for (size_t j = 0; j < BlockValues / 4; j++) {
+        uint32x4_t z = zero;
+        if (width) {
+            const unsigned bit = static_cast<unsigned>(j * width);
+            const unsigned w = bit / 32, shift = bit % 32;
+            const uint32x4_t cur = vld1q_u32(reinterpret_cast<const uint32_t*>(packed + 16 * w));
+            z = vshlq_u32(cur, vdupq_n_s32(-static_cast<int32_t>(shift)));
+            if (shift + width > 32) {
+                const uint32x4_t next = vld1q_u32(reinterpret_cast<const uint32_t*>(packed + 16 * (w + 1)));
+                z = vorrq_u32(z, vshlq_u32(next, vdupq_n_s32(static_cast<int32_t>(32 - shift))));
+            }
+            z = vandq_u32(z, mask);
+        }
+        uint32x4_t d = veorq_u32(vshrq_n_u32(z, 1), vsubq_u32(zero, vandq_u32(z, vdupq_n_u32(1))));
+        d = vaddq_u32(d, refs);
+        d = vaddq_u32(d, vextq_u32(zero, d, 3));
+        d = vaddq_u32(d, vextq_u32(zero, d, 2));
+        d = vaddq_u32(d, vdupq_n_u32(carry));
+        carry = vgetq_lane_u32(d, 3);
+        vst1q_u32(off + 4 * j, d);
+    }
+#else
+    const uint32_t mask = width == 32 ? 0xFFFFFFFFu : (1u << width) - 1;
+    uint32_t sum = first - static_cast<uint32_t>(ref);
+    for (size_t i = 0; i < BlockValues; i++) {
+        uint32_t z = 0;
+        if (width) {
+            const size_t j = i / 4, lane = i % 4;
+            const unsigned bit = static_cast<unsigned>(j * width);
+            const unsigned w = bit / 32, shift = bit % 32;
+            uint64_t v = get32(packed + 16 * w + 4 * lane);
+            if (shift + width > 32) v |= static_cast<uint64_t>(get32(packed + 16 * (w + 1) + 4 * lane)) << 32;
+            z = static_cast<uint32_t>(v >> shift) & mask;
+        }
+        sum += static_cast<uint32_t>(unzigzag(z)) + static_cast<uint32_t>(ref);
+        off[i] = sum;
+    }
+#endif
+}
+
+// Encodes n values of any integer type as one column, appended to out.
+template <typename T>
+void encode(const T* values, size_t n, std::vector<uint8_t>& out) {
+    const size_t blocks = (n + BlockValues - 1) / BlockValues;
+    const size_t head = out.size();
+    out.resize(head + ColumnHeader + 4 * blocks);
+    const uint64_t count = n;
+    memcpy(&out[head], &count, 8);
+    put32(&out[head + 8], static_cast<uint32_t>(blocks));
+
+    const size_t first = out.size();
+    int64_t v[BlockValues];
+    for (size_t b = 0; b < blocks; b++) {
+        const size_t begin = b * BlockValues;
+        for (size_t i = 0; i < BlockValues; i++) {
+            v[i] = static_cast<int64_t>(values[begin + i < n ? begin + i : n - 1]);
+        }
+        put32(&out[head + ColumnHeader + 4 * b], static_cast<uint32_t>(out.size() - first));
+        encode_block(v, out);
+    }
+}
+
+// Read access to an encoded column in memory (or in a mapped file); no copies.
+class Column {
+public:
+    // False when the bytes are too short for the column they claim to hold.
+    bool open(const uint8_t* data, size_t bytes) {
+        if (bytes < ColumnHeader) return false;
+        uint64_t count;
+        memcpy(&count, data, 8);
+        const uint32_t blocks = get32(data + 8);
+        if (blocks != (count + BlockValues - 1) / BlockValues || ColumnHeader + 4ull * blocks > bytes) return false;
+        offsets_ = data + ColumnHeader;
+        blocks_ = data + ColumnHeader + 4ull * blocks;
+        end_ = data + bytes;
+        count_ = static_cast<size_t>(count);
+        block_count_ = blocks;
+        for (uint32_t b = 0; b < blocks; b++) {
+            const uint8_t* p = block(b);
+            if (p + BlockHeader > end_ || (p[0] > 32 && p[0] != RawWidth) || p + block_bytes(p[0]) > end_) return false;
+        }
+        bytes_ = blocks ? static_cast<size_t>(block(blocks - 1) + block_bytes(block(blocks - 1)[0]) - data) : ColumnHeader;
+        return true;
+    }
+
+    size_t size() const { return count_; }
+    size_t blocks() const { return block_count_; }
+    size_t encoded_bytes() const { return bytes_; }        // from the column header to the end of the last block
+
+    // Values of block b (the last one may be short); returns how many were written.
+    template <typename T>
+    size_t decode_block(size_t b, T* out) const {
+        const uint8_t* p = block(b);
+        const int64_t base = get64(p + 1);
+        const size_t n = b + 1 < block_count_ ? BlockValues : count_ - b * BlockValues;
+        if (p[0] == RawWidth) {
+            for (size_t i = 0; i < n; i++) out[i] = static_cast<T>(get64(p + BlockHeader + 8 * i));
+            return n;
+        }
+        // up to 32-bit values come out of the wrapping sums whole; wider ones add the base
+        uint32_t off[BlockValues];
+        const uint32_t first = sizeof(T) <= 4 ? static_cast<uint32_t>(base) : 0;
+        unpack_block(p + BlockHeader, p[0], static_cast<int32_t>(get32(p + 9)), first, off);
+        if (sizeof(T) <= 4) {
+            if (n == BlockValues) narrow(off, out);
+            else for (size_t i = 0; i < n; i++) out[i] = static_cast<T>(off[i]);
+        }
+        else {
+            if (n == BlockValues) widen(base, off, out);
+            else for (size_t i = 0; i < n; i++) out[i] = static_cast<T>(base + static_cast<int32_t>(off[i]));
+        }
+        return n;
+    }
+
+    template <typename T>
+    void decode(T* out) const {
+        for (size_t b = 0; b < block_count_; b++) decode_block(b, out + b * BlockValues);
+    }
+
+    // The first value of block b without decoding it, for bisecting sorted columns.
+    int64_t block_first(size_t b) const { return get64(block(b) + 1); }
+
+private:
+    const uint8_t* offsets_ = nullptr;
+    const uint8_t* blocks_ = nullptr;
+    const uint8_t* end_ = nullptr;
+    size_t count_ = 0;
+    size_t block_count_ = 0;
+    size_t bytes_ = 0;
+
+    const uint8_t* block(size_t b) const { return blocks_ + get32(offsets_ + 4 * b); }
+
+    // full blocks: a fixed count, so the compiler turns these into vector packs and widens
+    template <typename T>
+    static void narrow(const uint32_t* off, T* out) {
+        for (size_t i = 0; i < BlockValues; i++) out[i] = static_cast<T>(off[i]);
+    }
+
+    template <typename T>
+    static void widen(int64_t base, const uint32_t* off, T* out) {
+        for (size_t i = 0; i < BlockValues; i++) out[i] = static_cast<T>(base + static_cast<int32_t>(off[i]));
+    }
+};
+
+} // namespace delta_codec
@@ -0,0 +1,300 @@
+// device_router.h - per-device routing of HID reports and the merged vehicle input
+//
+// Raw Input delivers every joystick-class device to the same window. The router keys
+// each report on its device handle, decodes it with that device's extraction plan, keeps
+// a separate engine state and report statistics per source, and merges the sources into
+// one VehicleInput (pedals from the pedal set, steering from the wheel, gear from the
+// shifter). Decoded pedal samples go through the noise filter and then the response
+// curves (if any) before anyone sees them.
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "hid_report.h"
+#include "pedal_engine.h"
+#include "pedal_filter.h"
+#include "response_curve.h"
+
+enum DeviceRole {
+    RoleIgnored,
+    RolePedals,
+    RoleWheel,
+    RoleShifter
+};
+
+inline const char* device_role_name(DeviceRole role) {
+    switch (role) {
+    case RolePedals:  return "Pedals";
+    case RoleWheel:   return "Wheel";
+    case RoleShifter: return "Shifter";
+    default:          return "Ignored";
+    }
+}
+
+// Guesses what a device is from its input fields.
+inline DeviceRole classify_device(const std::vector<HidField>& fields) {
+    int axes = 0;
+    int buttons = 0;
+    bool steering = false;
+    bool pedals = false;
+
+    for (const auto& f : fields) {
+        if (f.usage_page == hid_usage::PageButton) buttons++;
+        else if (f.usage_page == hid_usage::PageSimulation) {
+            if (f.usage == hid_usage::Steering) steering = true;
+            if (f.usage >= hid_usage::Accelerator && f.usage <= hid_usage::Clutch) pedals = true;
+        }
+        else if (f.usage_page == hid_usage::PageGenericDesktop &&
+            f.usage >= hid_usage::X && f.usage <= hid_usage::Wheel) {
+            axes++;
+        }
+    }
+
+    if (steering) return RoleWheel;
+    if (pedals) return RolePedals;
+    if (axes > 0 && buttons >= 4) return RoleWheel;      // wheel bases carry rim buttons
+    if (axes > 0) return RolePedals;
+    if (buttons > 0) return RoleShifter;
+    return RoleIgnored;
+}
+
+inline HidChannelMap channel_map_for(DeviceRole role) {
+    return role == RoleWheel ? HidChannelMap::wheel() : HidChannelMap::pedals();
+}
+
+struct DeviceStats {
+    uint64_t reports = 0;
+    uint64_t rejected = 0;          // shorter than the plan or a different report ID
+    int64_t first_us = 0;
+    int64_t last_us = 0;
+
+    int64_t interval_min_us = 0;    // time between consecutive reports
+    int64_t interval_max_us = 0;
+    double interval_avg_us = 0.0;   // exponential moving average
+
+    int64_t latency_max_us = 0;     // receive -> processed, reported by the front end
+    double latency_avg_us = 0.0;
+
+    double rate_hz() const {
+        if (reports < 2 || last_us <= first_us) return 0.0;
+        return (reports - 1) * 1e6 / static_cast<double>(last_us - first_us);
+    }
+};
+
+struct DeviceSlot {
+    uint64_t handle = 0;            // HANDLE from RAWINPUTHEADER::hDevice, 0 while detached
+    std::string path;               // device interface path, survives reconnects
+    DeviceRole role = RoleIgnored;
+    HidExtractionPlan plan;
+    PedalSample sample;             // filtered and shaped
+    bool has_sample = false;
+    PedalFilterState filter;
+    PedalEngineState engine;
+    DeviceStats stats;
+};
+
+struct VehicleInput {
+    PedalSample pedals;             // merged channels, 0..65535
+    int gear = 0;                   // 0 = neutral, shifter button n -> gear n
+    PedalEngineState engine;        // engine of the source that provides the throttle
+    int sources = 0;                // attached devices that are not ignored
+};
+
+class DeviceRouter {
+public:
+    static const int MaxDevices = 8;
+
+    // Registers (or re-registers after a reconnect) a device from its input fields.
+    // Returns null when all MaxDevices slots hold attached devices.
+    DeviceSlot* attach(uint64_t handle, const std::string& path, const std::vector<HidField>& fields) {
+        DeviceRole role = classify_device(fields);
+        HidExtractionPlan plan;
+        if (role != RoleIgnored && !plan.compile(fields, channel_map_for(role))) role = RoleIgnored;
+        return attach_plan(handle, path, role, plan);
+    }
+
+    DeviceSlot* attach_plan(uint64_t handle, const std::string& path, DeviceRole role, const HidExtractionPlan& plan) {
+        DeviceSlot* slot = find(handle);
+        if (!slot && !path.empty()) {
+            for (int i = 0; i < count_; i++) {
+                if (slots_[i].path == path) { slot = &slots_[i]; break; }
+            }
+        }
+        if (!slot) {
+            // A device without a path cannot be recognised when it comes back, so it takes
+            // over a detached slot without a path instead of a new one. A full table
+            // reclaims any detached slot. Either way the slot starts over.
+            if (path.empty()) slot = detached_slot(true);
+            if (!slot && count_ < MaxDevices) slot = &slots_[count_++];
+            if (!slot) slot = detached_slot(false);
+            if (!slot) return nullptr;
+            *slot = DeviceSlot();
+            slot->path = path;
+        }
+        slot->handle = handle;
+        slot->role = role;
+        slot->plan = plan;
+        return slot;
+    }
+
+    // Keeps the slot (and its engine state) so the same device path picks it up again.
+    void detach(uint64_t handle) {
+        DeviceSlot* slot = find(handle);
+        if (slot) {
+            slot->handle = 0;
+            slot->has_sample = false;
+            slot->filter.reset();
+        }
+    }
+
+    DeviceSlot* find(uint64_t handle) {
+        if (handle == 0) return nullptr;
+        for (int i = 0; i < count_; i++) {
+            if (slots_[i].handle == handle) return &slots_[i];
+        }
+        return nullptr;
+    }
+
+    // Decodes a report for its device. Returns null for unknown or ignored devices and
+    // for reports the plan rejects.
+    DeviceSlot* route(uint64_t handle, const uint8_t* report, size_t size, int64_t received_us) {
+        DeviceSlot* slot = find(handle);
+        if (!slot || slot->role == RoleIgnored) return nullptr;
+
+        DeviceStats& st = slot->stats;
+        if (!slot->plan.extract(report, size, slot->sample)) {
+            st.rejected++;
+            return nullptr;
+        }
+        slot->has_sample = true;
+        if (slot->role != RoleShifter) {
+            pedal_filter_apply(slot->filter, filter_, slot->sample, received_us);
+            if (response_) response_->apply(slot->sample);
+        }
+
+        if (st.reports == 0) {
+            st.first_us = received_us;
+        }
+        else {
+            int64_t interval = received_us - st.last_us;
+            if (st.reports == 1 || interval < st.interval_min_us) st.interval_min_us = interval;
+            if (interval > st.interval_max_us) st.interval_max_us = interval;
+            st.interval_avg_us = (st.reports == 1) ? interval : st.interval_avg_us + (interval - st.interval_avg_us) / 16.0;
+        }
+        st.last_us = received_us;
+        st.reports++;
+        return slot;
+    }
+
+    // Response curves applied to every decoded pedal sample (null = linear). The router
+    // does not own them; swapping curves inside the PedalResponse needs no router lock.
+    void set_response(const PedalResponse* response) { response_ = response; }
+
+    // Noise filter settings for every pedal source; call under the same lock as route().
+    void set_filter(const PedalFilterConfig& cfg) { filter_ = cfg; }
+    const PedalFilterConfig& filter() const { return filter_; }
+
+    static void record_latency(DeviceSlot& slot, int64_t latency_us) {
+        DeviceStats& st = slot.stats;
+        if (latency_us > st.latency_max_us) st.latency_max_us = latency_us;
+        st.latency_avg_us += (latency_us - st.latency_avg_us) / 16.0;
+    }
+
+    // Runs one fixed engine step for every source. With a shifter attached its gear
+    // drives the vehicle models (no button = neutral), otherwise they shift themselves.
+    void tick_engines(const PedalEngineConfig& cfg = PedalEngineConfig()) {
+        int gearRequest = GearAutomatic;
+        for (int i = 0; i < count_; i++) {
+            const DeviceSlot& s = slots_[i];
+            if (s.handle && s.role == RoleShifter && s.has_sample) {
+                gearRequest = lowest_button(s.sample.buttons);
+                break;
+            }
+        }
+        for (int i = 0; i < count_; i++) pedal_engine_tick(slots_[i].engine, cfg, gearRequest);
+    }
+
+    // Fires a front-end mode request (cruise, test modes, cancel) on every source's engine.
+    // Returns true if any engine took it.
+    bool request_mode(ModeTrigger request, const PedalEngineConfig& cfg = PedalEngineConfig()) {
+        bool taken = false;
+        for (int i = 0; i < count_; i++) {
+            DeviceSlot& s = slots_[i];
+            if (s.handle && s.role != RoleShifter) taken |= pedal_engine_request(s.engine, request, cfg);
+        }
+        return taken;
+    }
+
+    VehicleInput merge() const {
+        VehicleInput v;
+        const DeviceSlot* throttleSource = nullptr;
+
+        for (int c = 0; c < ChannelCount; c++) {
+            PedalChannel ch = static_cast<PedalChannel>(c);
+            const DeviceSlot* best = nullptr;
+            for (int i = 0; i < count_; i++) {
+                const DeviceSlot& s = slots_[i];
+                if (!s.handle || !s.has_sample || !s.plan.has_channel(ch)) continue;
+                if (!best || better(s, *best, ch)) best = &s;
+            }
+            if (best) {
+                v.pedals.axis[c] = best->sample.axis[c];
+                if (ch == ChannelThrottle) throttleSource = best;
+            }
+        }
+
+        for (int i = 0; i < count_; i++) {
+            const DeviceSlot& s = slots_[i];
+            if (!s.handle || s.role == RoleIgnored) continue;
+            v.sources++;
+            if (!s.has_sample) continue;
+            if (s.role == RoleShifter) {
+                v.gear = lowest_button(s.sample.buttons);
+            }
+            else {
+                v.pedals.buttons |= s.sample.buttons;
+            }
+        }
+
+        if (throttleSource) v.engine = throttleSource->engine;
+        return v;
+    }
+
+    int count() const { return count_; }
+    DeviceSlot& slot(int i) { return slots_[i]; }
+    const DeviceSlot& slot(int i) const { return slots_[i]; }
+
+private:
+    DeviceSlot slots_[MaxDevices];
+    int count_ = 0;
+    const PedalResponse* response_ = nullptr;
+    PedalFilterConfig filter_;
+
+    // Pedal channels prefer a dedicated pedal set over pedals wired into a wheel base,
+    // steering prefers the wheel; ties go to the most recently active source.
+    static int priority(DeviceRole role, PedalChannel ch) {
+        if (ch == ChannelSteering) return role == RoleWheel ? 2 : 1;
+        return role == RolePedals ? 2 : 1;
+    }
+
+    static bool better(const DeviceSlot& a, const DeviceSlot& b, PedalChannel ch) {
+        int pa = priority(a.role, ch);
+        int pb = priority(b.role, ch);
+        if (pa != pb) return pa > pb;
+        return a.stats.last_us > b.stats.last_us;
+    }
+
+    DeviceSlot* detached_slot(bool withoutPath) {
+        for (int i = 0; i < count_; i++) {
+            if (!slots_[i].handle && (!withoutPath || slots_[i].path.empty())) return &slots_[i];
+        }
+        return nullptr;
+    }
+
+    static int lowest_button(uint32_t buttons) {
+        for (int b = 0; b < 32; b++) {
+            if (buttons & (1u << b)) return b + 1;
+        }
+        return 0;
+    }
+};
@@ -0,0 +1,270 @@
+// drive_mode.h - drive modes as a table-driven state machine
+//
+// A mode reacts to triggers: rising pedal edges (clutch, throttle, brake), requests from
+// the front end (cruise, the two test generators, cancel) and its own tick reporting that
+// it is done. What a trigger does is data, not code:
+//
+//   rows in drive_mode_table()   from, trigger, optional guard, to, optional action
+//   drive_mode_info()            per mode: entry, exit and tick actions
+//
+// drive_mode_table() resolves the rows at compile time into a dense [mode][trigger] jump
+// table, so firing a trigger is one lookup plus the guards of that cell. Adding a mode is
+// adding rows; the engine and the front ends do not change.
+//
+// Whatever runs it, every action leaves the speed clamped to 0..max_speed.
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include "vehicle_model.h"
+
+enum DriveMode {
+    Static,             // speed steps once per throttle/brake press
+    Dynamic,            // speed from the vehicle model
+    CruiseHold,         // holds the speed it was entered with
+    RampTest,           // 0 -> max_speed at a fixed rate, then back to static
+    StepResponse,       // square wave between two speeds, then back to static
+    DriveModeCount
+};
+
+enum ModeTrigger {
+    TriggerClutch,      // rising pedal edges
+    TriggerThrottle,
+    TriggerBrake,
+    TriggerCruise,      // front-end requests
+    TriggerRampTest,
+    TriggerStepTest,
+    TriggerCancel,
+    TriggerFinished,    // a mode's tick says it is done
+    ModeTriggerCount
+};
+
+inline const char* drive_mode_name(DriveMode m) {
+    static const char* const names[DriveModeCount] = { "Static", "Dynamic", "Cruise", "Ramp test", "Step test" };
+    return m >= 0 && m < DriveModeCount ? names[m] : "?";
+}
+
+struct DriveModeConfig {
+    int static_step_up = 20;        // per throttle press (was two reports of 10)
+    int static_step_down = 20;      // per brake press
+    int max_speed = 300;
+    int cruise_min_speed = 20;      // km/h needed to engage cruise
+    double ramp_kmh_per_s = 20.0;
+    int step_low = 50;              // step response levels, km/h
+    int step_high = 100;
+    double step_period_s = 4.0;     // one low + one high phase
+    int step_cycles = 3;
+    VehicleParams vehicle;          // dynamic mode; one tick = vehicle.dt_s
+};
+
+struct DriveState {
+    DriveMode mode = Static;
+    int speed = 0;                  // km/h shown to the user (formerly pAccelCount)
+    VehicleState vehicle;           // dynamic and cruise
+    int target = 0;                 // cruise speed
+    int mode_ticks = 0;             // ticks since a test mode started
+};
+
+// what a tick sees of the pedals and the shifter
+struct DriveInputs {
+    double throttle = 0.0;          // 0..1
+    double brake = 0.0;
+    int gear = GearAutomatic;
+};
+
+typedef bool (*ModeGuard)(const DriveState&, const DriveModeConfig&);
+typedef void (*ModeAction)(DriveState&, const DriveModeConfig&);
+typedef bool (*ModeTick)(DriveState&, const DriveModeConfig&, const DriveInputs&);   // true = finished
+
+namespace drive_actions {
+
+inline bool cruise_allowed(const DriveState& s, const DriveModeConfig& c) { return s.speed >= c.cruise_min_speed; }
+
+inline void step_up(DriveState& s, const DriveModeConfig& c) { s.speed += c.static_step_up; }
+inline void step_down(DriveState& s, const DriveModeConfig& c) { s.speed -= c.static_step_down; }
+inline void raise_target(DriveState& s, const DriveModeConfig& c) { s.target = (std::min)(c.max_speed, s.target + c.static_step_up); }
+
+inline void enter_static(DriveState& s, const DriveModeConfig&) { s.speed = 0; }
+
+inline void enter_dynamic(DriveState& s, const DriveModeConfig&) {
+    s.vehicle = VehicleState();
+    s.vehicle.speed_ms = s.speed / 3.6;      // carry the current speed over
+}
+
+inline void enter_cruise(DriveState& s, const DriveModeConfig&) { s.target = s.speed; }
+inline void exit_cruise(DriveState& s, const DriveModeConfig&) { s.target = 0; }
+
+inline void enter_ramp(DriveState& s, const DriveModeConfig&) {
+    s.speed = 0;
+    s.mode_ticks = 0;
+}
+
+inline void enter_step(DriveState& s, const DriveModeConfig& c) {
+    s.speed = c.step_low;
+    s.mode_ticks = 0;
+}
+
+inline bool tick_dynamic(DriveState& s, const DriveModeConfig& c, const DriveInputs& in) {
+    vehicle_step(s.vehicle, c.vehicle, in.throttle, in.brake, in.gear);
+    s.speed = (std::min)(c.max_speed, static_cast<int>(std::lround(vehicle_speed_kmh(s.vehicle))));
+    return false;
+}
+
+inline bool tick_cruise(DriveState& s, const DriveModeConfig& c, const DriveInputs&) {
+    s.speed = s.target;
+    s.vehicle.speed_ms = s.target / 3.6;
+    s.vehicle.distance_m += s.vehicle.speed_ms * c.vehicle.dt_s;
+    return false;
+}
+
+inline bool tick_ramp(DriveState& s, const DriveModeConfig& c, const DriveInputs&) {
+    s.mode_ticks++;
+    s.speed = static_cast<int>(std::lround(c.ramp_kmh_per_s * c.vehicle.dt_s * s.mode_ticks));
+    return s.speed >= c.max_speed;
+}
+
+inline bool tick_step(DriveState& s, const DriveModeConfig& c, const DriveInputs&) {
+    const int period = (std::max)(2, static_cast<int>(std::lround(c.step_period_s / c.vehicle.dt_s)));
+    s.mode_ticks++;
+    s.speed = s.mode_ticks % period < period / 2 ? c.step_low : c.step_high;
+    return s.mode_ticks >= period * c.step_cycles;
+}
+
+} // namespace drive_actions
+
+struct ModeTransition {
+    DriveMode from;
+    ModeTrigger trigger;
+    ModeGuard guard;                // nullptr = always
+    DriveMode to;
+    ModeAction action;              // runs between exit and entry; nullptr = none
+};
+
+struct ModeInfo {
+    ModeAction entry;
+    ModeAction exit;
+    ModeTick tick;                  // nullptr = speed only changes on triggers
+};
+
+const int MaxModeTransitions = 32;
+
+// Rows of one (mode, trigger) cell are tried in order; the first whose guard passes wins.
+// Rows of a cell must be adjacent.
+struct DriveModeTable {
+    struct Cell {
+        unsigned char first;
+        unsigned char count;
+    };
+
+    ModeTransition rows[MaxModeTransitions];
+    int row_count;
+    Cell jump[DriveModeCount][ModeTriggerCount];
+    ModeInfo info[DriveModeCount];
+    bool valid;                     // every row in range, every cell contiguous
+};
+
+constexpr ModeInfo drive_mode_info(DriveMode m) {
+    using namespace drive_actions;
+    return m == Static ? ModeInfo{ enter_static, nullptr, nullptr }
+        : m == Dynamic ? ModeInfo{ enter_dynamic, nullptr, tick_dynamic }
+        : m == CruiseHold ? ModeInfo{ enter_cruise, exit_cruise, tick_cruise }
+        : m == RampTest ? ModeInfo{ enter_ramp, nullptr, tick_ramp }
+        : ModeInfo{ enter_step, nullptr, tick_step };
+}
+
+constexpr DriveModeTable drive_mode_table() {
+    using namespace drive_actions;
+    constexpr ModeTransition rows[] = {
+        { Static,       TriggerClutch,   nullptr,        Dynamic,      nullptr },
+        { Static,       TriggerThrottle, nullptr,        Static,       step_up },
+        { Static,       TriggerBrake,    nullptr,        Static,       step_down },
+        { Static,       TriggerRampTest, nullptr,        RampTest,     nullptr },
+        { Static,       TriggerStepTest, nullptr,        StepResponse, nullptr },
+
+        { Dynamic,      TriggerClutch,   nullptr,        Static,       nullptr },
+        { Dynamic,      TriggerCruise,   cruise_allowed, CruiseHold,   nullptr },
+
+        { CruiseHold,   TriggerClutch,   nullptr,        Static,       nullptr },
+        { CruiseHold,   TriggerThrottle, nullptr,        CruiseHold,   raise_target },
+        { CruiseHold,   TriggerBrake,    nullptr,        Dynamic,      nullptr },
+        { CruiseHold,   TriggerCancel,   nullptr,        Dynamic,      nullptr },
+
+        { RampTest,     TriggerClutch,   nullptr,        Static,       nullptr },
+        { RampTest,     TriggerCancel,   nullptr,        Static,       nullptr },
+        { RampTest,     TriggerFinished, nullptr,        Static,       nullptr },
+
+        { StepResponse, TriggerClutch,   nullptr,        Static,       nullptr },
+        { StepResponse, TriggerCancel,   nullptr,        Static,       nullptr },
+        { StepResponse, TriggerFinished, nullptr,        Static,       nullptr },
+    };
+    const int count = static_cast<int>(sizeof(rows) / sizeof(rows[0]));
+
+    DriveModeTable t{};
+    t.valid = count <= MaxModeTransitions;
+    t.row_count = t.valid ? count : 0;
+    for (int m = 0; m < DriveModeCount; m++) {
+        t.info[m] = drive_mode_info(static_cast<DriveMode>(m));
+    }
+    for (int i = 0; i < t.row_count; i++) {
+        const ModeTransition& r = rows[i];
+        t.rows[i] = r;
+        if (r.from < 0 || r.from >= DriveModeCount || r.to < 0 || r.to >= DriveModeCount ||
+            r.trigger < 0 || r.trigger >= ModeTriggerCount) {
+            t.valid = false;
+            continue;
+        }
+        DriveModeTable::Cell& c = t.jump[r.from][r.trigger];
+        if (c.count == 0) c.first = static_cast<unsigned char>(i);
+        else if (c.first + c.count != i) t.valid = false;
+        c.count++;
+    }
+    return t;
+}
+
+static_assert(drive_mode_table().valid, "drive mode rows out of range or not grouped by (mode, trigger)");
+
+// True when (from, trigger) has exactly one unguarded row going to `to` with `action`;
+// lets hard-coded fast paths (pedal_engine_batch.h) assert they match the table.
+constexpr bool drive_mode_plain_row(DriveMode from, ModeTrigger trigger, DriveMode to, ModeAction action) {
+    const DriveModeTable t = drive_mode_table();
+    const DriveModeTable::Cell c = t.jump[from][trigger];
+    return c.count == 1 && t.rows[c.first].guard == nullptr && t.rows[c.first].to == to &&
+        t.rows[c.first].action == action;
+}
+
+inline const DriveModeTable& drive_modes() {
+    static constexpr DriveModeTable table = drive_mode_table();
+    return table;
+}
+
+inline void drive_mode_clamp(DriveState& s, const DriveModeConfig& c) {
+    s.speed = (std::max)(0, (std::min)(c.max_speed, s.speed));
+}
+
+// Fires a trigger. Returns true when a transition was taken (also a self-transition).
+inline bool drive_mode_fire(DriveState& s, const DriveModeConfig& c, ModeTrigger trigger) {
+    const DriveModeTable& t = drive_modes();
+    const DriveModeTable::Cell cell = t.jump[s.mode][trigger];
+    for (int i = cell.first; i < cell.first + cell.count; i++) {
+        const ModeTransition& r = t.rows[i];
+        if (r.guard && !r.guard(s, c)) continue;
+
+        if (r.to != s.mode && t.info[s.mode].exit) t.info[s.mode].exit(s, c);
+        if (r.action) r.action(s, c);
+        if (r.to != s.mode) {
+            s.mode = r.to;
+            if (t.info[r.to].entry) t.info[r.to].entry(s, c);
+        }
+        drive_mode_clamp(s, c);
+        return true;
+    }
+    return false;
+}
+
+// Advances the current mode by one vehicle.dt_s; a finished mode fires TriggerFinished.
+inline void drive_mode_tick(DriveState& s, const DriveModeConfig& c, const DriveInputs& in) {
+    const ModeTick tick = drive_modes().info[s.mode].tick;
+    if (!tick) return;
+    const bool finished = tick(s, c, in);
+    drive_mode_clamp(s, c);
+    if (finished) drive_mode_fire(s, c, TriggerFinished);
+}
@@ -0,0 +1,107 @@
+// edge_detector.h - hysteresis (Schmitt trigger) edge detection for the pedals
+//
+// Replaces the rp_edge/mp_edge counters and the 0.5-1 s lockouts. A pedal is "pressed"
+// once its level reaches the rising threshold and "released" once it drops to the
+// falling one; noise between the two cannot flip it. After a transition the trigger
+// holds its state for hold_us, which absorbs contact bounce without delaying the edge
+// itself: a press is reported on the first report above the threshold, and quick taps
+// count as long as they are further apart than the hold time.
+//
+// Each report yields at most one edge per pedal, as timestamped EdgeEvents in the order
+// clutch, throttle, brake (the order the engine applies them in).
+#pragma once
+#include <cstdint>
+#include "hid_report.h"
+
+enum Edge {
+    EdgeNone = 0,
+    EdgeRising,
+    EdgeFalling
+};
+
+// Levels are the 8-bit pedal view (pedal_level8); rise > fall.
+struct SchmittConfig {
+    int rise;
+    int fall;
+    int64_t hold_us;
+};
+
+struct SchmittState {
+    bool high = false;
+    int64_t changed_us = INT64_MIN / 2;     // last accepted transition
+};
+
+inline Edge schmitt_update(SchmittState& s, const SchmittConfig& c, int level, int64_t t_us) {
+    if (t_us - s.changed_us < c.hold_us) return EdgeNone;
+    if (!s.high && level >= c.rise) {
+        s.high = true;
+        s.changed_us = t_us;
+        return EdgeRising;
+    }
+    if (s.high && level <= c.fall) {
+        s.high = false;
+        s.changed_us = t_us;
+        return EdgeFalling;
+    }
+    return EdgeNone;
+}
+
+// Plain data so an EdgeEvents on the stack costs nothing until edges are pushed.
+struct EdgeEvent {
+    int64_t t_us;
+    PedalChannel channel;
+    Edge edge;
+};
+
+// "clutch down", "brake up", ... for logs and status lines
+inline const char* edge_event_name(const EdgeEvent& e) {
+    static const char* const names[ChannelSteering][2] = {
+        { "throttle down", "throttle up" },
+        { "brake down", "brake up" },
+        { "clutch down", "clutch up" },
+    };
+    if (e.edge == EdgeNone || e.channel >= ChannelSteering) return "none";
+    return names[e.channel][e.edge == EdgeRising ? 0 : 1];
+}
+
+// The edges of one report.
+struct EdgeEvents {
+    static const int Capacity = ChannelSteering;    // one per pedal
+
+    EdgeEvent event[Capacity];
+    int count = 0;
+
+    void push(const EdgeEvent& e) { event[count++] = e; }
+    const EdgeEvent* begin() const { return event; }
+    const EdgeEvent* end() const { return event + count; }
+};
+
+// Thresholds keep the old trigger points on the way up (clutch > 14, throttle > 13,
+// brake > 30) and release at about half of them.
+struct PedalEdgeConfig {
+    SchmittConfig pedal[ChannelSteering] = {
+        { 14, 6, 30000 },      // ChannelThrottle
+        { 31, 15, 30000 },     // ChannelBrake
+        { 15, 7, 50000 },      // ChannelClutch
+    };
+};
+
+struct PedalEdgeState {
+    SchmittState pedal[ChannelSteering];
+};
+
+// Runs the three triggers on a report and appends the resulting edges to out.
+inline void detect_pedal_edges(PedalEdgeState& s, const PedalEdgeConfig& cfg, const PedalSample& sample,
+    int64_t t_us, EdgeEvents& out)
+{
+    static const PedalChannel order[ChannelSteering] = { ChannelClutch, ChannelThrottle, ChannelBrake };
+    for (PedalChannel ch : order) {
+        const Edge e = schmitt_update(s.pedal[ch], cfg.pedal[ch], pedal_level8(sample, ch), t_us);
+        if (e == EdgeNone) continue;
+        EdgeEvent ev;
+        ev.t_us = t_us;
+        ev.channel = ch;
+        ev.edge = e;
+        out.push(ev);
+    }
+}
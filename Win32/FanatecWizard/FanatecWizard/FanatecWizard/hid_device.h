@@ -0,0 +1,161 @@
+// hid_device.h - Windows side of the extraction plans: reads the layout of a raw input
+// device when it attaches and registers it with the DeviceRouter.
+//
+// Raw Input does not hand out the report descriptor itself, only the preparsed data.
+// The field layout is recovered from it by writing an all-ones value for each usage into
+// an empty report with HidP_SetUsageValue / HidP_SetUsages and looking at which bits moved.
+#pragma once
+#include <windows.h>
+#include <hidsdi.h>
+#include <hidpi.h>
+#include <vector>
+#include <string>
+#include "hid_report.h"
+#include "device_router.h"
+
+#pragma comment(lib, "hid.lib")
+
+class HidDevices {
+public:
+    // Recovers the input fields of device from its preparsed data.
+    static bool read_fields(HANDLE device, std::vector<HidField>& fields) {
+        fields.clear();
+
+        UINT size = 0;
+        if (GetRawInputDeviceInfo(device, RIDI_PREPARSEDDATA, NULL, &size) != 0 || size == 0) return false;
+        std::vector<BYTE> buffer(size);
+        if (GetRawInputDeviceInfo(device, RIDI_PREPARSEDDATA, buffer.data(), &size) == (UINT)-1) return false;
+        PHIDP_PREPARSED_DATA preparsed = reinterpret_cast<PHIDP_PREPARSED_DATA>(buffer.data());
+
+        HIDP_CAPS caps;
+        if (HidP_GetCaps(preparsed, &caps) != HIDP_STATUS_SUCCESS) return false;
+        if (caps.InputReportByteLength == 0) return false;
+
+        std::vector<char> report(caps.InputReportByteLength);
+
+        USHORT valueCount = caps.NumberInputValueCaps;
+        std::vector<HIDP_VALUE_CAPS> values(valueCount);
+        if (valueCount > 0 &&
+            HidP_GetValueCaps(HidP_Input, values.data(), &valueCount, preparsed) != HIDP_STATUS_SUCCESS) {
+            valueCount = 0;
+        }
+
+        for (USHORT v = 0; v < valueCount; v++) {
+            const HIDP_VALUE_CAPS& vc = values[v];
+            if (vc.ReportCount != 1 || vc.BitSize == 0 || vc.BitSize > 32) continue;
+
+            USAGE first = vc.IsRange ? vc.Range.UsageMin : vc.NotRange.Usage;
+            USAGE last = vc.IsRange ? vc.Range.UsageMax : vc.NotRange.Usage;
+            ULONG ones = vc.BitSize >= 32 ? 0xFFFFFFFFul : ((1ul << vc.BitSize) - 1ul);
+
+            for (USAGE u = first; u <= last && u >= first; u++) {
+                std::fill(report.begin(), report.end(), 0);
+                report[0] = static_cast<char>(vc.ReportID);
+                if (HidP_SetUsageValue(HidP_Input, vc.UsagePage, vc.LinkCollection, u, ones, preparsed,
+                    report.data(), static_cast<ULONG>(report.size())) != HIDP_STATUS_SUCCESS) {
+                    continue;
+                }
+
+                HidField f;
+                f.usage_page = vc.UsagePage;
+                f.usage = u;
+                f.report_id = vc.ReportID;
+                f.bit_offset = lowest_set_bit(report);
+                f.bit_size = static_cast<uint8_t>(vc.BitSize);
+                f.logical_min = vc.LogicalMin;
+                f.logical_max = vc.LogicalMax;
+                // same unsigned-range quirk the descriptor parser handles
+                if (f.logical_max < f.logical_min && f.logical_min >= 0) {
+                    f.logical_max = static_cast<int32_t>(static_cast<ULONG>(vc.LogicalMax) & ones);
+                }
+                if (f.bit_offset != 0) fields.push_back(f);
+            }
+        }
+
+        USHORT buttonCount = caps.NumberInputButtonCaps;
+        std::vector<HIDP_BUTTON_CAPS> buttons(buttonCount);
+        if (buttonCount > 0 &&
+            HidP_GetButtonCaps(HidP_Input, buttons.data(), &buttonCount, preparsed) != HIDP_STATUS_SUCCESS) {
+            buttonCount = 0;
+        }
+
+        for (USHORT b = 0; b < buttonCount; b++) {
+            const HIDP_BUTTON_CAPS& bc = buttons[b];
+            USAGE first = bc.IsRange ? bc.Range.UsageMin : bc.NotRange.Usage;
+            USAGE last = bc.IsRange ? bc.Range.UsageMax : bc.NotRange.Usage;
+
+            for (USAGE u = first; u <= last && u >= first && u <= HidExtractionPlan::MaxButtons; u++) {
+                std::fill(report.begin(), report.end(), 0);
+                report[0] = static_cast<char>(bc.ReportID);
+                USAGE usage = u;
+                ULONG one = 1;
+                if (HidP_SetUsages(HidP_Input, bc.UsagePage, bc.LinkCollection, &usage, &one, preparsed,
+                    report.data(), static_cast<ULONG>(report.size())) != HIDP_STATUS_SUCCESS) {
+                    continue;
+                }
+
+                HidField f;
+                f.usage_page = bc.UsagePage;
+                f.usage = u;
+                f.report_id = bc.ReportID;
+                f.bit_offset = lowest_set_bit(report);
+                f.bit_size = 1;
+                f.logical_min = 0;
+                f.logical_max = 1;
+                // array-style button fields (usage index instead of a bit) are not supported
+                if (f.bit_offset != 0) fields.push_back(f);
+            }
+        }
+
+        return !fields.empty();
+    }
+
+    static std::string device_path(HANDLE device) {
+        UINT chars = 0;
+        if (GetRawInputDeviceInfoA(device, RIDI_DEVICENAME, NULL, &chars) != 0 || chars == 0) return std::string();
+        std::string path(chars, '\0');
+        if (GetRawInputDeviceInfoA(device, RIDI_DEVICENAME, &path[0], &chars) == (UINT)-1) return std::string();
+        path.resize(strlen(path.c_str()));
+        return path;
+    }
+
+    // Call on WM_INPUT_DEVICE_CHANGE / GIDC_ARRIVAL. Devices whose layout cannot be read
+    // are treated as pedals with the old reverse-engineered offsets.
+    static DeviceSlot* attach(DeviceRouter& router, HANDLE device) {
+        uint64_t key = handle_key(device);
+        std::string path = device_path(device);
+        std::vector<HidField> fields;
+        if (read_fields(device, fields)) {
+            return router.attach(key, path, fields);
+        }
+        return router.attach_plan(key, path, RolePedals, HidExtractionPlan::legacy_fanatec());
+    }
+
+    static void detach(DeviceRouter& router, HANDLE device) {
+        router.detach(handle_key(device));
+    }
+
+    // Routes one report, attaching the device first if its arrival was missed.
+    static DeviceSlot* route(DeviceRouter& router, HANDLE device, const BYTE* data, UINT size, int64_t received_us) {
+        uint64_t key = handle_key(device);
+        if (!router.find(key)) attach(router, device);
+        return router.route(key, data, size, received_us);
+    }
+
+    static uint64_t handle_key(HANDLE device) {
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(device));
+    }
+
+private:
+    // first bit set after the report ID byte, 0 when nothing was written
+    static uint32_t lowest_set_bit(const std::vector<char>& report) {
+        for (size_t i = 1; i < report.size(); i++) {
+            uint8_t byte = static_cast<uint8_t>(report[i]);
+            if (byte == 0) continue;
+            for (uint32_t bit = 0; bit < 8; bit++) {
+                if (byte & (1u << bit)) return static_cast<uint32_t>(i * 8 + bit);
+            }
+        }
+        return 0;
+    }
+};
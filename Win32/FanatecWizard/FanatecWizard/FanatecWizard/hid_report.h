@@ -0,0 +1,401 @@
+// hid_report.h - HID report descriptor parsing and per-device extraction plans
+//
+// The pedal positions used to be read from hard-coded offsets (data[2], data[4],
+// data[6]) and truncated to 8 bits. Instead the descriptor is parsed once when a
+// device attaches and compiled into a HidExtractionPlan: a fixed list of
+// (byte offset, shift, mask, logical range) ops that the hot path runs without
+// knowing which device it is talking to.
+//
+// Portable on purpose (no windows.h) so stored descriptors can be checked on Linux.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+// Logical channels every front end works with. Values are normalized to 0..65535.
+enum PedalChannel {
+    ChannelThrottle = 0,
+    ChannelBrake,
+    ChannelClutch,
+    ChannelSteering,
+    ChannelCount
+};
+
+struct PedalSample {
+    uint16_t axis[ChannelCount] = { 0 };
+    uint32_t buttons = 0;      // button page usages 1..32, bit 0 = button 1
+};
+
+// 8-bit view used by the pedal thresholds (> 13, > 14, > 30 ...)
+inline int pedal_level8(const PedalSample& s, PedalChannel ch) {
+    return s.axis[ch] >> 8;
+}
+
+// One input field as found in a descriptor (or probed from preparsed data on Windows)
+struct HidField {
+    uint16_t usage_page = 0;
+    uint16_t usage = 0;
+    uint8_t report_id = 0;
+    uint32_t bit_offset = 0;   // from the start of the report, report ID byte included when present
+    uint8_t bit_size = 0;
+    int32_t logical_min = 0;
+    int32_t logical_max = 0;
+    bool is_constant = false;
+    bool is_variable = true;
+};
+
+namespace hid_usage {
+    const uint16_t PageGenericDesktop = 0x01;
+    const uint16_t PageSimulation = 0x02;
+    const uint16_t PageButton = 0x09;
+
+    const uint16_t X = 0x30;
+    const uint16_t Y = 0x31;
+    const uint16_t Z = 0x32;
+    const uint16_t Rx = 0x33;
+    const uint16_t Ry = 0x34;
+    const uint16_t Rz = 0x35;
+    const uint16_t Slider = 0x36;
+    const uint16_t Dial = 0x37;
+    const uint16_t Wheel = 0x38;
+
+    const uint16_t Accelerator = 0xC4;
+    const uint16_t Brake = 0xC5;
+    const uint16_t Clutch = 0xC6;
+    const uint16_t Steering = 0xC8;
+}
+
+// Parses a raw report descriptor into the list of input fields.
+// prefixReportId: true when reports are delivered with a leading report ID byte even
+// if the descriptor declares none (Windows raw input always does this).
+class HidDescriptorParser {
+public:
+    static bool parse(const uint8_t* desc, size_t len, bool prefixReportId, std::vector<HidField>& out) {
+        struct Globals {
+            uint16_t usage_page = 0;
+            int32_t logical_min = 0;
+            int32_t logical_max = 0;
+            uint32_t report_size = 0;
+            uint32_t report_count = 0;
+            uint8_t report_id = 0;
+        };
+
+        Globals g;
+        std::vector<Globals> stack;
+        std::vector<uint32_t> usages;      // local: extended usages (page << 16 | usage)
+        uint32_t usage_min = 0, usage_max = 0;
+        bool have_range = false;
+        bool uses_report_ids = false;
+
+        // input bit cursor per report ID (descriptors rarely use more than a handful)
+        std::vector<std::pair<uint8_t, uint32_t>> cursors;
+        auto cursor = [&](uint8_t id) -> uint32_t& {
+            for (auto& c : cursors) if (c.first == id) return c.second;
+            cursors.push_back(std::make_pair(id, 0u));
+            return cursors.back().second;
+        };
+
+        out.clear();
+        size_t i = 0;
+        while (i < len) {
+            uint8_t prefix = desc[i++];
+
+            if (prefix == 0xFE) {                      // long item: skip
+                if (i + 2 > len) return false;
+                i += 2 + desc[i];
+                continue;
+            }
+
+            size_t size = prefix & 0x03;
+            if (size == 3) size = 4;
+            if (i + size > len) return false;
+
+            uint32_t udata = 0;
+            for (size_t b = 0; b < size; b++) udata |= static_cast<uint32_t>(desc[i + b]) << (8 * b);
+            int32_t sdata = sign_extend(udata, size);
+            i += size;
+
+            uint8_t type = (prefix >> 2) & 0x03;
+            uint8_t tag = prefix >> 4;
+
+            if (type == 1) {                           // global
+                switch (tag) {
+                case 0x0: g.usage_page = static_cast<uint16_t>(udata); break;
+                case 0x1: g.logical_min = sdata; break;
+                case 0x2: g.logical_max = sdata; break;
+                case 0x7: g.report_size = udata; break;
+                case 0x8: g.report_id = static_cast<uint8_t>(udata); uses_report_ids = true; break;
+                case 0x9: g.report_count = udata; break;
+                case 0xA: stack.push_back(g); break;
+                case 0xB:
+                    if (stack.empty()) return false;
+                    g = stack.back();
+                    stack.pop_back();
+                    break;
+                }
+            }
+            else if (type == 2) {                      // local
+                uint32_t ext = (size == 4) ? udata : ((static_cast<uint32_t>(g.usage_page) << 16) | udata);
+                switch (tag) {
+                case 0x0: usages.push_back(ext); break;
+                case 0x1: usage_min = ext; have_range = true; break;
+                case 0x2: usage_max = ext; have_range = true; break;
+                }
+            }
+            else if (type == 0) {                      // main
+                if (tag == 0x8) {                      // Input
+                    // A logical maximum that sign-extends below the minimum is an
+                    // unsigned range written with the minimal item size (0x26 0xFF 0xFF).
+                    int32_t lmax = g.logical_max;
+                    if (lmax < g.logical_min && g.logical_min >= 0) {
+                        lmax = static_cast<int32_t>(g.logical_max & size_mask(g.report_size));
+                    }
+
+                    uint32_t& bit = cursor(g.report_id);
+                    for (uint32_t n = 0; n < g.report_count; n++) {
+                        uint32_t ext = 0;
+                        if (n < usages.size()) ext = usages[n];
+                        else if (have_range && usage_min + n <= usage_max) ext = usage_min + n;
+                        else if (!usages.empty()) ext = usages.back();
+
+                        HidField f;
+                        f.usage_page = static_cast<uint16_t>(ext >> 16);
+                        f.usage = static_cast<uint16_t>(ext & 0xFFFF);
+                        f.report_id = g.report_id;
+                        f.bit_offset = bit;
+                        f.bit_size = static_cast<uint8_t>(g.report_size);
+                        f.logical_min = g.logical_min;
+                        f.logical_max = lmax;
+                        f.is_constant = (udata & 0x01) != 0;
+                        f.is_variable = (udata & 0x02) != 0;
+                        if (!f.is_constant && g.report_size > 0 && g.report_size <= 32) out.push_back(f);
+
+                        bit += g.report_size;
+                    }
+                }
+                // Input, Output, Feature, Collection and End Collection all clear locals
+                usages.clear();
+                usage_min = usage_max = 0;
+                have_range = false;
+            }
+        }
+
+        // account for the report ID byte in front of every report
+        if (uses_report_ids || prefixReportId) {
+            for (auto& f : out) f.bit_offset += 8;
+        }
+        return true;
+    }
+
+private:
+    static int32_t sign_extend(uint32_t v, size_t size) {
+        if (size == 1) return static_cast<int8_t>(v);
+        if (size == 2) return static_cast<int16_t>(v);
+        return static_cast<int32_t>(v);
+    }
+
+    static uint32_t size_mask(uint32_t bits) {
+        return bits >= 32 ? 0xFFFFFFFFu : ((1u << bits) - 1u);
+    }
+};
+
+// Which usages feed which logical channel, in priority order.
+// Generic Desktop axes are handed out in descriptor order to the channels listed in
+// fallback_order once the explicit Simulation Controls usages have been matched.
+struct HidChannelMap {
+    uint16_t explicit_usage[ChannelCount];
+    PedalChannel fallback_order[ChannelCount];
+    int fallback_count;
+
+    // Fanatec pedals: first axis throttle, second brake, third clutch
+    static HidChannelMap pedals() {
+        HidChannelMap m;
+        m.explicit_usage[ChannelThrottle] = hid_usage::Accelerator;
+        m.explicit_usage[ChannelBrake] = hid_usage::Brake;
+        m.explicit_usage[ChannelClutch] = hid_usage::Clutch;
+        m.explicit_usage[ChannelSteering] = hid_usage::Steering;
+        m.fallback_order[0] = ChannelThrottle;
+        m.fallback_order[1] = ChannelBrake;
+        m.fallback_order[2] = ChannelClutch;
+        m.fallback_count = 3;
+        return m;
+    }
+
+    // Wheel bases: X is steering, any further axes are attached pedals
+    static HidChannelMap wheel() {
+        HidChannelMap m = pedals();
+        m.fallback_order[0] = ChannelSteering;
+        m.fallback_order[1] = ChannelThrottle;
+        m.fallback_order[2] = ChannelBrake;
+        m.fallback_order[3] = ChannelClutch;
+        m.fallback_count = 4;
+        return m;
+    }
+};
+
+// Compiled per-device extraction program. extract() is the only thing on the hot path.
+class HidExtractionPlan {
+public:
+    static const size_t MaxReportBytes = 64;
+    static const int MaxButtons = 32;
+
+    struct AxisOp {
+        uint16_t byte_offset;
+        uint8_t shift;
+        uint8_t sign_shift;      // 32 - bit_size for signed fields, 0 otherwise
+        uint32_t mask;
+        int32_t logical_min;
+        int64_t scale;           // 65535 / (max - min) in Q16
+    };
+
+    struct ButtonOp {
+        uint16_t byte_offset;
+        uint8_t bit;
+        uint8_t mask;            // 1, or 0 for usages the device does not report
+    };
+
+    // Builds the plan from parsed fields. Only fields of reportId are used; -1 picks the
+    // first input report in the descriptor.
+    bool compile(const std::vector<HidField>& fields, const HidChannelMap& map, int reportId = -1) {
+        *this = HidExtractionPlan();
+
+        const HidField* chosen[ChannelCount] = { nullptr };
+        std::vector<const HidField*> axes;
+
+        // a plan decodes a single input report; default to the first one declared
+        if (reportId < 0) {
+            for (const auto& f : fields) {
+                if (f.is_variable) { reportId = f.report_id; break; }
+            }
+        }
+
+        for (const auto& f : fields) {
+            if (f.report_id != reportId) continue;
+            if (!f.is_variable) continue;
+
+            if (f.usage_page == hid_usage::PageButton && f.bit_size == 1) {
+                if (f.usage >= 1 && f.usage <= MaxButtons) add_button(f);
+                continue;
+            }
+            if (f.bit_size < 2) continue;
+
+            bool taken = false;
+            if (f.usage_page == hid_usage::PageSimulation) {
+                for (int c = 0; c < ChannelCount; c++) {
+                    if (!chosen[c] && map.explicit_usage[c] == f.usage) { chosen[c] = &f; taken = true; break; }
+                }
+            }
+            if (!taken && f.usage_page == hid_usage::PageGenericDesktop &&
+                f.usage >= hid_usage::X && f.usage <= hid_usage::Wheel) {
+                axes.push_back(&f);
+            }
+        }
+
+        size_t next = 0;
+        for (int k = 0; k < map.fallback_count && next < axes.size(); k++) {
+            PedalChannel ch = map.fallback_order[k];
+            if (!chosen[ch]) chosen[ch] = axes[next++];
+        }
+
+        for (int c = 0; c < ChannelCount; c++) {
+            if (!chosen[c]) continue;
+            if (!make_axis(*chosen[c], ops_[c])) return false;
+            present_ |= 1u << c;
+        }
+        report_id_ = static_cast<uint8_t>(reportId);
+        return present_ != 0 || button_count_ > 0;
+    }
+
+    // Offsets reverse-engineered from the Fanatec pedals before descriptor parsing existed.
+    static HidExtractionPlan legacy_fanatec() {
+        HidExtractionPlan p;
+        const uint16_t offsets[3] = { 2, 4, 6 };
+        for (int c = 0; c < 3; c++) {
+            AxisOp& op = p.ops_[c];
+            op.byte_offset = offsets[c];
+            op.shift = 0;
+            op.sign_shift = 0;
+            op.mask = 0xFF;
+            op.logical_min = 0;
+            op.scale = (65535ll << 16) / 255;
+            p.present_ |= 1u << c;
+            p.min_report_size_ = std::max<size_t>(p.min_report_size_, offsets[c] + 1u);
+        }
+        return p;
+    }
+
+    // Decodes one report into sample. Returns false (sample untouched) when the report
+    // is shorter than the plan needs or belongs to a different report ID.
+    bool extract(const uint8_t* report, size_t size, PedalSample& sample) const {
+        if (size < min_report_size_) return false;
+        if (report_id_ != 0 && report[0] != report_id_) return false;
+
+        uint8_t buf[MaxReportBytes + 8] = { 0 };
+        std::memcpy(buf, report, size < MaxReportBytes ? size : MaxReportBytes);
+
+        for (int c = 0; c < ChannelCount; c++) {
+            const AxisOp& op = ops_[c];
+            uint64_t word;
+            std::memcpy(&word, buf + op.byte_offset, sizeof(word));   // little-endian hosts only
+            uint32_t raw = static_cast<uint32_t>(word >> op.shift) & op.mask;
+            int32_t value = static_cast<int32_t>(raw << op.sign_shift) >> op.sign_shift;
+            int64_t norm = ((static_cast<int64_t>(value) - op.logical_min) * op.scale) >> 16;
+            sample.axis[c] = static_cast<uint16_t>(std::min<int64_t>(std::max<int64_t>(norm, 0), 65535));
+        }
+
+        uint32_t buttons = 0;
+        for (int b = 0; b < button_count_; b++) {
+            const ButtonOp& op = buttons_[b];
+            buttons |= static_cast<uint32_t>((buf[op.byte_offset] >> op.bit) & op.mask) << b;
+        }
+        sample.buttons = buttons;
+        return true;
+    }
+
+    bool has_channel(PedalChannel ch) const { return (present_ & (1u << ch)) != 0; }
+    int button_count() const { return button_count_; }
+    size_t min_report_size() const { return min_report_size_; }
+    const AxisOp& op(PedalChannel ch) const { return ops_[ch]; }
+
+private:
+    // Absent channels keep an all-zero op: mask 0, scale 0 -> always decode to 0.
+    AxisOp ops_[ChannelCount] = {};
+    ButtonOp buttons_[MaxButtons] = {};
+    int button_count_ = 0;
+    uint32_t present_ = 0;
+    size_t min_report_size_ = 0;
+    uint8_t report_id_ = 0;      // 0 when the device does not number its reports
+
+    bool make_axis(const HidField& f, AxisOp& op) {
+        if (f.bit_size > 32) return false;
+        uint32_t end_byte = (f.bit_offset + f.bit_size + 7) / 8;
+        if (end_byte > MaxReportBytes) return false;
+
+        int64_t range = static_cast<int64_t>(f.logical_max) - f.logical_min;
+        if (range <= 0) return false;
+
+        op.byte_offset = static_cast<uint16_t>(f.bit_offset / 8);
+        op.shift = static_cast<uint8_t>(f.bit_offset % 8);
+        op.mask = f.bit_size >= 32 ? 0xFFFFFFFFu : ((1u << f.bit_size) - 1u);
+        op.sign_shift = (f.logical_min < 0 && f.bit_size < 32) ? static_cast<uint8_t>(32 - f.bit_size) : 0;
+        op.logical_min = f.logical_min;
+        op.scale = (65535ll << 16) / range;
+        min_report_size_ = std::max<size_t>(min_report_size_, end_byte);
+        return true;
+    }
+
+    void add_button(const HidField& f) {
+        if (button_count_ >= MaxButtons || f.bit_offset / 8 >= MaxReportBytes) return;
+        // keep buttons indexed by usage so bit n is always button n + 1
+        int index = f.usage - 1;
+        while (button_count_ <= index) {
+            buttons_[button_count_] = ButtonOp();
+            button_count_++;
+        }
+        buttons_[index].byte_offset = static_cast<uint16_t>(f.bit_offset / 8);
+        buttons_[index].bit = static_cast<uint8_t>(f.bit_offset % 8);
+        buttons_[index].mask = 1;
+        min_report_size_ = std::max<size_t>(min_report_size_, f.bit_offset / 8 + 1);
+    }
+};
@@ -0,0 +1,94 @@
+// latency_histogram.h - fixed-size log-linear histogram (HDR style) with atomic counters
+//
+// Values below 32 get their own bucket, above that every power of two is split into 16
+// buckets (about 6% resolution) up to ~2^40. record() is a handful of relaxed atomic
+// adds, so the recording thread never blocks and any other thread can read percentiles.
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+class LatencyHistogram {
+public:
+    static const int LinearBuckets = 32;
+    static const int SubBuckets = 16;
+    static const int MaxExponent = 36;
+    static const int BucketCount = LinearBuckets + MaxExponent * SubBuckets;
+
+    LatencyHistogram() { reset(); }
+
+    void record(int64_t value) {
+        if (value < 0) value = 0;
+        uint64_t v = static_cast<uint64_t>(value);
+        counts_[bucket_index(v)].fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(v, std::memory_order_relaxed);
+
+        uint64_t prev = max_.load(std::memory_order_relaxed);
+        while (v > prev && !max_.compare_exchange_weak(prev, v, std::memory_order_relaxed)) {
+        }
+    }
+
+    void reset() {
+        for (int i = 0; i < BucketCount; i++) counts_[i].store(0, std::memory_order_relaxed);
+        total_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+    uint64_t maximum() const { return max_.load(std::memory_order_relaxed); }
+
+    double mean() const {
+        uint64_t n = count();
+        return n ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+
+    // Upper bound of the bucket holding the p-th percentile (p in 0..100).
+    uint64_t percentile(double p) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * n + 0.5);
+        if (rank < 1) rank = 1;
+
+        uint64_t seen = 0;
+        for (int i = 0; i < BucketCount; i++) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t upper = bucket_upper(i);
+                uint64_t m = maximum();
+                return upper < m ? upper : m;
+            }
+        }
+        return maximum();
+    }
+
+    uint64_t bucket_count(int i) const { return counts_[i].load(std::memory_order_relaxed); }
+
+    // Smallest value that lands in bucket i.
+    static uint64_t bucket_lower(int i) {
+        if (i < LinearBuckets) return static_cast<uint64_t>(i);
+        int exp = (i - LinearBuckets) / SubBuckets + 1;
+        uint64_t mantissa = (i - LinearBuckets) % SubBuckets + SubBuckets;
+        return mantissa << exp;
+    }
+
+    static uint64_t bucket_upper(int i) {
+        return i + 1 < BucketCount ? bucket_lower(i + 1) - 1 : bucket_lower(i);
+    }
+
+    static int bucket_index(uint64_t v) {
+        if (v < LinearBuckets) return static_cast<int>(v);
+        int msb = 63;
+        while (!(v >> msb)) msb--;
+        int exp = msb - 4;                                  // mantissa = v >> exp is in [16, 32)
+        if (exp > MaxExponent) return BucketCount - 1;
+        int mantissa = static_cast<int>(v >> exp);
+        return LinearBuckets + (exp - 1) * SubBuckets + (mantissa - SubBuckets);
+    }
+
+private:
+    std::atomic<uint64_t> counts_[BucketCount];
+    std::atomic<uint64_t> total_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
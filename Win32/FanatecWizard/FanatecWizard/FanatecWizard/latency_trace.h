@@ -0,0 +1,93 @@
+// latency_trace.h - per-stage latency of a pedal sample, from the HID report to the output
+//
+// A LatencyTag travels with each sample and collects one timestamp per stage it passes:
+//
+//   receive    WM_INPUT picked up (the report's receivedUs)
+//   decode     routed and decoded into a PedalSample
+//   engine     pedal engine done
+//   publish    handed to the output side (queue push, XCP variables written)
+//   transmit   reached its consumer (CAN frame written, desktop UI thread picked it up)
+//
+// When the sample is done the owner calls LatencyTrace::record. Each stage histogram holds
+// the time since the previous stamped stage, "total" the time from receive to transmit.
+// The histograms are LatencyHistogram, so any thread can record and read without locks.
+// A sample that never gets transmitted (a CAN update superseded by a newer one) still
+// counts in the stages it reached, but not in the total.
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "latency_histogram.h"
+#include "timing.h"
+
+enum TraceStage {
+    StageReceive,
+    StageDecode,
+    StageEngine,
+    StagePublish,
+    StageTransmit,
+    TraceStageCount
+};
+
+inline const char* trace_stage_name(TraceStage s) {
+    static const char* const names[TraceStageCount] = { "receive", "decode", "engine", "publish", "transmit" };
+    return s >= 0 && s < TraceStageCount ? names[s] : "?";
+}
+
+// Plain data: it is copied through the queues with every sample. 0 = stage not reached.
+struct LatencyTag {
+    int64_t t_us[TraceStageCount];
+
+    void begin(int64_t receivedUs) {
+        t_us[StageReceive] = receivedUs;
+        for (int i = StageDecode; i < TraceStageCount; i++) t_us[i] = 0;
+    }
+
+    void stamp(TraceStage s, int64_t t = now_us()) { t_us[s] = t; }
+};
+
+class LatencyTrace {
+public:
+    void record(const LatencyTag& tag) {
+        int64_t prev = tag.t_us[StageReceive];
+        if (prev == 0) return;
+        for (int i = StageDecode; i < TraceStageCount; i++) {
+            const int64_t t = tag.t_us[i];
+            if (t == 0) continue;
+            stages_[i].record(t - prev);
+            prev = t;
+        }
+        if (tag.t_us[StageTransmit] != 0) total_.record(tag.t_us[StageTransmit] - tag.t_us[StageReceive]);
+    }
+
+    const LatencyHistogram& stage(TraceStage s) const { return stages_[s]; }
+    const LatencyHistogram& total() const { return total_; }
+
+    void reset() {
+        for (LatencyHistogram& h : stages_) h.reset();
+        total_.reset();
+    }
+
+    // One line per stage plus the total, in microseconds; the stats endpoint's reply.
+    std::string report() const {
+        std::string out = "stage         count     mean      p50      p99    p99.9      max\n";
+        for (int i = StageDecode; i < TraceStageCount; i++) {
+            append_line(out, trace_stage_name(static_cast<TraceStage>(i)), stages_[i]);
+        }
+        append_line(out, "total", total_);
+        return out;
+    }
+
+private:
+    LatencyHistogram stages_[TraceStageCount];     // [StageReceive] stays empty
+    LatencyHistogram total_;
+
+    static void append_line(std::string& out, const char* name, const LatencyHistogram& h) {
+        char line[128];
+        snprintf(line, sizeof(line), "%-9s %9llu %8.1f %8llu %8llu %8llu %8llu\n", name,
+            (unsigned long long)h.count(), h.mean(), (unsigned long long)h.percentile(50),
+            (unsigned long long)h.percentile(99), (unsigned long long)h.percentile(99.9),
+            (unsigned long long)h.maximum());
+        out += line;
+    }
+};
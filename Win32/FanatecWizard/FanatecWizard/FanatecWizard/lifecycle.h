@@ -0,0 +1,273 @@
+// lifecycle.h - starts a front end's subsystems in dependency order, stops them in reverse
+//
+// Every subsystem is a stage: a start and a stop function, the stages it needs running
+// first (the reactor before the servers on it, the recorder before the threads that
+// record into it) and how long its stop may take:
+//
+//   Lifecycle life;
+//   life.add("network", {}, [&](std::string*) { return network.start(); }, [&] { network.stop(); });
+//   life.add("telemetry", { "network" }, startTelemetry, [&] { telemetry.stop(); }, 500000);
+//   life.add("stats", {}, startStats, [&] { stats.stop(); }, Lifecycle::DefaultStopUs, Lifecycle::Optional);
+//   life.start(&error); ... life.stop(); ... life.start(&error);
+//
+// start() runs the stages so that each comes after the ones it needs, in the order they
+// were added otherwise. A required stage that fails stops what was started and start()
+// returns false; an optional one is marked failed and the rest go on, so a stage after it
+// has to cope without it (telemetry fails by itself when its reactor did not start).
+// stop() runs the stop functions of the running stages in reverse and times each against
+// its deadline. A stop cannot be cut short from outside, and the stages after it may
+// still be in use by it, so one that overruns is reported (on_overrun while it is still
+// stopping, then in report()) rather than abandoned. start() after stop() restarts them.
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "timing.h"
+
+enum class LifecycleState { Stopped, Running, Failed };
+
+inline const char* lifecycle_state_name(LifecycleState s) {
+    switch (s) {
+    case LifecycleState::Running: return "running";
+    case LifecycleState::Failed: return "failed";
+    default: return "stopped";
+    }
+}
+
+class Lifecycle {
+public:
+    typedef std::function<bool(std::string* error)> StartFn;
+    typedef std::function<void()> StopFn;
+    typedef std::function<void(const std::string& stage, int64_t elapsed_us)> OverrunFn;
+
+    enum Need { Required, Optional };
+
+    static constexpr int64_t DefaultStopUs = 1000000;
+
+    struct Stage {
+        std::string name;
+        std::vector<std::string> after;
+        StartFn start;
+        StopFn stop;
+        int64_t deadline_us = DefaultStopUs;
+        Need need = Required;
+        LifecycleState state = LifecycleState::Stopped;
+        std::string error;              // why it failed
+        int64_t start_us = 0;           // in the last start(), 0 when it did not run
+        int64_t stop_us = 0;            // in the last stop()
+        bool overran = false;           // stop_us > deadline_us
+    };
+
+    Lifecycle() = default;
+    Lifecycle(const Lifecycle&) = delete;
+    Lifecycle& operator=(const Lifecycle&) = delete;
+    ~Lifecycle() { stop(); }
+
+    // Not while running.
+    void add(const std::string& name, std::vector<std::string> after, StartFn start, StopFn stop,
+        int64_t stop_deadline_us = DefaultStopUs, Need need = Required) {
+        Stage s;
+        s.name = name;
+        s.after = std::move(after);
+        s.start = std::move(start);
+        s.stop = std::move(stop);
+        s.deadline_us = stop_deadline_us;
+        s.need = need;
+        stages_.push_back(std::move(s));
+    }
+
+    // Called on a watchdog thread once a stop passes its deadline, while it still runs;
+    // a test harness can log it or give up on the process.
+    void on_overrun(OverrunFn fn) { on_overrun_ = std::move(fn); }
+
+    bool start(std::string* error = nullptr) {
+        if (running_) return true;
+        std::vector<size_t> order;
+        if (!sort(order, error)) return false;
+        for (Stage& s : stages_) {
+            s.state = LifecycleState::Stopped;
+            s.error.clear();
+            s.start_us = 0;
+            s.stop_us = 0;
+            s.overran = false;
+        }
+        started_.clear();
+        running_ = true;
+        const int64_t t0 = now_us();
+        for (size_t i : order) {
+            Stage& s = stages_[i];
+            const int64_t begin = now_us();
+            const bool ok = s.start(&s.error);
+            s.start_us = now_us() - begin;
+            if (ok) {
+                s.state = LifecycleState::Running;
+                started_.push_back(i);
+                continue;
+            }
+            s.state = LifecycleState::Failed;
+            if (s.error.empty()) s.error = "did not start";
+            if (s.need == Optional) continue;
+            if (error) *error = s.name + ": " + s.error;
+            stop();
+            return false;
+        }
+        start_total_us_ = now_us() - t0;
+        return true;
+    }
+
+    // Returns false when a stage took longer than its deadline.
+    bool stop() {
+        if (!running_) return true;
+        Watchdog watchdog(*this);
+        bool inTime = true;
+        const int64_t t0 = now_us();
+        for (size_t n = started_.size(); n-- > 0;) {
+            Stage& s = stages_[started_[n]];
+            const int64_t begin = now_us();
+            watchdog.watch(&s, begin);
+            s.stop();
+            s.stop_us = now_us() - begin;
+            s.overran = s.stop_us > s.deadline_us;
+            s.state = LifecycleState::Stopped;
+            inTime = inTime && !s.overran;
+        }
+        watchdog.watch(nullptr, 0);
+        stop_total_us_ = now_us() - t0;
+        started_.clear();
+        running_ = false;
+        return inTime;
+    }
+
+    bool running() const { return running_; }
+    const std::vector<Stage>& stages() const { return stages_; }
+    int64_t start_us() const { return start_total_us_; }
+    int64_t stop_us() const { return stop_total_us_; }
+
+    // One line per stage in the order they were added: state, how long the last start and
+    // stop took in ms against the stop deadline, and why a stage failed.
+    std::string report() const {
+        std::string out = "stage        state     start_ms   stop_ms  deadline_ms\n";
+        for (const Stage& s : stages_) {
+            char line[160];
+            snprintf(line, sizeof(line), "%-12s %-8s %9.1f %9.1f %12.0f%s", s.name.c_str(), lifecycle_state_name(s.state),
+                s.start_us / 1e3, s.stop_us / 1e3, s.deadline_us / 1e3, s.overran ? "  overran" : "");
+            out += line;
+            if (!s.error.empty()) out += "  " + s.error;
+            out += "\n";
+        }
+        char total[96];
+        snprintf(total, sizeof(total), "%-12s %-8s %9.1f %9.1f\n", "total", "", start_total_us_ / 1e3, stop_total_us_ / 1e3);
+        return out + total;
+    }
+
+private:
+    std::vector<Stage> stages_;
+    std::vector<size_t> started_;       // in start order
+    OverrunFn on_overrun_;
+    bool running_ = false;
+    int64_t start_total_us_ = 0;
+    int64_t stop_total_us_ = 0;
+
+    // Reports the stage being stopped once it passes its deadline; only runs a thread
+    // when there is someone to tell.
+    class Watchdog {
+    public:
+        explicit Watchdog(Lifecycle& life) : fn_(life.on_overrun_) {
+            if (fn_) thread_ = std::thread(&Watchdog::run, this);
+        }
+
+        ~Watchdog() {
+            if (!thread_.joinable()) return;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                done_ = true;
+            }
+            changed_.notify_one();
+            thread_.join();
+        }
+
+        void watch(const Stage* stage, int64_t begin_us) {
+            if (!thread_.joinable()) return;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stage_ = stage;
+                begin_us_ = begin_us;
+            }
+            changed_.notify_one();
+        }
+
+    private:
+        const OverrunFn& fn_;
+        std::thread thread_;
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        const Stage* stage_ = nullptr;
+        int64_t begin_us_ = 0;
+        bool done_ = false;
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            const Stage* reported = nullptr;
+            while (!done_) {
+                if (!stage_ || stage_ == reported) {
+                    changed_.wait(lock);
+                    continue;
+                }
+                const Stage* stage = stage_;
+                const int64_t due = begin_us_ + stage->deadline_us;
+                const int64_t now = now_us();
+                if (now < due) {
+                    changed_.wait_for(lock, std::chrono::microseconds(due - now));
+                    continue;
+                }
+                reported = stage;
+                const std::string name = stage->name;
+                lock.unlock();
+                fn_(name, now - begin_us_);
+                lock.lock();
+            }
+        }
+    };
+
+    size_t index_of(const std::string& name) const {
+        for (size_t i = 0; i < stages_.size(); i++) {
+            if (stages_[i].name == name) return i;
+        }
+        return stages_.size();
+    }
+
+    // Each stage after the ones it needs, otherwise the earliest added first.
+    bool sort(std::vector<size_t>& order, std::string* error) const {
+        for (const Stage& s : stages_) {
+            for (const std::string& name : s.after) {
+                if (index_of(name) == stages_.size()) {
+                    if (error) *error = s.name + " needs " + name + ", which is not a stage";
+                    return false;
+                }
+            }
+        }
+        std::vector<bool> placed(stages_.size(), false);
+        while (order.size() < stages_.size()) {
+            size_t next = stages_.size();
+            for (size_t i = 0; i < stages_.size() && next == stages_.size(); i++) {
+                if (placed[i]) continue;
+                bool ready = true;
+                for (const std::string& name : stages_[i].after) ready = ready && placed[index_of(name)];
+                if (ready) next = i;
+            }
+            if (next == stages_.size()) {
+                if (error) *error = "the stages need each other in a circle";
+                return false;
+            }
+            placed[next] = true;
+            order.push_back(next);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,356 @@
+// maneuver_source.h - synthetic pedal manoeuvres in place of real pedals
+//
+// Generates parameterised traces per pedal (hold, ramp, step, sine, sweep, chirp, random
+// telegraph noise) and delivers them as HID reports of a virtual pedal set at up to
+// 10 kHz. A front end attaches the virtual device and starts ManeuverSource instead of
+// RawInputThread, with the same report handler: the reports then go through the same
+// router, filter, curves, engine and outputs (CAN, XCP, Simulink) as real hardware.
+// The front ends do this when FANATEC_MANEUVER names a plan (ManeuverPlan::from_environment).
+//
+// Plans are config_text files (maneuver.cfg); levels are pedal travel 0..1:
+//
+//   rate = 5000                        # reports per second, 1..10000
+//   duration = 3600                    # seconds, 0 = until stopped
+//   seed = 1                           # telegraph noise
+//   throttle.1 = ramp 2 0 1            # shape, seconds, shape parameters
+//   throttle.2 = sine 10 0.2 0.8 0.5   # low, high, Hz
+//   brake.1 = telegraph 30 0 0.6 4     # low, high, mean switches per second
+//   clutch.1 = chirp 20 0 1 0.1 10     # low, high, start Hz, end Hz
+//
+// Segments of a pedal play in index order and then repeat; a pedal without segments
+// stays released. The trace depends only on the plan and the report index, never on
+// wall time, so a run can be repeated exactly.
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config_text.h"
+#include "device_router.h"
+#include "hid_report.h"
+#include "timing.h"
+
+const int ManeuverPedals = ChannelSteering;     // steering is not generated
+const double ManeuverMaxRate = 10000.0;
+
+enum ManeuverShape {
+    ShapeHold,          // level
+    ShapeRamp,          // from, to
+    ShapeStep,          // from, to, delay s
+    ShapeSine,          // low, high, Hz
+    ShapeSweep,         // low, high, start Hz, end Hz (exponential)
+    ShapeChirp,         // low, high, start Hz, end Hz (linear)
+    ShapeTelegraph,     // low, high, mean switches per second
+    ShapeCount
+};
+
+struct ManeuverSegment {
+    ManeuverShape shape = ShapeHold;
+    double duration_s = 1.0;
+    double p[4] = { 0.0, 0.0, 0.0, 0.0 };
+};
+
+struct ManeuverPlan {
+    double rate_hz = 1000.0;
+    double duration_s = 0.0;
+    uint64_t seed = 1;
+    std::vector<ManeuverSegment> pedal[ManeuverPedals];
+
+    // A mixed workout for soak tests: throttle ramps, sines and a chirp, telegraph noise
+    // on the brake, a clutch press every 20 s (mode toggles).
+    static ManeuverPlan standard() {
+        ManeuverPlan p;
+        parse("throttle.1 = ramp 5 0 1\n"
+              "throttle.2 = hold 2 1\n"
+              "throttle.3 = sine 10 0.1 0.9 0.5\n"
+              "throttle.4 = chirp 10 0 1 0.2 20\n"
+              "brake.1 = telegraph 27 0 0.7 2\n"
+              "clutch.1 = hold 19.5 0\n"
+              "clutch.2 = hold 0.5 1\n", p);
+        return p;
+    }
+
+    static bool parse(const std::string& text, ManeuverPlan& out, std::string* error = nullptr) {
+        ManeuverPlan plan;
+        std::map<int, ManeuverSegment> segments[ManeuverPedals];
+        auto set = [&plan, &segments](const std::string& key, const std::string& value) {
+            return plan.set(key, value, segments);
+        };
+        if (!config_text::for_each_entry(text, set, error)) return false;
+        for (int c = 0; c < ManeuverPedals; c++) {
+            for (const auto& s : segments[c]) plan.pedal[c].push_back(s.second);
+        }
+        out = plan;
+        return true;
+    }
+
+    static bool load(const std::string& path, ManeuverPlan& out, std::string* error = nullptr) {
+        std::string text;
+        return config_text::read_file(path, text, error) && parse(text, out, error);
+    }
+
+    // FANATEC_MANEUVER=<plan file>, or "standard" for the plan above. False when the
+    // variable is unset (use the real pedals) or the plan does not load (error says why).
+    static bool from_environment(ManeuverPlan& out, std::string* error = nullptr) {
+        std::string value;
+#ifdef _MSC_VER
+        char* buffer = nullptr;
+        size_t length = 0;
+        if (_dupenv_s(&buffer, &length, "FANATEC_MANEUVER") == 0 && buffer) value = buffer;
+        free(buffer);
+#else
+        if (const char* v = getenv("FANATEC_MANEUVER")) value = v;
+#endif
+        if (value.empty()) return false;
+        if (value == "standard") {
+            out = standard();
+            return true;
+        }
+        return load(value, out, error);
+    }
+
+private:
+    bool set(const std::string& key, const std::string& value, std::map<int, ManeuverSegment>* segments) {
+        double v;
+        if (key == "rate") {
+            if (!config_text::number(value, v) || v < 1.0 || v > ManeuverMaxRate) return false;
+            rate_hz = v;
+            return true;
+        }
+        if (key == "duration") {
+            if (!config_text::number(value, v) || v < 0.0) return false;
+            duration_s = v;
+            return true;
+        }
+        if (key == "seed") {
+            if (!config_text::number(value, v) || v < 0.0) return false;
+            seed = static_cast<uint64_t>(v);
+            return true;
+        }
+
+        std::string field;
+        const int c = config_text::pedal_key(key, field);
+        double index;
+        if (c < 0 || !config_text::number(field, index) || index < 0.0) return false;
+        ManeuverSegment seg;
+        if (!segment(value, seg)) return false;
+        segments[c][static_cast<int>(index)] = seg;
+        return true;
+    }
+
+    // "<shape> <seconds> <parameters...>"
+    static bool segment(const std::string& value, ManeuverSegment& seg) {
+        static const char* const names[ShapeCount] = { "hold", "ramp", "step", "sine", "sweep", "chirp", "telegraph" };
+        static const int params[ShapeCount] = { 1, 2, 3, 3, 4, 4, 3 };
+
+        std::istringstream in(value);
+        std::string name;
+        in >> name >> seg.duration_s;
+        if (!in || seg.duration_s <= 0.0) return false;
+        int shape = 0;
+        while (shape < ShapeCount && name != names[shape]) shape++;
+        if (shape == ShapeCount) return false;
+        seg.shape = static_cast<ManeuverShape>(shape);
+        for (int i = 0; i < params[shape]; i++) {
+            if (!(in >> seg.p[i])) return false;
+        }
+        std::string rest;
+        return !(in >> rest);
+    }
+};
+
+// Produces the samples of a plan one report period at a time.
+class ManeuverGenerator {
+public:
+    explicit ManeuverGenerator(const ManeuverPlan& plan = ManeuverPlan()) : plan_(plan), rng_(plan.seed | 1) {}
+
+    // Total reports in the plan, 0 = endless.
+    uint64_t length() const { return static_cast<uint64_t>(std::llround(plan_.duration_s * plan_.rate_hz)); }
+    uint64_t index() const { return index_; }
+    const ManeuverPlan& plan() const { return plan_; }
+
+    void next(PedalSample& out) {
+        for (int c = 0; c < ManeuverPedals; c++) {
+            out.axis[c] = level_to_axis(step(c));
+        }
+        index_++;
+    }
+
+private:
+    struct Track {
+        size_t segment = 0;
+        uint64_t k = 0;             // report within the segment
+        bool high = false;          // telegraph state
+    };
+
+    ManeuverPlan plan_;
+    Track tracks_[ManeuverPedals];
+    uint64_t index_ = 0;
+    uint64_t rng_;
+
+    static uint16_t level_to_axis(double level) {
+        if (!(level > 0.0)) return 0;
+        if (level >= 1.0) return 65535;
+        return static_cast<uint16_t>(std::lround(level * 65535.0));
+    }
+
+    double random01() {
+        rng_ ^= rng_ << 13;
+        rng_ ^= rng_ >> 7;
+        rng_ ^= rng_ << 17;
+        return (rng_ >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    double step(int c) {
+        const std::vector<ManeuverSegment>& segs = plan_.pedal[c];
+        if (segs.empty()) return 0.0;
+        Track& tr = tracks_[c];
+        const ManeuverSegment* s = &segs[tr.segment];
+        uint64_t n = static_cast<uint64_t>((std::max)(1ll, std::llround(s->duration_s * plan_.rate_hz)));
+        if (tr.k >= n) {
+            tr.segment = (tr.segment + 1) % segs.size();
+            tr.k = 0;
+            s = &segs[tr.segment];
+            n = static_cast<uint64_t>((std::max)(1ll, std::llround(s->duration_s * plan_.rate_hz)));
+        }
+        const double t = tr.k / plan_.rate_hz;
+        const double T = n / plan_.rate_hz;
+        tr.k++;
+
+        const double pi2 = 6.283185307179586;
+        const double mid = 0.5 * (s->p[0] + s->p[1]);
+        const double amp = 0.5 * (s->p[1] - s->p[0]);
+        switch (s->shape) {
+        case ShapeHold:
+            return s->p[0];
+        case ShapeRamp:
+            return s->p[0] + (s->p[1] - s->p[0]) * (t / T);
+        case ShapeStep:
+            return t < s->p[2] ? s->p[0] : s->p[1];
+        case ShapeSine:
+            return mid + amp * std::sin(pi2 * s->p[2] * t);
+        case ShapeSweep: {
+            const double f0 = s->p[2], f1 = s->p[3];
+            if (f0 <= 0.0 || f1 <= 0.0 || f0 == f1) return mid + amp * std::sin(pi2 * f0 * t);
+            const double k = std::log(f1 / f0) / T;
+            return mid + amp * std::sin(pi2 * f0 * (std::exp(k * t) - 1.0) / k);
+        }
+        case ShapeChirp:
+            return mid + amp * std::sin(pi2 * (s->p[2] * t + (s->p[3] - s->p[2]) * t * t / (2.0 * T)));
+        case ShapeTelegraph:
+            if (random01() < s->p[2] / plan_.rate_hz) tr.high = !tr.high;
+            return tr.high ? s->p[1] : s->p[0];
+        default:
+            return 0.0;
+        }
+    }
+};
+
+// Runs a generator on its own thread and hands every sample to the report handler as a
+// report of the virtual pedal set (three 16-bit axes after a zero byte). Reports are
+// paced on the steady clock: sleep while more than 2 ms away, yield-spin for the rest.
+class ManeuverSource {
+public:
+    // device handle key, one report, its size, time it was handed over
+    typedef std::function<void(uint64_t, const uint8_t*, size_t, int64_t)> ReportHandler;
+
+    static const uint64_t Device = 0x4D4E5652;  // handle key of the virtual pedal set
+    static const size_t ReportSize = 8;
+
+    ~ManeuverSource() { stop(); }
+
+    // Registers the virtual pedal set with the router; call before start(), under the
+    // lock that guards the router when a tick thread or task already walks its slots.
+    // Other sources of encode()d reports pass their own key.
+    static DeviceSlot* attach(DeviceRouter& router, uint64_t device = Device, const char* path = "synthetic:maneuver") {
+        std::vector<HidField> fields;
+        const uint16_t usages[ManeuverPedals] = { hid_usage::X, hid_usage::Y, hid_usage::Z };
+        for (int c = 0; c < ManeuverPedals; c++) {
+            HidField f;
+            f.usage_page = hid_usage::PageGenericDesktop;
+            f.usage = usages[c];
+            f.bit_offset = 16 + 16 * c;
+            f.bit_size = 16;
+            f.logical_min = 0;
+            f.logical_max = 65535;
+            fields.push_back(f);
+        }
+        HidExtractionPlan plan;
+        plan.compile(fields, HidChannelMap::pedals());
+        return router.attach_plan(device, path, RolePedals, plan);
+    }
+
+    static void encode(const PedalSample& s, uint8_t* report) {
+        report[0] = 0;
+        report[1] = 0;
+        for (int c = 0; c < ManeuverPedals; c++) {
+            report[2 + 2 * c] = static_cast<uint8_t>(s.axis[c] & 0xFF);
+            report[3 + 2 * c] = static_cast<uint8_t>(s.axis[c] >> 8);
+        }
+    }
+
+    bool start(const ManeuverPlan& plan, ReportHandler onReport) {
+        if (thread_.joinable()) return true;
+        on_report_ = onReport;
+        stop_.store(false);
+        finished_.store(false);
+        reports_.store(0);
+        late_.store(0);
+        thread_ = std::thread(&ManeuverSource::run, this, plan);
+        return true;
+    }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        stop_.store(true);
+        thread_.join();
+    }
+
+    bool running() const { return thread_.joinable() && !finished_.load(); }
+    uint64_t reports() const { return reports_.load(std::memory_order_relaxed); }
+    // reports handed over more than one period after their due time
+    uint64_t late() const { return late_.load(std::memory_order_relaxed); }
+
+private:
+    ReportHandler on_report_;
+    std::thread thread_;
+    std::atomic<bool> stop_{ false };
+    std::atomic<bool> finished_{ false };
+    std::atomic<uint64_t> reports_{ 0 };
+    std::atomic<uint64_t> late_{ 0 };
+
+    void run(ManeuverPlan plan) {
+        ManeuverGenerator gen(plan);
+        const uint64_t length = gen.length();
+        const double periodUs = 1e6 / plan.rate_hz;
+        const int64_t start = now_us();
+
+        PedalSample sample;
+        uint8_t report[ReportSize];
+        while (!stop_.load(std::memory_order_relaxed) && (length == 0 || gen.index() < length)) {
+            const int64_t due = start + static_cast<int64_t>(gen.index() * periodUs);
+            int64_t now = now_us();
+            while (now < due) {
+                if (due - now > 2000) std::this_thread::sleep_for(std::chrono::microseconds(due - now - 1000));
+                else std::this_thread::yield();
+                if (stop_.load(std::memory_order_relaxed)) break;
+                now = now_us();
+            }
+            if (stop_.load(std::memory_order_relaxed)) break;
+            if (now - due > periodUs) late_.fetch_add(1, std::memory_order_relaxed);
+
+            gen.next(sample);
+            encode(sample, report);
+            on_report_(Device, report, ReportSize, now_us());
+            reports_.fetch_add(1, std::memory_order_relaxed);
+        }
+        finished_.store(true);
+    }
+};
@@ -0,0 +1,145 @@
+// mapped_file.h - file-backed memory maps for Win32 and POSIX
+//
+// Only what the session files need: open or create a file, map a range of it (growing
+// the file when the range is past its end), flush, unmap, and cut the file back to size
+// once nothing is mapped. Offsets must be multiples of Granularity, which is the Windows
+// allocation granularity and a whole number of pages everywhere else.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile {
+public:
+    static const size_t Granularity = 65536;
+
+    struct View {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        void* mapping = nullptr;        // Win32 file mapping object
+    };
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    // create = truncate or create for writing; otherwise open an existing file read-only.
+    bool open(const std::string& path, bool create) {
+        close();
+        writable_ = create;
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+            FILE_SHARE_READ | (create ? 0 : FILE_SHARE_WRITE), nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        return file_ != INVALID_HANDLE_VALUE;
+#else
+        fd_ = create ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(path.c_str(), O_RDONLY);
+        return fd_ >= 0;
+#endif
+    }
+
+    bool is_open() const {
+#ifdef _WIN32
+        return file_ != INVALID_HANDLE_VALUE;
+#else
+        return fd_ >= 0;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+#endif
+    }
+
+    int64_t size() const {
+#ifdef _WIN32
+        LARGE_INTEGER s;
+        return GetFileSizeEx(file_, &s) ? s.QuadPart : -1;
+#else
+        struct stat st;
+        return fstat(fd_, &st) == 0 ? static_cast<int64_t>(st.st_size) : -1;
+#endif
+    }
+
+    // Sets the file length; shrinking needs every view of the cut part unmapped.
+    bool resize(int64_t bytes) {
+#ifdef _WIN32
+        LARGE_INTEGER pos;
+        pos.QuadPart = bytes;
+        return SetFilePointerEx(file_, pos, nullptr, FILE_BEGIN) && SetEndOfFile(file_);
+#else
+        return ftruncate(fd_, static_cast<off_t>(bytes)) == 0;
+#endif
+    }
+
+    bool map(int64_t offset, size_t bytes, View& view) {
+        view = View();
+        if (writable_ && size() < offset + static_cast<int64_t>(bytes) && !resize(offset + static_cast<int64_t>(bytes))) {
+            return false;
+        }
+#ifdef _WIN32
+        const uint64_t end = static_cast<uint64_t>(offset) + bytes;
+        HANDLE mapping = CreateFileMappingA(file_, nullptr, writable_ ? PAGE_READWRITE : PAGE_READONLY,
+            static_cast<DWORD>(end >> 32), static_cast<DWORD>(end), nullptr);
+        if (!mapping) return false;
+        void* p = MapViewOfFile(mapping, writable_ ? FILE_MAP_WRITE : FILE_MAP_READ,
+            static_cast<DWORD>(static_cast<uint64_t>(offset) >> 32), static_cast<DWORD>(offset), bytes);
+        if (!p) {
+            CloseHandle(mapping);
+            return false;
+        }
+        view.mapping = mapping;
+#else
+        void* p = mmap(nullptr, bytes, PROT_READ | (writable_ ? PROT_WRITE : 0), MAP_SHARED, fd_, static_cast<off_t>(offset));
+        if (p == MAP_FAILED) return false;
+#endif
+        view.data = static_cast<uint8_t*>(p);
+        view.size = bytes;
+        return true;
+    }
+
+    // wait = false only schedules the write-back.
+    static void flush(const View& view, bool wait) {
+        if (!view.data) return;
+#ifdef _WIN32
+        FlushViewOfFile(view.data, view.size);
+        (void)wait;
+#else
+        msync(view.data, view.size, wait ? MS_SYNC : MS_ASYNC);
+#endif
+    }
+
+    static void unmap(View& view) {
+        if (!view.data) return;
+#ifdef _WIN32
+        UnmapViewOfFile(view.data);
+        CloseHandle(static_cast<HANDLE>(view.mapping));
+#else
+        munmap(view.data, view.size);
+#endif
+        view = View();
+    }
+
+private:
+    bool writable_ = false;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+};
@@ -0,0 +1,193 @@
+// pedal_capture.h - recorded pedal traces for offline replay
+//
+// A capture is the sequence of decoded samples one pedal source produced, with their
+// receive times. Three encodings are read:
+//
+//   binary (.fpc) - CaptureHeader followed by header.count CaptureRecord, little endian
+//   compressed    - "FPC2", column count (4), then per column (t_us, each axis, buttons)
+//                   its byte length (8) and a delta_codec column; a day at 1 kHz shrinks
+//                   to a few percent of the binary form
+//   text (.csv)   - "t_us,throttle,brake,clutch[,steering[,buttons]]" per line, axes
+//                   0..65535; lines starting with '#' and a non-numeric header are skipped
+//
+// Only the portable C++ library is used so traces can be replayed on any platform.
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "delta_codec.h"
+#include "hid_report.h"
+
+struct CaptureRecord {
+    int64_t t_us;                   // receive time, steady clock
+    uint16_t axis[ChannelCount];
+    uint32_t buttons;
+};
+
+struct CaptureHeader {
+    char magic[4];                  // "FPC1"
+    uint32_t record_size;           // sizeof(CaptureRecord), guards against layout changes
+    uint64_t count;
+};
+
+struct PedalCapture {
+    std::string name;
+    std::vector<CaptureRecord> records;
+
+    int64_t duration_us() const {
+        return records.size() < 2 ? 0 : records.back().t_us - records.front().t_us;
+    }
+
+    static PedalSample sample_of(const CaptureRecord& r) {
+        PedalSample s;
+        for (int c = 0; c < ChannelCount; c++) s.axis[c] = r.axis[c];
+        s.buttons = r.buttons;
+        return s;
+    }
+
+    static CaptureRecord record_of(const PedalSample& s, int64_t t_us) {
+        CaptureRecord r;
+        r.t_us = t_us;
+        for (int c = 0; c < ChannelCount; c++) r.axis[c] = s.axis[c];
+        r.buttons = s.buttons;
+        return r;
+    }
+};
+
+class CaptureFile {
+public:
+    static bool write_binary(const std::string& path, const PedalCapture& capture) {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) return false;
+
+        CaptureHeader h;
+        memcpy(h.magic, "FPC1", 4);
+        h.record_size = sizeof(CaptureRecord);
+        h.count = capture.records.size();
+        bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+        if (ok && h.count > 0) {
+            ok = fwrite(capture.records.data(), sizeof(CaptureRecord), capture.records.size(), f) == capture.records.size();
+        }
+        return fclose(f) == 0 && ok;
+    }
+
+    static bool write_compressed(const std::string& path, const PedalCapture& capture) {
+        const size_t n = capture.records.size();
+        std::vector<int64_t> column(n);
+        std::vector<uint8_t> out(8);
+        memcpy(&out[0], "FPC2", 4);
+        delta_codec::put32(&out[4], CaptureColumns);
+        for (int c = 0; c < CaptureColumns; c++) {
+            for (size_t i = 0; i < n; i++) {
+                const CaptureRecord& r = capture.records[i];
+                column[i] = c == 0 ? r.t_us : (c <= ChannelCount ? r.axis[c - 1] : r.buttons);
+            }
+            const size_t at = out.size();
+            out.resize(at + 8);
+            delta_codec::encode(column.data(), n, out);
+            delta_codec::put64(&out[at], static_cast<int64_t>(out.size() - at - 8));
+        }
+
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) return false;
+        const bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+        return fclose(f) == 0 && ok;
+    }
+
+    // Picks the encoding from the first bytes of the file.
+    static bool read(const std::string& path, PedalCapture& capture) {
+        capture.name = path;
+        capture.records.clear();
+
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) return false;
+
+        char magic[4] = { 0 };
+        size_t got = fread(magic, 1, sizeof(magic), f);
+        rewind(f);
+
+        bool ok;
+        if (got == 4 && memcmp(magic, "FPC1", 4) == 0) ok = read_binary(f, capture);
+        else if (got == 4 && memcmp(magic, "FPC2", 4) == 0) ok = read_compressed(f, capture);
+        else ok = read_text(f, capture);
+        fclose(f);
+        return ok;
+    }
+
+private:
+    static const int CaptureColumns = 2 + ChannelCount;     // t_us, axes, buttons
+
+    static bool read_compressed(FILE* f, PedalCapture& capture) {
+        std::vector<uint8_t> data;
+        uint8_t buffer[65536];
+        size_t got;
+        while ((got = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + got);
+        if (ferror(f) || data.size() < 8 || delta_codec::get32(&data[4]) != CaptureColumns) return false;
+
+        size_t at = 8;
+        std::vector<int64_t> column;
+        for (int c = 0; c < CaptureColumns; c++) {
+            if (at + 8 > data.size()) return false;
+            const uint64_t bytes = static_cast<uint64_t>(delta_codec::get64(&data[at]));
+            at += 8;
+            delta_codec::Column col;
+            if (bytes > data.size() - at || !col.open(&data[at], static_cast<size_t>(bytes))) return false;
+            if (c == 0) capture.records.resize(col.size());
+            else if (col.size() != capture.records.size()) return false;
+            column.resize(col.size());
+            col.decode(column.data());
+            for (size_t i = 0; i < column.size(); i++) {
+                CaptureRecord& r = capture.records[i];
+                if (c == 0) r.t_us = column[i];
+                else if (c <= ChannelCount) r.axis[c - 1] = static_cast<uint16_t>(column[i]);
+                else r.buttons = static_cast<uint32_t>(column[i]);
+            }
+            at += static_cast<size_t>(bytes);
+        }
+        return true;
+    }
+
+    static bool read_binary(FILE* f, PedalCapture& capture) {
+        CaptureHeader h;
+        if (fread(&h, sizeof(h), 1, f) != 1) return false;
+        if (h.record_size != sizeof(CaptureRecord)) return false;
+
+        capture.records.resize(static_cast<size_t>(h.count));
+        if (h.count == 0) return true;
+        return fread(capture.records.data(), sizeof(CaptureRecord), capture.records.size(), f) == capture.records.size();
+    }
+
+    static bool read_text(FILE* f, PedalCapture& capture) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+
+            long long v[2 + ChannelCount] = { 0 };
+            int fields = 0;
+            char* p = line;
+            while (fields < 2 + ChannelCount) {
+                char* end = nullptr;
+                long long x = strtoll(p, &end, 10);
+                if (end == p) break;
+                v[fields++] = x;
+                p = end;
+                while (*p == ',' || *p == ' ' || *p == '\t') p++;
+            }
+            if (fields == 0) continue;          // column header
+            if (fields < 4) return false;
+
+            CaptureRecord r;
+            r.t_us = v[0];
+            for (int c = 0; c < ChannelCount; c++) {
+                long long a = 1 + c < fields ? v[1 + c] : 0;
+                r.axis[c] = static_cast<uint16_t>(a < 0 ? 0 : (a > 65535 ? 65535 : a));
+            }
+            r.buttons = fields > 1 + ChannelCount ? static_cast<uint32_t>(v[1 + ChannelCount]) : 0;
+            capture.records.push_back(r);
+        }
+        return !ferror(f);
+    }
+};
@@ -0,0 +1,115 @@
+// pedal_engine.h - pedal logic (modes, pedal edges, speed) on explicit state
+//
+// Same rules the desktop app used to run on globals, but the state is a value so each
+// input source can own one and the logic runs without windows.h.
+//
+// Pedal presses are edges from hysteresis triggers (edge_detector.h), and each rising
+// edge fires the matching trigger of the drive mode state machine (drive_mode.h): in
+// static mode a clutch press switches to dynamic, and each throttle or brake press steps
+// the speed. Front-end requests (cruise, test modes) go through pedal_engine_request.
+// Between reports, pedal_engine_tick advances the mode one fixed dt: the vehicle model
+// in dynamic mode, the generators in the test modes.
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "drive_mode.h"
+#include "edge_detector.h"
+#include "hid_report.h"
+#include "vehicle_model.h"
+
+struct PedalEngineState : DriveState {
+    bool left_pressed = false;      // clutch -> changes modes (static & dynamic)
+    bool right_pressed = false;     // acceleration
+    bool middle_pressed = false;    // brake
+
+    int throttle = 0;              // 8-bit pressures of the last report
+    int brake = 0;
+    int clutch = 0;
+
+    PedalEdgeState edges;           // replaces the rp/mp edge counters and lockout timestamps
+};
+
+struct PedalEngineConfig : DriveModeConfig {
+    PedalEdgeConfig edges;          // press/release thresholds and hold times
+};
+
+// Runs one decoded report through the pedal rules. Returns true when speed changed.
+// events (optional) receives the pedal edges of this report.
+inline bool pedal_engine_process(PedalEngineState& s, const PedalSample& sample, int64_t t_us,
+    const PedalEngineConfig& cfg = PedalEngineConfig(), EdgeEvents* events = nullptr)
+{
+    const int before = s.speed;
+    s.clutch = pedal_level8(sample, ChannelClutch);
+    s.throttle = pedal_level8(sample, ChannelThrottle);
+    s.brake = pedal_level8(sample, ChannelBrake);
+
+    EdgeEvents local;
+    EdgeEvents& edges = events ? *events : local;
+    edges.count = 0;
+    detect_pedal_edges(s.edges, cfg.edges, sample, t_us, edges);
+
+    static const ModeTrigger triggers[ChannelSteering] = { TriggerThrottle, TriggerBrake, TriggerClutch };
+    for (const EdgeEvent& e : edges) {
+        if (e.edge == EdgeRising) drive_mode_fire(s, cfg, triggers[e.channel]);
+    }
+
+    s.left_pressed = s.edges.pedal[ChannelClutch].high;
+    s.right_pressed = s.edges.pedal[ChannelThrottle].high;
+    s.middle_pressed = s.edges.pedal[ChannelBrake].high;
+    return s.speed != before;
+}
+
+// Fires a front-end request (TriggerCruise, TriggerRampTest, TriggerStepTest,
+// TriggerCancel). Returns false when the current mode ignores it.
+inline bool pedal_engine_request(PedalEngineState& s, ModeTrigger request, const PedalEngineConfig& cfg = PedalEngineConfig()) {
+    return drive_mode_fire(s, cfg, request);
+}
+
+// Advances the current mode by one cfg.vehicle.dt_s. Callers run it at that fixed rate
+// (catching up if they were late), never once per report.
+inline void pedal_engine_tick(PedalEngineState& s, const PedalEngineConfig& cfg = PedalEngineConfig(),
+    int gearRequest = GearAutomatic)
+{
+    DriveInputs in;
+    in.throttle = s.throttle / 255.0;
+    in.brake = s.brake / 255.0;
+    in.gear = gearRequest;
+    drive_mode_tick(s, cfg, in);
+}
+
+// Fixed-step schedule for the thread or task that ticks the engines: wait until next_us,
+// then run due() steps. It follows the clock, not the reports, so the model keeps running
+// while the pedals are held still (they only report on change). After a stall longer
+// than maxSteps steps the rest of the backlog is skipped rather than run in one burst,
+// and counted in dropped. Offline tools may pass report time as now_us.
+struct PedalTickSchedule {
+    int64_t next_us = 0;
+    uint64_t dropped = 0;           // steps skipped after stalls
+
+    static int64_t step_us(const PedalEngineConfig& cfg) {
+        return std::llround(cfg.vehicle.dt_s * 1e6);
+    }
+
+    void start(int64_t now_us, const PedalEngineConfig& cfg) {
+        next_us = now_us + step_us(cfg);
+    }
+
+    int due(int64_t now_us, const PedalEngineConfig& cfg, int maxSteps = 10) {
+        const int64_t stepUs = step_us(cfg);
+        if (!next_us) {
+            start(now_us, cfg);
+            return 0;
+        }
+        int steps = 0;
+        while (next_us <= now_us && steps < maxSteps) {
+            next_us += stepUs;
+            steps++;
+        }
+        if (next_us <= now_us) {
+            dropped += static_cast<uint64_t>((now_us - next_us) / stepUs + 1);
+            next_us = now_us + stepUs;
+        }
+        return steps;
+    }
+};
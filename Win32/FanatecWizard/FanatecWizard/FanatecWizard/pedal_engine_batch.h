@@ -0,0 +1,371 @@
+// pedal_engine_batch.h - the pedal engine for many vehicles at once (structure of arrays)
+//
+// Holds every field of PedalEngineState as its own aligned array and runs the rules of
+// pedal_engine_process for all lanes with masks instead of branches: a condition becomes
+// an all-ones / all-zeros lane mask, and each update is an and/select with it. The
+// kernels are AVX2 (8 lanes) or NEON (4 lanes, AArch64) when the compiler targets them,
+// and a plain mask loop otherwise; all three produce the same bits as the scalar engine.
+// tick() runs the vehicle model for the lanes in dynamic mode through VehicleBatch.
+//
+// The kernels hard-code the static/dynamic part of the drive mode table (the asserts
+// below fail the build if the table changes under them); the front-end modes (cruise,
+// test generators) are not requested on a batch, so its lanes never leave those two.
+//
+// All lanes share one timestamp per process() call (one fleet step).
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "pedal_engine.h"
+#include "vehicle_model.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PEDAL_BATCH_AVX2 1
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#include <arm_neon.h>
+#define PEDAL_BATCH_NEON 1
+#endif
+
+static_assert(drive_mode_plain_row(Static, TriggerClutch, Dynamic, nullptr) &&
+    drive_mode_plain_row(Dynamic, TriggerClutch, Static, nullptr) &&
+    drive_mode_plain_row(Static, TriggerThrottle, Static, drive_actions::step_up) &&
+    drive_mode_plain_row(Static, TriggerBrake, Static, drive_actions::step_down) &&
+    drive_mode_table().jump[Dynamic][TriggerThrottle].count == 0 &&
+    drive_mode_table().jump[Dynamic][TriggerBrake].count == 0 &&
+    Static == 0 && Dynamic == 1, "pedal_engine_batch kernels no longer match the drive mode table");
+
+// Fixed-size array on a 64-byte boundary, zero-initialized.
+template <typename T>
+class AlignedArray {
+public:
+    explicit AlignedArray(size_t count = 0) { resize(count); }
+
+    void resize(size_t count) {
+        raw_.reset(new uint8_t[count * sizeof(T) + 64]);
+        uintptr_t p = reinterpret_cast<uintptr_t>(raw_.get());
+        data_ = reinterpret_cast<T*>((p + 63) & ~static_cast<uintptr_t>(63));
+        memset(data_, 0, count * sizeof(T));
+        size_ = count;
+    }
+
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+    T& operator[](size_t i) { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    size_t size() const { return size_; }
+
+private:
+    std::unique_ptr<uint8_t[]> raw_;
+    T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+class PedalEngineBatch {
+public:
+    explicit PedalEngineBatch(size_t count, const PedalEngineConfig& cfg = PedalEngineConfig())
+        : cfg_(cfg), count_(count), vehicles_(count, cfg.vehicle),
+        mode_(count), speed_(count), throttle_(count), brake_(count), clutch_(count),
+        changed_(count), to_dynamic_(count), throttle_in_(count), brake_in_(count)
+    {
+        for (int ch = 0; ch < ChannelSteering; ch++) {
+            high_[ch].resize(count);
+            edge_us_[ch].resize(count);
+            for (size_t i = 0; i < count; i++) edge_us_[ch][i] = SchmittState().changed_us;
+        }
+    }
+
+    size_t size() const { return count_; }
+    const PedalEngineConfig& config() const { return cfg_; }
+
+    // One report per lane, 16-bit axes like PedalSample::axis.
+    void process(const uint16_t* throttle, const uint16_t* brake, const uint16_t* clutch, int64_t t_us) {
+        size_t i = 0;
+#if defined(PEDAL_BATCH_AVX2)
+        for (; i + 8 <= count_; i += 8) process_avx2(i, throttle, brake, clutch, t_us);
+#elif defined(PEDAL_BATCH_NEON)
+        for (; i + 4 <= count_; i += 4) process_neon(i, throttle, brake, clutch, t_us);
+#endif
+        process_masks(i, count_, throttle, brake, clutch, t_us);
+        if (!toggled_) return;
+        toggled_ = false;
+
+        // entering dynamic mode restarts that lane's vehicle from its static speed; recount
+        // the dynamic lanes so tick() can skip an all-static fleet
+        dynamic_ = 0;
+        for (size_t l = 0; l < count_; l++) {
+            dynamic_ += mode_[l];
+            if (!to_dynamic_[l]) continue;
+            VehicleState v;
+            v.speed_ms = speed_[l] / 3.6;
+            vehicles_.set_state(l, v);
+        }
+    }
+
+    // One cfg.vehicle.dt_s step for every lane in dynamic mode.
+    void tick(const int* gearRequest = nullptr) {
+        if (dynamic_ == 0) return;
+        for (size_t i = 0; i < count_; i++) {
+            throttle_in_[i] = throttle_[i] / 255.0;
+            brake_in_[i] = brake_[i] / 255.0;
+        }
+        vehicles_.step(throttle_in_.data(), brake_in_.data(), gearRequest, mode_.data());
+
+        const double* v = vehicles_.speed_ms();
+        for (size_t i = 0; i < count_; i++) {
+            if (mode_[i] != Dynamic) continue;
+            VehicleState s;
+            s.speed_ms = v[i];
+            speed_[i] = (std::min)(cfg_.max_speed, static_cast<int>(std::lround(vehicle_speed_kmh(s))));
+        }
+    }
+
+    PedalEngineState state(size_t i) const {
+        PedalEngineState s;
+        s.mode = static_cast<DriveMode>(mode_[i]);
+        s.speed = speed_[i];
+        s.vehicle = vehicles_.state(i);
+        s.throttle = throttle_[i];
+        s.brake = brake_[i];
+        s.clutch = clutch_[i];
+        for (int ch = 0; ch < ChannelSteering; ch++) {
+            s.edges.pedal[ch].high = high_[ch][i] != 0;
+            s.edges.pedal[ch].changed_us = edge_us_[ch][i];
+        }
+        s.left_pressed = s.edges.pedal[ChannelClutch].high;
+        s.right_pressed = s.edges.pedal[ChannelThrottle].high;
+        s.middle_pressed = s.edges.pedal[ChannelBrake].high;
+        return s;
+    }
+
+    // 1 where the last process() changed the speed (pedal_engine_process's return value)
+    const int32_t* changed() const { return changed_.data(); }
+    const int32_t* speed() const { return speed_.data(); }
+    const int32_t* mode() const { return mode_.data(); }
+
+private:
+    PedalEngineConfig cfg_;
+    size_t count_;
+    VehicleBatch vehicles_;
+
+    AlignedArray<int32_t> mode_, speed_, throttle_, brake_, clutch_;
+    AlignedArray<int32_t> high_[ChannelSteering];     // trigger state per pedal, lane mask
+    AlignedArray<int64_t> edge_us_[ChannelSteering];  // last accepted transition
+    AlignedArray<int32_t> changed_, to_dynamic_;
+    std::vector<double> throttle_in_, brake_in_;
+    bool toggled_ = false;         // some clutch toggle in this process() call
+    size_t dynamic_ = 0;           // lanes in dynamic mode, recounted after a toggle
+
+    static int32_t mask(bool b) { return -static_cast<int32_t>(b); }
+
+    // Reference form of the kernels; also handles the lanes left over after them.
+    void process_masks(size_t begin, size_t end, const uint16_t* throttle, const uint16_t* brake,
+        const uint16_t* clutch, int64_t t_us)
+    {
+        int64_t ready[ChannelSteering];
+        for (int ch = 0; ch < ChannelSteering; ch++) ready[ch] = t_us - cfg_.edges.pedal[ch].hold_us;
+
+        for (size_t i = begin; i < end; i++) {
+            int32_t level[ChannelSteering];
+            level[ChannelThrottle] = throttle[i] >> 8;
+            level[ChannelBrake] = brake[i] >> 8;
+            level[ChannelClutch] = clutch[i] >> 8;
+
+            // the three triggers (schmitt_update with masks)
+            int32_t rise[ChannelSteering];
+            for (int ch = 0; ch < ChannelSteering; ch++) {
+                const SchmittConfig& c = cfg_.edges.pedal[ch];
+                const int32_t high = high_[ch][i];
+                const int32_t idle = mask(edge_us_[ch][i] <= ready[ch]);
+                rise[ch] = idle & ~high & mask(level[ch] >= c.rise);
+                const int32_t fall = idle & high & mask(level[ch] <= c.fall);
+                high_[ch][i] = high ^ (rise[ch] | fall);
+                edge_us_[ch][i] = (rise[ch] | fall) ? t_us : edge_us_[ch][i];
+            }
+
+            const int32_t before = speed_[i];
+            int32_t speed = before;
+
+            // clutch press: toggle the mode
+            const int32_t toggle = rise[ChannelClutch];
+            const int32_t wasStatic = mask(mode_[i] == Static);
+            speed &= ~(toggle & ~wasStatic);                    // dynamic -> static restarts at 0
+            const int32_t isStatic = wasStatic ^ toggle;
+
+            // static steps on throttle and brake presses, clamped after each like drive_mode_fire
+            speed += rise[ChannelThrottle] & isStatic & cfg_.static_step_up;
+            speed = speed < cfg_.max_speed ? speed : cfg_.max_speed;
+            speed -= rise[ChannelBrake] & isStatic & cfg_.static_step_down;
+            speed = speed > 0 ? speed : 0;
+
+            mode_[i] ^= toggle & 1;
+            speed_[i] = speed;
+            throttle_[i] = level[ChannelThrottle];
+            brake_[i] = level[ChannelBrake];
+            clutch_[i] = level[ChannelClutch];
+            changed_[i] = speed != before;
+            to_dynamic_[i] = toggle & wasStatic & 1;
+            toggled_ |= toggle != 0;
+        }
+    }
+
+#if defined(PEDAL_BATCH_AVX2)
+    // 4 x 64-bit compare results -> the matching 32-bit lanes of an 8-lane mask
+    static __m256i pack_mask64(__m256i lo, __m256i hi) {
+        const __m256i order = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        return _mm256_permutevar8x32_epi32(_mm256_blend_epi32(lo, _mm256_slli_epi64(hi, 32), 0xAA), order);
+    }
+
+    static void select64(int64_t* dst, __m256i mask32, __m256i value) {
+        __m256i lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(mask32));
+        __m256i hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(mask32, 1));
+        __m256i* d = reinterpret_cast<__m256i*>(dst);
+        _mm256_store_si256(d, _mm256_blendv_epi8(_mm256_load_si256(d), value, lo));
+        _mm256_store_si256(d + 1, _mm256_blendv_epi8(_mm256_load_si256(d + 1), value, hi));
+    }
+
+    static __m256i load_level8(const uint16_t* p) {
+        return _mm256_srli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))), 8);
+    }
+
+    static __m256i load32(const AlignedArray<int32_t>& a, size_t i) {
+        return _mm256_load_si256(reinterpret_cast<const __m256i*>(a.data() + i));
+    }
+
+    static void store32(AlignedArray<int32_t>& a, size_t i, __m256i v) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(a.data() + i), v);
+    }
+
+    // One hysteresis trigger for 8 lanes; updates its state and returns the press mask.
+    __m256i schmitt_avx2(int ch, size_t i, __m256i level, int64_t t_us) {
+        const SchmittConfig& c = cfg_.edges.pedal[ch];
+        const __m256i ready = _mm256_set1_epi64x(t_us - c.hold_us);
+        int64_t* edgeUs = edge_us_[ch].data() + i;
+        const __m256i* e = reinterpret_cast<const __m256i*>(edgeUs);
+        const __m256i busy = pack_mask64(_mm256_cmpgt_epi64(_mm256_load_si256(e), ready),
+            _mm256_cmpgt_epi64(_mm256_load_si256(e + 1), ready));
+
+        const __m256i high = load32(high_[ch], i);
+        const __m256i rise = _mm256_andnot_si256(_mm256_or_si256(busy, high),
+            _mm256_cmpgt_epi32(level, _mm256_set1_epi32(c.rise - 1)));
+        const __m256i fall = _mm256_andnot_si256(_mm256_or_si256(busy, _mm256_cmpgt_epi32(level, _mm256_set1_epi32(c.fall))),
+            high);
+        const __m256i flip = _mm256_or_si256(rise, fall);
+        store32(high_[ch], i, _mm256_xor_si256(high, flip));
+        if (!_mm256_testz_si256(flip, flip)) select64(edgeUs, flip, _mm256_set1_epi64x(t_us));
+        return rise;
+    }
+
+    void process_avx2(size_t i, const uint16_t* throttle, const uint16_t* brake, const uint16_t* clutch, int64_t t_us) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi32(1);
+
+        const __m256i t = load_level8(throttle + i);
+        const __m256i b = load_level8(brake + i);
+        const __m256i c = load_level8(clutch + i);
+        const __m256i toggle = schmitt_avx2(ChannelClutch, i, c, t_us);
+        const __m256i up = schmitt_avx2(ChannelThrottle, i, t, t_us);
+        const __m256i down = schmitt_avx2(ChannelBrake, i, b, t_us);
+        const __m256i before = load32(speed_, i);
+
+        // clutch press
+        const __m256i oldMode = load32(mode_, i);
+        const __m256i wasStatic = _mm256_cmpeq_epi32(oldMode, zero);
+        __m256i speed = _mm256_andnot_si256(_mm256_andnot_si256(wasStatic, toggle), before);
+        const __m256i isStatic = _mm256_xor_si256(wasStatic, toggle);
+        toggled_ |= !_mm256_testz_si256(toggle, toggle);
+
+        // static steps
+        speed = _mm256_add_epi32(speed, _mm256_and_si256(_mm256_and_si256(up, isStatic), _mm256_set1_epi32(cfg_.static_step_up)));
+        speed = _mm256_min_epi32(speed, _mm256_set1_epi32(cfg_.max_speed));
+        speed = _mm256_sub_epi32(speed, _mm256_and_si256(_mm256_and_si256(down, isStatic), _mm256_set1_epi32(cfg_.static_step_down)));
+        speed = _mm256_max_epi32(speed, zero);
+
+        store32(mode_, i, _mm256_xor_si256(oldMode, _mm256_and_si256(toggle, one)));
+        store32(speed_, i, speed);
+        store32(throttle_, i, t);
+        store32(brake_, i, b);
+        store32(clutch_, i, c);
+        store32(changed_, i, _mm256_andnot_si256(_mm256_cmpeq_epi32(speed, before), one));
+        store32(to_dynamic_, i, _mm256_and_si256(_mm256_and_si256(toggle, wasStatic), one));
+    }
+#endif
+
+#if defined(PEDAL_BATCH_NEON)
+    // 2 + 2 x 64-bit compare results -> a 4-lane 32-bit mask
+    static uint32x4_t pack_mask64(uint64x2_t lo, uint64x2_t hi) {
+        return vcombine_u32(vmovn_u64(lo), vmovn_u64(hi));
+    }
+
+    static void select64(int64_t* dst, uint32x4_t mask32, int64x2_t value) {
+        const int32x4_t m = vreinterpretq_s32_u32(mask32);
+        const uint64x2_t lo = vreinterpretq_u64_s64(vmovl_s32(vget_low_s32(m)));
+        const uint64x2_t hi = vreinterpretq_u64_s64(vmovl_s32(vget_high_s32(m)));
+        vst1q_s64(dst, vbslq_s64(lo, value, vld1q_s64(dst)));
+        vst1q_s64(dst + 2, vbslq_s64(hi, value, vld1q_s64(dst + 2)));
+    }
+
+    static int32x4_t load_level8(const uint16_t* p) {
+        return vreinterpretq_s32_u32(vshrq_n_u32(vmovl_u16(vld1_u16(p)), 8));
+    }
+
+    static int32x4_t and_mask(int32x4_t v, uint32x4_t m) {
+        return vandq_s32(v, vreinterpretq_s32_u32(m));
+    }
+
+    // One hysteresis trigger for 4 lanes; updates its state and returns the press mask.
+    uint32x4_t schmitt_neon(int ch, size_t i, int32x4_t level, int64_t t_us) {
+        const SchmittConfig& c = cfg_.edges.pedal[ch];
+        const int64x2_t ready = vdupq_n_s64(t_us - c.hold_us);
+        int64_t* edgeUs = edge_us_[ch].data() + i;
+        const uint32x4_t busy = pack_mask64(vcgtq_s64(vld1q_s64(edgeUs), ready),
+            vcgtq_s64(vld1q_s64(edgeUs + 2), ready));
+
+        int32_t* highP = high_[ch].data() + i;
+        const uint32x4_t high = vreinterpretq_u32_s32(vld1q_s32(highP));
+        const uint32x4_t rise = vbicq_u32(vcgeq_s32(level, vdupq_n_s32(c.rise)), vorrq_u32(busy, high));
+        const uint32x4_t fall = vbicq_u32(vandq_u32(vcleq_s32(level, vdupq_n_s32(c.fall)), high), busy);
+        const uint32x4_t flip = vorrq_u32(rise, fall);
+        vst1q_s32(highP, vreinterpretq_s32_u32(veorq_u32(high, flip)));
+        if (vmaxvq_u32(flip) != 0) select64(edgeUs, flip, vdupq_n_s64(t_us));
+        return rise;
+    }
+
+    void process_neon(size_t i, const uint16_t* throttle, const uint16_t* brake, const uint16_t* clutch, int64_t t_us) {
+        const int32x4_t zero = vdupq_n_s32(0);
+        const uint32x4_t one = vdupq_n_u32(1);
+
+        const int32x4_t t = load_level8(throttle + i);
+        const int32x4_t b = load_level8(brake + i);
+        const int32x4_t c = load_level8(clutch + i);
+        const uint32x4_t toggle = schmitt_neon(ChannelClutch, i, c, t_us);
+        const uint32x4_t up = schmitt_neon(ChannelThrottle, i, t, t_us);
+        const uint32x4_t down = schmitt_neon(ChannelBrake, i, b, t_us);
+        const int32x4_t before = vld1q_s32(speed_.data() + i);
+
+        // clutch press
+        const int32x4_t oldMode = vld1q_s32(mode_.data() + i);
+        const uint32x4_t wasStatic = vceqq_s32(oldMode, zero);
+        int32x4_t speed = vbicq_s32(before, vreinterpretq_s32_u32(vbicq_u32(toggle, wasStatic)));
+        const uint32x4_t isStatic = veorq_u32(wasStatic, toggle);
+        toggled_ |= vmaxvq_u32(toggle) != 0;
+
+        // static steps
+        speed = vaddq_s32(speed, and_mask(vdupq_n_s32(cfg_.static_step_up), vandq_u32(up, isStatic)));
+        speed = vminq_s32(speed, vdupq_n_s32(cfg_.max_speed));
+        speed = vsubq_s32(speed, and_mask(vdupq_n_s32(cfg_.static_step_down), vandq_u32(down, isStatic)));
+        speed = vmaxq_s32(speed, zero);
+
+        vst1q_s32(mode_.data() + i, veorq_s32(oldMode, vreinterpretq_s32_u32(vandq_u32(toggle, one))));
+        vst1q_s32(speed_.data() + i, speed);
+        vst1q_s32(throttle_.data() + i, t);
+        vst1q_s32(brake_.data() + i, b);
+        vst1q_s32(clutch_.data() + i, c);
+        vst1q_s32(changed_.data() + i, vreinterpretq_s32_u32(vbicq_u32(one, vceqq_s32(speed, before))));
+        vst1q_s32(to_dynamic_.data() + i, vreinterpretq_s32_u32(vandq_u32(vandq_u32(toggle, wasStatic), one)));
+    }
+#endif
+};
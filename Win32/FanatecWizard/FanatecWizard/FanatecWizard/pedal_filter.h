@@ -0,0 +1,139 @@
+// pedal_filter.h - per-pedal noise filtering ahead of the pedal engine
+//
+// Pedal sensors jitter by a few counts around rest, which used to reach the engine as
+// spurious edges and as creep in the low-pressure branches. Every decoded sample now
+// runs through a filter per pedal, each stage optional:
+//
+//   median of 3   drops single-report spikes (one report of delay on real steps)
+//   one-pole IIR  y += alpha * (x - y), state kept in Q8 (axis << 8), alpha in Q15
+//   rate limit    caps the change per elapsed microsecond, so it holds at any report rate
+//
+// Integer arithmetic only, fixed-size state, no allocation; one call per report on the
+// input thread. Settings come from pedal_filter.cfg (config_text.h format):
+//
+//   throttle.median = 1
+//   throttle.smoothing = 0.25      # IIR alpha, 1 = off, smaller = smoother
+//   brake.rate_limit = 20          # full pedal travels per second, 0 = off
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include "config_text.h"
+#include "hid_report.h"
+
+const int FilterPedals = ChannelSteering;      // steering is not filtered
+const int32_t FilterAlphaOne = 32768;          // Q15 1.0
+
+struct PedalFilterChannel {
+    bool median = false;
+    int32_t alpha_q15 = FilterAlphaOne;        // IIR off
+    int32_t rate_per_ms = 0;                   // axis counts per millisecond, 0 = off
+
+    bool passthrough() const { return !median && alpha_q15 >= FilterAlphaOne && rate_per_ms <= 0; }
+};
+
+struct PedalFilterConfig {
+    PedalFilterChannel pedal[FilterPedals];
+
+    static bool parse(const std::string& text, PedalFilterConfig& out, std::string* error = nullptr) {
+        PedalFilterConfig cfg;
+        auto set = [&cfg](const std::string& key, const std::string& value) { return cfg.set(key, value); };
+        if (!config_text::for_each_entry(text, set, error)) return false;
+        out = cfg;
+        return true;
+    }
+
+    static bool load(const std::string& path, PedalFilterConfig& out, std::string* error = nullptr) {
+        std::string text;
+        return config_text::read_file(path, text, error) && parse(text, out, error);
+    }
+
+private:
+    bool set(const std::string& key, const std::string& value) {
+        std::string field;
+        const int c = config_text::pedal_key(key, field);
+        double v;
+        if (c < 0 || !config_text::number(value, v)) return false;
+        PedalFilterChannel& f = pedal[c];
+        if (field == "median") f.median = v != 0.0;
+        else if (field == "smoothing" && v > 0.0 && v <= 1.0) f.alpha_q15 = static_cast<int32_t>(std::lround(v * FilterAlphaOne));
+        else if (field == "rate_limit" && v >= 0.0) f.rate_per_ms = static_cast<int32_t>(std::lround(v * 65535.0 / 1000.0));
+        else return false;
+        return true;
+    }
+};
+
+struct PedalFilterChannelState {
+    uint16_t window[2] = { 0, 0 };  // the two previous inputs, oldest first
+    int32_t iir_q8 = 0;
+    uint16_t in = 0;                // last raw input
+    uint16_t out = 0;               // last filtered output
+    int64_t last_us = 0;
+    uint32_t rate_limited = 0;      // outputs the limiter clipped
+    bool primed = false;            // false until the first sample, which passes through
+};
+
+struct PedalFilterState {
+    PedalFilterChannelState pedal[FilterPedals];
+
+    void reset() { *this = PedalFilterState(); }
+};
+
+// min/max on int32 so the compiler emits conditional moves; noisy input defeats branches
+inline int32_t median3(int32_t a, int32_t b, int32_t c) {
+    const int32_t lo = a < b ? a : b;
+    const int32_t hi = a < b ? b : a;
+    const int32_t m = hi < c ? hi : c;
+    return lo > m ? lo : m;
+}
+
+inline uint16_t pedal_filter_step(PedalFilterChannelState& s, const PedalFilterChannel& f, uint16_t x, int64_t t_us) {
+    s.in = x;
+    if (!s.primed) {
+        s.window[0] = s.window[1] = x;
+        s.iir_q8 = static_cast<int32_t>(x) << 8;
+        s.out = x;
+        s.last_us = t_us;
+        s.primed = true;
+        return x;
+    }
+
+    // disabled stages still track their input, so enabling one on reload starts clean
+    int32_t v = f.median ? median3(s.window[0], s.window[1], x) : x;
+    s.window[0] = s.window[1];
+    s.window[1] = x;
+
+    if (f.alpha_q15 < FilterAlphaOne) {
+        const int64_t diff = (static_cast<int64_t>(v) << 8) - s.iir_q8;
+        s.iir_q8 += static_cast<int32_t>((diff * f.alpha_q15) >> 15);
+        v = (s.iir_q8 + 128) >> 8;
+    }
+    else {
+        s.iir_q8 = v << 8;
+    }
+
+    if (f.rate_per_ms > 0) {
+        // at most one second of slew, so a long gap cannot overflow the step
+        const int64_t dt = (std::min)((std::max)(t_us - s.last_us, static_cast<int64_t>(0)), static_cast<int64_t>(1000000));
+        const int64_t step = f.rate_per_ms * dt / 1000;
+        const int64_t lo = s.out - step;
+        const int64_t hi = s.out + step;
+        if (v < lo || v > hi) {
+            v = static_cast<int32_t>(v < lo ? lo : hi);
+            s.rate_limited++;
+        }
+    }
+
+    s.out = static_cast<uint16_t>((std::min)((std::max)(v, 0), 65535));
+    s.last_us = t_us;
+    return s.out;
+}
+
+// Filters the pedal axes of one decoded report in place. Pass-through pedals still run
+// the step so their state (in/out for XCP) stays current.
+inline void pedal_filter_apply(PedalFilterState& s, const PedalFilterConfig& cfg, PedalSample& sample, int64_t t_us) {
+    for (int c = 0; c < FilterPedals; c++) {
+        sample.axis[c] = pedal_filter_step(s.pedal[c], cfg.pedal[c], sample.axis[c], t_us);
+    }
+}
@@ -0,0 +1,94 @@
+// pedal_frame.h - what the Simulink block outputs, and how it is packed into ports
+//
+// Kept free of Windows and Simulink headers so the packing (and its per-step cost)
+// can be exercised on any platform; see MatLab/FanatecWizardS/frame_harness.cpp.
+//
+// Port layouts:
+//   scalar mode - one port per PedalSignal (the original five ports plus the age)
+//   vector mode - port 0: PedalSignal vector
+//                 port 1: FrameCapacity x FrameColumns matrix, one row per pedal report
+//                         received since the previous step, oldest first
+//                 port 2: number of valid rows in port 1
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// One pedal report after the block's pedal logic ran on it.
+struct PedalSnapshot {
+    int speed = 0;
+    int driveMode = 0;
+    int throttle = 0;               // 0..255
+    int brake = 0;                  // 0..255
+    bool clutch = false;
+    int64_t updatedUs = 0;          // receive time of the report behind it, 0 before the first one
+    uint64_t reports = 0;
+};
+
+enum PedalSignal {
+    SignalSpeed,                    // 0..1 of 300 km/h
+    SignalMode,                     // DriveMode: 0 static, 1 dynamic, 2 cruise, 3 ramp test, 4 step test
+    SignalThrottle,                 // 0..1
+    SignalBrake,                    // 0..1
+    SignalClutch,                   // 0 / 1
+    SignalAge,                      // seconds since the report was received, -1 before the first
+    SignalCount
+};
+
+enum PedalOutputMode {
+    OutputScalarPorts = 0,
+    OutputVectorPorts = 1
+};
+
+enum PedalFrameColumn {
+    FrameTime,                      // receive time in seconds since the block started
+    FrameSpeed,
+    FrameMode,
+    FrameThrottle,
+    FrameBrake,
+    FrameClutch,
+    FrameColumns
+};
+
+// rows in the frame port; at 1 kHz reports this covers steps up to 64 ms
+const size_t FrameCapacity = 64;
+
+inline void pack_signals(const PedalSnapshot& snap, int64_t nowUs, double* out) {
+    out[SignalSpeed] = static_cast<double>(snap.speed) / 300.0;
+    out[SignalMode] = static_cast<double>(snap.driveMode);
+    out[SignalThrottle] = static_cast<double>(snap.throttle) / 255.0;
+    out[SignalBrake] = static_cast<double>(snap.brake) / 255.0;
+    out[SignalClutch] = snap.clutch ? 1.0 : 0.0;
+    out[SignalAge] = snap.updatedUs ? (nowUs - snap.updatedUs) / 1e6 : -1.0;
+}
+
+// Writes one row of the frame matrix. Simulink matrices are column-major, so column c
+// of row r lives at out[c * FrameCapacity + r].
+inline void pack_frame_row(const PedalSnapshot& snap, int64_t startUs, size_t row, double* out) {
+    out[FrameTime * FrameCapacity + row] = (snap.updatedUs - startUs) / 1e6;
+    out[FrameSpeed * FrameCapacity + row] = static_cast<double>(snap.speed) / 300.0;
+    out[FrameMode * FrameCapacity + row] = static_cast<double>(snap.driveMode);
+    out[FrameThrottle * FrameCapacity + row] = static_cast<double>(snap.throttle) / 255.0;
+    out[FrameBrake * FrameCapacity + row] = static_cast<double>(snap.brake) / 255.0;
+    out[FrameClutch * FrameCapacity + row] = snap.clutch ? 1.0 : 0.0;
+}
+
+// Zeroes the rows after the last valid one so stale samples never reach the model.
+inline void clear_frame_rows(size_t first, double* out) {
+    for (size_t c = 0; c < FrameColumns; c++) {
+        for (size_t r = first; r < FrameCapacity; r++) out[c * FrameCapacity + r] = 0.0;
+    }
+}
+
+// Fills the frame port from a consumer of PedalSnapshots (anything with bool try_pop(T&)).
+// Stops at FrameCapacity; whatever is left is delivered on the next step.
+template <typename Queue>
+size_t drain_frame(Queue& queue, int64_t startUs, double* out) {
+    size_t rows = 0;
+    PedalSnapshot snap;
+    while (rows < FrameCapacity && queue.try_pop(snap)) {
+        pack_frame_row(snap, startUs, rows, out);
+        rows++;
+    }
+    clear_frame_rows(rows, out);
+    return rows;
+}
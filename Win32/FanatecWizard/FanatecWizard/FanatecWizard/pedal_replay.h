@@ -0,0 +1,60 @@
+// pedal_replay.h - runs a recorded trace through the pedal engine offline
+//
+// Reproduces what the desktop app does live: every sample goes through
+// pedal_engine_process at its receive time, and the engine is ticked at the fixed
+// vehicle dt in between, so a replay gives the same speed trace the driver saw.
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include "pedal_capture.h"
+#include "pedal_engine.h"
+
+struct ReplayMetrics {
+    uint64_t samples = 0;
+    double duration_s = 0.0;
+    int final_speed = 0;            // km/h
+    int max_speed = 0;
+    int mode_switches = 0;
+    double time_at_limit_s = 0.0;   // speed at or above cfg.max_speed
+    double distance_m = 0.0;        // driven in dynamic mode
+    DriveMode final_mode = Static;
+};
+
+inline ReplayMetrics replay_capture(const PedalCapture& capture, const PedalEngineConfig& cfg = PedalEngineConfig()) {
+    ReplayMetrics m;
+    PedalEngineState s;
+    if (capture.records.empty()) return m;
+
+    const int64_t stepUs = std::llround(cfg.vehicle.dt_s * 1e6);
+    const int64_t start = capture.records.front().t_us;
+    int64_t nextTick = start + stepUs;
+    DriveMode mode = s.mode;
+
+    auto tick = [&]() {
+        const double before = s.vehicle.distance_m;
+        pedal_engine_tick(s, cfg);
+        m.distance_m += s.vehicle.distance_m - before;
+        if (s.speed >= cfg.max_speed) m.time_at_limit_s += cfg.vehicle.dt_s;
+        if (s.speed > m.max_speed) m.max_speed = s.speed;
+    };
+
+    for (const CaptureRecord& r : capture.records) {
+        while (nextTick <= r.t_us) {
+            tick();
+            nextTick += stepUs;
+        }
+
+        pedal_engine_process(s, PedalCapture::sample_of(r), r.t_us, cfg);
+        if (s.mode != mode) {
+            m.mode_switches++;
+            mode = s.mode;
+        }
+        if (s.speed > m.max_speed) m.max_speed = s.speed;
+        m.samples++;
+    }
+
+    m.duration_s = (capture.records.back().t_us - start) / 1e6;
+    m.final_speed = s.speed;
+    m.final_mode = s.mode;
+    return m;
+}
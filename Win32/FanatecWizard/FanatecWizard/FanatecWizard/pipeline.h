@@ -0,0 +1,385 @@
+// pipeline.h - sources, stages and sinks on named threads, wired by calls or queues
+//
+// A data flow as one object instead of globals and hand-made threads. The front ends
+// keep their own threads and reactors; Tools/PipelineRunner builds models of their flows
+// on it to measure them headless:
+//
+//   Pipeline pipe;
+//   PipelineLane& bus = pipe.lane("can", 2);                 // a thread, pinned to CPU 2
+//   Source<PedalReport>& input = pipe.source<PedalReport>("input", startFn, stopFn);
+//   Stage<PedalReport>& route = pipe.stage<PedalReport>("route", routeFn);
+//   Stage<VehicleUpdate>& latest = pipe.stage<VehicleUpdate>("latest", keepFn);
+//   pipe.every(bus, "send", 100000, sendFn);                 // every 100 ms on "can"
+//   pipe.connect(input.out, route);                           // direct call
+//   pipe.connect<256>(updates, latest, bus);                  // SPSC queue, drained on "can"
+//   pipe.start(); ... pipe.stop();
+//
+// A source runs on its own thread (raw input, a manoeuvre, shared memory) and emit()s
+// into its outlet. A stage is a function of one input type; it emits into whatever
+// Outlet it captured, so stages chain. A direct connection runs the stage on the
+// emitting thread; a queued one hands the item over through a bounded lock-free queue
+// (SpscQueue, so one emitting thread per queue) and the lane's thread runs the stage,
+// counting a drop instead of waiting when the queue is full. Periodic work (the CAN
+// send, a model tick, a UI refresh) is a ticker on a lane.
+//
+// Every stage counts its items and times each call; report() prints the table and can
+// be served by the stats endpoint. Nothing here depends on Windows, so a flow runs
+// headless on Linux as well.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_histogram.h"
+#include "spsc_queue.h"
+#include "thread_policy.h"
+#include "timing.h"
+
+// Pins the calling thread to one CPU; false where that is not supported.
+inline bool pipeline_pin_thread(int cpu) {
+    return thread_policy_pin(cpu);
+}
+
+// Counters of one source, stage or ticker; readable from any thread while it runs.
+class PipelineStage {
+public:
+    explicit PipelineStage(const std::string& name) : name_(name) {}
+    virtual ~PipelineStage() {}
+
+    const std::string& name() const { return name_; }
+    const std::string& lane() const { return lane_; }                  // "" = on the emitting thread, "own" = a source
+    uint64_t items() const { return service_ns_.count(); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }  // queue full
+    const LatencyHistogram& service_ns() const { return service_ns_; }  // per item, downstream direct calls included
+    const LatencyHistogram& queue_depth() const { return queue_depth_; }
+
+protected:
+    friend class Pipeline;
+    template <typename T, size_t N> friend class PipelineQueue;
+
+    // Runs fn and accounts for it as one item.
+    template <class Fn>
+    void timed(Fn&& fn) {
+        const auto t0 = std::chrono::steady_clock::now();
+        fn();
+        service_ns_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+    }
+
+    std::string name_;
+    std::string lane_;
+    LatencyHistogram service_ns_;
+    LatencyHistogram queue_depth_;
+    std::atomic<uint64_t> dropped_{ 0 };
+};
+
+// Where a source or stage sends its items: every connected stage, in connection order.
+template <typename T>
+class Outlet {
+public:
+    void emit(const T& item) const {
+        for (const auto& target : targets_) target(item);
+    }
+    bool connected() const { return !targets_.empty(); }
+
+private:
+    friend class Pipeline;
+    std::vector<std::function<void(const T&)>> targets_;
+};
+
+template <typename In>
+class Stage : public PipelineStage {
+public:
+    typedef std::function<void(const In&)> Fn;
+
+    Stage(const std::string& name, Fn fn) : PipelineStage(name), fn_(fn) {}
+
+    void operator()(const In& item) {
+        timed([&] { fn_(item); });
+    }
+
+private:
+    Fn fn_;
+};
+
+template <typename T>
+class Source : public PipelineStage {
+public:
+    typedef std::function<bool(Source<T>&)> StartFn;   // starts the thread that emits
+    typedef std::function<void()> StopFn;               // returns once it no longer emits
+
+    Source(const std::string& name, StartFn start, StopFn stop) : PipelineStage(name), start_(start), stop_(stop) {}
+
+    // From the source's thread.
+    void emit(const T& item) {
+        timed([&] { out.emit(item); });
+    }
+
+    Outlet<T> out;
+
+private:
+    friend class Pipeline;
+    StartFn start_;
+    StopFn stop_;
+};
+
+class PipelineTicker : public PipelineStage {
+public:
+    typedef std::function<void(int64_t)> Fn;    // gets now_us
+
+    PipelineTicker(const std::string& name, int64_t period_us, Fn fn) : PipelineStage(name), period_us_(period_us), fn_(fn) {}
+
+    int64_t period_us() const { return period_us_; }
+    uint64_t late() const { return late_.load(std::memory_order_relaxed); }   // ran more than a period after due
+
+private:
+    friend class PipelineLane;
+    int64_t period_us_;
+    int64_t next_us_ = 0;
+    Fn fn_;
+    std::atomic<uint64_t> late_{ 0 };
+};
+
+// Consumer end of a queued connection, drained by its lane.
+class PipelineLaneInput {
+public:
+    virtual ~PipelineLaneInput() {}
+    virtual size_t drain(size_t max) = 0;
+};
+
+template <typename T, size_t N>
+class PipelineQueue : public PipelineLaneInput {
+public:
+    explicit PipelineQueue(Stage<T>& stage) : stage_(stage) {}
+
+    // the emitting thread
+    void push(const T& item) {
+        stage_.queue_depth_.record(static_cast<int64_t>(queue_.size()));
+        if (!queue_.try_push(item)) stage_.dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t drain(size_t max) override {
+        size_t n = 0;
+        T item;
+        while (n < max && queue_.try_pop(item)) {
+            stage_(item);
+            n++;
+        }
+        return n;
+    }
+
+private:
+    Stage<T>& stage_;
+    SpscQueue<T, N> queue_;
+};
+
+// One thread: drains its queues, runs its tickers when due, and otherwise yields for a
+// while before sleeping up to 200 us (or until the next ticker is due).
+class PipelineLane {
+public:
+    PipelineLane(const std::string& name, int cpu) : name_(name), cpu_(cpu) {}
+    ~PipelineLane() { stop(); }
+
+    const std::string& name() const { return name_; }
+    int cpu() const { return cpu_; }
+    bool pinned() const { return pinned_.load(); }
+    uint64_t wakeups() const { return wakeups_.load(std::memory_order_relaxed); }
+
+private:
+    friend class Pipeline;
+    std::string name_;
+    int cpu_;
+    std::vector<PipelineLaneInput*> inputs_;
+    std::vector<PipelineTicker*> tickers_;
+    std::thread thread_;
+    std::atomic<bool> stop_{ false };
+    std::atomic<bool> pinned_{ false };
+    std::atomic<uint64_t> wakeups_{ 0 };
+
+    static const size_t Batch = 64;
+
+    void start() {
+        if (thread_.joinable()) return;
+        stop_.store(false);
+        const int64_t now = now_us();
+        for (PipelineTicker* t : tickers_) t->next_us_ = now + t->period_us_;
+        thread_ = std::thread(&PipelineLane::run, this);
+    }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        stop_.store(true);
+        thread_.join();
+    }
+
+    size_t drain_all() {
+        size_t n = 0;
+        for (PipelineLaneInput* in : inputs_) n += in->drain(Batch);
+        return n;
+    }
+
+    void run() {
+        pinned_.store(pipeline_pin_thread(cpu_));
+        int idle = 0;
+        while (!stop_.load(std::memory_order_relaxed)) {
+            size_t n = drain_all();
+            int64_t now = now_us();
+            int64_t next = now + 200;
+            for (PipelineTicker* t : tickers_) {
+                if (now >= t->next_us_) {
+                    if (now - t->next_us_ > t->period_us_) t->late_.fetch_add(1, std::memory_order_relaxed);
+                    t->timed([&] { t->fn_(now); });
+                    t->next_us_ += t->period_us_;
+                    if (t->next_us_ <= now) t->next_us_ = now + t->period_us_;     // fell behind: no burst
+                    n++;
+                }
+                next = (std::min)(next, t->next_us_);
+            }
+            if (n) {
+                idle = 0;
+                wakeups_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (++idle < 100) {
+                std::this_thread::yield();
+            }
+            else if (next > now) {
+                std::this_thread::sleep_for(std::chrono::microseconds(next - now));
+            }
+        }
+        while (drain_all()) {
+        }
+    }
+};
+
+class Pipeline {
+public:
+    Pipeline() = default;
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+    ~Pipeline() { stop(); }
+
+    // A named thread; cpu >= 0 pins it.
+    PipelineLane& lane(const std::string& name, int cpu = -1) {
+        lanes_.emplace_back(new PipelineLane(name, cpu));
+        return *lanes_.back();
+    }
+
+    template <typename T>
+    Source<T>& source(const std::string& name, typename Source<T>::StartFn start, typename Source<T>::StopFn stop) {
+        Source<T>* s = new Source<T>(name, start, stop);
+        s->lane_ = "own";
+        stages_.emplace_back(s);
+        sources_.push_back(Starter{ name, [s] { return s->start_(*s); }, s->stop_ });
+        return *s;
+    }
+
+    template <typename In>
+    Stage<In>& stage(const std::string& name, typename Stage<In>::Fn fn) {
+        Stage<In>* s = new Stage<In>(name, fn);
+        stages_.emplace_back(s);
+        return *s;
+    }
+
+    PipelineTicker& every(PipelineLane& lane, const std::string& name, int64_t period_us, PipelineTicker::Fn fn) {
+        PipelineTicker* t = new PipelineTicker(name, (std::max)(period_us, int64_t(1)), fn);
+        t->lane_ = lane.name();
+        stages_.emplace_back(t);
+        lane.tickers_.push_back(t);
+        return *t;
+    }
+
+    // Direct: the stage runs on the thread that emits.
+    template <typename T>
+    void connect(Outlet<T>& from, Stage<T>& to) {
+        Stage<T>* stage = &to;
+        from.targets_.push_back([stage](const T& item) { (*stage)(item); });
+    }
+
+    // Queued: through an N-slot queue to the stage on lane. One thread may emit into it.
+    template <size_t N, typename T>
+    void connect(Outlet<T>& from, Stage<T>& to, PipelineLane& lane) {
+        PipelineQueue<T, N>* queue = new PipelineQueue<T, N>(to);
+        queues_.emplace_back(queue);
+        lane.inputs_.push_back(queue);
+        to.lane_ = lane.name();
+        from.targets_.push_back([queue](const T& item) { queue->push(item); });
+    }
+
+    // Lanes first, then the sources in the order they were added. On a source that fails
+    // to start, everything started so far is stopped again.
+    bool start(std::string* error = nullptr) {
+        if (running_) return true;
+        started_us_ = now_us();
+        for (auto& l : lanes_) l->start();
+        running_ = true;
+        for (size_t i = 0; i < sources_.size(); i++) {
+            if (!sources_[i].start()) {
+                if (error) *error = "source " + sources_[i].name + " did not start";
+                started_sources_ = i;
+                stop();
+                return false;
+            }
+        }
+        started_sources_ = sources_.size();
+        return true;
+    }
+
+    // Sources in reverse order, then the lanes, which drain their queues before exiting.
+    void stop() {
+        if (!running_) return;
+        for (size_t i = started_sources_; i-- > 0;) sources_[i].stop();
+        for (auto& l : lanes_) l->stop();
+        started_sources_ = 0;
+        running_ = false;
+        run_us_ += now_us() - started_us_;
+    }
+
+    bool running() const { return running_; }
+    const std::vector<std::unique_ptr<PipelineStage>>& stages() const { return stages_; }
+    const std::vector<std::unique_ptr<PipelineLane>>& lanes() const { return lanes_; }
+
+    // Time it ran, over all starts: the counters add up across restarts too.
+    double seconds() const {
+        return (run_us_ + (running_ ? now_us() - started_us_ : 0)) / 1e6;
+    }
+
+    // One line per stage: lane, items, items/s, time per item in ns (mean, p99, max),
+    // share of the run spent in it, drops and the deepest queue seen.
+    std::string report() const {
+        const double s = seconds();
+        std::string out = "stage        lane            items    per s   mean ns    p99 ns    max ns  busy%  dropped  depth\n";
+        for (const auto& st : stages_) {
+            const LatencyHistogram& h = st->service_ns();
+            char line[192];
+            snprintf(line, sizeof(line), "%-12s %-10s %10llu %8.0f %9.0f %9llu %9llu %6.2f %8llu %6llu\n",
+                st->name().c_str(), st->lane().empty() ? "direct" : st->lane().c_str(), (unsigned long long)h.count(),
+                s > 0 ? h.count() / s : 0.0, h.mean(), (unsigned long long)h.percentile(99),
+                (unsigned long long)h.maximum(), s > 0 ? 100.0 * h.mean() * h.count() / (s * 1e9) : 0.0,
+                (unsigned long long)st->dropped(), (unsigned long long)st->queue_depth().maximum());
+            out += line;
+        }
+        return out;
+    }
+
+private:
+    struct Starter {
+        std::string name;
+        std::function<bool()> start;
+        std::function<void()> stop;
+    };
+
+    std::vector<std::unique_ptr<PipelineLane>> lanes_;
+    std::vector<std::unique_ptr<PipelineStage>> stages_;
+    std::vector<std::unique_ptr<PipelineLaneInput>> queues_;
+    std::vector<Starter> sources_;
+    size_t started_sources_ = 0;
+    bool running_ = false;
+    int64_t started_us_ = 0;
+    int64_t run_us_ = 0;
+};
@@ -0,0 +1,168 @@
+// raw_input_thread.h - Raw Input on its own thread
+//
+// Owns a message-only window, registers it for joystick/game pad raw input and blocks
+// in GetMessage until a report arrives, so pedal processing no longer waits behind
+// WM_PAINT on the UI thread (or polls with PeekMessage + Sleep). The handlers run on
+// this thread; hand results to other threads through an SpscQueue.
+#pragma once
+#include <windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "thread_policy.h"
+#include "timing.h"
+
+class RawInputThread {
+public:
+    // device, one report, its size, time the WM_INPUT was picked up
+    typedef std::function<void(HANDLE, const BYTE*, UINT, int64_t)> ReportHandler;
+    // device, true on arrival / false on removal
+    typedef std::function<void(HANDLE, bool)> DeviceHandler;
+
+    ~RawInputThread() { stop(); }
+
+    // Starts the thread and waits until the window exists and raw input is registered.
+    // The thread runs with the policy of stats (thread.input in fanatec.cfg), or at
+    // THREAD_PRIORITY_HIGHEST without one.
+    bool start(ReportHandler onReport, DeviceHandler onDevice, ThreadStats* stats = nullptr) {
+        if (thread_.joinable()) return true;
+        on_report_ = onReport;
+        on_device_ = onDevice;
+        stats_ = stats;
+        started_ = false;
+        ok_ = false;
+
+        thread_ = std::thread(&RawInputThread::run, this);
+
+        std::unique_lock<std::mutex> lock(start_mutex_);
+        start_cv_.wait(lock, [this]() { return started_; });
+        if (!ok_) {
+            lock.unlock();
+            thread_.join();
+        }
+        return ok_;
+    }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        PostThreadMessageW(thread_id_, WM_QUIT, 0, 0);
+        thread_.join();
+    }
+
+    bool running() const { return thread_.joinable(); }
+    uint64_t messages() const { return messages_.load(std::memory_order_relaxed); }
+
+private:
+    ReportHandler on_report_;
+    DeviceHandler on_device_;
+    ThreadStats* stats_ = nullptr;
+
+    std::thread thread_;
+    DWORD thread_id_ = 0;
+    HWND hwnd_ = NULL;
+    std::vector<BYTE> buffer_;              // reused for every WM_INPUT
+    std::atomic<uint64_t> messages_{ 0 };
+
+    std::mutex start_mutex_;
+    std::condition_variable start_cv_;
+    bool started_ = false;
+    bool ok_ = false;
+
+    void signal_started(bool ok) {
+        std::lock_guard<std::mutex> lock(start_mutex_);
+        ok_ = ok;
+        started_ = true;
+        start_cv_.notify_all();
+    }
+
+    void run() {
+        thread_id_ = GetCurrentThreadId();
+        if (stats_) stats_->apply();
+        else thread_policy_apply(ThreadPolicy::defaults(ThreadInput));
+
+        const wchar_t* className = L"FanatecRawInputThread";
+        WNDCLASSEXW wc = { sizeof(WNDCLASSEXW) };
+        wc.lpfnWndProc = window_proc;
+        wc.hInstance = GetModuleHandleW(NULL);
+        wc.lpszClassName = className;
+        if (!RegisterClassExW(&wc) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
+            signal_started(false);
+            return;
+        }
+
+        hwnd_ = CreateWindowExW(0, className, L"Fanatec Raw Input", 0, 0, 0, 0, 0,
+            HWND_MESSAGE, NULL, wc.hInstance, NULL);
+        if (!hwnd_) {
+            signal_started(false);
+            return;
+        }
+        SetWindowLongPtrW(hwnd_, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+
+        RAWINPUTDEVICE rid[2];
+        rid[0].usUsagePage = 0x01;
+        rid[0].usUsage = 0x04;              // joystick
+        rid[0].dwFlags = RIDEV_INPUTSINK | RIDEV_DEVNOTIFY;
+        rid[0].hwndTarget = hwnd_;
+        rid[1] = rid[0];
+        rid[1].usUsage = 0x05;              // game pad
+        if (!RegisterRawInputDevices(rid, 2, sizeof(RAWINPUTDEVICE))) {
+            DestroyWindow(hwnd_);
+            hwnd_ = NULL;
+            signal_started(false);
+            return;
+        }
+
+        signal_started(true);
+
+        MSG msg;
+        while (GetMessageW(&msg, NULL, 0, 0) > 0) {
+            DispatchMessageW(&msg);
+        }
+
+        rid[0].dwFlags = RIDEV_REMOVE;
+        rid[0].hwndTarget = NULL;
+        rid[1].dwFlags = RIDEV_REMOVE;
+        rid[1].hwndTarget = NULL;
+        RegisterRawInputDevices(rid, 2, sizeof(RAWINPUTDEVICE));
+        DestroyWindow(hwnd_);
+        hwnd_ = NULL;
+    }
+
+    void handle_input(LPARAM lParam) {
+        const int64_t receivedUs = now_us();
+        messages_.fetch_add(1, std::memory_order_relaxed);
+
+        UINT size = 0;
+        GetRawInputData((HRAWINPUT)lParam, RID_INPUT, NULL, &size, sizeof(RAWINPUTHEADER));
+        if (size == 0) return;
+        if (buffer_.size() < size) buffer_.resize(size);
+        if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, buffer_.data(), &size, sizeof(RAWINPUTHEADER)) != size) return;
+
+        const RAWINPUT* raw = reinterpret_cast<const RAWINPUT*>(buffer_.data());
+        if (raw->header.dwType != RIM_TYPEHID || !on_report_) return;
+
+        // a single WM_INPUT can carry several reports back to back
+        const UINT reportSize = raw->data.hid.dwSizeHid;
+        for (DWORD r = 0; r < raw->data.hid.dwCount; r++) {
+            on_report_(raw->header.hDevice, raw->data.hid.bRawData + r * reportSize, reportSize, receivedUs);
+        }
+    }
+
+    static LRESULT CALLBACK window_proc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+        RawInputThread* self = reinterpret_cast<RawInputThread*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+        if (self) {
+            if (msg == WM_INPUT) {
+                self->handle_input(lParam);
+                return DefWindowProcW(hwnd, msg, wParam, lParam);   // lets the system free the input
+            }
+            if (msg == WM_INPUT_DEVICE_CHANGE) {
+                if (self->on_device_) self->on_device_(reinterpret_cast<HANDLE>(lParam), wParam == GIDC_ARRIVAL);
+                return 0;
+            }
+        }
+        return DefWindowProcW(hwnd, msg, wParam, lParam);
+    }
+};
@@ -0,0 +1,868 @@
+// reactor.h - C++20 coroutine tasks on one event loop thread: sockets, timers, cancellation
+//
+// A Reactor is one thread running an event loop. Servers and periodic jobs run on it as
+// coroutines (Task<>), so one thread serves the XCP listener and all of its clients, the
+// telemetry clients or the CAN transmit schedule instead of a thread each. A task
+// suspends in co_await on
+//
+//   reactor.readable(s, deadline, &cancel)     the socket became readable (or hung up)
+//   reactor.writable(s, deadline, &cancel)     the socket takes bytes again
+//   reactor.sleep_until(t, &cancel)            a now_us() time
+//   reactor.wait(signal, deadline, &cancel)    Signal::notify() from another task
+//
+// which give an IoStatus: Ready, Timeout at the deadline (NoDeadline = none) or Cancelled
+// once the Cancel passed in is cancelled or the reactor stops. readable and writable
+// wait for the next readiness after a call returned would-block; recv, send_all and
+// accept do the call first and wait only when needed, with a deadline and a Cancel.
+// A Task can co_await another Task, which resumes the caller directly when it finishes.
+//
+// Readiness comes from epoll on Linux (edge triggered: a socket is registered once, in
+// adopt(), and deadlines go through a timerfd, so timers are microsecond accurate), and
+// from WSAPoll elsewhere (define REACTOR_POLL to get that loop on Linux). Windows has no
+// readiness API on IOCP short of the undocumented AFD calls, so it polls like the
+// telemetry server always did; its timeouts are whole milliseconds.
+//
+// Everything of a task runs on the reactor thread and needs no locks; Cancel and Signal
+// belong to that thread too. Other threads hand work over with post(), which wakes the
+// loop (an eventfd, or a loopback UDP socket with WSAPoll). stop() cancels every wait,
+// and every wait after it, lets the tasks run to their end and joins the thread; tasks
+// must not block the loop, so what blocks (a CAN driver write) gets a reactor of its own.
+//
+// On Windows include this (or <winsock2.h>) before <windows.h>.
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "stats_endpoint.h"         // socket shim
+#include "thread_policy.h"
+#include "timing.h"
+
+#if defined(__linux__) && !defined(REACTOR_POLL)
+#define REACTOR_EPOLL 1
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+#ifdef _WIN32
+#define reactor_poll WSAPoll
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#define reactor_poll ::poll
+#endif
+
+enum class IoStatus { Ready, Timeout, Cancelled, Closed };
+
+inline const char* io_status_name(IoStatus s) {
+    static const char* const names[] = { "ready", "timeout", "cancelled", "closed" };
+    return names[static_cast<int>(s)];
+}
+
+inline bool reactor_set_nonblocking(stats_socket_t s) {
+#ifdef _WIN32
+    u_long on = 1;
+    return ioctlsocket(s, FIONBIO, &on) == 0;
+#else
+    const int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+inline bool reactor_would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+class Reactor;
+class Cancel;
+class Signal;
+template <typename T = void> class Task;
+
+namespace reactor_detail {
+
+void finish_spawned(Reactor* reactor, std::coroutine_handle<> h, const std::exception_ptr& error);
+
+struct Waiter {
+    enum Kind { Read, Write, Sleep, Wake };
+
+    Reactor* reactor = nullptr;
+    Kind kind = Sleep;
+    stats_socket_t socket = STATS_INVALID_SOCKET;
+    Signal* signal = nullptr;
+    Cancel* cancel = nullptr;
+    int64_t deadline = INT64_MAX;
+    IoStatus status = IoStatus::Ready;
+    std::coroutine_handle<> handle;
+    bool linked = false;
+    bool timed = false;
+    std::multimap<int64_t, Waiter*>::iterator timer;
+    Waiter* prev = nullptr;                 // in the reactor's list of every wait
+    Waiter* next = nullptr;
+    Waiter* cancel_prev = nullptr;          // in its Cancel's list
+    Waiter* cancel_next = nullptr;
+};
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;   // the task awaiting this one
+    Reactor* owner = nullptr;               // spawned: the reactor frees the frame at the end
+    std::exception_ptr error;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept;
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+};
+
+} // namespace reactor_detail
+
+// A coroutine that starts when it is awaited or spawned on a reactor.
+template <typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = reactor_detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(Handle h) : handle_(h) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+
+    T await_resume() {
+        if (handle_.promise().error) std::rethrow_exception(handle_.promise().error);
+        if constexpr (!std::is_void_v<T>) return std::move(*handle_.promise().value);
+    }
+
+    Handle release() { return std::exchange(handle_, {}); }
+
+private:
+    Handle handle_;
+};
+
+template <typename T>
+Task<T> reactor_detail::Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> reactor_detail::Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// A cancellation scope: cancel() completes every wait made with it as Cancelled, and so
+// every later one. Reactor thread only.
+class Cancel {
+public:
+    Cancel() = default;
+    Cancel(const Cancel&) = delete;
+    Cancel& operator=(const Cancel&) = delete;
+
+    void cancel();
+    bool cancelled() const { return cancelled_; }
+    void reset() { cancelled_ = false; }
+
+private:
+    friend class Reactor;
+    bool cancelled_ = false;
+    reactor_detail::Waiter* head_ = nullptr;
+};
+
+// Wakes the one task waiting on it, or the next one to wait if none is. Reactor thread only.
+class Signal {
+public:
+    Signal() = default;
+    Signal(const Signal&) = delete;
+    Signal& operator=(const Signal&) = delete;
+
+    void notify();
+
+private:
+    friend class Reactor;
+    bool notified_ = false;
+    reactor_detail::Waiter* waiter_ = nullptr;
+};
+
+// A server's live tasks. wait_idle() blocks until the last one is gone (finished, or
+// destroyed by Reactor::stop()); not from the reactor's own thread.
+class TaskGroup {
+public:
+    int count() const { return n_.load(); }
+
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return n_.load() == 0; });
+    }
+
+private:
+    friend class TaskCounter;
+    std::atomic<int> n_{ 0 };
+    std::mutex mutex_;
+    std::condition_variable idle_;
+
+    void done() {
+        if (n_.fetch_sub(1) != 1) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.notify_all();
+    }
+};
+
+// Counts a task for as long as its frame lives, in a plain counter (clients) or in the
+// TaskGroup a server's stop() waits on.
+class TaskCounter {
+public:
+    explicit TaskCounter(std::atomic<int>& n) : n_(&n) { n_->fetch_add(1); }
+    explicit TaskCounter(TaskGroup& group) : group_(&group) { group_->n_.fetch_add(1); }
+    TaskCounter(const TaskCounter&) = delete;
+    TaskCounter& operator=(const TaskCounter&) = delete;
+    ~TaskCounter() {
+        if (group_) group_->done();
+        else n_->fetch_sub(1);
+    }
+
+private:
+    std::atomic<int>* n_ = nullptr;
+    TaskGroup* group_ = nullptr;
+};
+
+struct IoResult {
+    IoStatus status;
+    size_t bytes;                           // read; 0 unless status is Ready
+};
+
+class Reactor {
+public:
+    static constexpr int64_t NoDeadline = INT64_MAX;
+
+    class [[nodiscard]] Wait {
+    public:
+        Wait(const Wait&) = delete;
+        Wait& operator=(const Wait&) = delete;
+        ~Wait() {
+            if (w_.linked) w_.reactor->unlink(w_);
+        }
+
+        bool await_ready() { return w_.reactor->ready_now(w_); }
+        void await_suspend(std::coroutine_handle<> h) {
+            w_.handle = h;
+            w_.reactor->link(w_);
+        }
+        IoStatus await_resume() const { return w_.status; }
+
+    private:
+        friend class Reactor;
+        reactor_detail::Waiter w_;
+
+        Wait(Reactor* r, reactor_detail::Waiter::Kind kind, int64_t deadline, Cancel* cancel,
+             stats_socket_t s = STATS_INVALID_SOCKET, Signal* signal = nullptr) {
+            w_.reactor = r;
+            w_.kind = kind;
+            w_.deadline = deadline;
+            w_.cancel = cancel;
+            w_.socket = s;
+            w_.signal = signal;
+        }
+    };
+
+    Reactor() = default;
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+    ~Reactor() { stop(); }
+
+    // Runs the loop on a thread of its own; stats (optional) gives it a policy and takes
+    // the lateness of its timers.
+    bool start(ThreadStats* stats = nullptr) {
+        if (thread_.joinable()) return true;
+        stats_ = stats;
+        if (!open()) return false;
+        stopping_.store(false);
+        thread_ = std::thread(&Reactor::run, this);
+        return true;
+    }
+
+    // Cancels everything, lets the tasks end, closes the sockets still adopted and joins.
+    // Not from the reactor thread.
+    void stop() {
+        if (!thread_.joinable()) return;
+        stopping_.store(true);
+        wake();
+        thread_.join();
+        for (auto& f : fds_) stats_close_socket(f.first);
+        fds_.clear();
+        close();
+    }
+
+    bool running() const { return thread_.joinable(); }
+    bool on_reactor_thread() const { return std::this_thread::get_id() == thread_.get_id(); }
+
+    // Starts the task on the reactor; it frees itself when it ends. From the reactor
+    // thread, or from any thread while the reactor is not running.
+    void spawn(Task<> task) {
+        auto h = task.release();
+        h.promise().owner = this;
+        roots_.insert(h.address());
+        task_count_.store(roots_.size(), std::memory_order_relaxed);
+        ready_.push_back(h);
+    }
+
+    // Any thread: fn runs on the reactor thread, in order.
+    void post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(post_mutex_);
+            posted_.push_back(std::move(fn));
+        }
+        wake();
+    }
+
+    // post() and wait until fn has run; runs it right away on the reactor thread or while
+    // the reactor is not running.
+    void run_sync(std::function<void()> fn) {
+        if (!thread_.joinable() || on_reactor_thread()) {
+            fn();
+            return;
+        }
+        std::promise<void> done;
+        std::future<void> ran = done.get_future();
+        post([&] {
+            fn();
+            done.set_value();
+        });
+        ran.wait();
+    }
+
+    // Makes the socket non-blocking and watches it; the reactor closes it in close() or stop().
+    bool adopt(stats_socket_t s) {
+        if (!reactor_set_nonblocking(s)) return false;
+#ifdef REACTOR_EPOLL
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = s;
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, s, &ev) != 0) return false;
+#endif
+        fds_[s] = FdState();
+        return true;
+    }
+
+    // Wakes the socket's waits as Closed and closes it.
+    void close(stats_socket_t s) {
+        auto it = fds_.find(s);
+        if (it == fds_.end()) return;
+        if (it->second.reader) complete(*it->second.reader, IoStatus::Closed);
+        if (it->second.writer) complete(*it->second.writer, IoStatus::Closed);
+#ifdef REACTOR_EPOLL
+        epoll_ctl(epoll_, EPOLL_CTL_DEL, s, nullptr);
+#endif
+        fds_.erase(s);
+        stats_close_socket(s);
+    }
+
+    // An adopted listening socket on addr:port (host order), or STATS_INVALID_SOCKET.
+    stats_socket_t listen(uint32_t addr, uint16_t port, int backlog = 64) {
+        stats_socket_t s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s == STATS_INVALID_SOCKET) return s;
+        int reuse = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+        sockaddr_in sa{};
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(addr);
+        sa.sin_port = htons(port);
+        if (bind(s, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0 || ::listen(s, backlog) != 0 || !adopt(s)) {
+            stats_close_socket(s);
+            return STATS_INVALID_SOCKET;
+        }
+        return s;
+    }
+
+    Wait readable(stats_socket_t s, int64_t deadline = NoDeadline, Cancel* cancel = nullptr) {
+        return Wait(this, reactor_detail::Waiter::Read, deadline, cancel, s);
+    }
+
+    Wait writable(stats_socket_t s, int64_t deadline = NoDeadline, Cancel* cancel = nullptr) {
+        return Wait(this, reactor_detail::Waiter::Write, deadline, cancel, s);
+    }
+
+    // Ready at t; a t already past returns at once (an overrun in the ThreadStats).
+    Wait sleep_until(int64_t t, Cancel* cancel = nullptr) {
+        return Wait(this, reactor_detail::Waiter::Sleep, t, cancel);
+    }
+
+    Wait wait(Signal& signal, int64_t deadline = NoDeadline, Cancel* cancel = nullptr) {
+        return Wait(this, reactor_detail::Waiter::Wake, deadline, cancel, STATS_INVALID_SOCKET, &signal);
+    }
+
+    // A connection from the listener, adopted and with TCP_NODELAY; STATS_INVALID_SOCKET
+    // when cancelled or the listener failed.
+    Task<stats_socket_t> accept(stats_socket_t listener, Cancel* cancel = nullptr) {
+        for (;;) {
+            stats_socket_t s = ::accept(listener, nullptr, nullptr);
+            if (s != STATS_INVALID_SOCKET) {
+                int on = 1;
+                setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+                if (adopt(s)) co_return s;
+                stats_close_socket(s);
+                continue;
+            }
+            if (!reactor_would_block()) co_return STATS_INVALID_SOCKET;
+            if (co_await readable(listener, NoDeadline, cancel) != IoStatus::Ready) co_return STATS_INVALID_SOCKET;
+        }
+    }
+
+    // What has arrived, up to size bytes, waiting for it until the deadline.
+    // Closed when the peer hung up or the socket failed.
+    Task<IoResult> recv(stats_socket_t s, void* buffer, size_t size, int64_t deadline = NoDeadline,
+                        Cancel* cancel = nullptr) {
+        for (;;) {
+            const int n = ::recv(s, static_cast<char*>(buffer), static_cast<int>(size), 0);
+            if (n > 0) co_return IoResult{ IoStatus::Ready, static_cast<size_t>(n) };
+            if (n == 0 || !reactor_would_block()) co_return IoResult{ IoStatus::Closed, 0 };
+            const IoStatus st = co_await readable(s, deadline, cancel);
+            if (st != IoStatus::Ready) co_return IoResult{ st, 0 };
+        }
+    }
+
+    // Ready once all of it is with the socket; on Timeout or Cancelled part of it may be.
+    Task<IoStatus> send_all(stats_socket_t s, const void* data, size_t size, int64_t deadline = NoDeadline,
+                            Cancel* cancel = nullptr) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            const int n = ::send(s, p, static_cast<int>(size), STATS_SEND_FLAGS);
+            if (n > 0) {
+                p += n;
+                size -= static_cast<size_t>(n);
+                continue;
+            }
+            if (n == 0 || !reactor_would_block()) co_return IoStatus::Closed;
+            const IoStatus st = co_await writable(s, deadline, cancel);
+            if (st != IoStatus::Ready) co_return st;
+        }
+        co_return IoStatus::Ready;
+    }
+
+    size_t tasks() const { return task_count_.load(std::memory_order_relaxed); }
+    uint64_t loops() const { return loops_.load(std::memory_order_relaxed); }          // event waits
+    uint64_t resumes() const { return resumes_.load(std::memory_order_relaxed); }      // task wake-ups
+
+private:
+    friend void reactor_detail::finish_spawned(Reactor*, std::coroutine_handle<>, const std::exception_ptr&);
+    friend class Cancel;
+    friend class Signal;
+    typedef reactor_detail::Waiter Waiter;
+
+    struct FdState {
+        Waiter* reader = nullptr;
+        Waiter* writer = nullptr;
+    };
+
+    std::thread thread_;
+    std::atomic<bool> stopping_{ false };
+    ThreadStats* stats_ = nullptr;
+    std::unordered_map<stats_socket_t, FdState> fds_;
+    std::multimap<int64_t, Waiter*> timers_;
+    Waiter* waits_ = nullptr;
+    std::unordered_set<void*> roots_;
+    std::vector<std::coroutine_handle<>> ready_, running_;
+    std::mutex post_mutex_;
+    std::vector<std::function<void()>> posted_, posted_run_;
+    std::atomic<bool> wake_pending_{ false };
+    std::atomic<size_t> task_count_{ 0 };
+    std::atomic<uint64_t> loops_{ 0 }, resumes_{ 0 };
+#ifdef REACTOR_EPOLL
+    int epoll_ = -1;
+    int wake_fd_ = -1;
+    int timer_fd_ = -1;
+    int64_t armed_ = NoDeadline;
+#else
+    stats_socket_t wake_socket_ = STATS_INVALID_SOCKET;
+    std::vector<pollfd> pollfds_;
+    bool wsa_ = false;
+#endif
+
+    bool open() {
+#ifdef REACTOR_EPOLL
+        epoll_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        armed_ = NoDeadline;
+        if (epoll_ < 0 || wake_fd_ < 0 || timer_fd_ < 0) return close();
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = wake_fd_;
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, wake_fd_, &ev) != 0) return close();
+        ev.data.fd = timer_fd_;
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, timer_fd_, &ev) != 0) return close();
+        return true;
+#else
+#ifdef _WIN32
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return false;
+        wsa_ = true;
+#endif
+        // a UDP socket sending to itself: the one wake-up WSAPoll can wait on
+        wake_socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (wake_socket_ == STATS_INVALID_SOCKET) return close();
+        sockaddr_in sa{};
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+#ifdef _WIN32
+        int len = sizeof(sa);
+#else
+        socklen_t len = sizeof(sa);
+#endif
+        if (bind(wake_socket_, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0 ||
+            getsockname(wake_socket_, reinterpret_cast<sockaddr*>(&sa), &len) != 0 ||
+            connect(wake_socket_, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0 ||
+            !reactor_set_nonblocking(wake_socket_)) {
+            return close();
+        }
+        return true;
+#endif
+    }
+
+    bool close() {
+#ifdef REACTOR_EPOLL
+        for (int* fd : { &epoll_, &wake_fd_, &timer_fd_ }) {
+            if (*fd >= 0) ::close(*fd);
+            *fd = -1;
+        }
+#else
+        if (wake_socket_ != STATS_INVALID_SOCKET) stats_close_socket(wake_socket_);
+        wake_socket_ = STATS_INVALID_SOCKET;
+#ifdef _WIN32
+        if (wsa_) WSACleanup();
+#endif
+        wsa_ = false;
+#endif
+        return false;
+    }
+
+    void wake() {
+        if (wake_pending_.exchange(true)) return;
+#ifdef REACTOR_EPOLL
+        const uint64_t one = 1;
+        if (::write(wake_fd_, &one, sizeof(one)) < 0) {
+        }
+#else
+        const char one = 1;
+        send(wake_socket_, &one, 1, 0);
+#endif
+    }
+
+    void drain_wake() {
+#ifdef REACTOR_EPOLL
+        uint64_t n;
+        if (::read(wake_fd_, &n, sizeof(n)) < 0) {
+        }
+#else
+        char buf[16];
+        while (::recv(wake_socket_, buf, sizeof(buf), 0) > 0) {
+        }
+#endif
+    }
+
+    // await_ready: completes without suspending when cancelled, past the deadline or signalled
+    bool ready_now(Waiter& w) {
+        if ((w.cancel && w.cancel->cancelled_) || stopping_.load(std::memory_order_relaxed)) {
+            w.status = IoStatus::Cancelled;
+            return true;
+        }
+        if (w.kind == Waiter::Wake && w.signal->notified_) {
+            w.signal->notified_ = false;
+            w.status = IoStatus::Ready;
+            return true;
+        }
+        if (w.deadline != NoDeadline && w.deadline <= now_us()) {
+            if (w.kind == Waiter::Sleep) {
+                if (stats_) stats_->record_overrun();
+                w.status = IoStatus::Ready;
+            }
+            else {
+                w.status = IoStatus::Timeout;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void link(Waiter& w) {
+        if (w.kind == Waiter::Read || w.kind == Waiter::Write) {
+            FdState& f = fds_[w.socket];
+            (w.kind == Waiter::Read ? f.reader : f.writer) = &w;
+        }
+        else if (w.kind == Waiter::Wake) {
+            w.signal->waiter_ = &w;
+        }
+        if (w.deadline != NoDeadline) {
+            w.timer = timers_.emplace(w.deadline, &w);
+            w.timed = true;
+        }
+        if (w.cancel) {
+            w.cancel_prev = nullptr;
+            w.cancel_next = w.cancel->head_;
+            if (w.cancel_next) w.cancel_next->cancel_prev = &w;
+            w.cancel->head_ = &w;
+        }
+        w.prev = nullptr;
+        w.next = waits_;
+        if (waits_) waits_->prev = &w;
+        waits_ = &w;
+        w.linked = true;
+    }
+
+    void unlink(Waiter& w) {
+        if (w.kind == Waiter::Read || w.kind == Waiter::Write) {
+            auto it = fds_.find(w.socket);
+            if (it != fds_.end()) {
+                Waiter*& slot = w.kind == Waiter::Read ? it->second.reader : it->second.writer;
+                if (slot == &w) slot = nullptr;
+            }
+        }
+        else if (w.kind == Waiter::Wake && w.signal->waiter_ == &w) {
+            w.signal->waiter_ = nullptr;
+        }
+        if (w.timed) timers_.erase(w.timer);
+        w.timed = false;
+        if (w.cancel) {
+            if (w.cancel_prev) w.cancel_prev->cancel_next = w.cancel_next;
+            else w.cancel->head_ = w.cancel_next;
+            if (w.cancel_next) w.cancel_next->cancel_prev = w.cancel_prev;
+        }
+        if (w.prev) w.prev->next = w.next;
+        else waits_ = w.next;
+        if (w.next) w.next->prev = w.prev;
+        w.linked = false;
+    }
+
+    void complete(Waiter& w, IoStatus status) {
+        unlink(w);
+        w.status = status;
+        ready_.push_back(w.handle);
+    }
+
+    void finished(std::coroutine_handle<> h, const std::exception_ptr& error) {
+        if (error) {
+            try {
+                std::rethrow_exception(error);
+            }
+            catch (const std::exception& e) {
+                fprintf(stderr, "reactor: task ended with %s\n", e.what());
+            }
+            catch (...) {
+                fprintf(stderr, "reactor: task ended with an exception\n");
+            }
+        }
+        roots_.erase(h.address());
+        task_count_.store(roots_.size(), std::memory_order_relaxed);
+        h.destroy();
+    }
+
+    bool run_posted() {
+        wake_pending_.store(false);
+        {
+            std::lock_guard<std::mutex> lock(post_mutex_);
+            posted_run_.swap(posted_);
+        }
+        for (auto& fn : posted_run_) fn();
+        const bool any = !posted_run_.empty();
+        posted_run_.clear();
+        return any;
+    }
+
+    void resume_ready() {
+        while (!ready_.empty()) {
+            running_.swap(ready_);
+            resumes_.fetch_add(running_.size(), std::memory_order_relaxed);
+            for (auto h : running_) h.resume();
+            running_.clear();
+        }
+    }
+
+    void cancel_all() {
+        while (waits_) complete(*waits_, IoStatus::Cancelled);
+    }
+
+    void event(stats_socket_t s, bool in, bool out) {
+        auto it = fds_.find(s);
+        if (it == fds_.end()) return;
+        if (in && it->second.reader) complete(*it->second.reader, IoStatus::Ready);
+        if (out && it->second.writer) complete(*it->second.writer, IoStatus::Ready);
+    }
+
+    void expire_timers() {
+        if (timers_.empty()) return;
+        const int64_t now = now_us();
+        while (!timers_.empty() && timers_.begin()->first <= now) {
+            Waiter& w = *timers_.begin()->second;
+            if (w.kind == Waiter::Sleep && stats_) stats_->record_wakeup(now - w.deadline);
+            complete(w, w.kind == Waiter::Sleep ? IoStatus::Ready : IoStatus::Timeout);
+        }
+    }
+
+    // Waits for readiness, a post or the first deadline; block = false only looks.
+    void poll_events(bool block) {
+        loops_.fetch_add(1, std::memory_order_relaxed);
+        const int64_t next = timers_.empty() ? NoDeadline : timers_.begin()->first;
+#ifdef REACTOR_EPOLL
+        // re-armed only for an earlier deadline: a timer that fires early costs one loop
+        int timeout = block ? -1 : 0;
+        if (block && next < armed_) {
+            itimerspec ts{};
+            ts.it_value.tv_sec = static_cast<time_t>(next / 1000000);
+            ts.it_value.tv_nsec = static_cast<long>(next % 1000000) * 1000;
+            if (ts.it_value.tv_sec == 0 && ts.it_value.tv_nsec == 0) ts.it_value.tv_nsec = 1;
+            if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &ts, nullptr) == 0) armed_ = next;
+            else timeout = 1;
+        }
+        epoll_event events[64];
+        const int n = epoll_wait(epoll_, events, 64, timeout);
+        for (int i = 0; i < n; i++) {
+            const int fd = events[i].data.fd;
+            const uint32_t ev = events[i].events;
+            if (fd == wake_fd_) {
+                drain_wake();
+            }
+            else if (fd == timer_fd_) {
+                uint64_t expirations;
+                if (::read(timer_fd_, &expirations, sizeof(expirations)) < 0) {
+                }
+                armed_ = NoDeadline;
+            }
+            else {
+                event(fd, (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0, (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0);
+            }
+        }
+#else
+        int timeout = 0;
+        if (block) {
+            if (next == NoDeadline) timeout = -1;
+            else {
+                const int64_t wait = next - now_us();
+                timeout = wait <= 0 ? 0 : static_cast<int>((std::min)((wait + 999) / 1000, int64_t(1) << 30));
+            }
+        }
+        pollfds_.clear();
+        pollfd p{};
+        p.fd = wake_socket_;
+        p.events = POLLIN;
+        pollfds_.push_back(p);
+        for (const auto& f : fds_) {
+            if (!f.second.reader && !f.second.writer) continue;
+            p.fd = f.first;
+            p.events = static_cast<short>((f.second.reader ? POLLIN : 0) | (f.second.writer ? POLLOUT : 0));
+            p.revents = 0;
+            pollfds_.push_back(p);
+        }
+        if (reactor_poll(pollfds_.data(), static_cast<unsigned long>(pollfds_.size()), timeout) <= 0) return;
+        if (pollfds_[0].revents) drain_wake();
+        for (size_t i = 1; i < pollfds_.size(); i++) {
+            const short ev = pollfds_[i].revents;
+            if (!ev) continue;
+            const bool failed = (ev & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+            event(pollfds_[i].fd, failed || (ev & POLLIN), failed || (ev & POLLOUT));
+        }
+#endif
+    }
+
+    void run() {
+        if (stats_) stats_->apply();
+        bool cancelled = false;
+        for (;;) {
+            const bool posted = run_posted();
+            resume_ready();
+            if (stopping_.load()) {
+                // nothing can suspend any more: waits complete as Cancelled at once
+                if (!cancelled) cancel_all();
+                cancelled = true;
+                if (ready_.empty() && !run_posted()) break;
+                continue;
+            }
+            poll_events(!posted && ready_.empty() && !wake_pending_.load());
+            expire_timers();
+        }
+        resume_ready();
+        ready_.clear();
+        // tasks still suspended wait on something other than the reactor; their frames go
+        std::vector<void*> left(roots_.begin(), roots_.end());
+        roots_.clear();
+        for (void* a : left) std::coroutine_handle<>::from_address(a).destroy();
+        task_count_.store(0, std::memory_order_relaxed);
+        timers_.clear();
+        waits_ = nullptr;
+    }
+};
+
+template <typename P>
+std::coroutine_handle<> reactor_detail::PromiseBase::FinalAwaiter::await_suspend(std::coroutine_handle<P> h) noexcept {
+    PromiseBase& p = h.promise();
+    if (p.continuation) return p.continuation;
+    if (p.owner) finish_spawned(p.owner, h, p.error);
+    return std::noop_coroutine();
+}
+
+inline void reactor_detail::finish_spawned(Reactor* reactor, std::coroutine_handle<> h, const std::exception_ptr& error) {
+    reactor->finished(h, error);
+}
+
+inline void Cancel::cancel() {
+    cancelled_ = true;
+    while (head_) head_->reactor->complete(*head_, IoStatus::Cancelled);
+}
+
+inline void Signal::notify() {
+    if (waiter_) waiter_->reactor->complete(*waiter_, IoStatus::Ready);
+    else notified_ = true;
+}
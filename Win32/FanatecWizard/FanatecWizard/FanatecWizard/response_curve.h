@@ -0,0 +1,238 @@
+// response_curve.h - per-pedal response curves compiled into lookup tables
+//
+// A curve maps the normalized pedal travel (0..65535) to the position the rest of the
+// pipeline sees: a dead zone at the top of the rest position, a saturation point
+// where the pedal already counts as fully pressed, and a shape in between (a gamma
+// exponent or a list of breakpoints). Curves come from a small text file:
+//
+//   # pedal_curves.cfg
+//   table_bits = 16                         # 16: 65536 entries, exact; 8: 256 entries
+//   throttle.dead_zone = 0.02               # travel fractions, 0..1
+//   throttle.saturation = 0.97
+//   throttle.gamma = 1.6                    # > 1 soft start, < 1 aggressive start
+//   brake.points = 0:0 0.4:0.15 0.8:0.6 1:1 # overrides gamma
+//
+// Evaluating a curve costs a pow() or a breakpoint search, so each curve is compiled
+// once into a table and mapping a sample is one indexed load. PedalResponse holds the
+// compiled tables behind an atomic pointer: the input thread never locks, a reload
+// builds the new tables off to the side and swaps them in.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "config_text.h"
+#include "hid_report.h"
+
+// Curves apply to the pedals only; steering is centered and passes through.
+const int ResponsePedals = ChannelSteering;
+
+struct ResponseCurve {
+    static const int MaxPoints = 16;
+
+    double dead_zone = 0.0;         // travel below which the output stays at the start of the shape
+    double saturation = 1.0;        // travel from which it stays at the end (full scale for gamma)
+    double gamma = 1.0;
+    int point_count = 0;            // >= 2: piecewise linear through the points instead of gamma
+    double in[MaxPoints] = { 0 };   // strictly increasing, 0..1
+    double out[MaxPoints] = { 0 };
+
+    bool linear() const {
+        return dead_zone <= 0.0 && saturation >= 1.0 && gamma == 1.0 && point_count < 2;
+    }
+};
+
+// Direct evaluation, travel and result 0..1.
+inline double response_eval(const ResponseCurve& c, double x) {
+    double u = (x - c.dead_zone) / (c.saturation - c.dead_zone);
+    u = (std::min)((std::max)(u, 0.0), 1.0);     // dead zone -> start, saturation -> end of the shape
+
+    if (c.point_count < 2) return std::pow(u, c.gamma);
+    if (u <= c.in[0]) return c.out[0];
+    for (int i = 1; i < c.point_count; i++) {
+        if (u < c.in[i]) {
+            const double f = (u - c.in[i - 1]) / (c.in[i] - c.in[i - 1]);
+            return c.out[i - 1] + f * (c.out[i] - c.out[i - 1]);
+        }
+    }
+    return c.out[c.point_count - 1];
+}
+
+// Direct evaluation on the 16-bit axis scale; what a 16-bit table stores.
+inline uint16_t response_eval16(const ResponseCurve& c, uint16_t x) {
+    const double y = response_eval(c, x / 65535.0);
+    return static_cast<uint16_t>(std::lround((std::min)((std::max)(y, 0.0), 1.0) * 65535.0));
+}
+
+// A curve sampled at 2^bits points, indexed by the top bits of the axis value.
+class ResponseTable {
+public:
+    void compile(const ResponseCurve& c, int bits) {
+        const size_t entries = static_cast<size_t>(1) << bits;
+        shift_ = 16 - bits;
+        lut_.resize(entries);
+        for (size_t i = 0; i < entries; i++) {
+            // spread the indices over the full scale so both ends map exactly
+            const uint32_t x = static_cast<uint32_t>(i * 65535 / (entries - 1));
+            lut_[i] = response_eval16(c, static_cast<uint16_t>(x));
+        }
+    }
+
+    uint16_t map(uint16_t x) const { return lut_[x >> shift_]; }
+
+    size_t entries() const { return lut_.size(); }
+    int bits() const { return 16 - shift_; }
+
+private:
+    std::vector<uint16_t> lut_;
+    int shift_ = 0;
+};
+
+// Everything a curve file describes.
+struct ResponseCurves {
+    ResponseCurve pedal[ResponsePedals];
+    int table_bits = 16;
+
+    bool linear() const {
+        for (int c = 0; c < ResponsePedals; c++) {
+            if (!pedal[c].linear()) return false;
+        }
+        return true;
+    }
+
+    static bool parse(const std::string& text, ResponseCurves& out, std::string* error = nullptr) {
+        ResponseCurves curves;
+        auto set = [&curves](const std::string& key, const std::string& value) { return curves.set(key, value); };
+        if (!config_text::for_each_entry(text, set, error)) return false;
+        if (curves.table_bits != 8 && curves.table_bits != 16) {
+            return config_text::fail(error, 0, "table_bits must be 8 or 16");
+        }
+        for (int c = 0; c < ResponsePedals; c++) {
+            const ResponseCurve& r = curves.pedal[c];
+            if (r.dead_zone < 0.0 || r.saturation > 1.0 || r.dead_zone >= r.saturation || r.gamma <= 0.0) {
+                return config_text::fail(error, 0, "dead_zone must be below saturation, both 0..1, gamma > 0");
+            }
+        }
+        out = curves;
+        return true;
+    }
+
+    static bool load(const std::string& path, ResponseCurves& out, std::string* error = nullptr) {
+        std::string text;
+        return config_text::read_file(path, text, error) && parse(text, out, error);
+    }
+
+private:
+    bool set(const std::string& key, const std::string& value) {
+        double v;
+        if (key == "table_bits") {
+            if (!config_text::number(value, v)) return false;
+            table_bits = static_cast<int>(v);
+            return true;
+        }
+
+        std::string field;
+        const int c = config_text::pedal_key(key, field);
+        if (c < 0) return false;
+        ResponseCurve& r = pedal[c];
+        if (field == "points") return points(value, r);
+        if (!config_text::number(value, v)) return false;
+        if (field == "dead_zone") r.dead_zone = v;
+        else if (field == "saturation") r.saturation = v;
+        else if (field == "gamma") r.gamma = v;
+        else return false;
+        return true;
+    }
+
+    // "in:out in:out ...", in strictly increasing
+    static bool points(const std::string& value, ResponseCurve& r) {
+        r.point_count = 0;
+        const char* p = value.c_str();
+        while (*p) {
+            while (*p == ' ' || *p == '\t') p++;
+            if (!*p) break;
+            if (r.point_count == ResponseCurve::MaxPoints) return false;
+            char* end = nullptr;
+            const double in = strtod(p, &end);
+            if (end == p || *end != ':') return false;
+            p = end + 1;
+            const double out = strtod(p, &end);
+            if (end == p) return false;
+            p = end;
+            if (in < 0.0 || in > 1.0 || out < 0.0 || out > 1.0) return false;
+            if (r.point_count > 0 && in <= r.in[r.point_count - 1]) return false;
+            r.in[r.point_count] = in;
+            r.out[r.point_count] = out;
+            r.point_count++;
+        }
+        return r.point_count >= 2;
+    }
+};
+
+// One compiled generation of curves. Linear pedals get no table and pass through.
+struct ResponseTables {
+    ResponseCurves curves;
+    ResponseTable table[ResponsePedals];
+    bool active[ResponsePedals] = { false };
+    uint64_t generation = 0;
+
+    void apply(PedalSample& s) const {
+        for (int c = 0; c < ResponsePedals; c++) {
+            if (active[c]) s.axis[c] = table[c].map(s.axis[c]);
+        }
+    }
+};
+
+// Hot-swappable curves. apply() is wait-free; install() and load() may run on any other
+// thread. Replaced tables are kept until the PedalResponse goes away, because a reader
+// may still be using the pointer it loaded just before the swap (reloads are manual and
+// rare, one generation is at most ~400 KB).
+class PedalResponse {
+public:
+    PedalResponse() = default;
+    PedalResponse(const PedalResponse&) = delete;
+    PedalResponse& operator=(const PedalResponse&) = delete;
+
+    void apply(PedalSample& s) const {
+        const ResponseTables* t = current_.load(std::memory_order_acquire);
+        if (t) t->apply(s);
+    }
+
+    void install(const ResponseCurves& curves) {
+        std::unique_ptr<ResponseTables> t(new ResponseTables());
+        t->curves = curves;
+        for (int c = 0; c < ResponsePedals; c++) {
+            t->active[c] = !curves.pedal[c].linear();
+            if (t->active[c]) t->table[c].compile(curves.pedal[c], curves.table_bits);
+        }
+
+        std::lock_guard<std::mutex> lock(writer_);
+        t->generation = generations_.size() + 1;
+        current_.store(t.get(), std::memory_order_release);
+        generations_.push_back(std::move(t));
+    }
+
+    // Installs the curves from a file; on error the current curves stay in place.
+    bool load(const std::string& path, std::string* error = nullptr) {
+        ResponseCurves curves;
+        if (!ResponseCurves::load(path, curves, error)) return false;
+        install(curves);
+        return true;
+    }
+
+    // 0 until something is installed
+    uint64_t generation() const {
+        const ResponseTables* t = current_.load(std::memory_order_acquire);
+        return t ? t->generation : 0;
+    }
+
+private:
+    std::atomic<const ResponseTables*> current_{ nullptr };
+    std::mutex writer_;
+    std::vector<std::unique_ptr<ResponseTables>> generations_;
+};
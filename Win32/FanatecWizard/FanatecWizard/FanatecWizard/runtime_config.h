@@ -0,0 +1,352 @@
+// runtime_config.h - the front ends' tunables, read from fanatec.cfg and reloaded live
+//
+// The CAN channel and bitrate, the server ports, the send period, the drive mode limits,
+// the model step, the edge thresholds and hold times, and the history and gauge of the
+// desktop app used to be compiled in. They are now one file in config_text.h format;
+// a key left out keeps its default, so an empty or missing file is the old behaviour:
+//
+//   can.channel = usb1             # usb1..usb16, pci1..pci16, lan1..lan16 or a handle number
+//   can.fd = 0
+//   can.bitrate = 500              # kbit/s: 1000 800 500 250 125 100 95 83 50 47 33 20 10 5
+//   can.bitrate_fd = f_clock_mhz=20, nom_brp=5, nom_tseg1=2, nom_tseg2=1, nom_sjw=1, ...
+//   can.id = 0x100                 # pedal status frame
+//   can.extended = 1
+//   can.period_ms = 100            # CAN example send period
+//   xcp.port = 5555
+//   stats.port = 0                 # 0 = the front end's default (5556 desktop, 5557 CAN)
+//   telemetry.port = 0             # 0 = 5558 desktop, 5559 CAN
+//   engine.step_up = 20            # km/h per throttle press in Static
+//   engine.step_down = 20
+//   engine.max_speed = 300
+//   engine.cruise_min_speed = 20
+//   engine.ramp = 20               # ramp test, km/h per second
+//   engine.step_low = 50           # step test levels, period (s) and cycles
+//   engine.step_high = 100
+//   engine.step_period = 4
+//   engine.step_cycles = 3
+//   engine.tick_ms = 10            # vehicle model step
+//   throttle.rise = 14             # edge thresholds on the 8-bit level, hold in ms
+//   throttle.fall = 6
+//   throttle.hold_ms = 30
+//   ui.history_ms = 100            # desktop speed history period
+//   ui.history_bars = 100
+//   ui.gauge_max = 300
+//   thread.tick.cpu = 2            # per thread (input, tick, can, xcp, recorder, net), see
+//   thread.tick.priority = realtime  # thread_policy.h: normal, high or realtime
+//   thread.tick.fifo = 80          # SCHED_FIFO priority of realtime on Linux
+//   thread.lock_memory = 1         # keep the process in RAM
+//
+// A parsed file becomes an immutable snapshot. Readers take current() once per report
+// or tick and use that snapshot to the end of it: one atomic load, no lock. A reload
+// builds a new snapshot and swaps the pointer, as PedalResponse does with its tables;
+// the old ones stay allocated until the store goes, so a reader is never left holding
+// a freed snapshot. watch() polls the file on a thread of its own and reloads it when
+// it changes; a file that does not parse leaves the current snapshot in place.
+//
+// The CAN channel, bitrate and mode, the ports and the thread policies are read when
+// the front end starts;
+// a reload that changes them is reported (startup_differs) and applies at the next
+// start. Everything else applies from the next report or tick.
+#pragma once
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config_text.h"
+#include "pedal_engine.h"
+#include "thread_policy.h"
+
+struct CanSettings {
+    std::string channel = "usb1";
+    bool fd = false;
+    int bitrate_kbit = 500;
+    std::string bitrate_fd =
+        "f_clock_mhz=20, nom_brp=5, nom_tseg1=2, nom_tseg2=1, nom_sjw=1, data_brp=2, data_tseg1=3, data_tseg2=1, data_sjw=1";
+    uint32_t id = 0x100;
+    bool extended = true;
+    int period_ms = 100;
+};
+
+struct UiSettings {
+    int history_ms = 100;
+    int history_bars = 100;
+    int gauge_max = 300;
+};
+
+struct RuntimeConfig {
+    static const int MaxHistoryBars = 250;
+
+    CanSettings can;
+    int xcp_port = 5555;
+    int stats_port = 0;
+    int telemetry_port = 0;
+    PedalEngineConfig engine;
+    UiSettings ui;
+    ThreadPolicy threads[ThreadRoleCount] = { ThreadPolicy::defaults(ThreadInput), ThreadPolicy::defaults(ThreadTick),
+        ThreadPolicy::defaults(ThreadCanTx), ThreadPolicy::defaults(ThreadXcp), ThreadPolicy::defaults(ThreadRecorder),
+        ThreadPolicy::defaults(ThreadNetwork) };
+    bool lock_memory = false;
+    uint64_t generation = 0;        // set by RuntimeConfigStore, 1 = the defaults
+
+    // the port to use, given the front end's default
+    static uint16_t port_or(int port, int fallback) { return static_cast<uint16_t>(port > 0 ? port : fallback); }
+
+    // true when b changes something only read at start
+    static bool startup_differs(const RuntimeConfig& a, const RuntimeConfig& b) {
+        return a.can.channel != b.can.channel || a.can.fd != b.can.fd || a.can.bitrate_kbit != b.can.bitrate_kbit ||
+            a.can.bitrate_fd != b.can.bitrate_fd || a.xcp_port != b.xcp_port || a.stats_port != b.stats_port ||
+            a.telemetry_port != b.telemetry_port || a.lock_memory != b.lock_memory || a.threads_differ(b);
+    }
+
+    bool threads_differ(const RuntimeConfig& o) const {
+        for (int r = 0; r < ThreadRoleCount; r++) {
+            const ThreadPolicy& a = threads[r];
+            const ThreadPolicy& b = o.threads[r];
+            if (a.cpu != b.cpu || a.priority != b.priority || a.fifo != b.fifo) return true;
+        }
+        return false;
+    }
+
+    static bool parse(const std::string& text, RuntimeConfig& out, std::string* error = nullptr) {
+        RuntimeConfig cfg;
+        auto set = [&cfg](const std::string& key, const std::string& value) { return cfg.set(key, value); };
+        if (!config_text::for_each_entry(text, set, error)) return false;
+        if (cfg.engine.step_low > cfg.engine.step_high || cfg.engine.step_high > cfg.engine.max_speed) {
+            return config_text::fail(error, 0, "engine.step_low <= engine.step_high <= engine.max_speed");
+        }
+        for (const SchmittConfig& p : cfg.engine.edges.pedal) {
+            if (p.fall >= p.rise) return config_text::fail(error, 0, "each pedal needs fall < rise");
+        }
+        out = cfg;
+        return true;
+    }
+
+    static bool load(const std::string& path, RuntimeConfig& out, std::string* error = nullptr) {
+        std::string text;
+        return config_text::read_file(path, text, error) && parse(text, out, error);
+    }
+
+    // "usb3" -> bus 'u', index 3; a bare number is a PCAN handle and gives bus 0
+    static bool channel(const std::string& name, char& bus, int& index) {
+        static const char* const buses[] = { "usb", "pci", "lan" };
+        for (const char* b : buses) {
+            const size_t n = strlen(b);
+            if (name.compare(0, n, b) != 0) continue;
+            long v;
+            if (!integer(name.substr(n), v) || v < 1 || v > 16) return false;
+            bus = b[0];
+            index = static_cast<int>(v);
+            return true;
+        }
+        long v;
+        if (!integer(name, v) || v <= 0 || v > 0xFFFF) return false;
+        bus = 0;
+        index = static_cast<int>(v);
+        return true;
+    }
+
+private:
+    // decimal or 0x hex
+    static bool integer(const std::string& s, long& v) {
+        char* end = nullptr;
+        v = strtol(s.c_str(), &end, 0);
+        return !s.empty() && *end == '\0';
+    }
+
+    static bool in(long v, long lo, long hi) { return v >= lo && v <= hi; }
+
+    bool set(const std::string& key, const std::string& value) {
+        std::string field;
+        const int c = config_text::pedal_key(key, field);
+        if (c >= 0) return set_edge(engine.edges.pedal[c], field, value);
+
+        if (key == "can.channel") {
+            char bus;
+            int index;
+            if (!channel(value, bus, index)) return false;
+            can.channel = value;
+            return true;
+        }
+        if (key.compare(0, 7, "thread.") == 0 && key != "thread.lock_memory") return set_thread(key.substr(7), value);
+        if (key == "can.bitrate_fd") {
+            if (value.empty()) return false;
+            can.bitrate_fd = value;
+            return true;
+        }
+
+        long i;
+        double d;
+        if (integer(value, i)) d = static_cast<double>(i);
+        else if (config_text::number(value, d)) i = std::lround(d);
+        else return false;
+
+        if (key == "can.fd") can.fd = i != 0;
+        else if (key == "can.bitrate") {
+            static const long rates[] = { 1000, 800, 500, 250, 125, 100, 95, 83, 50, 47, 33, 20, 10, 5 };
+            bool known = false;
+            for (long r : rates) known = known || r == i;
+            if (!known) return false;
+            can.bitrate_kbit = static_cast<int>(i);
+        }
+        else if (key == "can.id" && in(i, 0, 0x1FFFFFFF)) can.id = static_cast<uint32_t>(i);
+        else if (key == "can.extended") can.extended = i != 0;
+        else if (key == "can.period_ms" && in(i, 1, 10000)) can.period_ms = static_cast<int>(i);
+        else if (key == "xcp.port" && in(i, 1, 65535)) xcp_port = static_cast<int>(i);
+        else if (key == "stats.port" && in(i, 0, 65535)) stats_port = static_cast<int>(i);
+        else if (key == "telemetry.port" && in(i, 0, 65535)) telemetry_port = static_cast<int>(i);
+        else if (key == "engine.step_up" && in(i, 1, 1000)) engine.static_step_up = static_cast<int>(i);
+        else if (key == "engine.step_down" && in(i, 1, 1000)) engine.static_step_down = static_cast<int>(i);
+        else if (key == "engine.max_speed" && in(i, 1, 1000)) {
+            engine.max_speed = static_cast<int>(i);
+            engine.vehicle.max_speed_ms = i / 3.6;
+        }
+        else if (key == "engine.cruise_min_speed" && in(i, 0, 1000)) engine.cruise_min_speed = static_cast<int>(i);
+        else if (key == "engine.ramp" && d > 0.0) engine.ramp_kmh_per_s = d;
+        else if (key == "engine.step_low" && in(i, 0, 1000)) engine.step_low = static_cast<int>(i);
+        else if (key == "engine.step_high" && in(i, 0, 1000)) engine.step_high = static_cast<int>(i);
+        else if (key == "engine.step_period" && d > 0.0) engine.step_period_s = d;
+        else if (key == "engine.step_cycles" && in(i, 1, 1000)) engine.step_cycles = static_cast<int>(i);
+        else if (key == "engine.tick_ms" && d >= 1.0 && d <= 1000.0) engine.vehicle.dt_s = d / 1000.0;
+        else if (key == "ui.history_ms" && in(i, 10, 10000)) ui.history_ms = static_cast<int>(i);
+        else if (key == "ui.history_bars" && in(i, 1, MaxHistoryBars)) ui.history_bars = static_cast<int>(i);
+        else if (key == "ui.gauge_max" && in(i, 1, 1000)) ui.gauge_max = static_cast<int>(i);
+        else if (key == "thread.lock_memory") lock_memory = i != 0;
+        else return false;
+        return true;
+    }
+
+    // "<role>.<field>"
+    bool set_thread(const std::string& key, const std::string& value) {
+        const size_t dot = key.find('.');
+        if (dot == std::string::npos) return false;
+        const std::string name = key.substr(0, dot), field = key.substr(dot + 1);
+        for (int r = 0; r < ThreadRoleCount; r++) {
+            if (name != thread_role_name(static_cast<ThreadRole>(r))) continue;
+            ThreadPolicy& p = threads[r];
+            if (field == "priority") return thread_priority_from_name(value, p.priority);
+            long v;
+            if (!integer(value, v)) return false;
+            if (field == "cpu" && in(v, -1, 63)) p.cpu = static_cast<int>(v);
+            else if (field == "fifo" && in(v, 1, 99)) p.fifo = static_cast<int>(v);
+            else return false;
+            return true;
+        }
+        return false;
+    }
+
+    static bool set_edge(SchmittConfig& p, const std::string& field, const std::string& value) {
+        double v;
+        if (!config_text::number(value, v)) return false;
+        if (field == "rise" && v >= 1 && v <= 255) p.rise = static_cast<int>(v);
+        else if (field == "fall" && v >= 0 && v <= 254) p.fall = static_cast<int>(v);
+        else if (field == "hold_ms" && v >= 0 && v <= 10000) p.hold_us = static_cast<int64_t>(std::llround(v * 1000.0));
+        else return false;
+        return true;
+    }
+};
+
+class RuntimeConfigStore {
+public:
+    // the new snapshot, or the current one and why the file was not taken
+    using Watcher = std::function<void(const RuntimeConfig& cfg, const std::string& error)>;
+
+    RuntimeConfigStore() { install(RuntimeConfig()); }
+    RuntimeConfigStore(const RuntimeConfigStore&) = delete;
+    RuntimeConfigStore& operator=(const RuntimeConfigStore&) = delete;
+    ~RuntimeConfigStore() { unwatch(); }
+
+    // lock-free; the snapshot stays valid for the life of the store
+    const RuntimeConfig& current() const { return *current_.load(std::memory_order_acquire); }
+
+    uint64_t generation() const { return current().generation; }
+
+    void install(const RuntimeConfig& cfg) {
+        std::unique_ptr<RuntimeConfig> snapshot(new RuntimeConfig(cfg));
+        std::lock_guard<std::mutex> lock(writer_);
+        snapshot->generation = generations_.size() + 1;
+        current_.store(snapshot.get(), std::memory_order_release);
+        generations_.push_back(std::move(snapshot));
+    }
+
+    // Installs the file; on error the current snapshot stays in place.
+    bool load(const std::string& path, std::string* error = nullptr) {
+        RuntimeConfig cfg;
+        if (!RuntimeConfig::load(path, cfg, error)) return false;
+        install(cfg);
+        return true;
+    }
+
+    // Checks the file's time and size every period_ms and reloads it when they change;
+    // fn (optional) runs on the watch thread after every reload attempt.
+    bool watch(const std::string& path, Watcher fn = Watcher(), int period_ms = 500) {
+        if (watcher_.joinable()) return false;
+        stop_ = false;
+        watcher_ = std::thread([this, path, fn, period_ms] {
+            FileStamp seen = stamp(path);
+            std::unique_lock<std::mutex> lock(wake_);
+            while (!wakeup_.wait_for(lock, std::chrono::milliseconds(period_ms), [this] { return stop_; })) {
+                const FileStamp now = stamp(path);
+                if (now == seen) continue;
+                seen = now;
+                if (!now.exists) continue;         // removed: keep what is loaded
+                std::string error;
+                load(path, &error);
+                if (fn) fn(current(), error);
+            }
+        });
+        return true;
+    }
+
+    void unwatch() {
+        if (!watcher_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(wake_);
+            stop_ = true;
+        }
+        wakeup_.notify_all();
+        watcher_.join();
+    }
+
+private:
+    struct FileStamp {
+        bool exists = false;
+        int64_t mtime = 0;
+        int64_t size = 0;
+
+        bool operator==(const FileStamp& o) const { return exists == o.exists && mtime == o.mtime && size == o.size; }
+    };
+
+    static FileStamp stamp(const std::string& path) {
+        FileStamp s;
+#ifdef _MSC_VER
+        struct _stat64 st;
+        if (_stat64(path.c_str(), &st) != 0) return s;
+#else
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return s;
+#endif
+        s.exists = true;
+        s.mtime = static_cast<int64_t>(st.st_mtime);
+        s.size = static_cast<int64_t>(st.st_size);
+        return s;
+    }
+
+    std::atomic<const RuntimeConfig*> current_{ nullptr };
+    std::mutex writer_;
+    std::vector<std::unique_ptr<RuntimeConfig>> generations_;
+
+    std::thread watcher_;
+    std::mutex wake_;
+    std::condition_variable wakeup_;
+    bool stop_ = false;
+};
@@ -0,0 +1,66 @@
+// seqlock.h - one value, many lock-free readers, a writer that never waits
+//
+// The writer bumps the sequence to odd, stores the value and bumps it to even; a reader
+// copies the value between two reads of the sequence and retries when a write overlapped
+// (odd or changed). Readers never block the writer and cost it nothing. The value is kept
+// as relaxed atomic 64-bit words, so the copy is not a data race, and the layout is plain
+// enough to live in shared memory.
+//
+// One writer at a time: callers with several writing threads serialize them (see
+// TelemetryServer::publish).
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+template <typename T>
+class Seqlock {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock<T> copies T as bytes");
+    static const size_t Words = (sizeof(T) + 7) / 8;
+
+    Seqlock() {
+        seq_.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < Words; i++) words_[i].store(0, std::memory_order_relaxed);
+    }
+
+    void store(const T& value) {
+        uint64_t w[Words] = {};
+        memcpy(w, &value, sizeof(T));
+        const uint32_t s = seq_.load(std::memory_order_relaxed);
+        seq_.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < Words; i++) words_[i].store(w[i], std::memory_order_relaxed);
+        seq_.store(s + 2, std::memory_order_release);
+    }
+
+    // False when a write was in progress; version = number of stores so far.
+    bool try_load(T& out, uint32_t* version = nullptr) const {
+        const uint32_t s = seq_.load(std::memory_order_acquire);
+        if (s & 1) return false;
+        uint64_t w[Words];
+        for (size_t i = 0; i < Words; i++) w[i] = words_[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) != s) return false;
+        memcpy(&out, w, sizeof(T));
+        if (version) *version = s / 2;
+        return true;
+    }
+
+    T load(uint32_t* version = nullptr) const {
+        T value;
+        for (int spins = 0; !try_load(value, version); spins++) {
+            if (spins > 64) std::this_thread::yield();      // the writer was preempted mid-store
+        }
+        return value;
+    }
+
+    uint32_t version() const { return seq_.load(std::memory_order_acquire) / 2; }
+
+private:
+    std::atomic<uint32_t> seq_;
+    std::atomic<uint64_t> words_[Words];
+};
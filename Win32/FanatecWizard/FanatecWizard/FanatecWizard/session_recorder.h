@@ -0,0 +1,495 @@
+// session_recorder.h - every published signal of a run in a memory-mapped columnar file
+//
+// A session file (.fsr) keeps one row per published state: each pedal report (raw and
+// filtered pedals, speed, mode) and each CAN or XCP transmit. Layout, all little endian:
+//
+//   file header         64 KiB: magic "FSR1", geometry, column table
+//   segment 0..n        64 KiB segment header (ChunkInfo per chunk) + ChunksPerSegment chunks
+//   chunk               ChunkRows rows stored by column: t_us[], throttle_raw[], ..., event[]
+//
+// Recording: the writer thread (2 ms period) keeps the next segment mapped with its pages
+// touched ahead of time and flushes and unmaps full ones, so record() only stores into
+// the mapped chunk and updates the chunk info; it never makes a system call or faults.
+// If the writer falls a whole segment behind, rows are counted as dropped instead of
+// blocking. Rows from several threads are ordered by a short spin lock around the stores.
+//
+// Reading: SessionReader maps the whole file at once and indexes the chunk infos, so an
+// hour-long session opens without reading its rows. slice() bisects chunks and rows by
+// time. A file of a crashed run reads up to its last recorded row.
+//
+// The front ends record when FANATEC_SESSION names a file (open_from_environment).
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hid_report.h"
+#include "mapped_file.h"
+#include "spsc_queue.h"
+#include "thread_policy.h"
+
+enum SessionEvent {
+    SessionReport,          // a pedal report went through the engine
+    SessionCanTx,           // the state was sent on CAN
+    SessionXcpTx,           // the XCP variables were updated by a model tick
+    SessionEventCount
+};
+
+inline const char* session_event_name(int e) {
+    static const char* const names[SessionEventCount] = { "report", "can", "xcp" };
+    return e >= 0 && e < SessionEventCount ? names[e] : "?";
+}
+
+struct SessionRow {
+    int64_t t_us;
+    uint16_t raw[ChannelSteering];      // pedal axes before the filter
+    uint16_t value[ChannelSteering];    // after filter and curves (what the engine saw)
+    int16_t speed;
+    uint8_t mode;
+    uint8_t event;                      // SessionEvent
+};
+
+// raw = the pedal inputs before the filter; transmit rows have none and repeat the values.
+inline SessionRow session_row(SessionEvent event, int64_t t, const PedalSample& value, int speed, int mode,
+    const uint16_t* raw = nullptr) {
+    SessionRow r;
+    r.t_us = t;
+    for (int c = 0; c < ChannelSteering; c++) {
+        r.value[c] = value.axis[c];
+        r.raw[c] = raw ? raw[c] : value.axis[c];
+    }
+    r.speed = static_cast<int16_t>(speed);
+    r.mode = static_cast<uint8_t>(mode);
+    r.event = static_cast<uint8_t>(event);
+    return r;
+}
+
+namespace session_format {
+
+enum Column {
+    ColTime,
+    ColThrottleRaw, ColBrakeRaw, ColClutchRaw,
+    ColThrottle, ColBrake, ColClutch,
+    ColSpeed, ColMode, ColEvent,
+    ColumnCount
+};
+
+const uint32_t Version = 1;
+const uint32_t HeaderBytes = 65536;
+const uint32_t SegmentHeaderBytes = 65536;
+const uint32_t ChunkRows = 8192;
+const uint32_t ChunksPerSegment = 32;
+const uint32_t RowBytes = 8 + 6 * 2 + 2 + 1 + 1;
+const uint32_t ChunkBytes = RowBytes * ChunkRows;               // 192 KiB, a multiple of 64 KiB
+const uint32_t SegmentBytes = SegmentHeaderBytes + ChunksPerSegment * ChunkBytes;
+
+struct ColumnInfo {
+    char name[16];
+    uint32_t offset;                    // within the chunk
+    uint32_t size;                      // bytes per value
+};
+
+struct ChunkInfo {
+    uint32_t rows;                      // written last, after the row itself
+    uint32_t reserved;
+    int64_t min_t;
+    int64_t max_t;
+};
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t header_bytes;
+    uint32_t segment_header_bytes;
+    uint32_t segment_bytes;
+    uint32_t chunk_rows;
+    uint32_t chunks_per_segment;
+    uint32_t column_count;
+    int64_t start_us;
+    uint32_t segments;                  // mapped so far; exact once closed
+    uint32_t closed;
+    ColumnInfo columns[ColumnCount];
+};
+
+struct ColumnTable {
+    ColumnInfo col[ColumnCount];
+
+    ColumnTable() {
+        static const char* const names[ColumnCount] = {
+            "t_us", "throttle_raw", "brake_raw", "clutch_raw", "throttle", "brake", "clutch", "speed", "mode", "event"
+        };
+        static const uint32_t sizes[ColumnCount] = { 8, 2, 2, 2, 2, 2, 2, 2, 1, 1 };
+        memset(col, 0, sizeof(col));
+        uint32_t offset = 0;
+        for (int c = 0; c < ColumnCount; c++) {
+            memcpy(col[c].name, names[c], strlen(names[c]));
+            col[c].offset = offset;
+            col[c].size = sizes[c];
+            offset += sizes[c] * ChunkRows;
+        }
+    }
+};
+
+inline const ColumnInfo* columns() {
+    static const ColumnTable table;
+    return table.col;
+}
+
+inline int64_t segment_offset(uint32_t index) {
+    return static_cast<int64_t>(HeaderBytes) + static_cast<int64_t>(index) * SegmentBytes;
+}
+
+} // namespace session_format
+
+class SessionRecorder {
+public:
+    SessionRecorder() = default;
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+    ~SessionRecorder() { close(); }
+
+    bool open(const std::string& path, int64_t startUs, std::string* error = nullptr) {
+        using namespace session_format;
+        close();
+        if (!file_.open(path, true) || !file_.map(0, HeaderBytes, header_)) {
+            if (error) *error = "cannot create " + path;
+            file_.close();
+            return false;
+        }
+        FileHeader& h = *reinterpret_cast<FileHeader*>(header_.data);
+        memcpy(h.magic, "FSR1", 4);
+        h.version = Version;
+        h.header_bytes = HeaderBytes;
+        h.segment_header_bytes = SegmentHeaderBytes;
+        h.segment_bytes = SegmentBytes;
+        h.chunk_rows = ChunkRows;
+        h.chunks_per_segment = ChunksPerSegment;
+        h.column_count = ColumnCount;
+        h.start_us = startUs;
+        h.segments = 0;
+        h.closed = 0;
+        memcpy(h.columns, columns(), sizeof(h.columns));
+
+        next_index_ = 0;
+        rows_.store(0);
+        dropped_.store(0);
+        Segment* first = prepare();
+        if (!first) {
+            if (error) *error = "cannot map the first segment of " + path;
+            MappedFile::unmap(header_);
+            file_.close();
+            return false;
+        }
+        spare_.store(first);
+        stop_.store(false);
+        writer_ = std::thread(&SessionRecorder::run_writer, this);
+        return true;
+    }
+
+    // The writer thread applies the policy of stats (thread.recorder in fanatec.cfg) and
+    // reports its wake-ups there; set before open().
+    void set_thread(ThreadStats* stats) { thread_ = stats; }
+
+    // Opens the file FANATEC_SESSION names; false when it is unset or cannot be created.
+    bool open_from_environment(int64_t startUs, std::string* error = nullptr) {
+        std::string path;
+#ifdef _MSC_VER
+        char* buffer = nullptr;
+        size_t length = 0;
+        if (_dupenv_s(&buffer, &length, "FANATEC_SESSION") == 0 && buffer) path = buffer;
+        free(buffer);
+#else
+        if (const char* v = getenv("FANATEC_SESSION")) path = v;
+#endif
+        if (path.empty()) return false;
+        return open(path, startUs, error);
+    }
+
+    bool is_open() const { return writer_.joinable(); }
+
+    // Any thread. Stores one row into the mapped chunk.
+    void record(const SessionRow& r) {
+        using namespace session_format;
+        while (lock_.test_and_set(std::memory_order_acquire)) {
+        }
+        if (!current_ || row_ == ChunkRows) advance();
+        if (current_) {
+            const uint32_t i = row_++;
+            t_[i] = r.t_us;
+            for (int c = 0; c < ChannelSteering; c++) {
+                raw_[c][i] = r.raw[c];
+                value_[c][i] = r.value[c];
+            }
+            speed_[i] = r.speed;
+            mode_[i] = r.mode;
+            event_[i] = r.event;
+            if (i == 0 || r.t_us < info_->min_t) info_->min_t = r.t_us;
+            if (i == 0 || r.t_us > info_->max_t) info_->max_t = r.t_us;
+            info_->rows = row_;
+            rows_.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        lock_.clear(std::memory_order_release);
+    }
+
+    // Flushes everything, trims the file to the segments used and marks it closed.
+    void close() {
+        using namespace session_format;
+        if (!writer_.joinable()) return;
+        stop_.store(true);
+        writer_.join();
+
+        uint32_t used = 0;
+        Segment* s = nullptr;
+        while (retired_.try_pop(s)) release(s, true);
+        if (current_) {
+            used = current_->index + 1;
+            release(current_, true);
+            current_ = nullptr;
+        }
+        else {
+            used = last_used_;
+        }
+        if ((s = spare_.exchange(nullptr)) != nullptr) release(s, false);
+
+        FileHeader& h = *reinterpret_cast<FileHeader*>(header_.data);
+        h.segments = used;
+        h.closed = 1;
+        MappedFile::flush(header_, true);
+        MappedFile::unmap(header_);
+        file_.resize(segment_offset(used));
+        file_.close();
+    }
+
+    uint64_t rows() const { return rows_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Segment {
+        uint32_t index;
+        MappedFile::View view;
+    };
+
+    MappedFile file_;
+    MappedFile::View header_;
+    std::thread writer_;
+    ThreadStats* thread_ = nullptr;
+    std::atomic<bool> stop_{ false };
+    std::atomic<Segment*> spare_{ nullptr };        // writer -> producer
+    SpscQueue<Segment*, 16> retired_;                // producer -> writer
+    uint32_t next_index_ = 0;                        // writer thread (and open/close)
+    uint32_t last_used_ = 0;
+
+    // producer side, under lock_
+    std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+    Segment* current_ = nullptr;
+    uint32_t chunk_ = 0;
+    uint32_t row_ = 0;
+    session_format::ChunkInfo* info_ = nullptr;
+    int64_t* t_ = nullptr;
+    uint16_t* raw_[ChannelSteering] = {};
+    uint16_t* value_[ChannelSteering] = {};
+    int16_t* speed_ = nullptr;
+    uint8_t* mode_ = nullptr;
+    uint8_t* event_ = nullptr;
+
+    std::atomic<uint64_t> rows_{ 0 };
+    std::atomic<uint64_t> dropped_{ 0 };
+
+    // Next chunk, or the next segment when this one is full; no segment ready = rows drop.
+    void advance() {
+        using namespace session_format;
+        if (current_) {
+            if (++chunk_ == ChunksPerSegment) {
+                last_used_ = current_->index + 1;
+                if (!retired_.try_push(current_)) release(current_, false);    // writer stalled for 16 segments
+                current_ = nullptr;
+            }
+        }
+        if (!current_) {
+            current_ = spare_.exchange(nullptr);
+            if (!current_) return;
+            chunk_ = 0;
+        }
+        row_ = 0;
+        uint8_t* base = current_->view.data;
+        info_ = reinterpret_cast<ChunkInfo*>(base) + chunk_;
+        uint8_t* chunk = base + SegmentHeaderBytes + static_cast<size_t>(chunk_) * ChunkBytes;
+        const ColumnInfo* col = columns();
+        t_ = reinterpret_cast<int64_t*>(chunk + col[ColTime].offset);
+        for (int c = 0; c < ChannelSteering; c++) {
+            raw_[c] = reinterpret_cast<uint16_t*>(chunk + col[ColThrottleRaw + c].offset);
+            value_[c] = reinterpret_cast<uint16_t*>(chunk + col[ColThrottle + c].offset);
+        }
+        speed_ = reinterpret_cast<int16_t*>(chunk + col[ColSpeed].offset);
+        mode_ = chunk + col[ColMode].offset;
+        event_ = chunk + col[ColEvent].offset;
+    }
+
+    Segment* prepare() {
+        using namespace session_format;
+        Segment* s = new Segment();
+        s->index = next_index_;
+        if (!file_.map(segment_offset(s->index), SegmentBytes, s->view)) {
+            delete s;
+            return nullptr;
+        }
+        // touch every page now, so the producer does not take the page faults
+        volatile uint8_t* p = s->view.data;
+        for (size_t i = 0; i < s->view.size; i += 4096) p[i] = 0;
+        next_index_++;
+        reinterpret_cast<FileHeader*>(header_.data)->segments = next_index_;
+        return s;
+    }
+
+    static void release(Segment* s, bool wait) {
+        MappedFile::flush(s->view, wait);
+        MappedFile::unmap(s->view);
+        delete s;
+    }
+
+    void run_writer() {
+        if (thread_) thread_->apply();
+        while (!stop_.load()) {
+            Segment* s;
+            while (retired_.try_pop(s)) release(s, false);
+            if (!spare_.load()) {
+                Segment* next = prepare();
+                if (next) spare_.store(next);
+            }
+            if (thread_) thread_->sleep_until(now_us() + 2000);
+            else std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+};
+
+// Column pointers of one chunk of a session, straight into the mapped file.
+struct SessionChunk {
+    const int64_t* t;
+    const uint16_t* raw[ChannelSteering];
+    const uint16_t* value[ChannelSteering];
+    const int16_t* speed;
+    const uint8_t* mode;
+    const uint8_t* event;
+    uint32_t rows;
+    int64_t min_t;
+    int64_t max_t;
+
+    SessionRow row(uint32_t i) const {
+        SessionRow r;
+        r.t_us = t[i];
+        for (int c = 0; c < ChannelSteering; c++) {
+            r.raw[c] = raw[c][i];
+            r.value[c] = value[c][i];
+        }
+        r.speed = speed[i];
+        r.mode = mode[i];
+        r.event = event[i];
+        return r;
+    }
+};
+
+// Calls fn(chunk, begin, end) for the rows with t0 <= t_us < t1, chunk by chunk. Rows are
+// in recording order; rows of different threads can be out of time order by a few
+// microseconds, which only matters right at t0 and t1.
+template <class Fn>
+void session_slice(const std::vector<SessionChunk>& chunks, int64_t t0, int64_t t1, Fn fn) {
+    auto first = std::partition_point(chunks.begin(), chunks.end(), [t0](const SessionChunk& c) { return c.max_t < t0; });
+    for (auto it = first; it != chunks.end() && it->min_t < t1; ++it) {
+        const int64_t* t = it->t;
+        const uint32_t begin = static_cast<uint32_t>(std::lower_bound(t, t + it->rows, t0) - t);
+        const uint32_t end = static_cast<uint32_t>(std::lower_bound(t + begin, t + it->rows, t1) - t);
+        if (begin < end) fn(*it, begin, end);
+    }
+}
+
+class SessionReader {
+public:
+    typedef SessionChunk Chunk;
+
+    SessionReader() = default;
+    SessionReader(const SessionReader&) = delete;
+    SessionReader& operator=(const SessionReader&) = delete;
+    ~SessionReader() { close(); }
+
+    bool open(const std::string& path, std::string* error = nullptr) {
+        using namespace session_format;
+        close();
+        auto fail = [&](const std::string& why) {
+            if (error) *error = path + ": " + why;
+            close();
+            return false;
+        };
+        if (!file_.open(path, false)) return fail("cannot open");
+        const int64_t size = file_.size();
+        if (size < static_cast<int64_t>(HeaderBytes) || !file_.map(0, static_cast<size_t>(size), view_)) {
+            return fail("not a session file");
+        }
+        header_ = *reinterpret_cast<const FileHeader*>(view_.data);
+        if (memcmp(header_.magic, "FSR1", 4) != 0 || header_.version != Version || header_.chunk_rows != ChunkRows ||
+            header_.chunks_per_segment != ChunksPerSegment || header_.segment_bytes != SegmentBytes ||
+            header_.column_count != ColumnCount || memcmp(header_.columns, columns(), sizeof(header_.columns)) != 0) {
+            return fail("unsupported session layout");
+        }
+
+        // a live or crashed file can end in a segment that was mapped but not written
+        const uint32_t segments = static_cast<uint32_t>((size - HeaderBytes) / SegmentBytes);
+        const ColumnInfo* col = columns();
+        for (uint32_t s = 0; s < segments; s++) {
+            const uint8_t* base = view_.data + segment_offset(s);
+            const ChunkInfo* info = reinterpret_cast<const ChunkInfo*>(base);
+            for (uint32_t k = 0; k < ChunksPerSegment; k++) {
+                if (info[k].rows == 0 || info[k].rows > ChunkRows) break;
+                const uint8_t* p = base + SegmentHeaderBytes + static_cast<size_t>(k) * ChunkBytes;
+                Chunk c;
+                c.t = reinterpret_cast<const int64_t*>(p + col[ColTime].offset);
+                for (int ch = 0; ch < ChannelSteering; ch++) {
+                    c.raw[ch] = reinterpret_cast<const uint16_t*>(p + col[ColThrottleRaw + ch].offset);
+                    c.value[ch] = reinterpret_cast<const uint16_t*>(p + col[ColThrottle + ch].offset);
+                }
+                c.speed = reinterpret_cast<const int16_t*>(p + col[ColSpeed].offset);
+                c.mode = p + col[ColMode].offset;
+                c.event = p + col[ColEvent].offset;
+                c.rows = info[k].rows;
+                c.min_t = info[k].min_t;
+                c.max_t = info[k].max_t;
+                chunks_.push_back(c);
+                rows_ += c.rows;
+            }
+        }
+        return true;
+    }
+
+    void close() {
+        MappedFile::unmap(view_);
+        file_.close();
+        chunks_.clear();
+        rows_ = 0;
+    }
+
+    const std::vector<Chunk>& chunks() const { return chunks_; }
+    uint64_t rows() const { return rows_; }
+    int64_t start_us() const { return header_.start_us; }
+    bool closed() const { return header_.closed != 0; }
+    int64_t first_t() const { return chunks_.empty() ? 0 : chunks_.front().min_t; }
+    int64_t last_t() const { return chunks_.empty() ? 0 : chunks_.back().max_t; }
+
+    // Calls fn(chunk, begin, end) for the rows with t0 <= t_us < t1 (session_slice).
+    template <class Fn>
+    void slice(int64_t t0, int64_t t1, Fn fn) const { session_slice(chunks_, t0, t1, fn); }
+
+private:
+    MappedFile file_;
+    MappedFile::View view_;
+    session_format::FileHeader header_ = {};
+    std::vector<Chunk> chunks_;
+    uint64_t rows_ = 0;
+};
+
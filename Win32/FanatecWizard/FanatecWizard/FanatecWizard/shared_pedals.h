@@ -0,0 +1,389 @@
+// shared_pedals.h - pedal data for other local processes through shared memory
+//
+// The process that owns the pedals (the desktop app) publishes into a named shared memory
+// block: a POSIX shm object (/dev/shm/FanatecPedals) or a Win32 page-file mapping
+// (Local\FanatecPedals). The block holds
+//   - the publisher's current state (filtered pedals, speed, mode, gear) in a seqlock,
+//   - a ring of the last RingSize raw pedal samples, each timestamped and numbered.
+// Readers map it read-only and copy straight out of it: no system call, no lock, and
+// nothing they do can hold up the publisher. A reader that falls more than RingSize
+// samples behind loses the oldest ones and is told how many.
+//
+// SharedPedalSource follows the ring on its own thread and hands every sample to the
+// usual report handler, as a report of a virtual pedal set (like ManeuverSource), so the
+// CAN example and the Simulink block can run on the desktop app's pedals with
+// FANATEC_SHARED set (to 1 or a channel name) instead of opening the device themselves.
+//
+// One publisher per channel. A second one is refused while the first is alive (it
+// published within the last second); one that died is taken over. Timestamps are now_us,
+// which is the same steady clock in every process.
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include "hid_report.h"
+#include "maneuver_source.h"
+#include "seqlock.h"
+#include "timing.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared memory needs address-free atomics");
+
+// What the publisher made of the pedals.
+struct SharedPedalState {
+    int64_t t_us = 0;
+    uint16_t pedal[ChannelCount] = {};  // filtered and shaped
+    uint32_t buttons = 0;
+    int16_t speed = 0;                  // km/h
+    uint8_t mode = 0;                   // DriveMode
+    int8_t gear = 0;
+    uint8_t sources = 0;                // attached input devices
+};
+
+// One pedal report as decoded, before filter and curves.
+struct SharedPedalSample {
+    uint64_t n = 0;                     // position in the stream, from 0
+    int64_t t_us = 0;                   // received
+    uint16_t axis[ChannelCount] = {};
+    uint32_t buttons = 0;
+};
+
+namespace shared_pedals {
+
+const char* const DefaultName = "FanatecPedals";
+const uint32_t Magic = 0x31535046;      // "FPS1"
+const uint32_t Version = 1;
+const uint32_t RingSize = 4096;         // about 4 s at 1 kHz; a power of two
+const int64_t AliveUs = 1000000;        // a publisher silent for longer may be replaced
+
+struct Channel {
+    std::atomic<uint32_t> magic;        // set last, once the rest is valid
+    uint32_t version;
+    uint32_t ring_size;
+    uint32_t sample_bytes;
+    std::atomic<uint32_t> generation;   // publishers that have opened the channel
+    std::atomic<uint32_t> open;         // a publisher has it
+    std::atomic<int64_t> heartbeat_us;  // last publish or push
+    alignas(64) Seqlock<SharedPedalState> state;
+    alignas(64) std::atomic<uint64_t> head;     // samples pushed
+    alignas(64) Seqlock<SharedPedalSample> ring[RingSize];
+};
+
+inline bool layout_matches(const Channel* c) {
+    return c->magic.load(std::memory_order_acquire) == Magic && c->version == Version && c->ring_size == RingSize &&
+        c->sample_bytes == sizeof(SharedPedalSample);
+}
+
+inline std::string object_name(const std::string& name) {
+#ifdef _WIN32
+    return "Local\\" + name;
+#else
+    return "/" + name;
+#endif
+}
+
+// The block of one channel, mapped into this process.
+class Mapping {
+public:
+    Mapping() = default;
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+    ~Mapping() { close(); }
+
+    // writable: open or create; otherwise open an existing one read-only.
+    bool open(const std::string& name, bool writable, std::string* error) {
+        close();
+        const std::string object = object_name(name);
+#ifdef _WIN32
+        if (writable) {
+            handle_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(Channel), object.c_str());
+        }
+        else {
+            handle_ = OpenFileMappingA(FILE_MAP_READ, FALSE, object.c_str());
+        }
+        if (!handle_) return fail(error, "cannot open shared memory " + object);
+        channel_ = static_cast<Channel*>(MapViewOfFile(handle_, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, sizeof(Channel)));
+#else
+        const int fd = shm_open(object.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+        if (fd < 0) return fail(error, "cannot open shared memory " + object);
+        struct stat st;
+        bool sized = fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Channel));
+        if (!sized && writable) sized = ftruncate(fd, sizeof(Channel)) == 0;
+        if (sized) {
+            void* p = mmap(nullptr, sizeof(Channel), PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) channel_ = static_cast<Channel*>(p);
+        }
+        ::close(fd);
+#endif
+        if (!channel_) {
+            close();
+            return fail(error, "cannot map shared memory " + object);
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (channel_) UnmapViewOfFile(channel_);
+        if (handle_) CloseHandle(handle_);
+        handle_ = nullptr;
+#else
+        if (channel_) munmap(channel_, sizeof(Channel));
+#endif
+        channel_ = nullptr;
+    }
+
+    Channel* get() const { return channel_; }
+
+private:
+    Channel* channel_ = nullptr;
+#ifdef _WIN32
+    HANDLE handle_ = nullptr;
+#endif
+
+    bool fail(std::string* error, const std::string& text) {
+        if (error) *error = text;
+        return false;
+    }
+};
+
+} // namespace shared_pedals
+
+class SharedPedalWriter {
+public:
+    ~SharedPedalWriter() { close(); }
+
+    bool open(const std::string& name = shared_pedals::DefaultName, std::string* error = nullptr) {
+        using namespace shared_pedals;
+        close();
+        if (!mapping_.open(name, true, error)) return false;
+        Channel* c = mapping_.get();
+        if (layout_matches(c)) {
+            if (c->open.load() && now_us() - c->heartbeat_us.load() < AliveUs) {
+                mapping_.close();
+                if (error) *error = "another process is publishing on " + name;
+                return false;
+            }
+            // the last publisher is gone: keep its samples, readers carry on from head
+            next_ = c->head.load();
+        }
+        else {
+            // new (zero-filled) or from another build: lay it out afresh
+            c->magic.store(0);
+            new (c) Channel();
+            c->version = Version;
+            c->ring_size = RingSize;
+            c->sample_bytes = sizeof(SharedPedalSample);
+            c->generation.store(0);
+            c->head.store(0);
+            c->magic.store(Magic, std::memory_order_release);
+            next_ = 0;
+        }
+        c->heartbeat_us.store(now_us());
+        c->open.store(1);
+        c->generation.fetch_add(1);
+        channel_ = c;
+        return true;
+    }
+
+    void close() {
+        if (!channel_) return;
+        channel_->open.store(0);
+        channel_ = nullptr;
+        mapping_.close();
+    }
+
+    bool is_open() const { return channel_ != nullptr; }
+
+    // Any thread, never blocks. With two threads publishing at once the later one is
+    // dropped; the next publish carries the newer state anyway.
+    void publish(const SharedPedalState& s) {
+        if (!channel_ || writing_.test_and_set(std::memory_order_acquire)) return;
+        channel_->state.store(s);
+        channel_->heartbeat_us.store(s.t_us, std::memory_order_relaxed);
+        writing_.clear(std::memory_order_release);
+    }
+
+    // One thread only (the input thread).
+    void push(const PedalSample& raw, int64_t t_us) {
+        if (!channel_) return;
+        SharedPedalSample s;
+        s.n = next_;
+        s.t_us = t_us;
+        memcpy(s.axis, raw.axis, sizeof(s.axis));
+        s.buttons = raw.buttons;
+        channel_->ring[next_ & (shared_pedals::RingSize - 1)].store(s);
+        channel_->head.store(++next_, std::memory_order_release);
+        channel_->heartbeat_us.store(t_us, std::memory_order_relaxed);
+    }
+
+    uint64_t pushed() const { return next_; }
+
+private:
+    shared_pedals::Mapping mapping_;
+    shared_pedals::Channel* channel_ = nullptr;
+    uint64_t next_ = 0;
+    std::atomic_flag writing_ = ATOMIC_FLAG_INIT;
+};
+
+class SharedPedalReader {
+public:
+    enum ReadResult { ReadOk, ReadNotYet, ReadOverwritten };
+
+    bool open(const std::string& name = shared_pedals::DefaultName, std::string* error = nullptr) {
+        if (!mapping_.open(name, false, error)) return false;
+        if (!shared_pedals::layout_matches(mapping_.get())) {
+            mapping_.close();
+            if (error) *error = "no publisher has set up " + name + " (or it is from another version)";
+            return false;
+        }
+        return true;
+    }
+
+    void close() { mapping_.close(); }
+    bool is_open() const { return mapping_.get() != nullptr; }
+
+    bool publisher_alive() const {
+        const shared_pedals::Channel* c = mapping_.get();
+        return c && c->open.load() && now_us() - c->heartbeat_us.load() < shared_pedals::AliveUs;
+    }
+    uint32_t generation() const { return mapping_.get()->generation.load(); }
+    uint64_t head() const { return mapping_.get()->head.load(std::memory_order_acquire); }
+
+    // version (optional) counts the states published so far.
+    SharedPedalState state(uint32_t* version = nullptr) const { return mapping_.get()->state.load(version); }
+
+    ReadResult read(uint64_t n, SharedPedalSample& out) const {
+        const shared_pedals::Channel* c = mapping_.get();
+        if (n >= c->head.load(std::memory_order_acquire)) return ReadNotYet;
+        // a slot being written now already belongs to a newer sample
+        if (!c->ring[n & (shared_pedals::RingSize - 1)].try_load(out) || out.n != n) return ReadOverwritten;
+        return ReadOk;
+    }
+
+    // Passes the samples from cursor up to head to fn in order and moves cursor past
+    // them. Samples already overwritten are skipped and added to lost; returns how many
+    // went to fn.
+    template <class Fn>
+    size_t drain(uint64_t& cursor, Fn fn, uint64_t* lost = nullptr) const {
+        const uint64_t end = head();
+        if (end > shared_pedals::RingSize && cursor < end - shared_pedals::RingSize) {
+            if (lost) *lost += end - shared_pedals::RingSize - cursor;
+            cursor = end - shared_pedals::RingSize;
+        }
+        size_t passed = 0;
+        SharedPedalSample s;
+        for (; cursor < end; cursor++) {
+            const ReadResult r = read(cursor, s);
+            if (r == ReadOk) {
+                fn(s);
+                passed++;
+            }
+            else if (lost) {
+                (*lost)++;
+            }
+        }
+        return passed;
+    }
+
+private:
+    shared_pedals::Mapping mapping_;
+};
+
+// Follows a channel on its own thread and hands every new sample to the report handler.
+// Spins for a moment after each sample, then sleeps 100 us at a time while the ring is quiet.
+class SharedPedalSource {
+public:
+    typedef ManeuverSource::ReportHandler ReportHandler;
+
+    static const uint64_t Device = 0x53484D50;  // handle key of the shared pedal set
+
+    ~SharedPedalSource() { stop(); }
+
+    // FANATEC_SHARED: a channel name, or 1 for the default one.
+    static bool name_from_environment(std::string& name) {
+        std::string value;
+#ifdef _MSC_VER
+        char* buffer = nullptr;
+        size_t length = 0;
+        if (_dupenv_s(&buffer, &length, "FANATEC_SHARED") == 0 && buffer) value = buffer;
+        free(buffer);
+#else
+        if (const char* v = getenv("FANATEC_SHARED")) value = v;
+#endif
+        if (value.empty() || value == "0") return false;
+        name = value == "1" ? shared_pedals::DefaultName : value;
+        return true;
+    }
+
+    // Registers the shared pedal set with the router; call before start(), under the
+    // router's lock once a tick thread or task shares it.
+    static DeviceSlot* attach(DeviceRouter& router) {
+        return ManeuverSource::attach(router, Device, "shared:pedals");
+    }
+
+    // Starts with the next sample published; fails if the channel is not set up.
+    bool start(const std::string& name, ReportHandler onReport, std::string* error = nullptr) {
+        if (thread_.joinable()) return true;
+        if (!reader_.open(name, error)) return false;
+        on_report_ = onReport;
+        stop_.store(false);
+        thread_ = std::thread(&SharedPedalSource::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        stop_.store(true);
+        thread_.join();
+        reader_.close();
+    }
+
+    bool running() const { return thread_.joinable(); }
+    bool publisher_alive() const { return reader_.publisher_alive(); }
+    uint64_t samples() const { return samples_.load(std::memory_order_relaxed); }
+    uint64_t lost() const { return lost_.load(std::memory_order_relaxed); }
+
+private:
+    SharedPedalReader reader_;
+    ReportHandler on_report_;
+    std::thread thread_;
+    std::atomic<bool> stop_{ false };
+    std::atomic<uint64_t> samples_{ 0 };
+    std::atomic<uint64_t> lost_{ 0 };
+
+    void run() {
+        uint64_t cursor = reader_.head();
+        uint8_t report[ManeuverSource::ReportSize];
+        int idle = 0;
+        while (!stop_.load(std::memory_order_relaxed)) {
+            uint64_t lost = 0;
+            const size_t n = reader_.drain(cursor, [&](const SharedPedalSample& s) {
+                PedalSample sample;
+                memcpy(sample.axis, s.axis, sizeof(sample.axis));
+                sample.buttons = s.buttons;
+                ManeuverSource::encode(sample, report);
+                on_report_(Device, report, sizeof(report), s.t_us);
+            }, &lost);
+            if (n) samples_.fetch_add(n, std::memory_order_relaxed);
+            if (lost) lost_.fetch_add(lost, std::memory_order_relaxed);
+            if (n || lost) idle = 0;
+            else if (++idle < 1000) std::this_thread::yield();
+            else std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+};
@@ -2,6 +2,7 @@
 #include "simplexcp.h"
 #include <iostream>
 #include <thread>
+#include <algorithm>
 
 // Your XCP variables
 volatile unsigned char xcp_brake_raw = 0;
@@ -9,22 +10,47 @@ volatile unsigned char xcp_throttle_raw = 0;
 volatile unsigned short xcp_speed = 0;
 volatile unsigned char xcp_mode = 0;
 
+volatile uint16_t xcp_throttle_in = 0;
+volatile uint16_t xcp_throttle_filtered = 0;
+volatile uint32_t xcp_throttle_limited = 0;
+volatile uint16_t xcp_brake_in = 0;
+volatile uint16_t xcp_brake_filtered = 0;
+volatile uint32_t xcp_brake_limited = 0;
+volatile uint16_t xcp_clutch_in = 0;
+volatile uint16_t xcp_clutch_filtered = 0;
+volatile uint32_t xcp_clutch_limited = 0;
+
+volatile uint32_t xcp_latency_decode_p99 = 0;
+volatile uint32_t xcp_latency_engine_p99 = 0;
+volatile uint32_t xcp_latency_publish_p99 = 0;
+volatile uint32_t xcp_latency_transmit_p99 = 0;
+volatile uint32_t xcp_latency_total_p99 = 0;
+volatile uint32_t xcp_latency_total_max = 0;
+
 // Thread control
 static std::atomic<bool> xcp_running{ false };
 static std::thread xcp_thread;
 
-void xcp_background_worker() {
+void xcp_background_worker(ThreadStats* stats) {
+    if (stats) stats->apply();
+    int64_t next = now_us();
     while (xcp_running.load()) {
         // TODO: Actual XCP communication
-        Sleep(10); // 100Hz
+        if (!stats) {
+            Sleep(10); // 100Hz
+            continue;
+        }
+        next += 10000; // 100Hz, on an absolute schedule
+        stats->sleep_until(next);
+        if (next + 10000 < now_us()) next = now_us();   // fell behind: no burst
     }
 }
 
-void xcp_init() {
+void xcp_init(ThreadStats* stats) {
     if (xcp_running.load()) return;
 
     xcp_running.store(true);
-    xcp_thread = std::thread(xcp_background_worker);
+    xcp_thread = std::thread(xcp_background_worker, stats);
 
     std::cout << "XCP thread started" << std::endl;
 }
@@ -42,4 +68,32 @@ void xcp_update_variables(int brake_raw, int throttle_raw, int speed, int mode)
     xcp_throttle_raw = static_cast<unsigned char>(throttle_raw);
     xcp_speed = static_cast<unsigned short>(speed);
     xcp_mode = static_cast<unsigned char>(mode);
-}
\ No newline at end of file
+}
+
+void xcp_update_filter(const PedalFilterState& filter) {
+    const PedalFilterChannelState& t = filter.pedal[ChannelThrottle];
+    const PedalFilterChannelState& b = filter.pedal[ChannelBrake];
+    const PedalFilterChannelState& c = filter.pedal[ChannelClutch];
+    xcp_throttle_in = t.in;
+    xcp_throttle_filtered = t.out;
+    xcp_throttle_limited = t.rate_limited;
+    xcp_brake_in = b.in;
+    xcp_brake_filtered = b.out;
+    xcp_brake_limited = b.rate_limited;
+    xcp_clutch_in = c.in;
+    xcp_clutch_filtered = c.out;
+    xcp_clutch_limited = c.rate_limited;
+}
+
+// Percentiles walk the histograms, so this runs at display rate, not per report.
+void xcp_update_latency(const LatencyTrace& trace) {
+    auto p99 = [](const LatencyHistogram& h) {
+        return static_cast<uint32_t>((std::min<uint64_t>)(h.percentile(99), UINT32_MAX));
+    };
+    xcp_latency_decode_p99 = p99(trace.stage(StageDecode));
+    xcp_latency_engine_p99 = p99(trace.stage(StageEngine));
+    xcp_latency_publish_p99 = p99(trace.stage(StagePublish));
+    xcp_latency_transmit_p99 = p99(trace.stage(StageTransmit));
+    xcp_latency_total_p99 = p99(trace.total());
+    xcp_latency_total_max = static_cast<uint32_t>((std::min<uint64_t>)(trace.total().maximum(), UINT32_MAX));
+}
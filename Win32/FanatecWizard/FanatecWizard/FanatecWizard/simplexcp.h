@@ -4,6 +4,9 @@
 #include <windows.h>
 #include <cstdint>
 #include <atomic>
+#include "pedal_filter.h"
+#include "latency_trace.h"
+#include "thread_policy.h"
 
 // Use standard C++11 types
 extern volatile uint8_t xcp_brake_raw;
@@ -11,6 +14,28 @@ extern volatile uint8_t xcp_throttle_raw;
 extern volatile uint16_t xcp_speed;
 extern volatile uint8_t xcp_mode;
 
-void xcp_init();
+// pedal filter state of the pedal set: raw input, filtered output, rate limiter hits
+extern volatile uint16_t xcp_throttle_in;
+extern volatile uint16_t xcp_throttle_filtered;
+extern volatile uint32_t xcp_throttle_limited;
+extern volatile uint16_t xcp_brake_in;
+extern volatile uint16_t xcp_brake_filtered;
+extern volatile uint32_t xcp_brake_limited;
+extern volatile uint16_t xcp_clutch_in;
+extern volatile uint16_t xcp_clutch_filtered;
+extern volatile uint32_t xcp_clutch_limited;
+
+// latency of the input path in microseconds (latency_trace.h): p99 per stage, total p99 and max
+extern volatile uint32_t xcp_latency_decode_p99;
+extern volatile uint32_t xcp_latency_engine_p99;
+extern volatile uint32_t xcp_latency_publish_p99;
+extern volatile uint32_t xcp_latency_transmit_p99;
+extern volatile uint32_t xcp_latency_total_p99;
+extern volatile uint32_t xcp_latency_total_max;
+
+// the worker runs with the policy of stats (thread.xcp in fanatec.cfg) when given
+void xcp_init(ThreadStats* stats = nullptr);
 void xcp_cleanup();
-void xcp_update_variables(int brake_raw, int throttle_raw, int speed, int mode);
\ No newline at end of file
+void xcp_update_variables(int brake_raw, int throttle_raw, int speed, int mode);
+void xcp_update_filter(const PedalFilterState& filter);
+void xcp_update_latency(const LatencyTrace& trace);
@@ -0,0 +1,49 @@
+// speed_history.h - speed samples behind the history graph
+//
+// A fixed window of the last Capacity samples, zero-filled at start like the array it
+// replaces. The graph has fewer columns than samples, so decimate() reduces the window
+// to one value per column, keeping the peak so a short burst of speed stays visible.
+#pragma once
+#include <algorithm>
+
+template <int Capacity>
+class SpeedHistory {
+public:
+    static const int Size = Capacity;
+
+    void push(int speed) {
+        data_[head_] = speed;
+        head_ = head_ + 1 == Capacity ? 0 : head_ + 1;
+    }
+
+    // i = 0 is the oldest sample, Capacity - 1 the newest
+    int at(int i) const {
+        const int j = head_ + i;
+        return data_[j < Capacity ? j : j - Capacity];
+    }
+
+    int newest() const { return at(Capacity - 1); }
+
+    // Writes `columns` values, oldest first; column c covers samples
+    // [c * Capacity / columns, (c + 1) * Capacity / columns), at least one.
+    void decimate(int* out, int columns) const {
+        for (int c = 0; c < columns; c++) {
+            const int begin = static_cast<int>(static_cast<long long>(c) * Capacity / columns);
+            int end = static_cast<int>((static_cast<long long>(c) + 1) * Capacity / columns);
+            if (end <= begin) end = begin + 1;
+
+            int p = head_ + begin;
+            if (p >= Capacity) p -= Capacity;
+            int peak = data_[p];
+            for (int n = end - begin - 1; n > 0; n--) {
+                if (++p == Capacity) p = 0;
+                peak = (std::max)(peak, data_[p]);
+            }
+            out[c] = peak;
+        }
+    }
+
+private:
+    int data_[Capacity] = {};
+    int head_ = 0;                  // next slot to write = oldest sample
+};
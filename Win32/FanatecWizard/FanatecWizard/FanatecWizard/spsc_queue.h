@@ -0,0 +1,53 @@
+// spsc_queue.h - bounded single-producer / single-consumer ring buffer
+//
+// Used to hand processed input from the input thread to its consumers without a lock.
+// Capacity must be a power of two. try_push fails (and the caller counts a drop) when
+// the consumer has fallen a full ring behind.
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // producer side
+    bool try_push(const T& item) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ >= Capacity) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ >= Capacity) return false;
+        }
+        items_[tail & (Capacity - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    bool try_pop(T& item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) return false;
+        }
+        item = items_[head & (Capacity - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // either side; exact only when called from one of them while the other is idle
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    static size_t capacity() { return Capacity; }
+
+private:
+    // head and tail on separate cache lines so producer and consumer do not false-share
+    alignas(64) std::atomic<size_t> head_{ 0 };
+    size_t tail_cache_ = 0;                 // consumer's copy of tail_
+    alignas(64) std::atomic<size_t> tail_{ 0 };
+    size_t head_cache_ = 0;                 // producer's copy of head_
+    alignas(64) T items_[Capacity];
+};
@@ -0,0 +1,140 @@
+// stats_endpoint.h - local text endpoint for live statistics
+//
+// Listens on 127.0.0.1:<port>; every connection gets the current text of the render
+// callback and is closed, so `nc localhost 5556` or a browser-less script can poll it.
+// The listening thread waits in select() with a short timeout, and stop() wakes it with a
+// connection of its own, so stop() returns right away instead of hanging in accept().
+// Nothing here touches the input path: the callback reads atomics (LatencyTrace,
+// LatencyHistogram).
+//
+// On Windows include this (or <winsock2.h>) before <windows.h>.
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET stats_socket_t;
+#define STATS_INVALID_SOCKET INVALID_SOCKET
+#define stats_close_socket closesocket
+#define STATS_SEND_FLAGS 0
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int stats_socket_t;
+#define STATS_INVALID_SOCKET (-1)
+#define stats_close_socket ::close
+#define STATS_SEND_FLAGS MSG_NOSIGNAL         // a client that hung up must not kill the process
+#endif
+
+class StatsEndpoint {
+public:
+    static const uint16_t DefaultPort = 5556;      // next to XCP on 5555
+
+    typedef std::function<std::string()> Render;
+
+    ~StatsEndpoint() { stop(); }
+
+    bool start(Render render, uint16_t port = DefaultPort) {
+        if (thread_.joinable()) return true;
+#ifdef _WIN32
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return false;
+        wsa_ = true;
+#endif
+        socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (socket_ == STATS_INVALID_SOCKET) return close_listener();
+
+        int reuse = 1;
+        setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (bind(socket_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(socket_, 4) != 0) {
+            return close_listener();
+        }
+
+        render_ = render;
+        port_ = port;
+        stop_.store(false);
+        thread_ = std::thread(&StatsEndpoint::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        stop_.store(true);
+        wake();
+        thread_.join();
+        close_listener();
+    }
+
+    bool running() const { return thread_.joinable(); }
+    uint16_t port() const { return port_; }
+    uint64_t served() const { return served_.load(std::memory_order_relaxed); }
+
+private:
+    Render render_;
+    std::thread thread_;
+    std::atomic<bool> stop_{ false };
+    std::atomic<uint64_t> served_{ 0 };
+    stats_socket_t socket_ = STATS_INVALID_SOCKET;
+    uint16_t port_ = 0;
+    bool wsa_ = false;
+
+    // closes the listening socket; also the cleanup of a failed start()
+    bool close_listener() {
+        if (socket_ != STATS_INVALID_SOCKET) {
+            stats_close_socket(socket_);
+            socket_ = STATS_INVALID_SOCKET;
+        }
+#ifdef _WIN32
+        if (wsa_) WSACleanup();
+#endif
+        wsa_ = false;
+        return false;
+    }
+
+    // connects to the listener so select() returns now rather than at its timeout
+    void wake() {
+        stats_socket_t s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s == STATS_INVALID_SOCKET) return;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port_);
+        connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        stats_close_socket(s);
+    }
+
+    void run() {
+        while (!stop_.load()) {
+            fd_set set;
+            FD_ZERO(&set);
+            FD_SET(socket_, &set);
+            timeval timeout{ 0, 100000 };
+            if (select(static_cast<int>(socket_) + 1, &set, nullptr, nullptr, &timeout) <= 0) continue;
+            if (stop_.load()) break;
+
+            stats_socket_t client = accept(socket_, nullptr, nullptr);
+            if (client == STATS_INVALID_SOCKET) continue;
+            const std::string text = render_();
+            size_t sent = 0;
+            while (sent < text.size()) {
+                const int n = send(client, text.data() + sent, static_cast<int>(text.size() - sent), STATS_SEND_FLAGS);
+                if (n <= 0) break;
+                sent += static_cast<size_t>(n);
+            }
+            stats_close_socket(client);
+            served_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
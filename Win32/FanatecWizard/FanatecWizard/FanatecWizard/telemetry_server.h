@@ -0,0 +1,390 @@
+// telemetry_server.h - live vehicle state over TCP for remote dashboards
+//
+// publish() puts the newest state into a seqlock and returns; it never takes a lock or
+// makes a system call, so the input thread can call it per report. The server runs as
+// tasks on a Reactor (reactor.h), its own or one shared with other servers: one accepts,
+// and each client has one reading its rate requests and one sending it the newest state
+// at that client's own rate (default DefaultRate, at most MaxRate Hz).
+//
+// Framing, little endian; every frame starts with its payload length:
+//
+//   frame    length (2) | type (1) | seq (4, per client) | payload
+//   Hello    version (1) | rate Hz (2) | max rate Hz (2)                 on connect
+//   Key      t_us (8) | throttle, brake, clutch (2 each) | speed (2) | mode (1) | gear (1) | sources (1)
+//   Delta    dt_us (4) | changed-field mask (1) | the changed fields in Key order
+//
+// The first state a client gets is a Key; after that a Delta against the last state sent
+// to that client, usually 12-14 bytes. Nothing is sent while the state is unchanged except
+// an empty Delta once a second as a heartbeat. A client that cannot keep up (its socket
+// buffer is full) skips states instead of queueing them; the next Delta is against what it
+// actually got. One whose socket stays full for WriteTimeoutUs is dropped. Clients set
+// their rate with 'R' + rate Hz (2), 0 = paused.
+//
+// On Windows include this (or <winsock2.h>) before <windows.h>.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "reactor.h"
+#include "seqlock.h"
+#include "timing.h"
+
+#define telemetry_poll reactor_poll     // for clients polling their sockets
+
+struct TelemetrySnapshot {
+    int64_t t_us = 0;               // when the state was published (now_us)
+    uint16_t pedal[3] = {};         // throttle, brake, clutch after filter and curves
+    int16_t speed = 0;              // km/h
+    uint8_t mode = 0;               // DriveMode
+    int8_t gear = 0;
+    uint8_t sources = 0;            // attached input devices
+    uint8_t reserved = 0;
+};
+
+namespace telemetry_wire {
+
+enum FrameType { FrameHello, FrameKey, FrameDelta };
+enum Field { FieldThrottle, FieldBrake, FieldClutch, FieldSpeed, FieldMode, FieldGear, FieldSources, FieldCount };
+
+const uint8_t Version = 1;
+const size_t HeaderBytes = 7;       // length + type + seq
+const size_t KeyBytes = 8 + 6 + 2 + 3;
+const size_t MaxFrameBytes = HeaderBytes + KeyBytes;
+const uint8_t RateRequest = 'R';
+
+inline size_t field_bytes(int f) { return f <= FieldSpeed ? 2 : 1; }
+
+inline uint32_t field_value(const TelemetrySnapshot& s, int f) {
+    switch (f) {
+    case FieldThrottle: case FieldBrake: case FieldClutch: return s.pedal[f];
+    case FieldSpeed: return static_cast<uint16_t>(s.speed);
+    case FieldMode: return s.mode;
+    case FieldGear: return static_cast<uint8_t>(s.gear);
+    default: return s.sources;
+    }
+}
+
+inline void set_field(TelemetrySnapshot& s, int f, uint32_t v) {
+    switch (f) {
+    case FieldThrottle: case FieldBrake: case FieldClutch: s.pedal[f] = static_cast<uint16_t>(v); break;
+    case FieldSpeed: s.speed = static_cast<int16_t>(static_cast<uint16_t>(v)); break;
+    case FieldMode: s.mode = static_cast<uint8_t>(v); break;
+    case FieldGear: s.gear = static_cast<int8_t>(static_cast<uint8_t>(v)); break;
+    default: s.sources = static_cast<uint8_t>(v); break;
+    }
+}
+
+inline void put(uint8_t*& p, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) *p++ = static_cast<uint8_t>(v >> (8 * i));
+}
+
+inline uint64_t get(const uint8_t*& p, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; i++) v |= static_cast<uint64_t>(*p++) << (8 * i);
+    return v;
+}
+
+// Key when prev is null or too old for a 32-bit dt; returns the frame size.
+inline size_t encode(const TelemetrySnapshot& s, const TelemetrySnapshot* prev, uint32_t seq, uint8_t* out) {
+    if (prev && (s.t_us < prev->t_us || s.t_us - prev->t_us > 0xFFFFFFFFll)) prev = nullptr;
+    uint8_t* p = out + 2;
+    put(p, prev ? FrameDelta : FrameKey, 1);
+    put(p, seq, 4);
+    if (!prev) {
+        put(p, static_cast<uint64_t>(s.t_us), 8);
+        for (int f = 0; f < FieldCount; f++) put(p, field_value(s, f), field_bytes(f));
+    }
+    else {
+        put(p, static_cast<uint64_t>(s.t_us - prev->t_us), 4);
+        uint8_t* mask = p++;
+        *mask = 0;
+        for (int f = 0; f < FieldCount; f++) {
+            if (field_value(s, f) == field_value(*prev, f)) continue;
+            *mask |= static_cast<uint8_t>(1u << f);
+            put(p, field_value(s, f), field_bytes(f));
+        }
+    }
+    const size_t n = static_cast<size_t>(p - out);
+    uint8_t* len = out;
+    put(len, n - 2, 2);
+    return n;
+}
+
+inline size_t encode_hello(uint16_t rate, uint16_t maxRate, uint8_t* out) {
+    uint8_t* p = out;
+    put(p, HeaderBytes - 2 + 5, 2);
+    put(p, FrameHello, 1);
+    put(p, 0, 4);
+    put(p, Version, 1);
+    put(p, rate, 2);
+    put(p, maxRate, 2);
+    return static_cast<size_t>(p - out);
+}
+
+} // namespace telemetry_wire
+
+// Client side: feed it the bytes from the socket, get every state in full.
+class TelemetryDecoder {
+public:
+    // fn(const TelemetrySnapshot&, uint32_t seq) per Key or Delta; false on a broken stream.
+    template <class Fn>
+    bool feed(const uint8_t* data, size_t size, Fn fn) {
+        using namespace telemetry_wire;
+        buffer_.insert(buffer_.end(), data, data + size);
+        size_t at = 0;
+        while (buffer_.size() - at >= 2) {
+            const size_t len = buffer_[at] | (buffer_[at + 1] << 8);
+            if (len < HeaderBytes - 2 || len > MaxFrameBytes) return false;
+            if (buffer_.size() - at < 2 + len) break;
+            const uint8_t* p = &buffer_[at + 2];
+            const uint8_t* end = p + len;
+            const int type = static_cast<int>(get(p, 1));
+            const uint32_t seq = static_cast<uint32_t>(get(p, 4));
+            if (type == FrameHello) {
+                if (end - p >= 5) {
+                    p++;
+                    rate_ = static_cast<uint16_t>(get(p, 2));
+                    max_rate_ = static_cast<uint16_t>(get(p, 2));
+                }
+            }
+            else if (type == FrameKey) {
+                if (end - p < static_cast<ptrdiff_t>(KeyBytes)) return false;
+                state_.t_us = static_cast<int64_t>(get(p, 8));
+                for (int f = 0; f < FieldCount; f++) set_field(state_, f, static_cast<uint32_t>(get(p, field_bytes(f))));
+                has_state_ = true;
+                fn(state_, seq);
+            }
+            else if (type == FrameDelta) {
+                if (!has_state_ || end - p < 5) return false;
+                state_.t_us += static_cast<int64_t>(get(p, 4));
+                const uint8_t mask = static_cast<uint8_t>(get(p, 1));
+                for (int f = 0; f < FieldCount; f++) {
+                    if (!(mask & (1u << f))) continue;
+                    if (static_cast<size_t>(end - p) < field_bytes(f)) return false;
+                    set_field(state_, f, static_cast<uint32_t>(get(p, field_bytes(f))));
+                }
+                fn(state_, seq);
+            }
+            at += 2 + len;
+        }
+        buffer_.erase(buffer_.begin(), buffer_.begin() + at);
+        return true;
+    }
+
+    uint16_t rate() const { return rate_; }
+    uint16_t max_rate() const { return max_rate_; }
+
+private:
+    std::vector<uint8_t> buffer_;
+    TelemetrySnapshot state_;
+    bool has_state_ = false;
+    uint16_t rate_ = 0;
+    uint16_t max_rate_ = 0;
+};
+
+class TelemetryServer {
+public:
+    static constexpr uint16_t DefaultPort = 5558;  // after the stats endpoints (5556, 5557)
+    static constexpr uint16_t DefaultRate = 60;     // Hz
+    static constexpr uint16_t MaxRate = 1000;
+    static constexpr int MaxClients = 256;
+    static constexpr int64_t WriteTimeoutUs = 2000000;  // socket full this long: the client is dropped
+
+    ~TelemetryServer() { stop(); }
+
+    // On a reactor of its own; stats (optional) is that thread's policy and timer lateness.
+    bool start(uint16_t port = DefaultPort, uint16_t rate = DefaultRate, ThreadStats* stats = nullptr) {
+        if (reactor_) return true;
+        if (!own_.start(stats)) return false;
+        if (start(own_, port, rate)) return true;
+        own_.stop();
+        return false;
+    }
+
+    // On a running reactor shared with other servers.
+    bool start(Reactor& reactor, uint16_t port = DefaultPort, uint16_t rate = DefaultRate) {
+        if (reactor_) return true;
+        if (!reactor.running()) return false;
+        rate_ = (std::min)((std::max)(rate, static_cast<uint16_t>(1)), MaxRate);
+        stats_socket_t listener = STATS_INVALID_SOCKET;
+        reactor.run_sync([&] {
+            listener = reactor.listen(INADDR_LOOPBACK, port);
+            if (listener == STATS_INVALID_SOCKET) return;
+            cancel_.reset();
+            reactor.spawn(accept_clients(reactor, listener));
+        });
+        if (listener == STATS_INVALID_SOCKET) return false;
+        reactor_ = &reactor;
+        port_ = port;
+        return true;
+    }
+
+    void stop() {
+        if (!reactor_) return;
+        reactor_->run_sync([this] {
+            cancel_.cancel();
+            for (auto& c : clients_) c->cancel.cancel();
+        });
+        tasks_.wait_idle();
+        own_.stop();
+        clients_.clear();                           // left by tasks a stopped reactor destroyed
+        client_count_.store(0);
+        reactor_ = nullptr;
+    }
+
+    // Any thread, never blocks. With two threads publishing at once the later one is
+    // dropped; the next publish carries the newer state anyway.
+    void publish(const TelemetrySnapshot& s) {
+        if (writing_.test_and_set(std::memory_order_acquire)) {
+            collisions_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        state_.store(s);
+        writing_.clear(std::memory_order_release);
+    }
+
+    bool running() const { return reactor_ != nullptr; }
+    uint16_t port() const { return port_; }
+    int clients() const { return client_count_.load(std::memory_order_relaxed); }
+    uint64_t frames_sent() const { return frames_.load(std::memory_order_relaxed); }
+    uint64_t bytes_sent() const { return bytes_.load(std::memory_order_relaxed); }
+    uint64_t frames_skipped() const { return skipped_.load(std::memory_order_relaxed); }     // client socket full
+    uint64_t clients_dropped() const { return dropped_.load(std::memory_order_relaxed); }    // full for WriteTimeoutUs
+    uint64_t publish_collisions() const { return collisions_.load(std::memory_order_relaxed); }
+
+private:
+    // Shared by the client's two tasks, on the reactor thread; the last one to end frees it.
+    struct Client {
+        stats_socket_t socket;
+        uint16_t rate;
+        int64_t period_us;
+        int64_t next_us;
+        int64_t last_sent_us;
+        uint32_t seq = 0;
+        uint32_t version = 0;               // of the last state sent
+        bool has_sent = false;
+        TelemetrySnapshot sent;
+        Signal rate_changed;
+        Cancel cancel;                      // either task ending ends the other
+        int tasks = 2;
+    };
+
+    Seqlock<TelemetrySnapshot> state_;
+    std::atomic_flag writing_ = ATOMIC_FLAG_INIT;
+    Reactor own_;
+    Reactor* reactor_ = nullptr;
+    Cancel cancel_;                                     // reactor thread
+    std::vector<std::unique_ptr<Client>> clients_;      // reactor thread
+    uint16_t port_ = 0;
+    uint16_t rate_ = DefaultRate;
+    TaskGroup tasks_;
+    std::atomic<int> client_count_{ 0 };
+    std::atomic<uint64_t> frames_{ 0 }, bytes_{ 0 }, skipped_{ 0 }, dropped_{ 0 }, collisions_{ 0 };
+
+    void set_rate(Client& c, uint16_t rate, int64_t now) {
+        c.rate = (std::min)(rate, MaxRate);
+        c.period_us = c.rate ? 1000000 / c.rate : 0;
+        c.next_us = now;
+    }
+
+    Task<> accept_clients(Reactor& reactor, stats_socket_t listener) {
+        TaskCounter task(tasks_);
+        for (;;) {
+            stats_socket_t s = co_await reactor.accept(listener, &cancel_);
+            if (s == STATS_INVALID_SOCKET) break;
+            if (static_cast<int>(clients_.size()) >= MaxClients) {
+                reactor.close(s);
+                continue;
+            }
+            std::unique_ptr<Client> c(new Client());
+            c->socket = s;
+            set_rate(*c, rate_, now_us());
+            c->last_sent_us = c->next_us;
+            reactor.spawn(read_requests(reactor, *c));
+            reactor.spawn(send_states(reactor, *c));
+            clients_.push_back(std::move(c));
+            client_count_.store(static_cast<int>(clients_.size()), std::memory_order_relaxed);
+        }
+        reactor.close(listener);
+    }
+
+    void end_client(Reactor& reactor, Client& c) {
+        c.cancel.cancel();
+        if (--c.tasks > 0) return;
+        reactor.close(c.socket);
+        clients_.erase(std::find_if(clients_.begin(), clients_.end(),
+            [&c](const std::unique_ptr<Client>& p) { return p.get() == &c; }));
+        client_count_.store(static_cast<int>(clients_.size()), std::memory_order_relaxed);
+    }
+
+    // 'R' + rate Hz (2) until the client hangs up or sends anything else
+    Task<> read_requests(Reactor& reactor, Client& c) {
+        TaskCounter task(tasks_);
+        uint8_t in[3];
+        size_t have = 0;
+        for (;;) {
+            const IoResult r = co_await reactor.recv(c.socket, in + have, sizeof(in) - have, Reactor::NoDeadline, &c.cancel);
+            if (r.status != IoStatus::Ready) break;
+            have += r.bytes;
+            if (in[0] != telemetry_wire::RateRequest) break;
+            if (have < sizeof(in)) continue;
+            set_rate(c, static_cast<uint16_t>(in[1] | (in[2] << 8)), now_us());
+            c.rate_changed.notify();
+            have = 0;
+        }
+        end_client(reactor, c);
+    }
+
+    // The newest state for a due client, or a heartbeat; 0 when there is nothing to send.
+    size_t serve(Client& c, int64_t now, uint8_t* frame) {
+        if (!c.rate || now < c.next_us) return 0;
+        c.next_us += c.period_us;
+        if (c.next_us <= now) c.next_us = now + c.period_us;     // fell behind: no burst
+        TelemetrySnapshot s;
+        uint32_t version = 0;
+        const bool valid = state_.try_load(s, &version) && version > 0;
+        const bool changed = valid && (!c.has_sent || version != c.version);
+        if (!changed && (!c.has_sent || now - c.last_sent_us < 1000000)) return 0;
+        TelemetrySnapshot next = changed ? s : c.sent;
+        if (!changed) next.t_us = c.sent.t_us;                  // heartbeat: empty delta
+        const size_t n = telemetry_wire::encode(next, c.has_sent ? &c.sent : nullptr, ++c.seq, frame);
+        c.sent = next;
+        c.version = version;
+        c.has_sent = true;
+        c.last_sent_us = now;
+        frames_.fetch_add(1, std::memory_order_relaxed);
+        return n;
+    }
+
+    // The hello, then a frame per due time at the client's rate. While a frame waits for
+    // room in the socket the states due meanwhile are skipped, not queued.
+    Task<> send_states(Reactor& reactor, Client& c) {
+        TaskCounter task(tasks_);
+        uint8_t frame[telemetry_wire::MaxFrameBytes];
+        size_t n = telemetry_wire::encode_hello(c.rate, MaxRate, frame);
+        for (;;) {
+            if (n) {
+                const int64_t start = now_us();
+                const IoStatus st = co_await reactor.send_all(c.socket, frame, n, start + WriteTimeoutUs, &c.cancel);
+                if (st == IoStatus::Timeout) dropped_.fetch_add(1, std::memory_order_relaxed);
+                if (st != IoStatus::Ready) break;
+                bytes_.fetch_add(n, std::memory_order_relaxed);
+                n = 0;
+                const int64_t now = now_us();
+                if (c.rate && c.next_us > start && c.next_us <= now) {
+                    const int64_t missed = (now - c.next_us) / c.period_us + 1;
+                    skipped_.fetch_add(static_cast<uint64_t>(missed), std::memory_order_relaxed);
+                    c.next_us += missed * c.period_us;
+                }
+            }
+            // until the next due time; a rate request restarts the schedule
+            const IoStatus st = co_await reactor.wait(c.rate_changed, c.rate ? c.next_us : Reactor::NoDeadline, &c.cancel);
+            if (st == IoStatus::Cancelled) break;
+            if (st == IoStatus::Timeout) n = serve(c, now_us(), frame);
+        }
+        end_client(reactor, c);
+    }
+};
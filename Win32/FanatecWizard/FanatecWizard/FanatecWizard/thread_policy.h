@@ -0,0 +1,309 @@
+// thread_policy.h - CPU affinity, priority and wake-up latency of the runtime threads
+//
+// Every long-lived thread of a front end has a role (input, tick, can, xcp, recorder,
+// net for the reactor serving the sockets) and a policy for it: a CPU to pin to, and a priority class.
+//
+//   normal     the OS default
+//   high       THREAD_PRIORITY_HIGHEST on Windows, nice -10 on Linux
+//   realtime   THREAD_PRIORITY_TIME_CRITICAL on Windows, SCHED_FIFO on Linux (fifo 1..99)
+//
+// A thread applies its own policy when it starts (thread_policy_apply). Processes can
+// also lock their memory so a page fault never lands in a periodic loop, and on Windows
+// raise the timer resolution to 1 ms, without which Sleep(10) takes 15.6 ms.
+//
+// Periodic threads wait through ThreadStats::sleep_until, which uses an absolute timer
+// (clock_nanosleep, or a high-resolution waitable timer on Windows) and records how late
+// each wake-up was, in microseconds. ThreadMonitor::report() prints the table per thread,
+// so the same numbers the cyclictest-style bench (Tools/CyclicBench) gives for a machine
+// can be read from a running front end (the stats endpoint appends it).
+//
+// Realtime needs privileges: CAP_SYS_NICE (or an rtprio limit) on Linux, and on Windows
+// TIME_CRITICAL only means much inside a HIGH or REALTIME priority class process. A
+// policy that cannot be applied is reported and the thread runs as it is.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include "latency_histogram.h"
+#include "timing.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+enum ThreadRole { ThreadInput, ThreadTick, ThreadCanTx, ThreadXcp, ThreadRecorder, ThreadNetwork, ThreadRoleCount };
+
+inline const char* thread_role_name(ThreadRole r) {
+    static const char* const names[ThreadRoleCount] = { "input", "tick", "can", "xcp", "recorder", "net" };
+    return names[r];
+}
+
+enum ThreadPriority { PriorityNormal, PriorityHigh, PriorityRealtime };
+
+inline const char* thread_priority_name(ThreadPriority p) {
+    static const char* const names[] = { "normal", "high", "realtime" };
+    return names[p];
+}
+
+inline bool thread_priority_from_name(const std::string& name, ThreadPriority& out) {
+    for (int p = PriorityNormal; p <= PriorityRealtime; p++) {
+        if (name == thread_priority_name(static_cast<ThreadPriority>(p))) {
+            out = static_cast<ThreadPriority>(p);
+            return true;
+        }
+    }
+    return false;
+}
+
+struct ThreadPolicy {
+    int cpu = -1;                           // -1 = any
+    ThreadPriority priority = PriorityNormal;
+    int fifo = 80;                          // SCHED_FIFO priority of realtime on Linux
+
+    static ThreadPolicy defaults(ThreadRole r) {
+        ThreadPolicy p;
+        if (r == ThreadInput) p.priority = PriorityHigh;    // what RawInputThread always did
+        return p;
+    }
+
+    std::string describe() const {
+        char buf[64];
+        if (priority == PriorityRealtime) snprintf(buf, sizeof(buf), "realtime (fifo %d)", fifo);
+        else snprintf(buf, sizeof(buf), "%s", thread_priority_name(priority));
+        std::string out = buf;
+        if (cpu >= 0) out += ", cpu " + std::to_string(cpu);
+        return out;
+    }
+};
+
+// Pins the calling thread to one CPU; false where that is not supported.
+inline bool thread_policy_pin(int cpu) {
+    if (cpu < 0) return false;
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// Applies the policy to the calling thread. On failure the thread keeps running with
+// whatever did apply, and error says what did not.
+inline bool thread_policy_apply(const ThreadPolicy& p, std::string* error = nullptr) {
+    std::string failed;
+    if (p.cpu >= 0 && !thread_policy_pin(p.cpu)) failed = "cpu " + std::to_string(p.cpu);
+#ifdef _WIN32
+    static const int levels[] = { THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_HIGHEST, THREAD_PRIORITY_TIME_CRITICAL };
+    if (!SetThreadPriority(GetCurrentThread(), levels[p.priority])) {
+        failed += std::string(failed.empty() ? "" : ", ") + "priority (error " + std::to_string(GetLastError()) + ")";
+    }
+#elif defined(__linux__)
+    int rc = 0;
+    if (p.priority == PriorityRealtime) {
+        sched_param sp;
+        sp.sched_priority = (std::max)(1, (std::min)(p.fifo, 99));
+        rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    }
+    else {
+        sched_param sp;
+        sp.sched_priority = 0;
+        rc = pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+        const int nice = p.priority == PriorityHigh ? -10 : 0;
+        if (rc == 0 && setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice) != 0) rc = errno;
+    }
+    if (rc != 0) failed += std::string(failed.empty() ? "" : ", ") + thread_priority_name(p.priority) + " (" + strerror(rc) + ")";
+#else
+    if (p.priority != PriorityNormal) failed += std::string(failed.empty() ? "" : ", ") + "priority (not supported)";
+#endif
+    if (failed.empty()) return true;
+    if (error) *error = "not applied: " + failed;
+    return false;
+}
+
+// Keeps the process's pages in RAM: mlockall on Linux; on Windows, which has no
+// equivalent, a working set minimum of min_bytes so the pages are not trimmed.
+inline bool thread_policy_lock_memory(std::string* error = nullptr, size_t min_bytes = size_t(64) << 20) {
+#ifdef _WIN32
+    if (SetProcessWorkingSetSize(GetCurrentProcess(), min_bytes, min_bytes * 4)) return true;
+    if (error) *error = "working set not raised (error " + std::to_string(GetLastError()) + ")";
+    return false;
+#elif defined(__linux__)
+    (void)min_bytes;
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) return true;
+    if (error) *error = std::string("mlockall: ") + strerror(errno);
+    return false;
+#else
+    (void)min_bytes;
+    if (error) *error = "memory locking not supported";
+    return false;
+#endif
+}
+
+// 1 ms timer resolution for Sleep and timers on Windows, until thread_policy_coarse_timer();
+// Linux timers are already fine-grained.
+inline void thread_policy_fine_timer() {
+#ifdef _WIN32
+    timeBeginPeriod(1);
+#endif
+}
+
+inline void thread_policy_coarse_timer() {
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+// One thread: its policy, whether it applied, and how late its timed wake-ups were.
+// sleep_until must only be called from the thread itself; the rest is safe anywhere.
+class ThreadStats {
+public:
+    ThreadStats(const std::string& name, const ThreadPolicy& policy) : name_(name), policy_(policy) {}
+    ThreadStats(const ThreadStats&) = delete;
+    ThreadStats& operator=(const ThreadStats&) = delete;
+
+    ~ThreadStats() {
+#ifdef _WIN32
+        if (timer_) CloseHandle(timer_);
+#endif
+    }
+
+    // Applies the policy to the calling thread and remembers the outcome for report().
+    bool apply() {
+        std::string error;
+        const bool ok = thread_policy_apply(policy_, &error);
+        std::lock_guard<std::mutex> lock(mutex_);
+        applied_ = true;
+        error_ = error;
+        return ok;
+    }
+
+    // Sleeps until due_us (now_us() time) and records the lateness of the wake-up. A
+    // time already past returns at once and counts as an overrun, not as latency.
+    void sleep_until(int64_t due_us) {
+        int64_t now = now_us();
+        if (due_us <= now) {
+            overruns_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        wait(due_us, now);
+        wakeup_us_.record(now_us() - due_us);
+    }
+
+    // For a thread that waits some other way (an event loop's timers): a wake-up late_us
+    // after its time, or a time that had already passed.
+    void record_wakeup(int64_t late_us) { wakeup_us_.record(late_us); }
+    void record_overrun() { overruns_.fetch_add(1, std::memory_order_relaxed); }
+
+    const std::string& name() const { return name_; }
+    const ThreadPolicy& policy() const { return policy_; }
+    const LatencyHistogram& wakeup_us() const { return wakeup_us_; }
+    uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+
+    // "" while running as configured, else what did not apply
+    std::string status() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!applied_) return "not started";
+        return error_;
+    }
+
+private:
+    std::string name_;
+    ThreadPolicy policy_;
+    LatencyHistogram wakeup_us_;
+    std::atomic<uint64_t> overruns_{ 0 };
+    mutable std::mutex mutex_;
+    bool applied_ = false;
+    std::string error_;
+#ifdef _WIN32
+    HANDLE timer_ = NULL;
+    bool high_resolution_ = true;
+#endif
+
+    void wait(int64_t due_us, int64_t now) {
+#ifdef _WIN32
+        // CREATE_WAITABLE_TIMER_HIGH_RESOLUTION (Windows 10 1803+) is not bound to the
+        // 1 ms tick; older systems get a normal timer
+        if (!timer_ && high_resolution_) {
+            timer_ = CreateWaitableTimerExW(NULL, NULL, 0x00000002, TIMER_ALL_ACCESS);
+            if (!timer_) {
+                high_resolution_ = false;
+                timer_ = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+            }
+        }
+        LARGE_INTEGER dueTime;
+        dueTime.QuadPart = -(due_us - now) * 10;       // relative, 100 ns units
+        if (timer_ && SetWaitableTimer(timer_, &dueTime, 0, NULL, NULL, FALSE)) {
+            WaitForSingleObject(timer_, INFINITE);
+        }
+        else {
+            Sleep(static_cast<DWORD>((due_us - now) / 1000));
+        }
+#elif defined(__linux__)
+        (void)now;
+        // steady_clock, and so now_us(), is CLOCK_MONOTONIC on Linux
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(due_us / 1000000);
+        ts.tv_nsec = static_cast<long>(due_us % 1000000) * 1000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+        }
+#else
+        std::this_thread::sleep_for(std::chrono::microseconds(due_us - now));
+#endif
+    }
+};
+
+// The threads of one process, for the stats endpoint and the exit summary.
+class ThreadMonitor {
+public:
+    // The entry stays at the same address for the life of the monitor.
+    ThreadStats& add(const std::string& name, const ThreadPolicy& policy) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.emplace_back(name, policy);
+        return threads_.back();
+    }
+
+    std::string report() const {
+        std::string out = "thread      policy                       wakeups  mean_us   p99_us  max_us  overruns\n";
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const ThreadStats& t : threads_) {
+            const LatencyHistogram& h = t.wakeup_us();
+            char line[192];
+            snprintf(line, sizeof(line), "%-11s %-27s %8llu %8.1f %8llu %7llu %9llu", t.name().c_str(),
+                t.policy().describe().c_str(), (unsigned long long)h.count(), h.mean(),
+                (unsigned long long)h.percentile(99), (unsigned long long)h.maximum(),
+                (unsigned long long)t.overruns());
+            out += line;
+            const std::string status = t.status();
+            if (!status.empty()) out += "  " + status;
+            out += "\n";
+        }
+        return out;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::deque<ThreadStats> threads_;
+};
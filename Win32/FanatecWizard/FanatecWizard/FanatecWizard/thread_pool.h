@@ -0,0 +1,156 @@
+// thread_pool.h - work-stealing thread pool for offline batch work
+//
+// Every worker owns a deque: it pushes and pops its own tasks at the back (newest first,
+// warm caches) and, when it runs dry, steals the oldest task from the front of another
+// worker's deque. Tasks submitted from outside the pool are dealt round-robin. The
+// deques are guarded by one mutex each, which is cheap next to tasks the size of a
+// trace replay, and only the thief and the owner of one deque ever contend.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    explicit ThreadPool(unsigned threads = 0) {
+        if (threads == 0) threads = (std::max)(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < threads; i++) workers_.emplace_back(new Worker());
+        for (unsigned i = 0; i < threads; i++) threads_.emplace_back(&ThreadPool::run, this, i);
+    }
+
+    ~ThreadPool() {
+        wait_idle();
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            stopping_ = true;
+        }
+        wake_cv_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+
+    void submit(Task task) {
+        unfinished_.fetch_add(1, std::memory_order_relaxed);
+
+        size_t target;
+        if (current_pool() == this) target = current_index();
+        else target = next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+        {
+            std::lock_guard<std::mutex> lock(workers_[target]->mutex);
+            workers_[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            queued_++;
+        }
+        wake_cv_.notify_one();
+    }
+
+    // Blocks until every submitted task (including ones submitted by tasks) has finished.
+    // Not for use from inside a task.
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(done_mutex_);
+        done_cv_.wait(lock, [this]() { return unfinished_.load(std::memory_order_acquire) == 0; });
+    }
+
+    uint64_t steals() const { return steals_.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_{ 0 };
+    std::atomic<size_t> unfinished_{ 0 };
+    std::atomic<uint64_t> steals_{ 0 };
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    size_t queued_ = 0;             // tasks sitting in some deque, guarded by wake_mutex_
+    bool stopping_ = false;
+
+    std::mutex done_mutex_;
+    std::condition_variable done_cv_;
+
+    static ThreadPool*& current_pool() { static thread_local ThreadPool* pool = nullptr; return pool; }
+    static size_t& current_index() { static thread_local size_t index = 0; return index; }
+
+    bool take(size_t self, Task& task) {
+        {
+            Worker& own = *workers_[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < workers_.size(); k++) {
+            Worker& victim = *workers_[(self + k) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                steals_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t self) {
+        current_pool() = this;
+        current_index() = self;
+
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(wake_mutex_);
+                wake_cv_.wait(lock, [this]() { return queued_ > 0 || stopping_; });
+                if (queued_ == 0 && stopping_) return;
+                queued_--;              // claim one task; it is in some deque
+            }
+
+            Task task;
+            // a claimed task is always in some deque, but a scan can race past it
+            while (!take(self, task)) std::this_thread::yield();
+            task();
+
+            if (unfinished_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(done_mutex_);
+                done_cv_.notify_all();
+            }
+        }
+    }
+};
+
+// Runs fn(i) for i in [0, count) on the pool in chunks and waits for all of them
+// (so, like wait_idle, only from outside the pool).
+template <typename Fn>
+void parallel_for(ThreadPool& pool, size_t count, Fn fn, size_t chunk = 1) {
+    if (chunk == 0) chunk = 1;
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        const size_t end = (std::min)(count, begin + chunk);
+        pool.submit([begin, end, &fn]() {
+            for (size_t i = begin; i < end; i++) fn(i);
+        });
+    }
+    pool.wait_idle();
+}
@@ -0,0 +1,9 @@
+// timing.h - monotonic microsecond clock shared by the input, engine and bus code
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+inline int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,51 @@
+// triple_buffer.h - latest-value hand-off between one writer and one reader
+//
+// The writer fills its private buffer and swaps it with the shared middle one; the
+// reader swaps the middle one with its private buffer when the writer marked it fresh.
+// Neither side ever waits for the other, so a reader stepping at a fixed rate (the
+// Simulink S-function) always gets the newest complete value in constant time.
+// Values published between two reads are overwritten - use an SpscQueue when every
+// sample matters.
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+template <typename T>
+class TripleBuffer {
+public:
+    // writer side
+    T& write_buffer() { return slots_[back_].value; }
+
+    void publish() {
+        back_ = middle_.exchange(back_ | FreshBit, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    void write(const T& value) {
+        write_buffer() = value;
+        publish();
+    }
+
+    // reader side: copies the newest value, returns true if it was not read before
+    bool read(T& value) {
+        bool fresh = false;
+        if (middle_.load(std::memory_order_relaxed) & FreshBit) {
+            front_ = middle_.exchange(front_, std::memory_order_acq_rel) & IndexMask;
+            fresh = true;
+        }
+        value = slots_[front_].value;
+        return fresh;
+    }
+
+private:
+    static const uint8_t IndexMask = 0x03;
+    static const uint8_t FreshBit = 0x04;
+
+    struct Slot {
+        alignas(64) T value{};
+    };
+
+    Slot slots_[3];
+    alignas(64) std::atomic<uint8_t> middle_{ 1 };
+    alignas(64) uint8_t back_ = 0;      // writer only
+    alignas(64) uint8_t front_ = 2;     // reader only
+};
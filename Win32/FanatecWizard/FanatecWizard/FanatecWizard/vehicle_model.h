@@ -0,0 +1,226 @@
+// vehicle_model.h - longitudinal vehicle model stepped at a fixed dt
+//
+// Replaces the dynamic-mode speed counter: pedal positions become engine torque (through
+// a torque map and the gearbox) and brake force, against aerodynamic drag and rolling
+// resistance. Every step covers exactly VehicleParams::dt_s, so the result no longer
+// depends on the USB report rate or on how often the caller happens to run.
+//
+// vehicle_step() advances one vehicle. VehicleBatch keeps many vehicles as structure of
+// arrays for replay and benchmarking; both go through the same per-lane arithmetic, so
+// a batch lane matches the scalar model bit for bit (as long as the compiler is not
+// allowed to contract into FMA, e.g. GCC/Clang with -march=native need -ffp-contract=off).
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const int GearAutomatic = -1;      // gear request: shift on engine speed
+const int MaxGears = 8;
+
+struct TorqueMap {
+    static const int Points = 8;
+    double rpm[Points];
+    double torque_nm[Points];      // full-throttle torque at rpm[i]
+};
+
+// Full-load torque, linear between the map points and flat outside them.
+inline double torque_at(const TorqueMap& map, double rpm) {
+    if (rpm <= map.rpm[0]) return map.torque_nm[0];
+    for (int i = 1; i < TorqueMap::Points; i++) {
+        if (rpm < map.rpm[i]) {
+            double f = (rpm - map.rpm[i - 1]) / (map.rpm[i] - map.rpm[i - 1]);
+            return map.torque_nm[i - 1] + f * (map.torque_nm[i] - map.torque_nm[i - 1]);
+        }
+    }
+    return map.torque_nm[TorqueMap::Points - 1];
+}
+
+// Defaults describe a mid-size petrol hatchback.
+struct VehicleParams {
+    double mass_kg = 1400.0;
+    double drag_area_m2 = 0.66;            // Cd * frontal area
+    double air_density = 1.225;
+    double rolling_coeff = 0.012;
+    double wheel_radius_m = 0.31;
+
+    int gear_count = 6;
+    double gear_ratio[MaxGears] = { 3.60, 2.19, 1.41, 1.12, 0.92, 0.75, 0.0, 0.0 };
+    double final_drive = 3.94;
+    double driveline_eff = 0.90;
+
+    double idle_rpm = 900.0;
+    double redline_rpm = 6800.0;           // no drive torque at or above
+    double upshift_rpm = 6200.0;           // automatic gear selection
+    double downshift_rpm = 2200.0;
+    double engine_brake_nm = 35.0;         // drag torque with the throttle closed, in gear
+
+    double max_brake_force_n = 14000.0;    // at full pedal
+    double max_speed_ms = 300.0 / 3.6;     // the gauge limit
+
+    double dt_s = 0.01;
+
+    TorqueMap torque = {
+        { 1000.0, 1500.0, 2000.0, 3000.0, 4000.0, 5000.0, 6000.0, 6800.0 },
+        {  150.0,  200.0,  240.0,  260.0,  260.0,  245.0,  220.0,  190.0 }
+    };
+};
+
+const double Gravity = 9.81;
+
+struct VehicleState {
+    double speed_ms = 0.0;
+    double distance_m = 0.0;
+    double accel_ms2 = 0.0;
+    double engine_rpm = 0.0;
+    int gear = 1;                  // 0 = neutral
+};
+
+inline double vehicle_speed_kmh(const VehicleState& s) { return s.speed_ms * 3.6; }
+
+// Engine speed for a road speed in a gear, never below idle.
+inline double vehicle_engine_rpm(const VehicleParams& p, double speed_ms, int gear) {
+    if (gear <= 0) return p.idle_rpm;
+    const double wheelRpm = speed_ms / p.wheel_radius_m * (60.0 / 6.283185307179586);
+    return (std::max)(p.idle_rpm, wheelRpm * p.gear_ratio[gear - 1] * p.final_drive);
+}
+
+// Gear for the next step: the request, or one shift per step on engine speed.
+inline int vehicle_select_gear(const VehicleParams& p, int current, double speed_ms, int request) {
+    if (request != GearAutomatic) return (std::min)((std::max)(request, 0), p.gear_count);
+
+    int gear = (std::max)(current, 1);
+    const double rpm = vehicle_engine_rpm(p, speed_ms, gear);
+    if (rpm > p.upshift_rpm && gear < p.gear_count) gear++;
+    else if (rpm < p.downshift_rpm && gear > 1) gear--;
+    return gear;
+}
+
+// Torque at the flywheel for a pedal position at an engine speed.
+inline double vehicle_engine_torque(const VehicleParams& p, double throttle, double rpm) {
+    if (rpm >= p.redline_rpm) return -p.engine_brake_nm;
+    return throttle * torque_at(p.torque, rpm) - (1.0 - throttle) * p.engine_brake_nm;
+}
+
+// Integrates one dt from the forces (semi-implicit Euler, no reversing).
+inline void vehicle_integrate(const VehicleParams& p, double engineTorque, double wheelRatio, double brake,
+    double& speed_ms, double& distance_m, double& accel_ms2)
+{
+    const double drive = engineTorque * wheelRatio * p.driveline_eff / p.wheel_radius_m;
+    const double drag = 0.5 * p.air_density * p.drag_area_m2 * speed_ms * speed_ms;
+    const double rolling = speed_ms > 0.0 ? p.rolling_coeff * p.mass_kg * Gravity : 0.0;
+    const double braking = brake * p.max_brake_force_n;
+
+    const double accel = (drive - drag - rolling - braking) / p.mass_kg;
+    double v = speed_ms + accel * p.dt_s;
+    v = (std::min)((std::max)(v, 0.0), p.max_speed_ms);
+
+    accel_ms2 = (v - speed_ms) / p.dt_s;
+    speed_ms = v;
+    distance_m += v * p.dt_s;
+}
+
+inline double vehicle_wheel_ratio(const VehicleParams& p, int gear) {
+    return gear > 0 ? p.gear_ratio[gear - 1] * p.final_drive : 0.0;
+}
+
+// Advances one vehicle by p.dt_s. throttle and brake are 0..1.
+inline void vehicle_step(VehicleState& s, const VehicleParams& p, double throttle, double brake,
+    int gearRequest = GearAutomatic)
+{
+    throttle = (std::min)((std::max)(throttle, 0.0), 1.0);
+    brake = (std::min)((std::max)(brake, 0.0), 1.0);
+
+    s.gear = vehicle_select_gear(p, s.gear, s.speed_ms, gearRequest);
+    s.engine_rpm = vehicle_engine_rpm(p, s.speed_ms, s.gear);
+    const double torque = s.gear > 0 ? vehicle_engine_torque(p, throttle, s.engine_rpm) : 0.0;
+    vehicle_integrate(p, torque, vehicle_wheel_ratio(p, s.gear), brake, s.speed_ms, s.distance_m, s.accel_ms2);
+}
+
+// Many independent vehicles sharing one parameter set, stored as structure of arrays.
+// step() runs gear selection and the torque lookup per lane, then the force and
+// integration pass as a straight loop over contiguous arrays that the compiler can
+// vectorize.
+class VehicleBatch {
+public:
+    VehicleBatch(size_t count, const VehicleParams& params = VehicleParams())
+        : params_(params), speed_(count, 0.0), distance_(count, 0.0), accel_(count, 0.0),
+        rpm_(count, 0.0), gear_(count, 1), torque_(count, 0.0), ratio_(count, 0.0) {}
+
+    size_t size() const { return speed_.size(); }
+    const VehicleParams& params() const { return params_; }
+
+    // gearRequest may be null (all automatic). With active given, only lanes where it is
+    // non-zero move; the others keep their state untouched.
+    void step(const double* throttle, const double* brake, const int* gearRequest = nullptr,
+        const int32_t* active = nullptr)
+    {
+        const size_t n = size();
+        const VehicleParams& p = params_;
+
+        for (size_t i = 0; i < n; i++) {
+            if (active && !active[i]) continue;
+            const double t = (std::min)((std::max)(throttle[i], 0.0), 1.0);
+            const int gear = vehicle_select_gear(p, gear_[i], speed_[i], gearRequest ? gearRequest[i] : GearAutomatic);
+            gear_[i] = gear;
+            rpm_[i] = vehicle_engine_rpm(p, speed_[i], gear);
+            torque_[i] = gear > 0 ? vehicle_engine_torque(p, t, rpm_[i]) : 0.0;
+            ratio_[i] = vehicle_wheel_ratio(p, gear);
+        }
+
+        double* speed = speed_.data();
+        double* distance = distance_.data();
+        double* accel = accel_.data();
+        const double* torque = torque_.data();
+        const double* ratio = ratio_.data();
+        if (!active) {
+            for (size_t i = 0; i < n; i++) {
+                const double b = (std::min)((std::max)(brake[i], 0.0), 1.0);
+                vehicle_integrate(p, torque[i], ratio[i], b, speed[i], distance[i], accel[i]);
+            }
+            return;
+        }
+
+        // masked: integrate every lane, keep the result only where active (a blend, not a branch)
+        for (size_t i = 0; i < n; i++) {
+            const double b = (std::min)((std::max)(brake[i], 0.0), 1.0);
+            double v = speed[i], d = distance[i], a = accel[i];
+            vehicle_integrate(p, active[i] ? torque[i] : 0.0, active[i] ? ratio[i] : 0.0, b, v, d, a);
+            speed[i] = active[i] ? v : speed[i];
+            distance[i] = active[i] ? d : distance[i];
+            accel[i] = active[i] ? a : accel[i];
+        }
+    }
+
+    VehicleState state(size_t i) const {
+        VehicleState s;
+        s.speed_ms = speed_[i];
+        s.distance_m = distance_[i];
+        s.accel_ms2 = accel_[i];
+        s.engine_rpm = rpm_[i];
+        s.gear = gear_[i];
+        return s;
+    }
+
+    void set_state(size_t i, const VehicleState& s) {
+        speed_[i] = s.speed_ms;
+        distance_[i] = s.distance_m;
+        accel_[i] = s.accel_ms2;
+        rpm_[i] = s.engine_rpm;
+        gear_[i] = s.gear;
+    }
+
+    const double* speed_ms() const { return speed_.data(); }
+    const double* distance_m() const { return distance_.data(); }
+    const int* gear() const { return gear_.data(); }
+
+private:
+    VehicleParams params_;
+    std::vector<double> speed_;
+    std::vector<double> distance_;
+    std::vector<double> accel_;
+    std::vector<double> rpm_;
+    std::vector<int> gear_;
+    std::vector<double> torque_;   // per-step scratch
+    std::vector<double> ratio_;
+};
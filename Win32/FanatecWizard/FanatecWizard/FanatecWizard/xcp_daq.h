@@ -0,0 +1,98 @@
+// xcp_daq.h - XCP DAQ packet assembly for the measurement variables (simplexcp.h)
+//
+// A DAQ list is a set of ODTs (object descriptor tables), each a list of (address, size)
+// entries that fit into one data transfer object. Sampling copies every entry into its
+// packet and frames the packets for XCP on Ethernet:
+//
+//   LEN (2, LE) | CTR (2, LE) | PID (1) | timestamp (4, LE, first ODT only) | entries
+//
+// The list is built once (add()), sampling only copies, so it can run at DAQ rate on the
+// XCP thread. No transport here: xcp_server.h or a UDP socket sends the frames.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+class XcpDaqList {
+public:
+    static const size_t MaxDto = 252;           // bytes per packet after the transport header
+    static const int MaxEntries = 64;
+    static const int MaxOdts = 16;
+    static const size_t HeaderSize = 4;         // LEN + CTR
+    static const size_t TimestampSize = 4;
+
+    explicit XcpDaqList(uint8_t firstPid = 0) : first_pid_(firstPid) {}
+
+    // Appends a variable to the current ODT, or opens the next one when it does not fit.
+    bool add(const volatile void* address, uint8_t size) {
+        if (entry_count_ == MaxEntries || size == 0 || size > MaxDto - 1 - TimestampSize) return false;
+        if (odt_count_ == 0 || odt_bytes_[odt_count_ - 1] + size > MaxDto) {
+            if (odt_count_ == MaxOdts) return false;
+            odt_first_[odt_count_] = entry_count_;
+            odt_bytes_[odt_count_] = 1 + (odt_count_ == 0 ? TimestampSize : 0);     // PID, timestamp
+            odt_count_++;
+        }
+        Entry& e = entries_[entry_count_++];
+        e.address = const_cast<const void*>(address);
+        e.size = size;
+        odt_bytes_[odt_count_ - 1] += size;
+        return true;
+    }
+
+    int odt_count() const { return odt_count_; }
+    int entry_count() const { return entry_count_; }
+
+    // Bytes one sample() writes.
+    size_t frame_bytes() const {
+        size_t n = 0;
+        for (int o = 0; o < odt_count_; o++) n += HeaderSize + odt_bytes_[o];
+        return n;
+    }
+
+    // Copies the current values into one framed packet per ODT. counter is the transport
+    // CTR, advanced per packet. Returns the bytes written, 0 when out is too small.
+    size_t sample(uint32_t timestamp, uint16_t& counter, uint8_t* out, size_t capacity) const {
+        if (capacity < frame_bytes()) return 0;
+        uint8_t* p = out;
+        for (int o = 0; o < odt_count_; o++) {
+            const size_t len = odt_bytes_[o];
+            put16(p, static_cast<uint16_t>(len));
+            put16(p + 2, counter++);
+            p += HeaderSize;
+            *p++ = static_cast<uint8_t>(first_pid_ + o);
+            if (o == 0) {
+                put32(p, timestamp);
+                p += TimestampSize;
+            }
+            const int end = o + 1 < odt_count_ ? odt_first_[o + 1] : entry_count_;
+            for (int i = odt_first_[o]; i < end; i++) {
+                memcpy(p, entries_[i].address, entries_[i].size);
+                p += entries_[i].size;
+            }
+        }
+        return static_cast<size_t>(p - out);
+    }
+
+private:
+    struct Entry {
+        const void* address;
+        uint8_t size;
+    };
+
+    Entry entries_[MaxEntries];
+    int entry_count_ = 0;
+    int odt_first_[MaxOdts];            // first entry of each ODT
+    size_t odt_bytes_[MaxOdts];         // PID + timestamp + entries
+    int odt_count_ = 0;
+    uint8_t first_pid_;
+
+    static void put16(uint8_t* p, uint16_t v) {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+    }
+
+    static void put32(uint8_t* p, uint32_t v) {
+        put16(p, static_cast<uint16_t>(v));
+        put16(p + 2, static_cast<uint16_t>(v >> 16));
+    }
+};
@@ -1,105 +1,106 @@
+// xcp_server.h - XCP on TCP for ControlDesk, as tasks on a Reactor
+//
+// One task accepts connections and one task per client answers its commands, all on
+// the reactor's thread. A client that sends nothing for IdleTimeoutUs is dropped, and
+// so is one that does not take a reply within SendTimeoutUs. stop() cancels the tasks
+// and waits until they are gone, also when no client ever connected (the blocking
+// accept() it used to sit in kept it waiting for one).
+//
+// start(port) runs the server on a reactor of its own; start(reactor, port) puts it on
+// a running reactor shared with other servers. The owner declares the server: the
+// desktop app keeps one on its net reactor.
+//
+// On Windows include this (or <winsock2.h>) before <windows.h>.
 #pragma once
-// xcp_server.h - Actual XCP TCP server
-#pragma once
-#include <winsock2.h>
-#include <thread>
 #include <atomic>
-
-#pragma comment(lib, "ws2_32.lib")
+#include <cstdint>
+#include "reactor.h"
 
 class XcpServer {
-private:
-    std::atomic<bool> running_{ false };
-    std::thread server_thread_;
-    SOCKET server_socket_ = INVALID_SOCKET;
-
 public:
-    bool start() {
-        // Initialize Winsock
-        WSADATA wsaData;
-        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-            return false;
-        }
+    static constexpr uint16_t DefaultPort = 5555;      // xcp.port in fanatec.cfg
+    static constexpr int64_t IdleTimeoutUs = 30000000;
+    static constexpr int64_t SendTimeoutUs = 1000000;
+    static constexpr int MaxClients = 64;               // a client costs a coroutine frame, not a thread
 
-        // Create TCP socket
-        server_socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-        if (server_socket_ == INVALID_SOCKET) {
-            return false;
-        }
-
-        // Bind to port 5555 (XCP standard)
-        sockaddr_in server_addr{};
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-        server_addr.sin_port = htons(5555);
+    ~XcpServer() { stop(); }
 
-        if (bind(server_socket_, (sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
-            closesocket(server_socket_);
-            return false;
-        }
-
-        // Listen for connections
-        if (listen(server_socket_, 1) == SOCKET_ERROR) {
-            closesocket(server_socket_);
-            return false;
-        }
+    bool start(uint16_t port = DefaultPort, ThreadStats* stats = nullptr) {
+        if (reactor_) return true;
+        if (!own_.start(stats)) return false;
+        if (start(own_, port)) return true;
+        own_.stop();
+        return false;
+    }
 
-        running_ = true;
-        server_thread_ = std::thread(&XcpServer::server_loop, this);
+    bool start(Reactor& reactor, uint16_t port = DefaultPort) {
+        if (reactor_) return true;
+        if (!reactor.running()) return false;
+        stats_socket_t listener = STATS_INVALID_SOCKET;
+        reactor.run_sync([&] {
+            listener = reactor.listen(INADDR_ANY, port, MaxClients);
+            if (listener == STATS_INVALID_SOCKET) return;
+            cancel_.reset();
+            reactor.spawn(accept_clients(reactor, listener));
+        });
+        if (listener == STATS_INVALID_SOCKET) return false;
+        reactor_ = &reactor;
+        port_ = port;
         return true;
     }
 
     void stop() {
-        running_ = false;
-        if (server_thread_.joinable()) {
-            server_thread_.join();
-        }
-        if (server_socket_ != INVALID_SOCKET) {
-            closesocket(server_socket_);
-            server_socket_ = INVALID_SOCKET;
-        }
-        WSACleanup();
+        if (!reactor_) return;
+        reactor_->run_sync([this] { cancel_.cancel(); });
+        tasks_.wait_idle();
+        own_.stop();
+        reactor_ = nullptr;
     }
 
+    bool running() const { return reactor_ != nullptr; }
+    uint16_t port() const { return port_; }
+    int clients() const { return clients_.load(std::memory_order_relaxed); }
+    uint64_t commands() const { return commands_.load(std::memory_order_relaxed); }
+    uint64_t timeouts() const { return timeouts_.load(std::memory_order_relaxed); }   // idle or slow clients dropped
+
 private:
-    void server_loop() {
-        while (running_) {
-            // Accept ControlDesk connection
-            sockaddr_in client_addr{};
-            int client_size = sizeof(client_addr);
-            SOCKET client_socket = accept(server_socket_, (sockaddr*)&client_addr, &client_size);
+    Reactor own_;
+    Reactor* reactor_ = nullptr;
+    Cancel cancel_;                                     // reactor thread
+    uint16_t port_ = 0;
+    TaskGroup tasks_;
+    std::atomic<int> clients_{ 0 };
+    std::atomic<uint64_t> commands_{ 0 }, timeouts_{ 0 };
 
-            if (client_socket != INVALID_SOCKET) {
-                handle_client(client_socket);
-                closesocket(client_socket);
-            }
-            Sleep(10);
+    Task<> accept_clients(Reactor& reactor, stats_socket_t listener) {
+        TaskCounter task(tasks_);
+        for (;;) {
+            stats_socket_t s = co_await reactor.accept(listener, &cancel_);
+            if (s == STATS_INVALID_SOCKET) break;
+            if (clients_.load() >= MaxClients) reactor.close(s);
+            else reactor.spawn(serve(reactor, s));
         }
+        reactor.close(listener);
     }
 
-    void handle_client(SOCKET client_socket) {
-        // Basic XCP command handling
-        uint8_t rx_buffer[64];
-        uint8_t tx_buffer[64];
-
-        while (running_) {
-            int bytes_received = recv(client_socket, (char*)rx_buffer, sizeof(rx_buffer), 0);
-
-            if (bytes_received > 0) {
-                // Simple XCP command processing
-                if (rx_buffer[0] == 0xFF) { // CONNECT
-                    tx_buffer[0] = 0xFF; // Positive response
-                    tx_buffer[1] = 0x00;
-                    send(client_socket, (char*)tx_buffer, 2, 0);
-                }
-                // Add more XCP commands as needed
+    Task<> serve(Reactor& reactor, stats_socket_t s) {
+        TaskCounter task(tasks_), client(clients_);
+        uint8_t rx[64];
+        uint8_t tx[64];
+        for (;;) {
+            const IoResult in = co_await reactor.recv(s, rx, sizeof(rx), now_us() + IdleTimeoutUs, &cancel_);
+            if (in.status == IoStatus::Timeout) timeouts_.fetch_add(1, std::memory_order_relaxed);
+            if (in.status != IoStatus::Ready) break;
+            commands_.fetch_add(1, std::memory_order_relaxed);
+            if (rx[0] == 0xFF) {                        // CONNECT
+                tx[0] = 0xFF;                           // positive response
+                tx[1] = 0x00;
+                const IoStatus out = co_await reactor.send_all(s, tx, 2, now_us() + SendTimeoutUs, &cancel_);
+                if (out == IoStatus::Timeout) timeouts_.fetch_add(1, std::memory_order_relaxed);
+                if (out != IoStatus::Ready) break;
             }
-            else if (bytes_received == 0) {
-                break; // Client disconnected
-            }
-            Sleep(1);
+            // Add more XCP commands as needed
         }
+        reactor.close(s);
     }
 };
-
-static XcpServer g_xcp_server;
\ No newline at end of file